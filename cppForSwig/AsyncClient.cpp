@@ -202,6 +202,20 @@ void BlockDataViewer::shutdownNode(const string& cookie)
    sock_->pushPayload(move(payload), nullptr);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+void BlockDataViewer::snapshotDatabases(
+   const string& cookie, const string& path)
+{
+   auto payload = make_payload(StaticMethods::snapshotDatabases);
+   auto command = dynamic_cast<StaticCommand*>(payload->message_.get());
+
+   if (cookie.size() > 0)
+      command->set_cookie(cookie);
+   command->set_path(path);
+
+   sock_->pushPayload(move(payload), nullptr);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 AsyncClient::BtcWallet BlockDataViewer::instantiateWallet(const string& id)
 {
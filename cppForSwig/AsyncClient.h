@@ -435,6 +435,9 @@ namespace AsyncClient
       void shutdown(const std::string&);
       void shutdownNode(const std::string&);
 
+      //cookie, snapshot dir on the server side, has to exist and be empty
+      void snapshotDatabases(const std::string&, const std::string&);
+
       //ledgers
       void getLedgerDelegateForWallets(
          std::function<void(ReturnMessage<LedgerDelegate>)>);
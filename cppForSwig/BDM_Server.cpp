@@ -893,6 +893,47 @@ BDVCommandProcessingResultType BDV_Server_Object::processCommand(
       chainState_proto->set_blocksleft(nodeStatus.chainState_.getBlocksLeft());
       response->set_allocated_chainstate(chainState_proto);
 
+      for (auto& usage : nodeStatus.dbMapUsage_)
+      {
+         auto usage_proto = response->add_dbmapusage();
+         usage_proto->set_name(usage.first);
+         usage_proto->set_mapsize(usage.second.first);
+         usage_proto->set_usedsize(usage.second.second);
+      }
+
+      for (auto& stats : nodeStatus.dbCacheStats_)
+      {
+         auto stats_proto = response->add_dbcachestats();
+         stats_proto->set_name(stats.first);
+         stats_proto->set_hits(stats.second.hits_);
+         stats_proto->set_misses(stats.second.misses_);
+         stats_proto->set_cachedbytes(stats.second.size_);
+         stats_proto->set_entrycount(stats.second.count_);
+      }
+
+      for (auto& metrics : nodeStatus.dbMetrics_)
+      {
+         auto metrics_proto = response->add_dbmetrics();
+         metrics_proto->set_name(metrics.first);
+         for (auto& val : metrics.second.counters_)
+            metrics_proto->add_counters(val);
+
+         for (unsigned i = 0; i < DBMetrics_HistogramCount; i++)
+         {
+            auto& hist = metrics.second.histograms_[i];
+            auto hist_proto = metrics_proto->add_histograms();
+            hist_proto->set_type(i);
+            hist_proto->set_totalns(hist.totalNs_);
+
+            //trailing empty buckets are left out
+            unsigned bucketCount = DBMETRICS_BUCKETS;
+            while (bucketCount > 0 && hist.buckets_[bucketCount - 1] == 0)
+               --bucketCount;
+            for (unsigned y = 0; y < bucketCount; y++)
+               hist_proto->add_buckets(hist.buckets_[y]);
+         }
+      }
+
       resultingPayload = response;
       break;
    }
@@ -1494,8 +1535,9 @@ BDVCommandProcessingResultType BDV_Server_Object::processCommand(
 
       map<BinaryDataRef, map<unsigned, SpentnessResult>> spenderMap;
       {
-         //grab all spentness data for these outputs
-         auto&& spentness_tx = db_->beginTransaction(SPENTNESS, LMDB::ReadOnly);
+         //outputs to resolve, spentness is fetched in one batch
+         vector<StoredTxOut> stxos;
+         vector<SpentnessResult*> results;
 
          for (int i = 0; i < command->bindata_size(); i++)
          {
@@ -1537,24 +1579,26 @@ BDVCommandProcessingResultType BDV_Server_Object::processCommand(
 
                //set txout index
                stxo.txOutIndex_ = txOutIndex;
-             
-               //get spentness for index
-               db_->getSpentness(stxo);
+               stxos.push_back(stxo);
+               results.push_back(&opInsertIter.first->second);
+            }
+         }
 
-               //add to the result vector
-               if (stxo.isSpent())
-               {
-                  opInsertIter.first->second.state_ = 
-                     OutputSpentnessState::Spent;
-                  
-                  opInsertIter.first->second.spender_ = 
-                     stxo.spentByTxInKey_;
-               }
-               else
-               {
-                  opInsertIter.first->second.state_ = 
-                     OutputSpentnessState::Unspent;
-               }
+         //get spentness for all indices
+         db_->getSpentnessBatch(stxos);
+
+         for (size_t y = 0; y < stxos.size(); y++)
+         {
+            //add to the result vector
+            auto& stxo = stxos[y];
+            if (stxo.isSpent())
+            {
+               results[y]->state_ = OutputSpentnessState::Spent;
+               results[y]->spender_ = stxo.spentByTxInKey_;
+            }
+            else
+            {
+               results[y]->state_ = OutputSpentnessState::Unspent;
             }
          }
       }
@@ -2103,6 +2147,24 @@ void BDV_Server_Object::processNotification(
       chainState_proto->set_blocksleft(nodeStatus.chainState_.getBlocksLeft());
       status->set_allocated_chainstate(chainState_proto);
 
+      for (auto& usage : nodeStatus.dbMapUsage_)
+      {
+         auto usage_proto = status->add_dbmapusage();
+         usage_proto->set_name(usage.first);
+         usage_proto->set_mapsize(usage.second.first);
+         usage_proto->set_usedsize(usage.second.second);
+      }
+
+      for (auto& stats : nodeStatus.dbCacheStats_)
+      {
+         auto stats_proto = status->add_dbcachestats();
+         stats_proto->set_name(stats.first);
+         stats_proto->set_hits(stats.second.hits_);
+         stats_proto->set_misses(stats.second.misses_);
+         stats_proto->set_cachedbytes(stats.second.size_);
+         stats_proto->set_entrycount(stats.second.count_);
+      }
+
       break;
    }
 
@@ -2581,6 +2643,19 @@ void Clients::processShutdownCommand(shared_ptr<StaticCommand> command)
       break;
    }
 
+   case StaticMethods::snapshotDatabases:
+   {
+      if (!command->has_path())
+      {
+         LOGWARN << "db snapshot command is missing the destination path";
+         break;
+      }
+
+      //runs in its own thread, progress is reported as BDMPhase_DBSnapshot
+      bdmT_->bdm()->snapshotDatabases(command->path());
+      break;
+   }
+
    default:
       LOGWARN << "unexpected command in processShutdownCommand";
    }
@@ -3412,6 +3487,16 @@ shared_ptr<Message> Clients::processUnregisteredCommand(const uint64_t& bdvId,
       break;
    }
 
+   case StaticMethods::snapshotDatabases:
+   {
+      /*
+      in: cookie, destination path
+      out: void
+      */
+      processShutdownCommand(command);
+      break;
+   }
+
    case StaticMethods::registerBDV:
    {
       /*
@@ -17,6 +17,7 @@
 
 #include "nodeRPC.h"
 #include "BitcoinP2p.h"
+#include "BlockFileWatcher.h"
 
 #include <ctime>
 
@@ -65,6 +66,7 @@ bool BlockDataManagerThread::shutdown()
    if (pimpl == nullptr)
       return false;
    
+   pimpl->bdm->cancelSnapshot();
    pimpl->bdm->shutdownNotifications();
 
    if (!pimpl->run)
@@ -207,6 +209,24 @@ try
    bdm->nodeRPC_->registerNodeStatusLambda(updateNodeStatusLambda);
 
    auto newBlockStack = bdm->processNode_->getInvBlockStack();
+
+   //pick up new blocks as soon as the node writes them to disk, the
+   //block inv can lag behind. Queued entries only signal a chain update
+   //is due, an empty one will do
+   unique_ptr<BlockFileWatcher> blkFileWatcher;
+   if (bdm->config().blkFileDebounceMs_ > 0)
+   {
+      auto newBlockLbd = [newBlockStack](void)->void
+      {
+         newBlockStack->push_back(vector<InvEntry>());
+      };
+
+      blkFileWatcher = make_unique<BlockFileWatcher>(
+         bdm->blockFiles()->folderPath(), 
+         bdm->config().blkFileDebounceMs_, newBlockLbd);
+      blkFileWatcher->start();
+   }
+
    while (pimpl->run)
    {
       try
@@ -307,6 +307,9 @@ void BlockDataManagerConfig::printHelp(void)
                           Much faster than rescan or rebuild.
 --checkchain              builds db (no scanning) with full txhints, then
                           verifies all tx (consensus and sigs).
+--verify-checkpoint       before resuming an interrupted scan, drop the history
+                          the db holds past the scan checkpoint. Costs a full
+                          pass over the STXO and SUBSSH dbs.
 --datadir                 path to the operation folder
 --dbdir                   path to folder containing the database files.
                           If empty, a new db will be created there
@@ -323,6 +326,24 @@ void BlockDataManagerConfig::printHelp(void)
 --zcthread-count          defines the maximum number on threads the zc parser
                           can create for processing incoming transcations from
                           the network node
+--db-map-growth           factor by which the database maps grow once they are
+                          close to full. Maps start small and are grown online.
+                          Defaults to 2. Has to be greater than 1.
+--db-cache-size           size in MB of the cache of decoded transactions and
+                          txouts served to clients. Defaults to 64. Set to 0
+                          to disable it.
+--utxo-cache-size         size in MB of the utxo set kept in RAM during scans.
+                          Past it, older utxos are looked up in the db instead.
+                          Defaults to 512.
+--io-thread-count         number of threads faulting in blk files ahead of
+                          scans. Defaults to 2. Set to 0 to disable readahead.
+--readahead-files         number of blk files prefetched ahead of the file
+                          being scanned. Defaults to 4. Set to 0 to disable
+                          readahead.
+--blkfile-debounce        time in ms the blk files have to be left alone by the
+                          node before new blocks are picked up from them.
+                          Defaults to 50. Set to 0 to only pick up new blocks
+                          on the node's block notifications.
 --db-type                 sets the db type:
                           DB_BARE:  tracks wallet history only. Smallest DB.
                           DB_FULL:  tracks wallet history and resolves all
@@ -637,6 +658,10 @@ void BlockDataManagerConfig::processArgs(const map<string, string>& args,
    if (iter != args.end())
       clearMempool_ = true;
 
+   iter = args.find("verify-checkpoint");
+   if (iter != args.end())
+      verifyCheckpoint_ = true;
+
    //db type
    iter = args.find("db-type");
    if (iter != args.end())
@@ -717,6 +742,102 @@ void BlockDataManagerConfig::processArgs(const map<string, string>& args,
          zcThreadCount_ = val;
    }
 
+   iter = args.find("db-map-growth");
+   if (iter != args.end())
+   {
+      float val = 0.0f;
+      try
+      {
+         val = stof(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val > 1.0f)
+         dbMapGrowth_ = val;
+   }
+
+   iter = args.find("db-cache-size");
+   if (iter != args.end())
+   {
+      int val = -1;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val >= 0)
+         dbCacheSize_ = val;
+   }
+
+   iter = args.find("utxo-cache-size");
+   if (iter != args.end())
+   {
+      int val = 0;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val > 0)
+         utxoCacheSize_ = val;
+   }
+
+   iter = args.find("io-thread-count");
+   if (iter != args.end())
+   {
+      int val = -1;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val >= 0)
+         ioThreadCount_ = val;
+   }
+
+   iter = args.find("readahead-files");
+   if (iter != args.end())
+   {
+      int val = -1;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val >= 0)
+         readaheadFiles_ = val;
+   }
+
+   iter = args.find("blkfile-debounce");
+   if (iter != args.end())
+   {
+      int val = -1;
+      try
+      {
+         val = stoi(iter->second);
+      }
+      catch (...)
+      {
+      }
+
+      if (val >= 0)
+         blkFileDebounceMs_ = val;
+   }
+
    //cookie
    iter = args.find("cookie");
    if (iter != args.end())
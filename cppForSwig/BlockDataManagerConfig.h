@@ -26,6 +26,11 @@
 #include "NetworkConfig.h"
 
 #define DEFAULT_ZCTHREAD_COUNT 100
+#define DEFAULT_DBCACHE_SIZE 64
+#define DEFAULT_UTXOCACHE_SIZE 512
+#define DEFAULT_IOTHREAD_COUNT 2
+#define DEFAULT_READAHEAD_FILES 4
+#define DEFAULT_BLKFILE_DEBOUNCE_MS 50
 #define WEBSOCKET_PORT 7681
 
 size_t MAX_THREADS();
@@ -80,6 +85,12 @@ public:
    unsigned ramUsage_ = 4;
    unsigned threadCount_ = MAX_THREADS();
    unsigned zcThreadCount_ = DEFAULT_ZCTHREAD_COUNT;
+   float dbMapGrowth_ = 2.0f;
+   unsigned dbCacheSize_ = DEFAULT_DBCACHE_SIZE;
+   unsigned utxoCacheSize_ = DEFAULT_UTXOCACHE_SIZE;
+   unsigned ioThreadCount_ = DEFAULT_IOTHREAD_COUNT;
+   unsigned readaheadFiles_ = DEFAULT_READAHEAD_FILES;
+   unsigned blkFileDebounceMs_ = DEFAULT_BLKFILE_DEBOUNCE_MS;
 
    std::exception_ptr exceptionPtr_ = nullptr;
 
@@ -87,6 +98,7 @@ public:
 
    bool checkChain_ = false;
    bool clearMempool_ = false;
+   bool verifyCheckpoint_ = false;
 
    const std::string cookie_;
    bool useCookie_ = false;
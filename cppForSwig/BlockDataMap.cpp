@@ -11,10 +11,51 @@
 
 #ifndef _WIN32
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
+//stride of the prefetch page walk
+#define READAHEAD_PAGE_SIZE 4096
+
 using namespace std;
 
+////////////////////////////////////////////////////////////////////////////////
+void BCTX::computeHashes(const vector<shared_ptr<BCTX>>& txns)
+{
+   //keeps the stripped witness txns alive until they are hashed
+   vector<BinaryData> noWitData;
+   vector<BinaryDataRef> msgs;
+   vector<uint8_t*> digests;
+
+   for (auto& txn : txns)
+   {
+      if (txn->txHash_.getSize() != 0)
+         continue;
+
+      if (txn->usesWitness_)
+         noWitData.push_back(txn->getNoWitnessData());
+   }
+
+   size_t witnessId = 0;
+   for (auto& txn : txns)
+   {
+      if (txn->txHash_.getSize() != 0)
+         continue;
+
+      if (txn->usesWitness_)
+         msgs.push_back(noWitData[witnessId++].getRef());
+      else
+         msgs.push_back(BinaryDataRef(txn->data_, txn->size_));
+
+      txn->txHash_.resize(32);
+      digests.push_back(txn->txHash_.getPtr());
+   }
+
+   Sha256Multi::getHash256(msgs.data(), digests.data(), msgs.size());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void BlockData::deserialize(const uint8_t* data, size_t size,
    const shared_ptr<BlockHeader> blockHeader,
@@ -65,6 +106,8 @@ void BlockData::deserialize(const uint8_t* data, size_t size,
       return;
 
    //let's check the merkle root
+   BCTX::computeHashes(txns_);
+
    vector<BinaryData> allhashes;
    for (auto& txn : txns_)
    {
@@ -185,8 +228,127 @@ shared_ptr<BlockDataFileMap> BlockDataLoader::get(const string& filename)
 /////////////////////////////////////////////////////////////////////////////
 shared_ptr<BlockDataFileMap> BlockDataLoader::get(uint32_t fileid)
 {
-   //don't have this fileid yet, create it
-   return getNewBlockDataMap(fileid);
+   shared_ptr<BlockDataFileMap> fileMap;
+   {
+      unique_lock<mutex> lock(readaheadMutex_);
+      if (readaheadQueue_ == nullptr)
+      {
+         lock.unlock();
+
+         //don't have this fileid yet, create it
+         return getNewBlockDataMap(fileid);
+      }
+
+      auto iter = prefetched_.find(fileid);
+      if (iter != prefetched_.end())
+      {
+         fileMap = iter->second;
+         prefetched_.erase(iter);
+      }
+   }
+
+   if (fileMap == nullptr)
+      fileMap = getNewBlockDataMap(fileid);
+
+   fileMap->dropOnRelease_.store(true, memory_order_relaxed);
+   return fileMap;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataLoader::startReadahead(unsigned ioThreads, unsigned fileCount)
+{
+   stopReadahead();
+   if (ioThreads == 0 || fileCount == 0)
+      return;
+
+   unique_lock<mutex> lock(readaheadMutex_);
+   readaheadQueue_ = make_unique<ArmoryThreading::BlockingQueue<
+      shared_ptr<BlockDataFileMap>>>();
+   readaheadFiles_ = fileCount;
+   nextReadahead_ = 0;
+
+   auto queuePtr = readaheadQueue_.get();
+   auto ioLambda = [queuePtr](void)->void
+   {
+      while (true)
+      {
+         shared_ptr<BlockDataFileMap> fileMap;
+         try
+         {
+            fileMap = move(queuePtr->pop_front());
+         }
+         catch (ArmoryThreading::StopBlockingLoop&)
+         {
+            break;
+         }
+
+         fileMap->prefetch();
+      }
+   };
+
+   for (unsigned i = 0; i < ioThreads; i++)
+      ioThreads_.push_back(thread(ioLambda));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataLoader::stopReadahead()
+{
+   {
+      unique_lock<mutex> lock(readaheadMutex_);
+      if (readaheadQueue_ == nullptr)
+         return;
+
+      readaheadQueue_->terminate();
+   }
+
+   for (auto& thr : ioThreads_)
+   {
+      if (thr.joinable())
+         thr.join();
+   }
+
+   unique_lock<mutex> lock(readaheadMutex_);
+   ioThreads_.clear();
+   readaheadQueue_.reset();
+
+   //never handed out, leave their pages be
+   prefetched_.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataLoader::readahead(uint32_t fileid)
+{
+   unique_lock<mutex> lock(readaheadMutex_);
+   if (readaheadQueue_ == nullptr)
+      return;
+
+   //the caller is past these, they won't be claimed
+   auto iter = prefetched_.begin();
+   while (iter != prefetched_.end() && iter->first <= fileid)
+      prefetched_.erase(iter++);
+
+   if (nextReadahead_ <= fileid)
+      nextReadahead_ = fileid + 1;
+
+   while (nextReadahead_ <= fileid + readaheadFiles_)
+   {
+      auto fileMap = getNewBlockDataMap(nextReadahead_);
+
+      //past the last blk file
+      if (fileMap->getPtr() == nullptr)
+         break;
+
+      prefetched_.insert(make_pair(nextReadahead_, fileMap));
+      readaheadQueue_->push_back(move(fileMap));
+      ++nextReadahead_;
+   }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t BlockDataLoader::prefetchedCount()
+{
+   unique_lock<mutex> lock(readaheadMutex_);
+   return prefetched_.size();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -222,30 +384,54 @@ shared_ptr<BlockDataFileMap>
 }
 
 /////////////////////////////////////////////////////////////////////////////
-BlockDataFileMap::BlockDataFileMap(const string& filename)
+BlockDataFileMap::BlockDataFileMap(const string& filename) :
+   filename_(filename)
 {
    //relaxed memory order for loads and stores, we only care about 
    //atomicity in these operations
    useCounter_.store(0, memory_order_relaxed);
+   dropOnRelease_.store(false, memory_order_relaxed);
+
+   map();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+BlockDataFileMap::~BlockDataFileMap()
+{
+   unmap();
+}
 
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataFileMap::map()
+{
    try
    {
-      auto filemap = DBUtils::getMmapOfFile(filename);
+      auto filemap = DBUtils::getMmapOfFile(filename_);
       fileMap_ = filemap.filePtr_;
       size_ = filemap.size_;
    }
    catch (exception&)
    {
       //LOGERR << "Failed to create BlockDataMap with error: " << e.what();
+      return;
    }
+
+#ifndef _WIN32
+   struct stat st;
+   if (stat(filename_.c_str(), &st) == 0)
+      inode_ = st.st_ino;
+#endif
 }
 
 /////////////////////////////////////////////////////////////////////////////
-BlockDataFileMap::~BlockDataFileMap()
+void BlockDataFileMap::unmap()
 {
    //close file mmap
    if (fileMap_ != nullptr)
    {
+      if (dropOnRelease_.load(memory_order_relaxed))
+         dropPages();
+
 #ifdef _WIN32
       UnmapViewOfFile(fileMap_);
 #else
@@ -253,4 +439,92 @@ BlockDataFileMap::~BlockDataFileMap()
 #endif
       fileMap_ = nullptr;
    }
+
+   size_ = 0;
+   inode_ = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool BlockDataFileMap::grow()
+{
+   /***
+   The node only ever appends to its blk files. Extending the existing 
+   mapping leaves the pages already faulted in alone, only the new bytes
+   cost anything. A file that shrank or was replaced is mapped again from
+   scratch, reading past its end through the old mapping would fault.
+   ***/
+
+#ifdef __linux__
+   if (fileMap_ != nullptr)
+   {
+      struct stat st;
+      if (stat(filename_.c_str(), &st) != 0)
+         return false;
+
+      size_t newSize = st.st_size;
+      if ((uint64_t)st.st_ino == inode_ && newSize >= size_)
+      {
+         if (newSize == size_)
+            return false;
+
+         auto ptr = mremap(fileMap_, size_, newSize, MREMAP_MAYMOVE);
+         if (ptr != MAP_FAILED)
+         {
+            fileMap_ = (uint8_t*)ptr;
+            size_ = newSize;
+            return true;
+         }
+      }
+   }
+#else
+   if (fileMap_ != nullptr && 
+      BtcUtils::GetFileSize(filename_) == size_)
+      return false;
+#endif
+
+   auto prevSize = size_;
+   unmap();
+   map();
+   return fileMap_ != nullptr || prevSize != 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataFileMap::prefetch()
+{
+   if (fileMap_ == nullptr)
+      return;
+
+#ifndef _WIN32
+   //sequential widens the kernel readahead window, willneed starts it
+   madvise(fileMap_, size_, MADV_SEQUENTIAL);
+   madvise(fileMap_, size_, MADV_WILLNEED);
+#endif
+
+   //take the page faults here rather than in the scanner threads
+   const volatile uint8_t* ptr = fileMap_;
+   uint8_t tally = 0;
+   for (size_t i = 0; i < size_; i += READAHEAD_PAGE_SIZE)
+      tally += ptr[i];
+   (void)tally;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataFileMap::dropPages()
+{
+   if (fileMap_ == nullptr)
+      return;
+
+#ifndef _WIN32
+   madvise(fileMap_, size_, MADV_DONTNEED);
+
+#ifdef POSIX_FADV_DONTNEED
+   //the mapping doesn't own the page cache, evict it through the file
+   auto fd = open(filename_.c_str(), O_RDONLY);
+   if (fd != -1)
+   {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+   }
+#endif
+#endif
 }
@@ -24,9 +24,11 @@
 #include <iomanip>
 
 #include <map>
+#include <vector>
 
 #include "BlockObj.h"
 #include "BinaryData.h"
+#include "ThreadSafeClasses.h"
 
 #define OffsetAndSize std::pair<size_t, size_t>
 
@@ -59,24 +61,30 @@ public:
       data_(bdr.getPtr()), size_(bdr.getSize())
    {}
 
+   //tx serialized without the witness data, what the hash commits to
+   BinaryData getNoWitnessData(void) const
+   {
+      BinaryData noWitData;
+      BinaryDataRef version(data_, 4);
+
+      auto& lastTxOut = txouts_.back();
+      auto witnessOffset = lastTxOut.first + lastTxOut.second;
+      BinaryDataRef txinout(data_ + 6, witnessOffset - 6);
+      BinaryDataRef locktime(data_ + size_ - 4, 4);
+
+      noWitData.append(version);
+      noWitData.append(txinout);
+      noWitData.append(locktime);
+      return noWitData;
+   }
+
    const BinaryData& getHash(void) const
    {
       if(txHash_.getSize() == 0)
       {
          if (usesWitness_)
          {
-            BinaryData noWitData;
-            BinaryDataRef version(data_, 4);
-           
-            auto& lastTxOut = txouts_.back();
-            auto witnessOffset = lastTxOut.first + lastTxOut.second;
-            BinaryDataRef txinout(data_ + 6, witnessOffset - 6);
-            BinaryDataRef locktime(data_ + size_ - 4, 4);
-           
-            noWitData.append(version);
-            noWitData.append(txinout);
-            noWitData.append(locktime);
-            
+            auto&& noWitData = getNoWitnessData();
             BtcUtils::getHash256(noWitData, txHash_);
          }
          else
@@ -89,6 +97,9 @@ public:
       return txHash_;
    }
 
+   //hashes all txns that don't have theirs yet in one batch
+   static void computeHashes(const std::vector<std::shared_ptr<BCTX>>&);
+
    BinaryData&& moveHash(void)
    {
       getHash();
@@ -301,11 +312,22 @@ class BlockDataFileMap
    friend class BlockDataLoader;
 
 private:
+   const std::string filename_;
    uint8_t* fileMap_ = nullptr;
    size_t size_ = 0;
 
    std::atomic<int> useCounter_;
 
+   //evict the file's pages once the last user lets go of the map
+   std::atomic<bool> dropOnRelease_;
+
+   //tells a replaced file from a grown one
+   uint64_t inode_ = 0;
+
+private:
+   void map(void);
+   void unmap(void);
+
 public:
    BlockDataFileMap(const std::string& filename);
    ~BlockDataFileMap(void);
@@ -316,6 +338,15 @@ public:
    }
 
    size_t size(void) const { return size_; }
+
+   //faults the whole file in, blocks until it's all read
+   void prefetch(void);
+   void dropPages(void);
+
+   //maps the bytes appended to the file since it was mapped, returns false
+   //if the file did not change size. Pointers from getPtr() are invalid 
+   //after this returns true
+   bool grow(void);
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -335,14 +366,39 @@ private:
    std::shared_ptr<BlockDataFileMap>
       getNewBlockDataMap(uint32_t fileid);
 
+private:
+   //readahead
+   std::mutex readaheadMutex_;
+   std::map<uint32_t, std::shared_ptr<BlockDataFileMap>> prefetched_;
+   std::unique_ptr<ArmoryThreading::BlockingQueue<
+      std::shared_ptr<BlockDataFileMap>>> readaheadQueue_;
+   std::vector<std::thread> ioThreads_;
+
+   unsigned readaheadFiles_ = 0;
+   uint32_t nextReadahead_ = 0;
+
 public:
    BlockDataLoader(const std::string& path);
 
    ~BlockDataLoader(void)
-   {}
+   {
+      stopReadahead();
+   }
 
    std::shared_ptr<BlockDataFileMap> get(const std::string& filename);
    std::shared_ptr<BlockDataFileMap> get(uint32_t fileid);
+
+   /***
+   While readahead runs, readahead(fileid) queues the fileCount files past
+   fileid for the io threads to fault in. Maps handed out by get() in the
+   meantime drop their pages from the page cache once they are released,
+   so only call it for sequential passes over the blk files.
+   ***/
+   void startReadahead(unsigned ioThreads, unsigned fileCount);
+   void stopReadahead(void);
+   void readahead(uint32_t fileid);
+
+   size_t prefetchedCount(void);
 };
 
 #endif
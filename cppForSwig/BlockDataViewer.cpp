@@ -1076,7 +1076,10 @@ vector<pair<StoredTxOut, BinaryDataRef>> BlockDataViewer::getOutputsForOutpoints
       zcSS = zc_->getSnapshot();
    }
    
-   auto&& stxo_tx = db_->beginTransaction(STXO, LMDB::ReadOnly);
+   //mined outputs are fetched in one batch, keep track of their position
+   //in the result vector
+   vector<BinaryData> stxoKeys;
+   vector<size_t> stxoPositions;
 
    for (auto& opSet : outpoints)
    {
@@ -1086,18 +1089,13 @@ vector<pair<StoredTxOut, BinaryDataRef>> BlockDataViewer::getOutputsForOutpoints
       {
          for (auto& op : opSet.second)
          {
-            //set txout index
-            pair<StoredTxOut, BinaryDataRef> stxoPair;
-            stxoPair.second = opSet.first;
-            
-            auto& stxo = stxoPair.first;
-            stxo.txOutIndex_ = op;
             auto stxoKey = dbkey;
             stxoKey.append(WRITE_UINT16_BE(op));
+            stxoKeys.emplace_back(move(stxoKey));
+            stxoPositions.push_back(result.size());
 
-            if (!db_->getStoredTxOut(stxo, stxoKey))
-               throw runtime_error("invalid outpoint");
-               
+            pair<StoredTxOut, BinaryDataRef> stxoPair;
+            stxoPair.second = opSet.first;
             result.emplace_back(stxoPair);
          }
 
@@ -1141,6 +1139,16 @@ vector<pair<StoredTxOut, BinaryDataRef>> BlockDataViewer::getOutputsForOutpoints
       }
    }
 
+   vector<StoredTxOut> stxos;
+   db_->getStoredTxOuts(stxoKeys, stxos);
+   for (size_t i = 0; i < stxos.size(); i++)
+   {
+      if (!stxos[i].isInitialized())
+         throw runtime_error("invalid outpoint");
+
+      result[stxoPositions[i]].first = move(stxos[i]);
+   }
+
    return result;
 }
 
@@ -0,0 +1,273 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstring>
+
+#include "BlockFileWatcher.h"
+#include "BtcUtils.h"
+#include "log.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+BlockFileWatcher::BlockFileWatcher(const string& folderPath,
+   unsigned debounceMs, const function<void(void)>& callback) :
+   folderPath_(folderPath), debounceMs_(debounceMs), callback_(callback)
+{
+   run_.store(false, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BlockFileWatcher::~BlockFileWatcher()
+{
+   shutdown();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockFileWatcher::start()
+{
+   if (run_.load(memory_order_relaxed))
+      return;
+
+   run_.store(true, memory_order_relaxed);
+   if (initInotify())
+   {
+      LOGINFO << "watching blk files with inotify";
+      thr_ = thread(&BlockFileWatcher::watchInotify, this);
+   }
+   else
+   {
+      LOGINFO << "polling blk files every " <<
+         BLKFILE_POLL_INTERVAL_MS << "ms";
+      thr_ = thread(&BlockFileWatcher::watchPoll, this);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockFileWatcher::shutdown()
+{
+   {
+      unique_lock<mutex> lock(mu_);
+      run_.store(false, memory_order_relaxed);
+      cv_.notify_all();
+   }
+
+#ifdef __linux__
+   if (stopPipe_[1] != -1)
+   {
+      char c = 0;
+      if (write(stopPipe_[1], &c, 1) != 1)
+         LOGWARN << "failed to signal blk file watcher";
+   }
+#endif
+
+   if (thr_.joinable())
+      thr_.join();
+
+   closeInotify();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockFileWatcher::initInotify()
+{
+#ifdef __linux__
+   inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (inotifyFd_ == -1)
+   {
+      LOGWARN << "inotify is not available: " << strerror(errno);
+      return false;
+   }
+
+   auto mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO;
+   if (inotify_add_watch(inotifyFd_, folderPath_.c_str(), mask) == -1 ||
+      pipe2(stopPipe_, O_CLOEXEC) == -1)
+   {
+      LOGWARN << "failed to watch " << folderPath_ << ": " << strerror(errno);
+      closeInotify();
+      return false;
+   }
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockFileWatcher::closeInotify()
+{
+#ifdef __linux__
+   if (inotifyFd_ != -1)
+      close(inotifyFd_);
+
+   for (auto& fd : stopPipe_)
+   {
+      if (fd != -1)
+         close(fd);
+      fd = -1;
+   }
+#endif
+
+   inotifyFd_ = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockFileWatcher::watchInotify()
+{
+#ifdef __linux__
+   /***
+   The callback fires once the blk files have been quiet for debounceMs_,
+   or BLKFILE_POLL_INTERVAL_MS after the first pending write at the latest,
+   so that a node syncing at full speed still gets its blocks picked up.
+   ***/
+
+   alignas(struct inotify_event) char buffer[4096];
+
+   bool pending = false;
+   auto firstWrite = chrono::steady_clock::now();
+   auto lastWrite = firstWrite;
+
+   while (run_.load(memory_order_relaxed))
+   {
+      int timeout = -1;
+      if (pending)
+      {
+         auto deadline = min(
+            lastWrite + chrono::milliseconds(debounceMs_),
+            firstWrite + chrono::milliseconds(BLKFILE_POLL_INTERVAL_MS));
+         auto remaining = chrono::duration_cast<chrono::milliseconds>(
+            deadline - chrono::steady_clock::now()).count();
+         timeout = max<int>(remaining, 0);
+      }
+
+      pollfd fds[2];
+      fds[0].fd = inotifyFd_;
+      fds[0].events = POLLIN;
+      fds[1].fd = stopPipe_[0];
+      fds[1].events = POLLIN;
+
+      auto result = poll(fds, 2, timeout);
+      if (result == -1)
+      {
+         if (errno == EINTR)
+            continue;
+
+         LOGWARN << "blk file watcher failed: " << strerror(errno);
+         break;
+      }
+
+      if (fds[1].revents != 0)
+         return;
+
+      if (result == 0)
+      {
+         pending = false;
+         callback_();
+         continue;
+      }
+
+      bool watchLost = false;
+      while (true)
+      {
+         auto len = read(inotifyFd_, buffer, sizeof(buffer));
+         if (len <= 0)
+            break;
+
+         for (ssize_t i = 0; i < len; )
+         {
+            auto event = (const struct inotify_event*)(buffer + i);
+            i += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_IGNORED)
+            {
+               watchLost = true;
+               continue;
+            }
+
+            //only blk files matter, rev and index files are ignored
+            if (!(event->mask & IN_Q_OVERFLOW))
+            {
+               if (event->len == 0 ||
+                  strncmp(event->name, "blk", 3) != 0 ||
+                  strstr(event->name, ".dat") == nullptr)
+                  continue;
+            }
+
+            lastWrite = chrono::steady_clock::now();
+            if (!pending)
+               firstWrite = lastWrite;
+            pending = true;
+         }
+      }
+
+      if (watchLost)
+      {
+         LOGWARN << "lost inotify watch on " << folderPath_;
+         break;
+      }
+   }
+
+   //inotify gave out, keep going on polling
+   if (run_.load(memory_order_relaxed))
+   {
+      if (pending)
+         callback_();
+      watchPoll();
+   }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockFileWatcher::watchPoll()
+{
+   auto state = getLastFileState(0);
+
+   while (true)
+   {
+      {
+         unique_lock<mutex> lock(mu_);
+         cv_.wait_for(lock, chrono::milliseconds(BLKFILE_POLL_INTERVAL_MS),
+            [this](void)->bool { return !run_.load(memory_order_relaxed); });
+
+         if (!run_.load(memory_order_relaxed))
+            return;
+      }
+
+      auto newState = getLastFileState(state.first);
+      if (newState == state)
+         continue;
+
+      state = newState;
+      callback_();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+pair<unsigned, uint64_t> BlockFileWatcher::getLastFileState(
+   unsigned fromFile) const
+{
+   auto fileNum = fromFile;
+   while (fileNum < UINT16_MAX)
+   {
+      auto&& path = BtcUtils::getBlkFilename(folderPath_, fileNum + 1);
+      if (BtcUtils::GetFileSize(path) == FILE_DOES_NOT_EXIST)
+         break;
+      ++fileNum;
+   }
+
+   auto&& path = BtcUtils::getBlkFilename(folderPath_, fileNum);
+   return make_pair(fileNum, BtcUtils::GetFileSize(path));
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_BLOCKFILEWATCHER
+#define _H_BLOCKFILEWATCHER
+
+#include <string>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#define BLKFILE_POLL_INTERVAL_MS 1000
+
+////////////////////////////////////////////////////////////////////////////////
+class BlockFileWatcher
+{
+   /***
+   Fires the callback as soon as the node writes to its blk files, rather
+   than waiting on the block inv from the P2P node.
+
+   Linux builds watch the blk file folder with inotify. Events are
+   debounced: the callback fires once the folder has been quiet for the
+   debounce window, so a block written in several chunks costs a single
+   chain update. A block that is still partially written by then is left
+   for the next update, parseBlockFile stops at incomplete entries.
+
+   Where inotify is not available, the size of the last blk file is polled
+   every BLKFILE_POLL_INTERVAL_MS instead.
+   ***/
+
+private:
+   const std::string folderPath_;
+   const unsigned debounceMs_;
+   const std::function<void(void)> callback_;
+
+   std::thread thr_;
+   std::atomic<bool> run_;
+
+   //wakes the polling loop on shutdown
+   std::mutex mu_;
+   std::condition_variable cv_;
+
+   int inotifyFd_ = -1;
+   int stopPipe_[2] = { -1, -1 };
+
+private:
+   bool initInotify(void);
+   void closeInotify(void);
+   void watchInotify(void);
+   void watchPoll(void);
+
+   //number and size of the last blk file in the folder
+   std::pair<unsigned, uint64_t> getLastFileState(unsigned fromFile) const;
+
+public:
+   BlockFileWatcher(const std::string& folderPath, unsigned debounceMs,
+      const std::function<void(void)>& callback);
+   ~BlockFileWatcher(void);
+
+   void start(void);
+   void shutdown(void);
+
+   bool usesInotify(void) const { return inotifyFd_ != -1; }
+};
+
+#endif
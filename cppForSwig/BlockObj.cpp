@@ -28,6 +28,22 @@ void BlockHeader::unserialize(uint8_t const * ptr, uint32_t size)
       throw BlockDeserializingException();
    dataCopy_.copyFrom(ptr, HEADER_SIZE);
    BtcUtils::getHash256(dataCopy_.getPtr(), HEADER_SIZE, thisHash_);
+   initFromData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockHeader::unserialize(BinaryDataRef header, BinaryDataRef hash)
+{
+   if (header.getSize() < HEADER_SIZE || hash.getSize() != 32)
+      throw BlockDeserializingException();
+   dataCopy_.copyFrom(header.getPtr(), HEADER_SIZE);
+   thisHash_ = hash;
+   initFromData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockHeader::initFromData()
+{
    difficultyDbl_ = BtcUtils::convertDiffBitsToDouble( 
                               BinaryDataRef(dataCopy_.getPtr()+72, 4));
    isInitialized_ = true;
@@ -185,7 +201,7 @@ void TxRef::setRef(BinaryDataRef bdr)
 /////////////////////////////////////////////////////////////////////////////
 BinaryData DBTxRef::serialize(void) const 
 { 
-   return db_->getFullTxCopy(dbKey6B_).serialize();
+   return db_->getFullTxPtr(dbKey6B_)->serialize();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -27,6 +27,10 @@
 #include "BtcUtils.h"
 #include "TxClasses.h"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 typedef uint32_t TxFilterType;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -35,6 +39,90 @@ class Tx;
 class TxIn;
 class TxOut;
 
+////////////////////////////////////////////////////////////////////////////////
+struct TxFilterScan
+{
+   //calls onHit(i) for every i in [0, len) where ptr[i] == key
+   template<typename T, typename F>
+   static void find(const T* ptr, size_t len, const T& key, F onHit)
+   {
+      for (size_t i = 0; i < len; i++)
+      {
+         if (ptr[i] == key)
+            onHit(i);
+      }
+   }
+
+   //4 byte prefixes are compared 16 at a time. Hits are rare, so the
+   //per lane mask is only looked at when a block has a match
+   template<typename F>
+   static void find(const uint32_t* ptr, size_t len, uint32_t key, F onHit)
+   {
+      size_t i = 0;
+
+#if defined(__AVX2__)
+      auto keyVec = _mm256_set1_epi32((int)key);
+      for (; i + 16 <= len; i += 16)
+      {
+         auto lo = _mm256_cmpeq_epi32(keyVec,
+            _mm256_loadu_si256((const __m256i*)(ptr + i)));
+         auto hi = _mm256_cmpeq_epi32(keyVec,
+            _mm256_loadu_si256((const __m256i*)(ptr + i + 8)));
+
+         auto any = _mm256_or_si256(lo, hi);
+         if (_mm256_testz_si256(any, any))
+            continue;
+
+         unsigned mask =
+            (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lo)) |
+            ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+         reportMask(mask, i, onHit);
+      }
+#elif defined(__SSE2__)
+      auto keyVec = _mm_set1_epi32((int)key);
+      for (; i + 16 <= len; i += 16)
+      {
+         auto c0 = _mm_cmpeq_epi32(keyVec,
+            _mm_loadu_si128((const __m128i*)(ptr + i)));
+         auto c1 = _mm_cmpeq_epi32(keyVec,
+            _mm_loadu_si128((const __m128i*)(ptr + i + 4)));
+         auto c2 = _mm_cmpeq_epi32(keyVec,
+            _mm_loadu_si128((const __m128i*)(ptr + i + 8)));
+         auto c3 = _mm_cmpeq_epi32(keyVec,
+            _mm_loadu_si128((const __m128i*)(ptr + i + 12)));
+
+         auto any = _mm_or_si128(_mm_or_si128(c0, c1), _mm_or_si128(c2, c3));
+         if (_mm_movemask_epi8(any) == 0)
+            continue;
+
+         unsigned mask =
+            (unsigned)_mm_movemask_ps(_mm_castsi128_ps(c0)) |
+            ((unsigned)_mm_movemask_ps(_mm_castsi128_ps(c1)) << 4) |
+            ((unsigned)_mm_movemask_ps(_mm_castsi128_ps(c2)) << 8) |
+            ((unsigned)_mm_movemask_ps(_mm_castsi128_ps(c3)) << 12);
+         reportMask(mask, i, onHit);
+      }
+#endif
+
+      for (; i < len; i++)
+      {
+         if (ptr[i] == key)
+            onHit(i);
+      }
+   }
+
+private:
+   template<typename F>
+   static void reportMask(unsigned mask, size_t offset, F& onHit)
+   {
+      for (unsigned bit = 0; mask != 0; bit++, mask >>= 1)
+      {
+         if (mask & 1)
+            onHit(offset + bit);
+      }
+   }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 template<typename T> class TxFilter
 {
@@ -172,20 +260,20 @@ public:
    std::set<uint32_t> compare(const T& key) const
    {
       std::set<uint32_t> resultSet;
+      auto onHit = [&resultSet](size_t i)->void
+      {
+         resultSet.insert((uint32_t)i);
+      };
+
       if (filterVector_.size() != 0)
       {
-         for (unsigned i = 0; i < filterVector_.size(); i++)
-         {
-            if (filterVector_[i] == key)
-               resultSet.insert(i);
-         }
+         TxFilterScan::find(
+            &filterVector_[0], filterVector_.size(), key, onHit);
       }
       else if (filterPtr_ != nullptr)
       {
-         auto ptr = (T*)(filterPtr_ + 12);
-         for (unsigned i = 0; i < len_; i++)
-            if (ptr[i] == key)
-               resultSet.insert(i);
+         TxFilterScan::find(
+            (const T*)(filterPtr_ + 12), len_, key, onHit);
       }
       else
          throw std::runtime_error("invalid filter");
@@ -222,6 +310,7 @@ class BlockHeader
    friend class Blockchain;
    friend class testBlockHeader;
    friend class BlockData;
+   friend class HeaderSnapshot;
 
 public:
 
@@ -304,6 +393,9 @@ public:
    void unserialize(BinaryDataRef const & str);
    void unserialize(BinaryRefReader & brr);
 
+   //for callers that already hashed the header
+   void unserialize(BinaryDataRef header, BinaryDataRef hash);
+
    void unserialize_swigsafe_(BinaryData const & rawHead) { unserialize(rawHead); }
 
    uint8_t getDuplicateID(void) const { return duplicateID_; }
@@ -319,6 +411,9 @@ public:
    unsigned int getThisID(void) const { return uniqueID_; }
    void setUniqueID(unsigned int& ID) { uniqueID_ = ID; }
 
+private:
+   void initFromData(void);
+
 private:
    BinaryData     dataCopy_;
    bool           isInitialized_ = false;
@@ -161,7 +161,7 @@ protected:
 ////////////////////////////////////////////////////////////////////////////////
 BlockDataManager::BlockDataManager(
    const BlockDataManagerConfig &bdmConfig) 
-   : config_(bdmConfig)
+   : config_(bdmConfig), snapshotRunning_(false), snapshotCancel_(false)
 {
 
    if (config_.exceptionPtr_ != nullptr)
@@ -235,6 +235,9 @@ void BlockDataManager::openDatabase()
       throw runtime_error("ERROR: Genesis Block Hash not set!");
    }
 
+   DatabaseContainer::mapGrowthFactor_ = config_.dbMapGrowth_;
+   iface_->setObjectCacheSize((size_t)config_.dbCacheSize_ * 1024 * 1024);
+
    try
    {
       iface_->openDatabases(config_.dbDir_);
@@ -250,7 +253,18 @@ void BlockDataManager::openDatabase()
 /////////////////////////////////////////////////////////////////////////////
 BlockDataManager::~BlockDataManager()
 {
+   cancelSnapshot();
+   if (snapshotThr_.joinable())
+      snapshotThr_.join();
+
    zeroConfCont_.reset();
+
+   if (dbBuilder_ != nullptr && BDMstate_ == BDM_ready)
+   {
+      unique_lock<mutex> lock(chainUpdateMutex_);
+      dbBuilder_->writeHeaderSnapshot();
+   }
+
    blockFiles_.reset();
    dbBuilder_.reset();
    processNode_.reset();
@@ -272,9 +286,12 @@ BinaryData BlockDataManager::applyBlockRangeToDB(
    BlockchainScanner bcs(blockchain_, iface_, &scrAddrData, 
       *blockFiles_.get(), config_.threadCount_, config_.ramUsage_,
       prog, config_.reportProgress_);
+   bcs.setUtxoCacheSize((size_t)config_.utxoCacheSize_ * 1024 * 1024);
+   bcs.setReadahead(config_.ioThreadCount_, config_.readaheadFiles_);
    bcs.scan_nocheck(blk0);
    bcs.updateSSH(false, blk0);
    bcs.resolveTxHashes();
+   iface_->updateTxHashIndex();
 
    return bcs.getTopScannedBlockHash();
 }
@@ -375,9 +392,54 @@ void BlockDataManager::loadDiskState(const ProgressCallback &progress,
 ////////////////////////////////////////////////////////////////////////////////
 Blockchain::ReorganizationState BlockDataManager::readBlkFileUpdate()
 { 
+   unique_lock<mutex> lock(chainUpdateMutex_);
    return dbBuilder_->update();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool BlockDataManager::snapshotDatabases(const string& destDir)
+{
+   bool expected = false;
+   if (!snapshotRunning_.compare_exchange_strong(expected, true))
+   {
+      LOGWARN << "a db snapshot is already running";
+      return false;
+   }
+
+   if (snapshotThr_.joinable())
+      snapshotThr_.join();
+
+   auto snapshotLambda = [this, destDir](void)->void
+   {
+      auto progress = [this](unsigned count, unsigned total)->void
+      {
+         double prog = total == 0 ? 1.0 : double(count) / double(total);
+         auto&& notifPtr = make_unique<BDV_Notification_Progress>(
+            BDMPhase_DBSnapshot, prog, 0, count, vector<string>());
+         notificationStack_.push_back(move(notifPtr));
+      };
+
+      try
+      {
+         //new blocks are held while a db is copied, not for the whole 
+         //snapshot. Reads and zc are not affected
+         LOGINFO << "snapshotting dbs to " << destDir;
+         iface_->snapshotDatabases(
+            destDir, progress, chainUpdateMutex_, snapshotCancel_);
+         LOGINFO << "db snapshot completed";
+      }
+      catch (exception& e)
+      {
+         LOGERR << "db snapshot failed with error: " << e.what();
+      }
+
+      snapshotRunning_.store(false);
+   };
+
+   snapshotThr_ = thread(snapshotLambda);
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 StoredHeader BlockDataManager::getBlockFromDB(uint32_t hgt, uint8_t dup) const
 {
@@ -435,6 +497,18 @@ void BlockDataManager::disableZeroConf(void)
 NodeStatusStruct BlockDataManager::getNodeStatus() const
 {
    NodeStatusStruct nss;
+   if (iface_ != nullptr)
+   {
+      for (auto& usage : iface_->getMapUsage())
+      {
+         nss.dbMapUsage_.insert(make_pair(usage.first,
+            make_pair(usage.second.first, usage.second.second)));
+      }
+
+      nss.dbCacheStats_ = iface_->getObjectCacheStats();
+      nss.dbMetrics_ = iface_->getDbMetrics();
+   }
+
    if (processNode_ == nullptr)
       return nss;
    
@@ -19,6 +19,8 @@
 #include <vector>
 #include <set>
 #include <future>
+#include <thread>
+#include <atomic>
 #include <exception>
 
 #include "Blockchain.h"
@@ -141,6 +143,12 @@ private:
 
    ArmoryThreading::Queue<std::shared_ptr<BDVNotificationHook>> oneTimeHooks_;
 
+   //chain updates wait on the db a snapshot is copying
+   std::mutex chainUpdateMutex_;
+   std::atomic<bool> snapshotRunning_;
+   std::atomic<bool> snapshotCancel_;
+   std::thread snapshotThr_;
+
 public:
    typedef std::function<void(BDMPhase, double,unsigned, unsigned)> ProgressCallback;
    std::shared_ptr<BitcoinNodeInterface> processNode_, watchNode_;
@@ -216,6 +224,7 @@ public:
       processNode_->shutdown(); 
    }
    void shutdownNotifications(void) { notificationStack_.terminate(); }
+   void cancelSnapshot(void) { snapshotCancel_.store(true); }
 
 public:
    bool isRunning(void) const { return BDMstate_ != BDM_offline; }
@@ -232,6 +241,10 @@ public:
 
    void registerOneTimeHook(std::shared_ptr<BDVNotificationHook>);
    void triggerOneTimeHooks(BDV_Notification*);
+
+   //compacted copy of the dbs to destDir in a side thread, the bdm keeps 
+   //serving. Returns false if a snapshot is already running
+   bool snapshotDatabases(const std::string& destDir);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
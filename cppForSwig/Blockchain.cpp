@@ -11,6 +11,8 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+
 #include "Blockchain.h"
 #include "util.h"
 
@@ -20,6 +22,359 @@
 
 using namespace std;
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//
+// HeaderStore
+//
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockHeader> HeaderStore::HeaderArray::get(unsigned index) const
+{
+   if (index >= size_)
+      return nullptr;
+
+   auto& chunk = chunks_[index >> HEADER_CHUNK_BITS];
+   if (chunk == nullptr)
+      return nullptr;
+
+   return chunk->headers_[index & (HEADER_CHUNK_SIZE - 1)];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::HeaderArray::beginUpdate()
+{
+   publishedSize_ = size_;
+   ownedChunks_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::HeaderArray::set(unsigned index, shared_ptr<BlockHeader> ptr)
+{
+   auto chunkId = index >> HEADER_CHUNK_BITS;
+   if (chunkId >= chunks_.size())
+      chunks_.resize(chunkId + 1);
+
+   auto& chunk = chunks_[chunkId];
+   if (chunk == nullptr)
+   {
+      chunk = make_shared<HeaderChunk>();
+      ownedChunks_.insert(chunkId);
+   }
+   else if (index < publishedSize_ && 
+      ownedChunks_.find(chunkId) == ownedChunks_.end())
+   {
+      //readers may be on this slot, change a copy of the chunk
+      chunk = make_shared<HeaderChunk>(*chunk);
+      ownedChunks_.insert(chunkId);
+   }
+
+   chunk->headers_[index & (HEADER_CHUNK_SIZE - 1)] = ptr;
+   if (index >= size_)
+      size_ = index + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::HeaderArray::truncate(unsigned size)
+{
+   if (size >= size_)
+      return;
+
+   size_ = size;
+   auto chunkCount = (size + HEADER_CHUNK_SIZE - 1) >> HEADER_CHUNK_BITS;
+   chunks_.resize(chunkCount);
+   ownedChunks_.erase(
+      ownedChunks_.lower_bound(chunkCount), ownedChunks_.end());
+
+   //clear the tail of the last chunk so that growing back doesn't 
+   //resurrect stale entries
+   auto offset = size & (HEADER_CHUNK_SIZE - 1);
+   if (offset == 0)
+      return;
+
+   auto chunkId = chunkCount - 1;
+   auto& chunk = chunks_[chunkId];
+   if (chunk == nullptr)
+      return;
+
+   if (ownedChunks_.find(chunkId) == ownedChunks_.end())
+   {
+      chunk = make_shared<HeaderChunk>(*chunk);
+      ownedChunks_.insert(chunkId);
+   }
+
+   for (unsigned i = offset; i < HEADER_CHUNK_SIZE; i++)
+      chunk->headers_[i] = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+HeaderStore::HashIndex::HashIndex(size_t size) :
+   slots_(new atomic<uint32_t>[size]), mask_(size - 1)
+{
+   for (size_t i = 0; i < size; i++)
+      slots_[i].store(0, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+HeaderStore::HeaderStore()
+{
+   clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::clear()
+{
+   auto snapshot = make_shared<Snapshot>();
+   snapshot->hashIndex_ = make_shared<HashIndex>(1024);
+
+   unique_lock<mutex> lock(writeMutex_);
+   atomic_store(&snapshot_, snapshot);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<HeaderStore::Snapshot> HeaderStore::getSnapshot() const
+{
+   return atomic_load(&snapshot_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t HeaderStore::getHashKey(BinaryDataRef hash)
+{
+   if (hash.getSize() >= 8)
+      return READ_UINT64_LE(hash.getPtr());
+
+   uint64_t key = 0;
+   for (unsigned i = 0; i < hash.getSize(); i++)
+      key = (key << 8) | hash.getPtr()[i];
+   return key;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t HeaderStore::findSlot(
+   const Snapshot& snapshot, BinaryDataRef hash, size_t& slot)
+{
+   /***
+   Returns the id + 1 at the slot holding this hash, 0 and the first free
+   slot if the hash isn't in the table, UINT32_MAX if the table refers
+   to an id past the snapshot.
+   ***/
+
+   auto& hashIndex = *snapshot.hashIndex_;
+   slot = getHashKey(hash) & hashIndex.mask_;
+
+   while (true)
+   {
+      auto val = hashIndex.slots_[slot].load(memory_order_acquire);
+      if (val == 0)
+         return 0;
+
+      auto header = snapshot.byId_.get(val - 1);
+      if (header == nullptr)
+         return UINT32_MAX;
+
+      if (header->getThisHash() == hash)
+         return val;
+
+      slot = (slot + 1) & hashIndex.mask_;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::putHash(HashIndex& hashIndex, const Snapshot& snapshot,
+   const BinaryData& hash, uint32_t id)
+{
+   auto slot = getHashKey(hash) & hashIndex.mask_;
+   while (true)
+   {
+      auto val = hashIndex.slots_[slot].load(memory_order_relaxed);
+      if (val == 0)
+      {
+         ++hashIndex.count_;
+         break;
+      }
+
+      auto header = snapshot.byId_.get(val - 1);
+      if (header != nullptr && header->getThisHash() == hash)
+         break;
+
+      slot = (slot + 1) & hashIndex.mask_;
+   }
+
+   hashIndex.slots_[slot].store(id + 1, memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockHeader> HeaderStore::getByHash(BinaryDataRef hash) const
+{
+   while (true)
+   {
+      auto snapshot = getSnapshot();
+
+      size_t slot;
+      auto val = findSlot(*snapshot, hash, slot);
+      if (val == 0)
+         return nullptr;
+      
+      //hash added since we grabbed the snapshot
+      if (val == UINT32_MAX)
+         continue;
+
+      return snapshot->byId_.get(val - 1);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockHeader> HeaderStore::getById(unsigned id) const
+{
+   auto snapshot = getSnapshot();
+   return snapshot->byId_.get(id);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockHeader> HeaderStore::getByHeight(unsigned height) const
+{
+   auto snapshot = getSnapshot();
+   return snapshot->byHeight_.get(height);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned HeaderStore::getHeightCount() const
+{
+   auto snapshot = getSnapshot();
+   return snapshot->byHeight_.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<shared_ptr<BlockHeader>> HeaderStore::getHeaders() const
+{
+   auto snapshot = getSnapshot();
+   vector<shared_ptr<BlockHeader>> result;
+
+   for (unsigned i = 0; i < snapshot->byId_.size(); i++)
+   {
+      auto header = snapshot->byId_.get(i);
+      if (header == nullptr)
+         continue;
+
+      //skip headers replaced at their hash
+      size_t slot;
+      if (findSlot(*snapshot, header->getThisHash(), slot) != i + 1)
+         continue;
+
+      result.push_back(header);
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<shared_ptr<BlockHeader>> HeaderStore::getHeadersById() const
+{
+   auto snapshot = getSnapshot();
+   vector<shared_ptr<BlockHeader>> result;
+
+   for (unsigned i = 0; i < snapshot->byId_.size(); i++)
+   {
+      auto header = snapshot->byId_.get(i);
+      if (header != nullptr)
+         result.push_back(header);
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::insert(const vector<shared_ptr<BlockHeader>>& headers)
+{
+   if (headers.size() == 0)
+      return;
+
+   unique_lock<mutex> lock(writeMutex_);
+   auto snapshot = make_shared<Snapshot>(*snapshot_);
+
+   snapshot->byId_.beginUpdate();
+   for (auto& header : headers)
+   {
+      if (header->getThisID() == UINT32_MAX)
+         throw runtime_error("cannot store header without an id");
+
+      snapshot->byId_.set(header->getThisID(), header);
+   }
+
+   //keep the table under half load
+   auto& hashIndex = *snapshot_->hashIndex_;
+   if ((hashIndex.count_ + headers.size()) * 2 > hashIndex.mask_ + 1)
+   {
+      auto size = hashIndex.mask_ + 1;
+      while ((hashIndex.count_ + headers.size()) * 2 > size)
+         size *= 2;
+
+      //rebuild from the previous table, then add the new headers
+      auto newIndex = make_shared<HashIndex>(size);
+      for (size_t i = 0; i <= hashIndex.mask_; i++)
+      {
+         auto val = hashIndex.slots_[i].load(memory_order_relaxed);
+         if (val == 0)
+            continue;
+
+         auto header = snapshot->byId_.get(val - 1);
+         putHash(*newIndex, *snapshot, header->getThisHash(), val - 1);
+      }
+
+      for (auto& header : headers)
+      {
+         putHash(*newIndex, *snapshot, 
+            header->getThisHash(), header->getThisID());
+      }
+
+      snapshot->hashIndex_ = newIndex;
+      atomic_store(&snapshot_, snapshot);
+      return;
+   }
+
+   //publish the headers before the table points at them
+   atomic_store(&snapshot_, snapshot);
+   for (auto& header : headers)
+   {
+      putHash(hashIndex, *snapshot, 
+         header->getThisHash(), header->getThisID());
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::setHeights(const map<unsigned, shared_ptr<BlockHeader>>& hMap)
+{
+   if (hMap.size() == 0)
+      return;
+
+   unique_lock<mutex> lock(writeMutex_);
+   auto snapshot = make_shared<Snapshot>(*snapshot_);
+
+   snapshot->byHeight_.beginUpdate();
+   for (auto& height_pair : hMap)
+      snapshot->byHeight_.set(height_pair.first, height_pair.second);
+   snapshot->byHeight_.truncate(hMap.rbegin()->first + 1);
+
+   atomic_store(&snapshot_, snapshot);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderStore::setHeights(const vector<shared_ptr<BlockHeader>>& headers)
+{
+   if (headers.size() == 0)
+      return;
+
+   unique_lock<mutex> lock(writeMutex_);
+   auto snapshot = make_shared<Snapshot>(*snapshot_);
+
+   snapshot->byHeight_.beginUpdate();
+   for (auto& header : headers)
+      snapshot->byHeight_.set(header->getBlockHeight(), header);
+   snapshot->byHeight_.truncate(headers.back()->getBlockHeight() + 1);
+
+   atomic_store(&snapshot_, snapshot);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -37,15 +392,11 @@ Blockchain::Blockchain(const HashString &genesisHash)
 void Blockchain::clear()
 {
    newlyParsedBlocks_.clear();
-   headersByHeight_.clear();
-   headersById_.clear();
-   headerMap_.clear();
-
-   pair<BinaryData, shared_ptr<BlockHeader>> genesisPair;
-   genesisPair.first = genesisHash_;
-   genesisPair.second = make_shared<BlockHeader>();
-   atomic_store(&topBlockPtr_, genesisPair.second);
-   headerMap_.insert(genesisPair);
+   headers_.clear();
+
+   auto genesisPtr = make_shared<BlockHeader>();
+   atomic_store(&topBlockPtr_, genesisPtr);
+   atomic_store(&genesisPlaceholder_, genesisPtr);
    topBlockId_ = 0;
 
    topID_.store(0, memory_order_relaxed);
@@ -163,13 +514,14 @@ shared_ptr<BlockHeader> Blockchain::top() const
 
 shared_ptr<BlockHeader> Blockchain::getGenesisBlock() const
 {
-   auto headermap = headerMap_.get();
+   auto header = headers_.getByHash(genesisHash_);
+   if (header == nullptr)
+      header = atomic_load(&genesisPlaceholder_);
 
-   auto iter = headermap->find(genesisHash_);
-   if (iter == headermap->end())
+   if (header == nullptr)
       throw runtime_error("missing genesis block header");
 
-   return iter->second;
+   return header;
 }
 
 const shared_ptr<BlockHeader> Blockchain::getHeaderByHeight(
@@ -181,14 +533,12 @@ const shared_ptr<BlockHeader> Blockchain::getHeaderByHeight(
    Passing a dupId for a forked block will throw.
    */
 
-   auto headermap = headersByHeight_.get();
-
-   auto headerIter = headermap->find(index);
-   if (headerIter == headermap->end())
+   auto header = headers_.getByHeight(index);
+   if (header == nullptr)
       throw std::range_error("Cannot get block at height " + to_string(index));
 
-   if (dupId > 0x7F || headerIter->second->getDuplicateID() == dupId)
-      return (headerIter->second);
+   if (dupId > 0x7F || header->getDuplicateID() == dupId)
+      return header;
 
    //if we get this far, we're looking for a block that isn't on the main chain
    throw std::length_error("Cannot get block at height " + to_string(index) +
@@ -197,7 +547,7 @@ const shared_ptr<BlockHeader> Blockchain::getHeaderByHeight(
 
 bool Blockchain::hasHeaderByHeight(unsigned height) const
 {
-   if (height >= headersByHeight_.size())
+   if (height >= headers_.getHeightCount())
       return false;
 
    return true;
@@ -205,37 +555,34 @@ bool Blockchain::hasHeaderByHeight(unsigned height) const
 
 const shared_ptr<BlockHeader> Blockchain::getHeaderByHash(HashString const & blkHash) const
 {
-   auto headermap = headerMap_.get();
+   auto header = headers_.getByHash(blkHash);
+   if (header == nullptr && blkHash == genesisHash_)
+      header = atomic_load(&genesisPlaceholder_);
 
-   auto it = headermap->find(blkHash);
-   if(it == headermap->end())
+   if (header == nullptr)
       throw std::range_error("Cannot find block with hash " + blkHash.copySwapEndian().toHexStr());
 
-   return it->second;
+   return header;
 }
 
 shared_ptr<BlockHeader> Blockchain::getHeaderById(uint32_t id) const
 {
-   auto headermap = headersById_.get();
-
-   auto headerIter = headermap->find(id);
-   if (headerIter == headermap->end())
+   auto header = headers_.getById(id);
+   if (header == nullptr)
    {
       LOGERR << "cannot find block for id: " << id;
       throw std::range_error("Cannot find block by id");
    }
 
-   return headerIter->second;
+   return header;
 }
 
 bool Blockchain::hasHeaderWithHash(BinaryData const & txHash) const
 {
-   auto headermap = headerMap_.get();
-   auto it = headermap->find(txHash);
-   if (it == headermap->end())
-      return false;
+   if (headers_.getByHash(txHash) != nullptr)
+      return true;
 
-   return true;
+   return txHash == genesisHash_;
 }
 
 const shared_ptr<BlockHeader> Blockchain::getHeaderPtrForTxRef(const TxRef &txr) const
@@ -253,6 +600,104 @@ const shared_ptr<BlockHeader> Blockchain::getHeaderPtrForTxRef(const TxRef &txr)
    return bh;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+#define PREV_UNRESOLVED -2
+#define PREV_MISSING -1
+
+////////////////////////////////////////////////////////////////////////////////
+Blockchain::ChainIndex::ChainIndex(vector<shared_ptr<BlockHeader>> headers) :
+   headers_(move(headers))
+{
+   /***
+   headers come from HeaderStore::getHeaders, in id order, so the last
+   one carries the highest id
+   ***/
+
+   storeCount_ = headers_.size();
+   if (storeCount_ > 0)
+      byId_.assign((size_t)headers_.back()->getThisID() + 1, -1);
+
+   prev_.reserve(storeCount_ + 2);
+   diff_.reserve(storeCount_ + 2);
+   diffSum_.reserve(storeCount_ + 2);
+   height_.reserve(storeCount_ + 2);
+   orphan_.reserve(storeCount_ + 2);
+   finished_.reserve(storeCount_ + 2);
+
+   for (size_t i = 0; i < storeCount_; i++)
+   {
+      auto& header = headers_[i];
+      byId_[header->getThisID()] = i;
+
+      prev_.push_back(PREV_UNRESOLVED);
+      diff_.push_back(header->difficultyDbl_);
+      diffSum_.push_back(header->difficultySum_);
+      height_.push_back(header->blockHeight_);
+      orphan_.push_back(header->isOrphan_);
+      finished_.push_back(header->isFinishedCalc_);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int32_t Blockchain::ChainIndex::getIndex(
+   const shared_ptr<BlockHeader>& header) const
+{
+   auto id = header->getThisID();
+   if (id < byId_.size())
+   {
+      auto idx = byId_[id];
+      if (idx >= 0 && headers_[idx] == header)
+         return idx;
+   }
+
+   //headers that aren't in the store, only ever a couple of them
+   for (auto i = storeCount_; i < headers_.size(); i++)
+   {
+      if (headers_[i] == header)
+         return i;
+   }
+
+   return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int32_t Blockchain::ChainIndex::add(const shared_ptr<BlockHeader>& header)
+{
+   auto idx = getIndex(header);
+   if (idx >= 0)
+      return idx;
+
+   headers_.push_back(header);
+   prev_.push_back(PREV_UNRESOLVED);
+   diff_.push_back(header->difficultyDbl_);
+   diffSum_.push_back(header->difficultySum_);
+   height_.push_back(header->blockHeight_);
+   orphan_.push_back(header->isOrphan_);
+   finished_.push_back(header->isFinishedCalc_);
+
+   return headers_.size() - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int32_t Blockchain::getPrevIndex(ChainIndex& ci, int32_t idx) const
+{
+   //each header's prev hash is looked up once per organizeChain call
+   auto& prevIdx = ci.prev_[idx];
+   if (prevIdx == PREV_UNRESOLVED)
+   {
+      auto prevHash = ci.headers_[idx]->getPrevHashRef();
+      auto prevPtr = headers_.getByHash(prevHash);
+      if (prevPtr != nullptr)
+         prevIdx = ci.getIndex(prevPtr);
+      else if (ci.genesisPlaceholder_ >= 0 && prevHash == genesisHash_)
+         prevIdx = ci.genesisPlaceholder_;
+      else
+         prevIdx = PREV_MISSING;
+   }
+
+   return prevIdx;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Returns nullptr if the new top block is a direct follower of
 // the previous top. Returns the branch point if we had to reorg
@@ -274,17 +719,17 @@ shared_ptr<BlockHeader> Blockchain::organizeChain(bool forceRebuild, bool verbos
    // invalid.  Rather than get fancy, just rebuild all which takes less
    // than a second, anyway.
 
-   auto headermap = headerMap_.get();
+   auto&& headers = headers_.getHeaders();
 
    if(forceRebuild)
    {
-      for (const auto& headerPair : *headermap)
+      for (const auto& header : headers)
       {
-         headerPair.second->difficultySum_  = -1;
-         headerPair.second->blockHeight_ = 0;
-         headerPair.second->isFinishedCalc_ = false;
-         headerPair.second->nextHash_ = BtcUtils::EmptyHash();
-         headerPair.second->isMainBranch_ = false;
+         header->difficultySum_  = -1;
+         header->blockHeight_ = 0;
+         header->isFinishedCalc_ = false;
+         header->nextHash_ = BtcUtils::EmptyHash();
+         header->isMainBranch_ = false;
       }
       topBlockPtr_ = NULL;
    }
@@ -301,33 +746,40 @@ shared_ptr<BlockHeader> Blockchain::organizeChain(bool forceRebuild, bool verbos
 
    // If this is the first run, the topBlock is the genesis block
    {
-      auto headermap = headersById_.get();
-      auto topblock_iter = headermap->find(topBlockId_);
-      if (topblock_iter != headermap->end())
-      {
-         atomic_store(&topBlockPtr_, topblock_iter->second);
-      }
+      auto topblock = headers_.getById(topBlockId_);
+      if (topblock != nullptr)
+         atomic_store(&topBlockPtr_, topblock);
       else
-      {
          atomic_store(&topBlockPtr_, genBlock);
-      }
    }
 
    const auto prevTopBlock = top();
-   auto newTopBlock = topBlockPtr_;
+
+   /***
+   The chain is organized on flat arrays of the header state, indexed
+   like the header vector, and written back to the headers once done.
+   The genesis placeholder stands in for the genesis header until it is
+   added, it gets an index too.
+   ***/
+   ChainIndex ci(move(headers));
+   if (genBlock != headers_.getByHash(genesisHash_))
+      ci.genesisPlaceholder_ = ci.add(genBlock);
+
+   const auto prevTopIdx = ci.add(prevTopBlock);
+   auto newTopIdx = prevTopIdx;
    
    // Iterate over all blocks, track the maximum difficulty-sum block
-   double   maxDiffSum     = prevTopBlock->getDifficultySum();
-   for( auto &header_pair : *headermap)
+   double   maxDiffSum     = ci.diffSum_[prevTopIdx];
+   for (int32_t i = 0; i < (int32_t)ci.storeCount_; i++)
    {
       // *** Walk down the chain following prevHash fields, until
       //     you find a "solved" block.  Then walk back up and 
       //     fill in the difficulty-sum values (do not set next-
       //     hash ptrs, as we don't know if this is the main branch)
       //     Method returns instantly if block is already "solved"
-      double thisDiffSum = traceChainDown(header_pair.second);
+      double thisDiffSum = traceChainDown(ci, i);
 
-      if (header_pair.second->isOrphan_)
+      if (ci.orphan_[i])
       {
          // disregard this block
       }
@@ -336,43 +788,60 @@ shared_ptr<BlockHeader> Blockchain::organizeChain(bool forceRebuild, bool verbos
       else if(thisDiffSum > maxDiffSum)
       {
          maxDiffSum     = thisDiffSum;
-         newTopBlock = header_pair.second;
+         newTopIdx = i;
       }
    }
 
    
    // Walk down the list one more time, set nextHash fields
-   // Also set headersByHeight_;
-   map<unsigned, shared_ptr<BlockHeader>> heightMap;
-   bool prevChainStillValid = (newTopBlock == prevTopBlock);
+   bool prevChainStillValid = (newTopIdx == prevTopIdx);
+   auto newTopBlock = ci.headers_[newTopIdx];
    newTopBlock->nextHash_ = BtcUtils::EmptyHash();
-   auto thisHeaderPtr = newTopBlock;
+   vector<int32_t> mainBranch;
+   auto thisIdx = newTopIdx;
 
-   while (!thisHeaderPtr->isFinishedCalc_)
+   while (!ci.finished_[thisIdx])
    {
-      thisHeaderPtr->isFinishedCalc_ = true;
-      thisHeaderPtr->isMainBranch_   = true;
-      thisHeaderPtr->isOrphan_       = false;
-      heightMap[thisHeaderPtr->getBlockHeight()] = thisHeaderPtr;
+      ci.finished_[thisIdx] = true;
+      ci.orphan_[thisIdx] = false;
+      mainBranch.push_back(thisIdx);
 
-      auto prevHash = thisHeaderPtr->getPrevHashRef();
-      auto childIter = headermap->find(prevHash);
-      if (childIter == headermap->end())
+      auto prevIdx = getPrevIndex(ci, thisIdx);
+      if (prevIdx < 0)
       {
          LOGERR << "failed to get prev header by hash";
          throw runtime_error("failed to get prev header by hash");
       }
 
-      childIter->second->nextHash_ = thisHeaderPtr->getThisHash();
-      thisHeaderPtr = childIter->second;
-      if (thisHeaderPtr == prevTopBlock)
+      ci.headers_[prevIdx]->nextHash_ = ci.headers_[thisIdx]->getThisHash();
+      thisIdx = prevIdx;
+      if (thisIdx == prevTopIdx)
          prevChainStillValid = true;
    }
 
    // Last header in the loop didn't get added (the genesis block on first run)
-   thisHeaderPtr->isMainBranch_ = true;
-   heightMap[thisHeaderPtr->getBlockHeight()] = thisHeaderPtr;
-   headersByHeight_.update(heightMap);
+   mainBranch.push_back(thisIdx);
+
+   // Write the chain state back to the headers
+   for (size_t i = 0; i < ci.headers_.size(); i++)
+   {
+      auto& header = ci.headers_[i];
+      header->difficultySum_ = ci.diffSum_[i];
+      header->blockHeight_ = ci.height_[i];
+      header->isOrphan_ = ci.orphan_[i];
+      header->isFinishedCalc_ = ci.finished_[i];
+   }
+
+   // Also set the height index of headers_
+   vector<shared_ptr<BlockHeader>> mainHeaders;
+   mainHeaders.reserve(mainBranch.size());
+   for (auto it = mainBranch.rbegin(); it != mainBranch.rend(); ++it)
+   {
+      auto& header = ci.headers_[*it];
+      header->isMainBranch_ = true;
+      mainHeaders.push_back(header);
+   }
+   headers_.setHeights(mainHeaders);
 
    topBlockId_ = newTopBlock->getThisID();
    atomic_store(&topBlockPtr_, newTopBlock);
@@ -384,7 +853,7 @@ shared_ptr<BlockHeader> Blockchain::organizeChain(bool forceRebuild, bool verbos
       LOGWARN << "Reorg detected!";
 
       organizeChain(true); // force-rebuild blockchain (takes less than 1s)
-      return thisHeaderPtr;
+      return ci.headers_[thisIdx];
    }
 
    if (verbose)
@@ -402,36 +871,29 @@ shared_ptr<BlockHeader> Blockchain::organizeChain(bool forceRebuild, bool verbos
 // Start from a node, trace down to the highest solved block, accumulate
 // difficulties and difficultySum values.  Return the difficultySum of 
 // this block.
-double Blockchain::traceChainDown(shared_ptr<BlockHeader> bhpStart)
+double Blockchain::traceChainDown(ChainIndex& ci, int32_t startIdx)
 {
-   if(bhpStart->difficultySum_ > 0)
-      return bhpStart->difficultySum_;
-
-   // Prepare some data structures for walking down the chain
-   vector<shared_ptr<BlockHeader>>   headerPtrStack(headerMap_.size());
-   vector<double>         difficultyStack(headerMap_.size());
-   uint32_t blkIdx = 0;
+   if(ci.diffSum_[startIdx] > 0)
+      return ci.diffSum_[startIdx];
 
-   // Walk down the chain of prevHash_ values, until we find a block
+   // Walk down the chain of prev indices, until we find a block
    // that has a definitive difficultySum value (i.e. >0). 
-   auto headermap = headerMap_.get();
+   auto& idxStack = ci.stack_;
+   idxStack.clear();
 
-   auto thisPtr = bhpStart;
-   while( thisPtr->difficultySum_ < 0)
+   auto thisIdx = startIdx;
+   while(ci.diffSum_[thisIdx] < 0)
    {
-      double thisDiff         = thisPtr->difficultyDbl_;
-      difficultyStack[blkIdx] = thisDiff;
-      headerPtrStack[blkIdx]  = thisPtr;
-      blkIdx++;
+      idxStack.push_back(thisIdx);
 
-      auto iter = headermap->find(thisPtr->getPrevHash());
-      if(iter != headermap->end())
+      auto prevIdx = getPrevIndex(ci, thisIdx);
+      if(prevIdx >= 0)
       {
-         thisPtr = iter->second;
+         thisIdx = prevIdx;
       }
       else
       {
-         thisPtr->isOrphan_ = true;
+         ci.orphan_[thisIdx] = true;
          // this block is an orphan, possibly caused by a HeadersFirst
          // blockchain. Nothing to do about that
          return numeric_limits<double>::max();
@@ -439,24 +901,21 @@ double Blockchain::traceChainDown(shared_ptr<BlockHeader> bhpStart)
    }
 
 
-   // Now we have a stack of difficulties and pointers.  Walk back up
-   // (by pointer) and accumulate the difficulty values 
-   double   seedDiffSum = thisPtr->difficultySum_;
-   uint32_t blkHeight   = thisPtr->blockHeight_;
-   for(int32_t i=blkIdx-1; i>=0; i--)
+   // Now we have a stack of indices.  Walk back up and accumulate the 
+   // difficulty values 
+   double   seedDiffSum = ci.diffSum_[thisIdx];
+   uint32_t blkHeight   = ci.height_[thisIdx];
+   for (auto iter = idxStack.rbegin(); iter != idxStack.rend(); ++iter)
    {
-      seedDiffSum += difficultyStack[i];
+      seedDiffSum += ci.diff_[*iter];
       blkHeight++;
-      thisPtr                 = headerPtrStack[i];
-      thisPtr->difficultyDbl_ = difficultyStack[i];
-      thisPtr->difficultySum_ = seedDiffSum;
-      thisPtr->blockHeight_   = blkHeight;
-      thisPtr->isOrphan_ = false;
+      ci.diffSum_[*iter] = seedDiffSum;
+      ci.height_[*iter]  = blkHeight;
+      ci.orphan_[*iter]  = false;
    }
    
    // Finally, we have all the difficulty sums calculated, return this one
-   return bhpStart->difficultySum_;
-  
+   return ci.diffSum_[startIdx];
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -473,13 +932,21 @@ void Blockchain::putBareHeaders(LMDBBlockDatabase *db, bool updateDupID)
    block file is created by Core.
    ***/
 
-   auto headermap = headerMap_.get();
-   for (auto& block : *headermap)
+   //dups go to the lowest hash first
+   auto&& headers = headers_.getHeaders();
+   sort(headers.begin(), headers.end(), 
+      [](const shared_ptr<BlockHeader>& lhs, 
+         const shared_ptr<BlockHeader>& rhs)->bool
+   {
+      return lhs->getThisHash() < rhs->getThisHash();
+   });
+
+   for (auto& block : headers)
    {
       StoredHeader sbh;
-      sbh.createFromBlockHeader(*(block.second));
+      sbh.createFromBlockHeader(*block);
       uint8_t dup = db->putBareHeader(sbh, updateDupID);
-      block.second->setDuplicateID(dup);  // make sure headerMap_ and DB agree
+      block->setDuplicateID(dup);  // make sure headers_ and DB agree
    }
 }
 
@@ -506,7 +973,7 @@ void Blockchain::putNewBareHeaders(LMDBBlockDatabase *db)
          sbh.createFromBlockHeader(*block);
          //don't update SDBI, we'll do it here once instead
          uint8_t dup = db->putBareHeader(sbh, true, false);
-         block->setDuplicateID(dup);  // make sure headerMap_ and DB agree
+         block->setDuplicateID(dup);  // make sure headers_ and DB agree
          
          if(block->isMainBranch())
             dupIdMap.insert(make_pair(block->blockHeight_, dup));
@@ -555,27 +1022,20 @@ set<uint32_t> Blockchain::addBlocksInBulk(
    set<uint32_t> returnSet;
    unique_lock<mutex> lock(mu_);
 
-   map<BinaryData, shared_ptr<BlockHeader>> toAddMap;
-   map<unsigned, shared_ptr<BlockHeader>> idMap;
-   
+   vector<shared_ptr<BlockHeader>> toAdd;
+   for (auto& header_pair : bhMap)
    {
-      auto headermap = headerMap_.get();
-
-      for (auto& header_pair : bhMap)
+      auto header = headers_.getByHash(header_pair.first);
+      if (header != nullptr)
       {
-         auto iter = headermap->find(header_pair.first);
-         if (iter != headermap->end())
-         {
-            if (iter->second->dataCopy_.getSize() == HEADER_SIZE)
-               continue;
-         }
-
-         toAddMap.insert(header_pair);
-         idMap[header_pair.second->getThisID()] = header_pair.second;
-         if (areNew)
-            newlyParsedBlocks_.push_back(header_pair.second);
-         returnSet.insert(header_pair.second->getThisID());
+         if (header->dataCopy_.getSize() == HEADER_SIZE)
+            continue;
       }
+
+      toAdd.push_back(header_pair.second);
+      if (areNew)
+         newlyParsedBlocks_.push_back(header_pair.second);
+      returnSet.insert(header_pair.second->getThisID());
    }
 
    if (!areNew)
@@ -598,8 +1058,7 @@ set<uint32_t> Blockchain::addBlocksInBulk(
       topID_.store(topID, memory_order_relaxed);
    }
 
-   headerMap_.update(toAddMap);
-   headersById_.update(idMap);
+   headers_.insert(toAdd);
    return returnSet;
 }
 
@@ -608,16 +1067,90 @@ void Blockchain::forceAddBlocksInBulk(
    map<HashString, shared_ptr<BlockHeader>>& bhMap)
 {
    unique_lock<mutex> lock(mu_);
-   map<unsigned, shared_ptr<BlockHeader>> idMap;
+   vector<shared_ptr<BlockHeader>> toAdd;
 
    for (auto& headerPair : bhMap)
    {
-      idMap[headerPair.second->getThisID()] = headerPair.second;
+      toAdd.push_back(headerPair.second);
       newlyParsedBlocks_.push_back(headerPair.second);
    }
 
-   headersById_.update(idMap);
-   headerMap_.update(bhMap);
+   headers_.insert(toAdd);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+Blockchain::ReorganizationState Blockchain::setOrganizedHeaders(
+   const vector<shared_ptr<BlockHeader>>& headers, const BinaryData& tipHash)
+{
+   /***
+   Headers carry the chain state they were saved with (difficulty sums,
+   branch flags), this only rebuilds the height index and the next hash
+   links of the main branch. Throws if the main branch has gaps, the
+   caller should fall back to organizing the chain from scratch then.
+   ***/
+
+   unique_lock<mutex> lock(mu_);
+
+   ReorganizationState st;
+   st.prevTop_ = top();
+
+   map<unsigned, shared_ptr<BlockHeader>> heightMap;
+   unsigned topID = topID_.load(memory_order_relaxed);
+   for (auto& header : headers)
+   {
+      if (header->isMainBranch_)
+         heightMap[header->blockHeight_] = header;
+
+      if (topID < header->uniqueID_)
+         topID = header->uniqueID_;
+   }
+
+   auto tipIter = heightMap.rbegin();
+   if (tipIter == heightMap.rend() || 
+      tipIter->second->getThisHash() != tipHash ||
+      tipIter->first != heightMap.size() - 1 ||
+      heightMap.begin()->second->getThisHash() != genesisHash_)
+   {
+      throw runtime_error("organized headers do not form a chain");
+   }
+
+   shared_ptr<BlockHeader> prevHeader;
+   for (auto& height_pair : heightMap)
+   {
+      auto& header = height_pair.second;
+      if (prevHeader != nullptr)
+      {
+         if (header->getPrevHashRef() != prevHeader->getThisHashRef())
+            throw runtime_error("organized headers do not form a chain");
+         prevHeader->nextHash_ = header->getThisHash();
+      }
+
+      prevHeader = header;
+   }
+
+   tipIter->second->nextHash_ = BtcUtils::EmptyHash();
+
+   headers_.insert(headers);
+   headers_.setHeights(heightMap);
+   topID_.store(topID, memory_order_relaxed);
+
+   topBlockId_ = tipIter->second->getThisID();
+   atomic_store(&topBlockPtr_, tipIter->second);
+
+   st.prevTopStillValid_ = true;
+   st.hasNewTop_ = (st.prevTop_ != top());
+   st.newTop_ = top();
+   return st;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+vector<shared_ptr<BlockHeader>> Blockchain::getCommittedHeaders() const
+{
+   unique_lock<mutex> lock(mu_);
+   if (newlyParsedBlocks_.size() != 0)
+      return vector<shared_ptr<BlockHeader>>();
+
+   return headers_.getHeaders();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -625,13 +1158,13 @@ map<unsigned, set<unsigned>> Blockchain::mapIDsPerBlockFile(void) const
 {
    unique_lock<mutex> lock(mu_);
 
-   auto headermap = headersById_.get();
+   auto&& headers = headers_.getHeadersById();
    map<unsigned, set<unsigned>> resultMap;
 
-   for (auto& header : *headermap)
+   for (auto& header : headers)
    {
-      auto& result_set = resultMap[header.second->blkFileNum_];
-      result_set.insert(header.second->uniqueID_);
+      auto& result_set = resultMap[header->blkFileNum_];
+      result_set.insert(header->uniqueID_);
    }
 
    return resultMap;
@@ -640,16 +1173,16 @@ map<unsigned, set<unsigned>> Blockchain::mapIDsPerBlockFile(void) const
 /////////////////////////////////////////////////////////////////////////////
 map<unsigned, HeightAndDup> Blockchain::getHeightAndDupMap(void) const
 {
-   auto headermap = headersById_.get();
+   auto&& headers = headers_.getHeadersById();
    map<unsigned, HeightAndDup> hd_map;
 
-   for (auto& block_pair : *headermap)
+   for (auto& header : headers)
    {
-      HeightAndDup hd(block_pair.second->getBlockHeight(), 
-         block_pair.second->getDuplicateID(),
-         block_pair.second->isMainBranch());
+      HeightAndDup hd(header->getBlockHeight(), 
+         header->getDuplicateID(),
+         header->isMainBranch());
 
-      hd_map.insert(make_pair(block_pair.first, hd));
+      hd_map.insert(make_pair(header->getThisID(), hd));
    }
 
    return hd_map;
@@ -21,6 +21,10 @@
 #include <memory>
 #include <deque>
 #include <map>
+#include <set>
+#include <vector>
+#include <atomic>
+#include <mutex>
 
 ////////////////////////////////////////////////////////////////////////////////
 struct HeightAndDup
@@ -34,6 +38,114 @@ struct HeightAndDup
    {}
 };
 
+////////////////////////////////////////////////////////////////////////////////
+#define HEADER_CHUNK_BITS 12
+#define HEADER_CHUNK_SIZE (1 << HEADER_CHUNK_BITS)
+
+////////////////////////////////////////////////////////////////////////////////
+class HeaderStore
+{
+   /***
+   Header lookups by hash, id and height, without locking the readers.
+
+   Ids and heights index dense arrays of header pointers, split in chunks
+   of HEADER_CHUNK_SIZE. Hashes go through an open addressing table of 
+   ids, probed on the first 8 bytes of the hash.
+
+   The writer works on a copy of the current snapshot and swaps it in
+   once done. The copy shares the chunks: slots past the published size
+   are written in place, since no reader can see them yet, and a chunk
+   that has a published slot changed gets copied first. Inserting a 
+   header costs a copy of the chunk directory, one slot and one table 
+   entry.
+
+   The hash table is shared across snapshots too. New entries are 
+   written after the snapshot that carries their header is published.
+   A reader hitting an id past its snapshot reloads the snapshot. The
+   table is rebuilt into the next snapshot past half load.
+   ***/
+
+private:
+   struct HeaderChunk
+   {
+      std::shared_ptr<BlockHeader> headers_[HEADER_CHUNK_SIZE];
+   };
+
+   ////
+   class HeaderArray
+   {
+   private:
+      std::vector<std::shared_ptr<HeaderChunk>> chunks_;
+      unsigned size_ = 0;
+
+      //writer side, chunks this copy owns
+      unsigned publishedSize_ = 0;
+      std::set<unsigned> ownedChunks_;
+
+   public:
+      std::shared_ptr<BlockHeader> get(unsigned) const;
+      unsigned size(void) const { return size_; }
+
+      void beginUpdate(void);
+      void set(unsigned, std::shared_ptr<BlockHeader>);
+
+      //drops the entries at and past size
+      void truncate(unsigned size);
+   };
+
+   ////
+   struct HashIndex
+   {
+      std::unique_ptr<std::atomic<uint32_t>[]> slots_;
+      size_t mask_;
+      size_t count_ = 0;
+
+      HashIndex(size_t);
+   };
+
+   ////
+   struct Snapshot
+   {
+      HeaderArray byId_;
+      HeaderArray byHeight_;
+      std::shared_ptr<HashIndex> hashIndex_;
+   };
+
+private:
+   std::shared_ptr<Snapshot> snapshot_;
+   std::mutex writeMutex_;
+
+private:
+   static uint64_t getHashKey(BinaryDataRef);
+   static uint32_t findSlot(const Snapshot&, BinaryDataRef, size_t&);
+   static void putHash(HashIndex&, const Snapshot&, 
+      const BinaryData&, uint32_t);
+   
+   std::shared_ptr<Snapshot> getSnapshot(void) const;
+
+public:
+   HeaderStore(void);
+
+   std::shared_ptr<BlockHeader> getByHash(BinaryDataRef) const;
+   std::shared_ptr<BlockHeader> getById(unsigned) const;
+   std::shared_ptr<BlockHeader> getByHeight(unsigned) const;
+   unsigned getHeightCount(void) const;
+
+   //one header per hash, in id order
+   std::vector<std::shared_ptr<BlockHeader>> getHeaders(void) const;
+   //every header added, replaced ones included
+   std::vector<std::shared_ptr<BlockHeader>> getHeadersById(void) const;
+
+   //a header replaces the one at the same hash
+   void insert(const std::vector<std::shared_ptr<BlockHeader>>&);
+   //the height index ends at the highest header set, heights past it
+   //(left over from a longer branch) are dropped
+   void setHeights(const std::map<unsigned, std::shared_ptr<BlockHeader>>&);
+   //headers go at their own height, in ascending height order
+   void setHeights(const std::vector<std::shared_ptr<BlockHeader>>&);
+   void clear(void);
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Manages the blockchain, keeping track of all the block headers
@@ -63,6 +175,13 @@ public:
 
    ReorganizationState organize(bool verbose);
    ReorganizationState forceOrganize();
+
+   //replaces organizing the chain when loading it from a header snapshot
+   ReorganizationState setOrganizedHeaders(
+      const std::vector<std::shared_ptr<BlockHeader>>&, const BinaryData&);
+
+   //live headers, empty if some have yet to be committed to the db
+   std::vector<std::shared_ptr<BlockHeader>> getCommittedHeaders(void) const;
    ReorganizationState findReorgPointFromBlock(const BinaryData& blkHash);
 
    void updateBranchingMaps(LMDBBlockDatabase*, ReorganizationState&);
@@ -79,11 +198,6 @@ public:
    bool hasHeaderWithHash(BinaryData const & txHash) const;
    const std::shared_ptr<BlockHeader> getHeaderPtrForTxRef(const TxRef &txr) const;
    
-   std::shared_ptr<const std::map<HashString, std::shared_ptr<BlockHeader>>> allHeaders(void) const
-   {
-      return headerMap_.get();
-   }
-
    void putBareHeaders(LMDBBlockDatabase *db, bool updateDupID=true);
    void putNewBareHeaders(LMDBBlockDatabase *db);
 
@@ -93,24 +207,51 @@ public:
    std::map<unsigned, HeightAndDup> getHeightAndDupMap(void) const;
 
 private:
+   //flat copy of the chain state organizeChain works on, headers are
+   //referred to by their index in headers_
+   struct ChainIndex
+   {
+      std::vector<std::shared_ptr<BlockHeader>> headers_;
+
+      std::vector<int32_t> prev_;
+      std::vector<double> diff_;
+      std::vector<double> diffSum_;
+      std::vector<uint32_t> height_;
+      std::vector<uint8_t> orphan_;
+      std::vector<uint8_t> finished_;
+
+      //index per unique id, for headers from the store
+      std::vector<int32_t> byId_;
+      size_t storeCount_ = 0;
+      int32_t genesisPlaceholder_ = -1;
+
+      //traceChainDown scratch space
+      std::vector<int32_t> stack_;
+
+      ChainIndex(std::vector<std::shared_ptr<BlockHeader>>);
+      int32_t getIndex(const std::shared_ptr<BlockHeader>&) const;
+      int32_t add(const std::shared_ptr<BlockHeader>&);
+   };
+
    std::shared_ptr<BlockHeader> organizeChain(bool forceRebuild = false, bool verbose = false);
+   //the genesis placeholder stands in for a genesis header the store
+   //doesn't have yet
+   int32_t getPrevIndex(ChainIndex&, int32_t) const;
    /////////////////////////////////////////////////////////////////////////////
    // Update/organize the headers map (figure out longest chain, mark orphans)
    // Start from a node, trace down to the highest solved block, accumulate
    // difficulties and difficultySum values.  Return the difficultySum of 
    // this block.
-   double traceChainDown(std::shared_ptr<BlockHeader> bhpStart);
+   double traceChainDown(ChainIndex&, int32_t);
 
 private:
    //TODO: make this whole class thread safe
 
    const BinaryData genesisHash_;
-   ArmoryThreading::TransactionalMap<
-      BinaryData, std::shared_ptr<BlockHeader>> headerMap_;
-   ArmoryThreading::TransactionalMap<
-      unsigned, std::shared_ptr<BlockHeader>> headersById_;
-   ArmoryThreading::TransactionalMap<
-      unsigned, std::shared_ptr<BlockHeader>> headersByHeight_;
+   HeaderStore headers_;
+
+   //stands in for the genesis block until its header is added
+   std::shared_ptr<BlockHeader> genesisPlaceholder_;
 
    std::vector<std::shared_ptr<BlockHeader>> newlyParsedBlocks_;
    std::shared_ptr<BlockHeader> topBlockPtr_;
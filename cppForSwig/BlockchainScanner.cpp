@@ -17,7 +17,13 @@ void BlockchainScanner::scan(int32_t scanFrom)
 {
    scanFrom = check_merkle(scanFrom);
    if (scanFrom == INT32_MIN)
+   {
+      setupBlockUndo(scanFrom);
       return;
+   }
+
+   if (verifyCheckpoint_)
+      verifyCheckpoint(scanFrom);
 
    scan_nocheck(scanFrom);
 }
@@ -28,42 +34,197 @@ int32_t BlockchainScanner::check_merkle(int32_t scanFrom)
    auto topBlock = blockchain_->top();
 
    scrAddrFilter_->updateAddressMerkleInDB();
-   auto&& subsshSdbi = scrAddrFilter_->getSubSshSDBI();
 
-   shared_ptr<BlockHeader> sdbiblock;
+   //resume past the last committed batch, this will set scanFrom to 0
+   //before an initial scan
+   auto checkpoint = getCheckpointHeight();
+   if (checkpoint + 1 > scanFrom)
+   {
+      if (checkpoint != -1)
+         LOGINFO << "resuming scan from checkpoint at block #" << checkpoint;
+
+      scanFrom = checkpoint + 1;
+   }
+
+   if (scanFrom > (int)topBlock->getBlockHeight() || 
+       scrAddrFilter_->getScanFilterAddrMap()->size() == 0)
+   {
+      LOGINFO << "no history to scan";
+      topScannedBlockHash_ = topBlock->getThisHash();
+      return INT32_MIN;
+   }
+
+   return scanFrom;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int32_t BlockchainScanner::getCheckpointHeight() const
+{
+   /***
+   The SUBSSH sdbi is the scan checkpoint. It is committed in the same 
+   transaction as the batch's SUBSSH entries, after the batch's STXO and 
+   TXHINTS writes, so everything up to its height is in the db. 
+   
+   It only counts if it sits on the main branch and was written for the
+   current address set. Returns -1 otherwise.
+   ***/
+
+   StoredDBInfo sdbi;
+   try
+   {
+      sdbi = scrAddrFilter_->getSubSshSDBI();
+   }
+   catch (runtime_error&)
+   {
+      return -1;
+   }
+
+   if (sdbi.metaHash_ != scrAddrFilter_->getAddressMapMerkle())
+      return -1;
 
-   //check if we need to scan anything
+   shared_ptr<BlockHeader> header;
    try
    {
-      sdbiblock =
-         blockchain_->getHeaderByHash(subsshSdbi.topScannedBlkHash_);
+      header = blockchain_->getHeaderByHash(sdbi.topScannedBlkHash_);
    }
    catch (...)
    {
-      sdbiblock = blockchain_->getHeaderByHeight(0, 0);
+      return -1;
    }
 
-   if (sdbiblock->isMainBranch())
+   if (!header->isMainBranch() || header->getBlockHeight() != sdbi.topBlkHgt_)
+      return -1;
+
+   return header->getBlockHeight();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::verifyCheckpoint(int32_t scanFrom)
+{
+   /***
+   The scan redoes everything from scanFrom on. An interrupted run may have
+   left STXO entries past the checkpoint: txouts created or spent by a batch
+   that never got its checkpoint written. preloadUtxos reads around those,
+   this pass removes them from the db for the tracked addresses, along
+   with any SUBSSH entry past the checkpoint.
+   ***/
+
+   if (scanFrom < 0)
+      scanFrom = 0;
+
+   LOGINFO << "verifying scan checkpoint, scanning from block #" << scanFrom;
+   auto scrAddrMap = scrAddrFilter_->getScanFilterAddrMap();
+
+   //subssh keys: prefix (1) | scrAddr | hgtx (4)
+   vector<BinaryData> subsshKeys;
+   {
+      auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadOnly);
+      auto dbIter = db_->getIterator(SUBSSH);
+      if (dbIter->seekToStartsWith(DB_PREFIX_SCRIPT))
+      {
+         do
+         {
+            auto keyRef = dbIter->getKeyRef();
+            if (keyRef.getSize() < 6 || keyRef.getPtr()[0] != DB_PREFIX_SCRIPT)
+               break;
+
+            auto&& hgtx = keyRef.getSliceCopy(keyRef.getSize() - 4, 4);
+            if ((int32_t)DBUtils::hgtxToHeight(hgtx) < scanFrom)
+               continue;
+
+            auto scrAddr = keyRef.getSliceRef(1, keyRef.getSize() - 5);
+            if (scrAddrMap->find(scrAddr) == scrAddrMap->end())
+               continue;
+
+            subsshKeys.push_back(keyRef);
+         } while (dbIter->advanceAndRead());
+      }
+   }
+
+   //stxo keys: hgtx (4) | txid (2) | txoutid (2), skip the sdbi
+   vector<BinaryData> stxoKeys;
+   map<BinaryData, BinaryWriter> unspentStxos;
    {
-      //this will set scanFrom to 0 before an initial scan
-      if ((int)sdbiblock->getBlockHeight() > scanFrom)
-         scanFrom = sdbiblock->getBlockHeight();
+      auto scrRefMap = scrAddrFilter_->getOutScrRefMap();
 
-      if (scanFrom > (int)topBlock->getBlockHeight() || 
-          scrAddrFilter_->getScanFilterAddrMap()->size() == 0)
+      auto&& tx = db_->beginTransaction(STXO, LMDB::ReadOnly);
+      auto dbIter = db_->getIterator(STXO);
+      if (dbIter->seekToFirst())
       {
-         LOGINFO << "no history to scan";
-         topScannedBlockHash_ = topBlock->getThisHash();
-         return INT32_MIN;
+         vector<LDBIterSpan> spans(LDBITER_BATCH_SIZE);
+         while (true)
+         {
+            auto count = dbIter->readBatch(
+               spans.data(), spans.size(), LDBITER_PREFETCH_BYTES);
+            if (count == 0)
+               break;
+
+            for (size_t i = 0; i < count; i++)
+            {
+               auto& span = spans[i];
+               if (span.key_.getSize() != 8 && span.key_.getSize() != 9)
+                  continue;
+
+               StoredTxOut stxo;
+               stxo.unserializeDBKey(span.key_);
+               stxo.unserializeDBValue(span.value_);
+
+               auto&& scrRef = 
+                  BtcUtils::getTxOutScrAddrNoCopy(stxo.getScriptRef());
+               if (scrRefMap->find(scrRef) == scrRefMap->end())
+                  continue;
+
+               if ((int32_t)stxo.blockHeight_ >= scanFrom)
+               {
+                  stxoKeys.push_back(span.key_);
+                  continue;
+               }
+
+               if (stxo.spentness_ != TXOUT_SPENT ||
+                  stxo.spentByTxInKey_.getSize() != 8 ||
+                  (int32_t)DBUtils::hgtxToHeight(
+                     stxo.spentByTxInKey_.getSliceCopy(0, 4)) < scanFrom)
+                  continue;
+
+               stxo.spentness_ = TXOUT_UNSPENT;
+               stxo.spentByTxInKey_.clear();
+               stxo.serializeDBValue(unspentStxos[span.key_]);
+            }
+         }
       }
    }
 
-   return scanFrom;
+   if (subsshKeys.size() == 0 && stxoKeys.size() == 0 && 
+      unspentStxos.size() == 0)
+   {
+      LOGINFO << "scan checkpoint is consistent";
+      return;
+   }
+
+   LOGWARN << "dropping state past the scan checkpoint: " <<
+      subsshKeys.size() << " subssh entries, " << stxoKeys.size() <<
+      " txouts, " << unspentStxos.size() << " spends";
+
+   {
+      auto&& tx = db_->beginTransaction(STXO, LMDB::ReadWrite);
+      for (auto& key : stxoKeys)
+         db_->deleteValue(STXO, key.getRef());
+
+      for (auto& stxo : unspentStxos)
+         db_->putValue(STXO, stxo.first.getRef(), stxo.second.getDataRef());
+   }
+
+   {
+      auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadWrite);
+      for (auto& key : subsshKeys)
+         db_->deleteValue(SUBSSH, key.getRef());
+   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner::scan_nocheck(int32_t scanFrom)
 {
+   setupBlockUndo(scanFrom);
    if (scanFrom > (int32_t)db_->blockchain()->top()->getBlockHeight())
       return;
 
@@ -71,25 +232,41 @@ void BlockchainScanner::scan_nocheck(int32_t scanFrom)
 
    startAt_ = scanFrom;
    auto topBlock = blockchain_->top();
+   addrMerkle_ = scrAddrFilter_->getAddressMapMerkle();
 
+   setupBlockFilters(scanFrom);
    preloadUtxos();
+   if (filterScrAddrs_.size() + filterOutpoints_.size() > 
+      BLOCKFILTER_MAX_QUERY)
+   {
+      useBlockFilters_ = false;
+      filterInputs_ = false;
+      filterOutpoints_.clear();
+   }
 
    auto scrRefMap = scrAddrFilter_->getOutScrRefMap();
+   pipeline_ = make_unique<ScanPipeline>(totalThreadCount_);
+   lastStageLog_ = chrono::steady_clock::now();
 
-   //lambdas
-   auto commitLambda = [this](void)
-   { writeBlockData(); };
-
-   auto outputsLambda = [this](void)
-   { processOutputs(); };
-
-   auto inputsLambda = [this](void)
-   { processInputs(); };
-
-   //start threads
-   auto commit_tID = thread(commitLambda);
-   auto outputs_tID = thread(outputsLambda);
-   auto inputs_tID = thread(inputsLambda);
+   /***
+   Filtered scans mostly skip block data, don't fault it in. Neither do
+   scans that stay within a single blk file (new blocks, short reorgs):
+   there is nothing to read ahead and that file is the one the next
+   update reads again, its pages should stay in the cache.
+   ***/
+   auto firstFileNum = blockchain_->getHeaderByHeight(
+      scanFrom, 0xFF)->getBlockFileNum();
+   if (!useBlockFilters_ && topBlock->getBlockFileNum() > firstFileNum)
+      blockDataLoader_.startReadahead(ioThreadCount_, readaheadFiles_);
+
+   //start stage drivers
+   vector<thread> stageThreads;
+   stageThreads.push_back(thread([this](void) { readBlockFiles(); }));
+   stageThreads.push_back(thread([this](void) { parseBlocks(); }));
+   stageThreads.push_back(thread([this](void) { processOutputs(); }));
+   stageThreads.push_back(thread([this](void) { processInputs(); }));
+   stageThreads.push_back(thread([this](void) { serializeBatches(); }));
+   stageThreads.push_back(thread([this](void) { writeBlockData(); }));
 
    auto startHeight = scanFrom;
    unsigned endHeight = 0;
@@ -165,8 +342,8 @@ void BlockchainScanner::scan_nocheck(int32_t scanFrom)
          completedFutures.push_back(batch->completedPromise_.get_future());
          batch->count_ = _count;
          
-         //post for txout parsing
-         outputQueue_.push_back(move(batch));
+         //post for block file reads
+         readQueue_.push_back(move(batch));
          if (_count - completedBatches_.load(memory_order_relaxed) >= 
             writeQueueDepth_)
          {
@@ -199,53 +376,119 @@ void BlockchainScanner::scan_nocheck(int32_t scanFrom)
       //let the scan terminate
    }
 
-   //mark all queues complete
-   outputQueue_.completed();
+   //stages complete the next queue as they run out of batches
+   readQueue_.completed();
 
-   if (outputs_tID.joinable())
-      outputs_tID.join();
-   
-   if (inputs_tID.joinable())
-      inputs_tID.join();
+   for (auto& thr : stageThreads)
+   {
+      if (thr.joinable())
+         thr.join();
+   }
 
-   if (commit_tID.joinable())
-      commit_tID.join();
+   blockDataLoader_.stopReadahead();
+
+   auto pruneHeight = 
+      (int32_t)topBlock->getBlockHeight() - BLOCK_UNDO_DEPTH + 1;
+   if (pruneHeight > 0)
+      db_->pruneBlockUndo(pruneHeight);
 
    topScannedBlockHash_ = topBlock->getThisHash();
 
    TIMER_STOP("scan_nocheck");
+   if (useBlockFilters_)
+   {
+      LOGINFO << "block filters skipped " << 
+         skippedBlockCount_.load(memory_order_relaxed) << " out of " <<
+         topBlock->getBlockHeight() - scanFrom + 1 << " blocks";
+   }
+
    if (topBlock->getBlockHeight() - scanFrom > 100)
    {
       auto timeSpent = TIMER_READ_SEC("scan_nocheck");
       LOGINFO << "scanned transaction history in " << timeSpent << "s";
+
+      for (unsigned i = 0; i < ScanStage_Count; i++)
+      {
+         auto stats = pipeline_->getStats((ScanStage)i);
+         LOGINFO << "  " << ScanPipeline::getStageName((ScanStage)i) <<
+            ": " << stats.wallNs_ / 1000000000.0 << "s over " <<
+            stats.batches_ << " batches, " <<
+            stats.workerNs_ / 1000000000.0 << "s of worker time";
+      }
    }
 
-   auto timeSpent = TIMER_READ_SEC("throttling");
-   if (timeSpent > 5)
-      LOGINFO << "throttling for " << timeSpent << "s";
+   pipeline_.reset();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void BlockchainScanner::processOutputs()
+void BlockchainScanner::runStage(ScanStage stage,
+   BatchQueue& inQueue, BatchQueue* outQueue,
+   const function<void(ParserBatch*)>& process)
 {
-   TIMER_RESET("throttling");
-   TIMER_RESET("preload");
-   TIMER_RESET("outputs");
-
-   auto process_thread = [this](ParserBatch* batch)->void
+   while (1)
    {
-      this->processOutputsThread(batch);
-   };
+      unique_ptr<ParserBatch> batch;
+      try
+      {
+         batch = move(inQueue.pop_front());
+      }
+      catch (StopBlockingLoop&)
+      {
+         //end condition
+         break;
+      }
 
-   map<unsigned, shared_ptr<BlockDataFileMap>> localFileMap;
+      auto start = chrono::steady_clock::now();
+      process(batch.get());
+      auto ns = chrono::duration_cast<chrono::nanoseconds>(
+         chrono::steady_clock::now() - start);
+      pipeline_->record(stage, ns.count());
 
-   auto preloadBlockDataFiles = [&](ParserBatch* batch)->void
+      if (outQueue == nullptr)
+      {
+         //last stage, the batch is done
+         logStages();
+         continue;
+      }
+
+      outQueue->push_back(move(batch));
+   }
+
+   //there won't be anymore batches for the next stage
+   if (outQueue != nullptr)
+      outQueue->completed();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::logStages()
+{
+   //only the commit stage calls this, no need to lock
+   auto now = chrono::steady_clock::now();
+   if (now - lastStageLog_ < chrono::seconds(SCAN_STAGE_LOG_INTERVAL))
+      return;
+   lastStageLog_ = now;
+
+   //per stage: threads from the pool and duration of the last batch
+   stringstream ss;
+   for (unsigned i = 0; i < ScanStage_Count; i++)
    {
-      if (batch == nullptr)
-         return;
+      auto stats = pipeline_->getStats((ScanStage)i);
+      ss << " " << ScanPipeline::getStageName((ScanStage)i) << ": " <<
+         stats.lastWorkers_ << "/" << pipeline_->getThreadCount() << 
+         " threads, " << stats.lastWallNs_ / 1000000 << "ms;";
+   }
+
+   LOGINFO << "scan stages:" << ss.str();
+}
 
-      TIMER_START("preload");
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::readBlockFiles()
+{
+   //file maps carry over from one batch to the next
+   map<unsigned, shared_ptr<BlockDataFileMap>> localFileMap;
 
+   auto readLambda = [&](ParserBatch* batch)->void
+   {
       auto file_id = batch->startBlockFileID_;
       while (file_id <= batch->targetBlockFileID_)
       {
@@ -266,101 +509,287 @@ void BlockchainScanner::processOutputs()
 
       localFileMap = batch->fileMaps_;
 
-      TIMER_STOP("preload");
+      //fault in the next files while this batch is parsed
+      blockDataLoader_.readahead(batch->targetBlockFileID_);
    };
 
-   //init batch
-   unique_ptr<ParserBatch> batch;
-   while (1)
+   runStage(ScanStage_Read, readQueue_, &parseQueue_, readLambda);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::parseBlocks()
+{
+   auto parseLambda = [this](ParserBatch* batch)->void
    {
-      try
+      batch->blockCounter_.store(batch->start_, memory_order_relaxed);
+      pipeline_->run(ScanStage_Parse, [this, batch](void)->void
       {
-         batch = move(outputQueue_.pop_front());
-         break;
-      }
-      catch (StopBlockingLoop&)
-      {}
-   }
+         parseBlocksThread(batch);
+      });
+   };
 
-   preloadBlockDataFiles(batch.get());
+   runStage(ScanStage_Parse, parseQueue_, &outputQueue_, parseLambda);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::parseBlocksThread(ParserBatch* batch)
+{
+   map<unsigned, shared_ptr<BlockData>> blockMap;
+   map<unsigned, GcsFilter> skippedBlocks;
+   map<BinaryData, BinaryData> blockFilters;
+
+   auto&& tx = db_->beginTransaction(BLKFILTERS, LMDB::ReadOnly);
 
    while (1)
    {
-      //start processing threads
-      vector<thread> thr_vec;
-      for (unsigned i = 0; i < totalThreadCount_; i++)
-         thr_vec.push_back(thread(process_thread, batch.get()));
+      auto currentBlock =
+         batch->blockCounter_.fetch_add(1, memory_order_relaxed);
 
-      unique_ptr<ParserBatch> nextBatch;
+      if (currentBlock > batch->end_)
+         break;
 
-      TIMER_START("throttling");
-      try
+      auto header = blockchain_->getHeaderByHeight(currentBlock, 0xFF);
+      auto&& hgtx = DBUtils::heightAndDupToHgtx(
+         currentBlock, header->getDuplicateID());
+      auto filterData = db_->getValueNoCopy(BLKFILTERS, hgtx.getRef());
+
+      if (useBlockFilters_ && filterData.getSize() > 0)
       {
-         nextBatch = move(outputQueue_.pop_front());
+         GcsFilter filter(header->getThisHash(), filterData);
+         if (!filter.matchAny(filterScrAddrRefs_))
+         {
+            skippedBlocks.insert(make_pair(currentBlock, move(filter)));
+            continue;
+         }
       }
-      catch (StopBlockingLoop&)
-      {}
-      TIMER_STOP("throttling");
 
-      TIMER_START("outputs");
-
-      //populate the next batch's file map while the first
-      //batch is being processed
-      preloadBlockDataFiles(nextBatch.get());
-
-      //wait on threads
-      for (auto& thr : thr_vec)
+      auto blockdata = getBlockData(batch, currentBlock);
+      if (!blockdata->isInitialized())
       {
-         if (thr.joinable())
-            thr.join();
+         LOGERR << "Could not get block data for height #" << currentBlock;
+         return;
       }
-      
-      //push first batch for input processing
-      inputQueue_.push_back(move(batch));
 
-      //exit loop condition
-      if (nextBatch == nullptr)
+      if (filterData.getSize() == 0)
+         blockFilters.insert(make_pair(hgtx, getBlockFilter(*blockdata)));
+
+      blockMap.insert(make_pair(currentBlock, blockdata));
+   }
+
+   unique_lock<mutex> lock(batch->mergeMutex_);
+   batch->blockMap_.insert(blockMap.begin(), blockMap.end());
+   batch->skippedBlocks_.insert(skippedBlocks.begin(), skippedBlocks.end());
+   batch->blockFilters_.insert(blockFilters.begin(), blockFilters.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::setupBlockUndo(int32_t scanFrom)
+{
+   /***
+   Undo records start at the height carried by the BLKUNDO sdbi metaInt_.
+   The first scan to run with undo records sets it to where it picks up.
+   The blocks before that have no record, undo reparses them instead.
+
+   A side scan can't start the records if the main filter holds history:
+   it has no view of the main addresses' txouts in the blocks it goes 
+   through.
+   ***/
+
+   auto topHeight = (int32_t)blockchain_->top()->getBlockHeight();
+   undoFloor_ = INT32_MAX;
+
+   auto&& tx = db_->beginTransaction(BLKUNDO, LMDB::ReadWrite);
+   auto&& sdbi = db_->getStoredDBInfo(BLKUNDO, 0);
+   if (sdbi.metaInt_ == UINT64_MAX)
+   {
+      if (scrAddrFilter_->isSideScan())
       {
-         TIMER_STOP("outputs");
-         break;
+         auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadOnly);
+         auto&& sdbiMain = db_->getStoredDBInfo(SUBSSH, 0);
+         if (sdbiMain.topScannedBlkHash_.getSize() != 0 &&
+            sdbiMain.topScannedBlkHash_ != BtcUtils::EmptyHash_)
+            return;
       }
+      else
+      {
+         //nothing to scan, the main filter is synced
+         if (scanFrom == INT32_MIN)
+            scanFrom = topHeight + 1;
 
-      //set batch for next iteration
-      batch = move(nextBatch);
+         //an empty address set has no history to miss
+         if (scrAddrFilter_->getScanFilterAddrMap()->size() == 0)
+            scanFrom = 0;
+      }
 
-      TIMER_STOP("outputs");
+      sdbi.metaInt_ = max(scanFrom, 0);
+      db_->putStoredDBInfo(BLKUNDO, sdbi, 0);
    }
 
-   //done with processing ouputs, there won't be anymore batches to push 
-   //to the input queue, we can mark it complete
-   inputQueue_.completed();
+   undoFloor_ = max(
+      topHeight - BLOCK_UNDO_DEPTH, (int32_t)sdbi.metaInt_ - 1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void BlockchainScanner::processInputs()
+void BlockchainScanner::getBlockUndo(ParserBatch* batch)
 {
-   TIMER_RESET("inputs");
+   if ((int32_t)batch->end_ <= undoFloor_)
+      return;
+
+   //a record for every block in range, blocks without tracked txouts
+   //get an empty one
+   auto start = max((int32_t)batch->start_, undoFloor_ + 1);
+   for (auto height = start; height <= (int32_t)batch->end_; height++)
+   {
+      auto header = blockchain_->getHeaderByHeight(height, 0xFF);
+      StoredBlockUndo sbu(height, header->getDuplicateID());
+      batch->blockUndo_.insert(make_pair(sbu.getDBKey(false), move(sbu)));
+   }
 
-   auto process_thread = [this](ParserBatch* batch)->void
+   auto getRecord = [batch](const BinaryData& key)->StoredBlockUndo*
    {
-      this->processInputsThread(batch);
+      auto iter = batch->blockUndo_.find(key.getSliceRef(0, 4));
+      if (iter == batch->blockUndo_.end())
+         return nullptr;
+
+      return &iter->second;
    };
 
-   while (1)
+   for (auto& utxomap : batch->outputMap_)
    {
-      unique_ptr<ParserBatch> batch;
-      try
+      for (auto& utxo : utxomap.second)
       {
-         batch = move(inputQueue_.pop_front());
+         auto&& txoutKey = utxo.second.getDBKey(false);
+         auto sbu = getRecord(txoutKey);
+         if (sbu == nullptr)
+            continue;
+
+         auto& delta = sbu->createdTxOuts_[txoutKey];
+         delta.scrAddr_ = utxo.second.getScrAddress();
+         delta.value_ = utxo.second.getValue();
       }
-      catch (StopBlockingLoop&)
+   }
+
+   for (auto& stxo : batch->spentOutputs_)
+   {
+      auto sbu = getRecord(stxo.spentByTxInKey_);
+      if (sbu == nullptr)
+         continue;
+
+      auto& delta = sbu->spentTxOuts_[stxo.getDBKey(false)];
+      delta.scrAddr_ = stxo.getScrAddress();
+      delta.value_ = stxo.getValue();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData BlockchainScanner::getBlockFilter(const BlockData& block)
+{
+   //txout scrAddrs and txin outpoints
+   vector<BinaryData> scrAddrs;
+   vector<BinaryDataRef> items;
+
+   auto& txns = block.getTxns();
+   for (auto& txn : txns)
+   {
+      for (auto& txout : txn->txouts_)
       {
-         //end condition
-         break;
+         BinaryRefReader brr(txn->data_ + txout.first, txout.second);
+         brr.advance(8);
+         unsigned scriptSize = (unsigned)brr.get_var_int();
+         auto&& scrRef = BtcUtils::getTxOutScrAddrNoCopy(
+            brr.get_BinaryDataRef(scriptSize));
+         scrAddrs.push_back(scrRef.getScrAddr());
       }
 
-      TIMER_START("inputs");
+      if (txn->isCoinbase_)
+         continue;
+
+      for (auto& txin : txn->txins_)
+         items.push_back(BinaryDataRef(txn->data_ + txin.first, 36));
+   }
+
+   for (auto& scrAddr : scrAddrs)
+      items.push_back(scrAddr.getRef());
+
+   return GcsFilter::build(block.header()->getThisHash(), items);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::setupBlockFilters(int32_t scanFrom)
+{
+   /***
+   Scans for a few addresses test the block filters first. Blocks that 
+   don't match our scrAddrs are left unparsed, the inputs stage parses them
+   later if they match the outpoints of our utxos at that point.
+
+   Filters are written by the scans that parse blocks without one. Only use
+   them if the range starts on a filtered block.
+   ***/
+
+   useBlockFilters_ = false;
+   filterInputs_ = false;
+   filterScrAddrs_.clear();
+   filterScrAddrRefs_.clear();
+   filterOutpoints_.clear();
+   skippedBlockCount_.store(0, memory_order_relaxed);
+
+   auto scrAddrMap = scrAddrFilter_->getScanFilterAddrMap();
+   if (scrAddrMap->size() > BLOCKFILTER_MAX_QUERY)
+      return;
+
+   try
+   {
+      auto header = blockchain_->getHeaderByHeight(scanFrom, 0xFF);
+      auto&& hgtx = DBUtils::heightAndDupToHgtx(
+         scanFrom, header->getDuplicateID());
+
+      auto&& tx = db_->beginTransaction(BLKFILTERS, LMDB::ReadOnly);
+      if (db_->getValueNoCopy(BLKFILTERS, hgtx.getRef()).getSize() == 0)
+         return;
+   }
+   catch (exception&)
+   {
+      return;
+   }
+
+   //filter items are scrAddrs, same as what getOutScrRefMap carries
+   for (auto& scrAddr : *scrAddrMap)
+   {
+      if (scrAddr.first.getSize() == 0)
+         continue;
+
+      TxOutScriptRef scrRef;
+      scrRef.setRef(scrAddr.first);
+      filterScrAddrs_.push_back(scrRef.getScrAddr());
+   }
+
+   for (auto& scrAddr : filterScrAddrs_)
+      filterScrAddrRefs_.push_back(scrAddr.getRef());
+
+   useBlockFilters_ = true;
+   filterInputs_ = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::processOutputs()
+{
+   auto outputsLambda = [this](ParserBatch* batch)->void
+   {
+      batch->blockCounter_.store(batch->start_, memory_order_relaxed);
+      pipeline_->run(ScanStage_Outputs, [this, batch](void)->void
+      {
+         processOutputsThread(batch);
+      });
+   };
+
+   runStage(ScanStage_Outputs, outputQueue_, &inputQueue_, outputsLambda);
+}
 
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::processInputs()
+{
+   auto inputsLambda = [this](ParserBatch* batch)->void
+   {
       //reset counter
       batch->blockCounter_.store(batch->start_, memory_order_relaxed);
 
@@ -368,63 +797,141 @@ void BlockchainScanner::processInputs()
       //this data needs copied because we still have use for the original map
       for (auto& hash_map : batch->outputMap_)
       {
-         auto hash_iter = utxoMap_.find(hash_map.first);
-         if (hash_iter == utxoMap_.end())
+         for (auto& id_pair : hash_map.second)
          {
-            utxoMap_.insert(hash_map);
-            continue;
+            utxoCache_.insert(id_pair.second, false);
+
+            if (filterInputs_)
+            {
+               BinaryWriter outpoint;
+               outpoint.put_BinaryData(hash_map.first);
+               outpoint.put_uint32_t(id_pair.first);
+               filterOutpoints_.insert(outpoint.getData());
+            }
          }
+      }
 
-         hash_iter->second.insert(
-            hash_map.second.begin(), hash_map.second.end());
+      //past the query limit, parse all skipped blocks from here on
+      if (filterOutpoints_.size() > BLOCKFILTER_MAX_QUERY)
+      {
+         filterInputs_ = false;
+         filterOutpoints_.clear();
       }
 
-      //start processing threads
-      vector<thread> thr_vec;
-      for (unsigned i = 1; i < totalThreadCount_; i++)
-         thr_vec.push_back(thread(process_thread, batch.get()));
-      process_thread(batch.get());
+      vector<BinaryDataRef> outpoints;
+      for (auto& outpoint : filterOutpoints_)
+         outpoints.push_back(outpoint.getRef());
 
-      //wait on threads
-      for (auto& thr : thr_vec)
+      pipeline_->run(ScanStage_Inputs, [this, batch, &outpoints](void)->void
       {
-         if (thr.joinable())
-            thr.join();
-      }
+         processInputsThread(batch, filterInputs_ ? &outpoints : nullptr);
+      });
 
       //purge spent outputs from global map
       for (auto& spent_txout : batch->spentOutputs_)
       {
-         auto hash_iter = utxoMap_.find(spent_txout.parentHash_);
-         if (hash_iter == utxoMap_.end())
-         {
+         if (!utxoCache_.erase(
+            spent_txout.parentHash_, spent_txout.txOutIndex_))
             LOGERR << "missing utxo";
-            continue;
-         }
 
-         auto utxo_iter = hash_iter->second.find(spent_txout.txOutIndex_);
-         if (utxo_iter == hash_iter->second.end())
+         if (filterInputs_)
          {
-            LOGERR << "missing utxo";
-            continue;
+            BinaryWriter outpoint;
+            outpoint.put_BinaryData(spent_txout.parentHash_);
+            outpoint.put_uint32_t(spent_txout.txOutIndex_);
+            filterOutpoints_.erase(outpoint.getData());
          }
-
-         hash_iter->second.erase(utxo_iter);
-         if (hash_iter->second.size() == 0)
-            utxoMap_.erase(hash_iter);
       }
 
-      //push for commit
-      commitQueue_.push_back(move(batch));
-
-      TIMER_STOP("inputs");
-   }
+      utxoCache_.enforceBudget(committedHeight_.load(memory_order_acquire));
+   };
 
-   //done with processing inputs, there won't be anymore batches to push 
-   //to the commit queue, we can mark it complete
-   commitQueue_.completed();
+   runStage(ScanStage_Inputs, inputQueue_, &serializeQueue_, inputsLambda);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner::serializeBatches()
+{
+   auto serializeLambda = [this](ParserBatch* batch)->void
+   {
+      //ssh entries are serialized in chunks, the extra work item is the
+      //txout pass
+      vector<const pair<const BinaryData,
+         map<BinaryData, StoredSubHistory>>*> sshEntries;
+      sshEntries.reserve(batch->sshMap_.size());
+      for (auto& ssh : batch->sshMap_)
+         sshEntries.push_back(&ssh);
+
+      size_t chunkCount = 
+         (sshEntries.size() + SERIALIZE_CHUNK_SIZE - 1) / SERIALIZE_CHUNK_SIZE;
+      atomic<size_t> counter;
+      counter.store(0, memory_order_relaxed);
+
+      auto serializeThread = [&](void)->void
+      {
+         map<BinaryData, BinaryWriter> serializedSubSSH;
+
+         while (1)
+         {
+            auto chunk = counter.fetch_add(1, memory_order_relaxed);
+            if (chunk > chunkCount)
+               break;
+
+            if (chunk == chunkCount)
+            {
+               for (auto& utxomap : batch->outputMap_)
+               {
+                  for (auto& utxo : utxomap.second)
+                  {
+                     auto& bw = batch->serializedStxo_[utxo.second.getDBKey()];
+                     utxo.second.serializeDBValue(bw);
+                  }
+               }
+
+               //spent txouts go last to overwrite utxos that were found
+               //and spent within the same batch
+               for (auto& stxo : batch->spentOutputs_)
+               {
+                  auto& bw = batch->serializedStxo_[stxo.getDBKey()];
+                  if (bw.getSize() > 0)
+                     bw.reset();
+                  stxo.serializeDBValue(bw);
+               }
+
+               getBlockUndo(batch);
+               continue;
+            }
+
+            auto last = min((chunk + 1) * SERIALIZE_CHUNK_SIZE, sshEntries.size());
+            for (auto i = chunk * SERIALIZE_CHUNK_SIZE; i < last; i++)
+            {
+               auto& ssh = *sshEntries[i];
+               for (auto& subssh : ssh.second)
+               {
+                  //TODO: modify subssh serialization to fit our needs
+
+                  BinaryWriter subsshkey;
+                  subsshkey.put_uint8_t(DB_PREFIX_SCRIPT);
+                  subsshkey.put_BinaryData(ssh.first);
+                  subsshkey.put_BinaryData(subssh.first);
+
+                  auto& bw = serializedSubSSH[subsshkey.getDataRef()];
+                  subssh.second.serializeDBValue(bw);
+               }
+            }
+         }
+
+         unique_lock<mutex> lock(batch->mergeMutex_);
+         for (auto& subssh : serializedSubSSH)
+            batch->serializedSubSsh_.insert(move(subssh));
+      };
+
+      pipeline_->run(ScanStage_Serialize, serializeThread);
+   };
+
+   runStage(ScanStage_Serialize, 
+      serializeQueue_, &commitQueue_, serializeLambda);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 shared_ptr<BlockData> BlockchainScanner::getBlockData(
@@ -467,7 +974,6 @@ shared_ptr<BlockData> BlockchainScanner::getBlockData(
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner::processOutputsThread(ParserBatch* batch)
 {
-   map<unsigned, shared_ptr<BlockData>> blockMap;
    map<BinaryData, map<unsigned, StoredTxOut>> outputMap;
    map<BinaryData, map<BinaryData, StoredSubHistory>> sshMap;
 
@@ -479,14 +985,12 @@ void BlockchainScanner::processOutputsThread(ParserBatch* batch)
       if (currentBlock > batch->end_)
          break;
 
-      auto blockdata = getBlockData(batch, currentBlock);
-      if (!blockdata->isInitialized())
-      {
-         LOGERR << "Could not get block data for height #" << currentBlock;
-         return;
-      }
+      //blocks that failed to parse are reported by the inputs stage
+      auto blockdata_iter = batch->blockMap_.find(currentBlock);
+      if (blockdata_iter == batch->blockMap_.end())
+         continue;
 
-      blockMap.insert(make_pair(currentBlock, blockdata));
+      auto& blockdata = blockdata_iter->second;
 
       //TODO: flag isMultisig
       const auto header = blockdata->header();
@@ -562,7 +1066,6 @@ void BlockchainScanner::processOutputsThread(ParserBatch* batch)
    //grab batch mutex and merge processed data in
    unique_lock<mutex> lock(batch->mergeMutex_);
 
-   batch->blockMap_.insert(blockMap.begin(), blockMap.end());
    batch->outputMap_.insert(outputMap.begin(), outputMap.end());
 
    for (auto& ssh_pair : sshMap)
@@ -580,7 +1083,8 @@ void BlockchainScanner::processOutputsThread(ParserBatch* batch)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void BlockchainScanner::processInputsThread(ParserBatch* batch)
+void BlockchainScanner::processInputsThread(ParserBatch* batch,
+   const vector<BinaryDataRef>* outpoints)
 {
    map<BinaryData, map<BinaryData, StoredSubHistory>> sshMap;
    vector<StoredTxOut> spentOutputs;
@@ -593,14 +1097,31 @@ void BlockchainScanner::processInputsThread(ParserBatch* batch)
       if (currentBlock > batch->end_)
          break;
 
+      shared_ptr<BlockData> blockdata;
       auto blockdata_iter = batch->blockMap_.find(currentBlock);
-      if (blockdata_iter == batch->blockMap_.end())
+      if (blockdata_iter != batch->blockMap_.end())
       {
-         LOGERR << "can't find block #" << currentBlock << " in batch";
-         throw runtime_error("missing block");
+         blockdata = blockdata_iter->second;
       }
+      else
+      {
+         auto skipped_iter = batch->skippedBlocks_.find(currentBlock);
+         if (skipped_iter == batch->skippedBlocks_.end())
+         {
+            LOGERR << "can't find block #" << currentBlock << " in batch";
+            throw runtime_error("missing block");
+         }
+
+         //none of our txouts in there, only parse it for our spends
+         if (outpoints != nullptr && 
+            !skipped_iter->second.matchAny(*outpoints))
+         {
+            skippedBlockCount_.fetch_add(1, memory_order_relaxed);
+            continue;
+         }
 
-      auto blockdata = blockdata_iter->second;
+         blockdata = getBlockData(batch, currentBlock);
+      }
 
       const auto header = blockdata->header();
       auto& txns = blockdata->getTxns();
@@ -615,16 +1136,21 @@ void BlockchainScanner::processInputsThread(ParserBatch* batch)
             BinaryDataRef outHash(
                txn.data_ + txin.first, 32);
 
-            auto utxoIter = utxoMap_.find(outHash);
-            if (utxoIter == utxoMap_.end())
-               continue;
-
             unsigned txOutId = READ_UINT32_LE(
                txn.data_ + txin.first + 32);
+            if (txOutId > UINT16_MAX)
+               continue;
+
+            StoredTxOut stxo;
+            auto result = utxoCache_.find(outHash, txOutId, stxo);
+            if (result == UtxoCache_Miss)
+               continue;
 
-            auto idIter = utxoIter->second.find(txOutId);
-            if (idIter == utxoIter->second.end())
+            if (result == UtxoCache_Evicted && !getEvictedUtxo(stxo))
+            {
+               LOGERR << "evicted utxo missing from db";
                continue;
+            }
 
             //if we got this far, this txins consumes one of our utxos
 
@@ -636,7 +1162,7 @@ void BlockchainScanner::processInputsThread(ParserBatch* batch)
                header->getBlockHeight(), header->getDuplicateID(),
                i, y);
 
-            StoredTxOut stxo = idIter->second;
+            stxo.parentHash_ = outHash;
             stxo.spentness_ = TXOUT_SPENT;
             stxo.spentByTxInKey_ = txinkey;
 
@@ -721,98 +1247,91 @@ void BlockchainScanner::writeBlockData()
       [&](ParserBatch* batch_ref)->void
    { processAndCommitTxHints(batch_ref); };
 
-   TIMER_RESET("write");
-
-   while (1)
+   auto commitLambda = [&](ParserBatch* batch)->void
    {
-      unique_ptr<ParserBatch> batch;
-      try
-      {
-         batch = move(commitQueue_.pop_front());
-      }
-      catch (StopBlockingLoop&)
-      { 
-         break;
-      }
-
-      TIMER_START("write");
-
       //start txhint writer thread
       thread writeHintsThreadId = 
-         thread(writeHintsLambda, batch.get());
+         thread(writeHintsLambda, batch);
 
       //sanity check
-      if (batch->blockMap_.size() == 0)
-         continue;
+      if (batch->blockMap_.size() == 0 && batch->skippedBlocks_.size() == 0)
+      {
+         writeHintsThreadId.join();
+         return;
+      }
 
-      //serialize data
-      auto topheader = batch->blockMap_.rbegin()->second->getHeaderPtr();
+      auto topheader = blockchain_->getHeaderByHeight(batch->end_, 0xFF);
       if (topheader == nullptr)
       {
          LOGERR << "empty top block header ptr, aborting scan";
          throw runtime_error("nullptr header");
       }
-      
-      map<BinaryData, BinaryWriter> serializedSubSSH;
-      map<BinaryData, BinaryWriter> serializedStxo;
 
+      //write data, the serialize stage prepared it
       {
-         for (auto& ssh : batch->sshMap_)
-         {
-            for (auto& subssh : ssh.second)
-            {
-               //TODO: modify subssh serialization to fit our needs
-
-               BinaryWriter subsshkey;
-               subsshkey.put_uint8_t(DB_PREFIX_SCRIPT);
-               subsshkey.put_BinaryData(ssh.first);
-               subsshkey.put_BinaryData(subssh.first);
+         //txouts
+         auto&& tx = db_->beginTransaction(STXO, LMDB::ReadWrite);
 
-               auto& bw = serializedSubSSH[subsshkey.getDataRef()];
-               subssh.second.serializeDBValue(bw);
-            }
+         for (auto& stxo : batch->serializedStxo_)
+         { 
+            //TODO: dont rewrite utxos, check if they are already in DB first
+            db_->putValue(STXO,
+               stxo.first.getRef(),
+               stxo.second.getDataRef());
          }
+      }
 
-         for (auto& utxomap : batch->outputMap_)
+      if (batch->blockUndo_.size() > 0)
+      {
+         auto&& tx = db_->beginTransaction(BLKUNDO, LMDB::ReadWrite);
+         for (auto& undo_pair : batch->blockUndo_)
          {
-            for (auto& utxo : utxomap.second)
+            //merge with the records of scans over other addresses
+            auto& sbu = undo_pair.second;
+            StoredBlockUndo dbSbu;
+            if (db_->getStoredBlockUndo(
+               dbSbu, sbu.blockHeight_, sbu.duplicateID_))
             {
-               auto& bw = serializedStxo[utxo.second.getDBKey()];
-               utxo.second.serializeDBValue(bw);
+               dbSbu.merge(sbu);
+               db_->putStoredBlockUndo(dbSbu);
+            }
+            else
+            {
+               db_->putStoredBlockUndo(sbu);
             }
          }
       }
 
-      //we've serialized utxos, now let's do another pass for spent txouts
-      //to make sure they overwrite utxos that were found and spent within
-      //the same batch
-      for (auto& stxo : batch->spentOutputs_)
+      if (batch->blockFilters_.size() > 0)
       {
-         auto& bw = serializedStxo[stxo.getDBKey()];
-         if (bw.getSize() > 0)
-            bw.reset();
-         stxo.serializeDBValue(bw);
+         auto&& tx = db_->beginTransaction(BLKFILTERS, LMDB::ReadWrite);
+         for (auto& filter : batch->blockFilters_)
+         {
+            db_->putValue(BLKFILTERS,
+               filter.first.getRef(), filter.second.getRef());
+         }
       }
 
-      //write data
-      {
-         //txouts
-         auto&& tx = db_->beginTransaction(STXO, LMDB::ReadWrite);
+      //utxos up to here can be dropped from the cache
+      committedHeight_.store(
+         topheader->getBlockHeight(), memory_order_release);
 
-         for (auto& stxo : serializedStxo)
-         { 
-            //TODO: dont rewrite utxos, check if they are already in DB first
-            db_->putValue(STXO,
-               stxo.first.getRef(),
-               stxo.second.getDataRef());
-         }
-      }
+      //the checkpoint goes in with the subssh entries, the rest of the 
+      //batch has to be in the db by then
+      if (writeHintsThreadId.joinable())
+         writeHintsThreadId.join();
+
+      //the envs are opened with MDB_NOSYNC, flush the batch before the 
+      //checkpoint can reach the disk so a power loss cannot leave it 
+      //ahead of the txouts and hints it vouches for
+      db_->syncDatabase(STXO);
+      db_->syncDatabase(TXHINTS);
 
       {
          //subssh
          auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadWrite);
 
-         for (auto& subssh : serializedSubSSH)
+         for (auto& subssh : batch->serializedSubSsh_)
          {
             db_->putValue(
                SUBSSH,
@@ -820,16 +1339,15 @@ void BlockchainScanner::writeBlockData()
                subssh.second.getDataRef());
          }
 
-         //update SUBSSH sdbi
+         //update SUBSSH sdbi, this is the scan checkpoint
          auto&& sdbi = scrAddrFilter_->getSubSshSDBI();
          sdbi.topBlkHgt_ = topheader->getBlockHeight();
          sdbi.topScannedBlkHash_ = topheader->getThisHash();
+         sdbi.metaHash_ = addrMerkle_;
          scrAddrFilter_->putSubSshSDBI(sdbi);
       }
 
-      //wait on writeHintsThreadId
-      if (writeHintsThreadId.joinable())
-         writeHintsThreadId.join();
+      db_->syncDatabase(SUBSSH);
 
       if (batch->start_ != batch->end_)
       {
@@ -852,9 +1370,9 @@ void BlockchainScanner::writeBlockData()
 
       completedBatches_.fetch_add(1, memory_order_relaxed);
       batch->completedPromise_.set_value(true);
+   };
 
-      TIMER_STOP("write");
-   }
+   runStage(ScanStage_Commit, commitQueue_, nullptr, commitLambda);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1081,16 +1599,17 @@ void BlockchainScanner::updateSSH(bool force, int32_t startHeight)
       for (auto& txid : txnsToResolve)
       {
          //grab tx
-         Tx tx;
+         shared_ptr<const Tx> txPtr;
          try
          {
-            tx = move(db_->getFullTxCopy(txid));
+            txPtr = db_->getFullTxPtr(txid);
          }
          catch (exception&)
          {
             LOGERR << "failed to grab tx by key";
             continue;
          }
+         auto& tx = *txPtr;
 
          //build list of all referred hashes in txins
          auto txinCount = tx.getNumTxIn();
@@ -1156,27 +1675,92 @@ void BlockchainScanner::updateSSH(bool force, int32_t startHeight)
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner::preloadUtxos()
 {
-   //TODO: check utxos pulled vs scraddrfilter (to reduce dataset for side scans)
+   //only pull utxos for the addresses we are scanning for, side scans
+   //don't need the rest
+   auto scrRefMap = scrAddrFilter_->getOutScrRefMap();
+
    auto&& tx = db_->beginTransaction(STXO, LMDB::ReadOnly);
    auto dbIter = db_->getIterator(STXO);
-   dbIter->seekToFirst();
+   if (!dbIter->seekToFirst())
+      return;
 
-   while (dbIter->advanceAndRead())
+   vector<LDBIterSpan> spans(LDBITER_BATCH_SIZE);
+   while (true)
    {
-      StoredTxOut stxo;
-      stxo.unserializeDBKey(dbIter->getKeyRef());
-      stxo.unserializeDBValue(dbIter->getValueRef());
+      auto count = dbIter->readBatch(
+         spans.data(), spans.size(), LDBITER_PREFETCH_BYTES);
+      if (count == 0)
+         break;
 
-      if (stxo.spentness_ == TXOUT_SPENT)
-         continue;
+      for (size_t i = 0; i < count; i++)
+      {
+         //skip the sdbi, txout keys are 8 or 9 bytes
+         auto& span = spans[i];
+         if (span.key_.getSize() != 8 && span.key_.getSize() != 9)
+            continue;
 
-      stxo.parentHash_ = move(db_->getTxHashForLdbKey(
-         stxo.getDBKeyOfParentTx(false)));
-      auto& idMap = utxoMap_[stxo.parentHash_];
-      idMap.insert(make_pair(stxo.txOutIndex_, move(stxo)));
+         StoredTxOut stxo;
+         stxo.unserializeDBKey(span.key_);
+         stxo.unserializeDBValue(span.value_);
+
+         //an interrupted scan can leave txouts past the checkpoint, the
+         //scan redoes these blocks so read the set as of startAt_
+         if (stxo.blockHeight_ >= startAt_)
+            continue;
+
+         if (stxo.spentness_ == TXOUT_SPENT)
+         {
+            if (stxo.spentByTxInKey_.getSize() != 8 ||
+               DBUtils::hgtxToHeight(
+                  stxo.spentByTxInKey_.getSliceCopy(0, 4)) < startAt_)
+               continue;
+
+            stxo.spentness_ = TXOUT_UNSPENT;
+            stxo.spentByTxInKey_.clear();
+         }
+
+         auto&& scrRef = BtcUtils::getTxOutScrAddrNoCopy(stxo.getScriptRef());
+         if (scrRefMap->find(scrRef) == scrRefMap->end())
+            continue;
+
+         stxo.parentHash_ = move(db_->getTxHashForLdbKey(
+            stxo.getDBKeyOfParentTx(false)));
+         if (stxo.parentHash_.getSize() != 32)
+         {
+            LOGWARN << "failed to resolve utxo parent hash";
+            continue;
+         }
+
+         if (filterInputs_ && 
+            filterOutpoints_.size() <= BLOCKFILTER_MAX_QUERY)
+         {
+            BinaryWriter outpoint;
+            outpoint.put_BinaryData(stxo.parentHash_);
+            outpoint.put_uint32_t(stxo.txOutIndex_);
+            filterOutpoints_.insert(outpoint.getData());
+         }
+
+         utxoCache_.insert(stxo, true);
+      }
+
+      //these are all in the db already
+      utxoCache_.enforceBudget(-1);
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool BlockchainScanner::getEvictedUtxo(StoredTxOut& stxo) const
+{
+   //evicted utxos were committed to STXO before leaving the cache
+   auto&& tx = db_->beginTransaction(STXO, LMDB::ReadOnly);
+   auto data = db_->getValueNoCopy(STXO, stxo.getDBKey());
+   if (data.getSize() == 0)
+      return false;
+
+   stxo.unserializeDBValue(data);
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner::undo(Blockchain::ReorganizationState& reorgState)
 {
@@ -1195,124 +1779,171 @@ void BlockchainScanner::undo(Blockchain::ReorganizationState& reorgState)
       throw runtime_error("invalid reorg state");
 
    auto scrAddrMap = scrAddrFilter_->getScanFilterAddrMap();
+   unsigned replayedCount = 0;
+
+   //revert a txout created (negative value) or spent by the block
+   auto undoTxio = [&](const BinaryData& scrAddr, int64_t value, 
+      int currentHeight)->bool
+   {
+      //update ssh value and txio count
+      auto& ssh = sshMap[scrAddr];
+      if (!ssh.isInitialized())
+         db_->getStoredScriptHistorySummary(ssh, scrAddr);
+
+      if (ssh.scanHeight_ < currentHeight)
+         return false;
+
+      ssh.totalUnspent_ += value;
+      ssh.totalTxioCount_--;
+
+      //decrement summary count at height, remove entry if necessary
+      auto& sum = ssh.subsshSummary_[currentHeight];
+      sum--;
+      if (sum <= 0)
+         ssh.subsshSummary_.erase(currentHeight);
+
+      return true;
+   };
+
+   auto getStxoKey = [](BinaryDataRef txoutKey)->BinaryData
+   {
+      BinaryWriter bw(9);
+      bw.put_uint8_t((uint8_t)DB_PREFIX_TXDATA);
+      bw.put_BinaryData(txoutKey);
+      return bw.getData();
+   };
 
    while (blockPtr != reorgState.reorgBranchPoint_)
    {
       int currentHeight = blockPtr->getBlockHeight();
       auto currentDupId  = blockPtr->getDuplicateID();
 
-      //create tx to pull subssh data
-      auto&& sshTx = db_->beginTransaction(SUBSSH, LMDB::ReadOnly);
-
       //grab blocks from previous top until branch point
       if (blockPtr == nullptr)
          throw runtime_error("reorg failed while tracing back to "
          "branch point");
 
-      auto filenum = blockPtr->getBlockFileNum();
-      auto fileIter = fileMaps_.find(filenum);
-      if (fileIter == fileMaps_.end())
+      //replay the undo record if the scan left one
+      StoredBlockUndo sbu;
+      bool hasUndo;
       {
-         fileIter = fileMaps_.insert(make_pair(
-            filenum, blockDataLoader_.get(filenum))).first;
+         auto&& undoTx = db_->beginTransaction(BLKUNDO, LMDB::ReadOnly);
+         hasUndo = db_->getStoredBlockUndo(sbu, currentHeight, currentDupId);
       }
 
-      auto filemap = fileIter->second;
-
-      auto getID = [blockPtr]
-         (const BinaryData&)->uint32_t {return blockPtr->getThisID(); };
+      if (hasUndo)
+      {
+         for (auto& delta : sbu.createdTxOuts_)
+         {
+            if (scrAddrMap->find(delta.second.scrAddr_) == scrAddrMap->end())
+               continue;
 
-      BlockData bdata;
-      bdata.deserialize(filemap.get()->getPtr() + blockPtr->getOffset(),
-         blockPtr->getBlockSize(), blockPtr, getID, false, false);
+            if (!undoTxio(delta.second.scrAddr_, 
+               -(int64_t)delta.second.value_, currentHeight))
+               continue;
 
-      auto& txns = bdata.getTxns();
-      for (unsigned i = 0; i < txns.size(); i++)
-      {
-         auto& txn = txns[i];
+            //mark stxo key for deletion
+            keysToDelete[STXO].insert(getStxoKey(delta.first));
+         }
 
-         //undo tx outs added by this block
-         for (unsigned y = 0; y < txn->txouts_.size(); y++)
+         for (auto& delta : sbu.spentTxOuts_)
          {
-            auto& txout = txn->txouts_[y];
-
-            BinaryRefReader brr(
-               txn->data_ + txout.first, txout.second);
-            brr.advance(8);
-            unsigned scriptSize = (unsigned)brr.get_var_int();
-            auto&& scrAddr = BtcUtils::getTxOutScrAddr(
-               brr.get_BinaryDataRef(scriptSize));
+            if (scrAddrMap->find(delta.second.scrAddr_) == scrAddrMap->end())
+               continue;
 
-            auto saIter = scrAddrMap->find(scrAddr);
-            if (saIter == scrAddrMap->end())
+            if (!undoTxio(delta.second.scrAddr_, 
+               delta.second.value_, currentHeight))
                continue;
 
-            //update ssh value and txio count
-            auto& ssh = sshMap[scrAddr];
-            if (!ssh.isInitialized())
-               db_->getStoredScriptHistorySummary(ssh, scrAddr);
+            //mark txout key for undoing spentness
+            undoSpentness.insert(delta.first);
+         }
 
-            if (ssh.scanHeight_ < currentHeight)
-               continue;
-            
-            brr.resetPosition();
-            uint64_t value = brr.get_uint64_t();
-            ssh.totalUnspent_ -= value;
-            ssh.totalTxioCount_--;
-            
-            //mark stxo key for deletion
-            auto&& txoutKey = DBUtils::getBlkDataKey(
-               currentHeight, currentDupId,
-               i, y);
-            keysToDelete[STXO].insert(txoutKey);
+         keysToDelete[BLKUNDO].insert(sbu.getDBKey());
+         ++replayedCount;
+      }
+      else
+      {
+         //create tx to pull subssh data
+         auto&& sshTx = db_->beginTransaction(SUBSSH, LMDB::ReadOnly);
 
-            //decrement summary count at height, remove entry if necessary
-            auto& sum = ssh.subsshSummary_[currentHeight];
-            sum--;
-            if (sum <= 0)
-               ssh.subsshSummary_.erase(currentHeight);
+         auto filenum = blockPtr->getBlockFileNum();
+         auto fileIter = fileMaps_.find(filenum);
+         if (fileIter == fileMaps_.end())
+         {
+            fileIter = fileMaps_.insert(make_pair(
+               filenum, blockDataLoader_.get(filenum))).first;
          }
 
-         //undo spends from this block
-         for (unsigned y = 0; y < txn->txins_.size(); y++)
+         auto filemap = fileIter->second;
+
+         auto getID = [blockPtr]
+            (const BinaryData&)->uint32_t {return blockPtr->getThisID(); };
+
+         BlockData bdata;
+         bdata.deserialize(filemap.get()->getPtr() + blockPtr->getOffset(),
+            blockPtr->getBlockSize(), blockPtr, getID, false, false);
+
+         auto& txns = bdata.getTxns();
+         for (unsigned i = 0; i < txns.size(); i++)
          {
-            auto& txin = txn->txins_[y];
+            auto& txn = txns[i];
 
-            BinaryDataRef outHash(
-               txn->data_ + txin.first, 32);
+            //undo tx outs added by this block
+            for (unsigned y = 0; y < txn->txouts_.size(); y++)
+            {
+               auto& txout = txn->txouts_[y];
 
-            auto&& txKey = db_->getDBKeyForHash(outHash, currentDupId);
-            if (txKey.getSize() != 6)
-               continue;
+               BinaryRefReader brr(
+                  txn->data_ + txout.first, txout.second);
+               brr.advance(8);
+               unsigned scriptSize = (unsigned)brr.get_var_int();
+               auto&& scrAddr = BtcUtils::getTxOutScrAddr(
+                  brr.get_BinaryDataRef(scriptSize));
 
-            uint16_t txOutId = (uint16_t)READ_UINT32_LE(
-               txn->data_ + txin.first + 32);
-            txKey.append(WRITE_UINT16_BE(txOutId));
+               auto saIter = scrAddrMap->find(scrAddr);
+               if (saIter == scrAddrMap->end())
+                  continue;
 
-            StoredTxOut stxo;
-            if (!db_->getStoredTxOut(stxo, txKey))
-               continue;
+               brr.resetPosition();
+               uint64_t value = brr.get_uint64_t();
+               if (!undoTxio(scrAddr, -(int64_t)value, currentHeight))
+                  continue;
 
-            //update ssh value and txio count
-            auto& scrAddr = stxo.getScrAddress();
-            auto& ssh = sshMap[scrAddr];
-            if (!ssh.isInitialized())
-               db_->getStoredScriptHistorySummary(ssh, scrAddr);
+               //mark stxo key for deletion
+               auto&& txoutKey = DBUtils::getBlkDataKey(
+                  currentHeight, currentDupId,
+                  i, y);
+               keysToDelete[STXO].insert(txoutKey);
+            }
 
-            if (ssh.scanHeight_ < currentHeight)
-               continue;
+            //undo spends from this block
+            for (unsigned y = 0; y < txn->txins_.size(); y++)
+            {
+               auto& txin = txn->txins_[y];
 
-            ssh.totalUnspent_ += stxo.getValue();
-            ssh.totalTxioCount_--;
+               BinaryDataRef outHash(
+                  txn->data_ + txin.first, 32);
 
-            //mark txout key for undoing spentness
-            undoSpentness.insert(txKey);
+               auto&& txKey = db_->getDBKeyForHash(outHash, currentDupId);
+               if (txKey.getSize() != 6)
+                  continue;
 
-            //decrement summary count at height, remove entry if necessary
-            auto& sum = ssh.subsshSummary_[currentHeight];
-            sum--;
-            if (sum <= 0)
-               ssh.subsshSummary_.erase(currentHeight);
+               uint16_t txOutId = (uint16_t)READ_UINT32_LE(
+                  txn->data_ + txin.first + 32);
+               txKey.append(WRITE_UINT16_BE(txOutId));
+
+               StoredTxOut stxo;
+               if (!db_->getStoredTxOut(stxo, txKey))
+                  continue;
+
+               if (!undoTxio(stxo.getScrAddress(), 
+                  stxo.getValue(), currentHeight))
+                  continue;
+
+               //mark txout key for undoing spentness
+               undoSpentness.insert(txKey);
+            }
          }
       }
 
@@ -1328,6 +1959,11 @@ void BlockchainScanner::undo(Blockchain::ReorganizationState& reorgState)
       }
    }
 
+   LOGINFO << "undid " << 
+      reorgState.prevTop_->getBlockHeight() - 
+      reorgState.reorgBranchPoint_->getBlockHeight() << " blocks, " <<
+      replayedCount << " from undo records";
+
    //at this point we have a map of updated ssh, as well as a 
    //set of keys to delete from the DB and spentness to undo by stxo key
 
@@ -1360,6 +1996,13 @@ void BlockchainScanner::undo(Blockchain::ReorganizationState& reorgState)
          db_->deleteValue(STXO, key);
    }
 
+   //undo records of the blocks off the main branch
+   {
+      auto&& tx = db_->beginTransaction(BLKUNDO, LMDB::ReadWrite);
+      for (auto& key : keysToDelete[BLKUNDO])
+         db_->deleteValue(BLKUNDO, key);
+   }
+
    int branchPointHeight = 
       reorgState.reorgBranchPoint_->getBlockHeight();
 
@@ -1434,11 +2077,27 @@ void BlockchainScanner::getFilterHitsThread(
          if (fileNum < 0)
             break;
 
+         //skip the pool scan for hashes the file prefilter rules out
+         vector<const BinaryData*> candidates;
+         auto&& prefilter = db_->getPrefilterRefForFileNum(fileNum);
+         for (auto& hash : hashSet)
+         {
+            if (prefilter.isValid() && hash.getSize() == 32 &&
+               !prefilter.contains(*(TxFilterType*)hash.getPtr()))
+               continue;
+
+            candidates.push_back(&hash);
+         }
+
+         if (candidates.size() == 0)
+            continue;
+
          try
          {
             auto&& pool = db_->getFilterPoolRefForFileNum<TxFilterType>(fileNum);
-            for (auto& hash : hashSet)
+            for (auto hashPtr : candidates)
             {
+               auto& hash = *hashPtr;
                auto&& blockKeys = pool.compare(hash);
                if (blockKeys.size() > 0)
                {
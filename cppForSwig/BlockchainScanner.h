@@ -18,6 +18,9 @@
 #include "ThreadSafeClasses.h"
 
 #include "SshParser.h"
+#include "UtxoCache.h"
+#include "ScanPipeline.h"
+#include "GcsFilter.h"
 
 #include <future>
 #include <atomic>
@@ -25,6 +28,15 @@
 
 #define BATCH_SIZE  1024 * 1024 * 512ULL
 
+//ssh entries per serialize work item
+#define SERIALIZE_CHUNK_SIZE 64
+
+//seconds between scan stage timing logs
+#define SCAN_STAGE_LOG_INTERVAL 60
+
+//past this many scrAddrs and utxos, scans don't bother with block filters
+#define BLOCKFILTER_MAX_QUERY 10000
+
 class ScanningException : public std::runtime_error
 {
 private:
@@ -56,6 +68,19 @@ public:
    std::map<BinaryData, std::map<BinaryData, StoredSubHistory>> sshMap_;
    std::vector<StoredTxOut> spentOutputs_;
 
+   std::map<BinaryData, BinaryWriter> serializedSubSsh_;
+   std::map<BinaryData, BinaryWriter> serializedStxo_;
+
+   //blocks whose filter ruled out our scripts, the inputs stage only
+   //parses them if they may spend one of our utxos
+   std::map<unsigned, GcsFilter> skippedBlocks_;
+
+   //filters for the blocks that didn't have one, by hgtx
+   std::map<BinaryData, BinaryData> blockFilters_;
+
+   //undo records for the blocks within BLOCK_UNDO_DEPTH of the top, by hgtx
+   std::map<BinaryData, StoredBlockUndo> blockUndo_;
+
    const std::shared_ptr<std::map<TxOutScriptRef, int>> scriptRefMap_;
    std::promise<bool> completedPromise_;
    unsigned count_;
@@ -109,24 +134,66 @@ private:
    bool reportProgress_ = false;
 
    //only for relevant utxos
-   std::map<BinaryData, std::map<unsigned, StoredTxOut>> utxoMap_;
+   UtxoCache utxoCache_;
+
+   //blk files faulted in ahead of the read stage
+   unsigned ioThreadCount_ = DEFAULT_IOTHREAD_COUNT;
+   unsigned readaheadFiles_ = DEFAULT_READAHEAD_FILES;
+
+   //top height written to STXO, evicted utxos have to be at or below it
+   std::atomic<int> committedHeight_;
 
    unsigned startAt_ = 0;
 
+   //address set the scan checkpoint is written for
+   BinaryData addrMerkle_;
+   bool verifyCheckpoint_ = false;
+
+   //block filter queries, only for scans with few enough items
+   bool useBlockFilters_ = false;
+   bool filterInputs_ = false;
+   std::vector<BinaryData> filterScrAddrs_;
+   std::vector<BinaryDataRef> filterScrAddrRefs_;
+   std::set<BinaryData> filterOutpoints_;
+   std::atomic<unsigned> skippedBlockCount_;
+
+   //blocks above this height get undo records
+   int32_t undoFloor_ = -1;
+
    std::mutex resolverMutex_;
 
-   ArmoryThreading::BlockingQueue<std::unique_ptr<ParserBatch>> outputQueue_;
-   ArmoryThreading::BlockingQueue<std::unique_ptr<ParserBatch>> inputQueue_;
-   ArmoryThreading::BlockingQueue<std::unique_ptr<ParserBatch>> commitQueue_;
+   //read -> parse -> outputs -> inputs -> serialize -> commit
+   typedef ArmoryThreading::BoundedQueue<std::unique_ptr<ParserBatch>>
+      BatchQueue;
+   BatchQueue readQueue_;
+   BatchQueue parseQueue_;
+   BatchQueue outputQueue_;
+   BatchQueue inputQueue_;
+   BatchQueue serializeQueue_;
+   BatchQueue commitQueue_;
+
+   std::unique_ptr<ScanPipeline> pipeline_;
 
    std::atomic<unsigned> completedBatches_;
+   std::chrono::steady_clock::time_point lastStageLog_;
 
 private:
+   void runStage(ScanStage, BatchQueue&, BatchQueue*,
+      const std::function<void(ParserBatch*)>&);
+   void logStages(void);
+
+   void readBlockFiles(void);
+   void parseBlocks(void);
+   void parseBlocksThread(ParserBatch*);
+   void serializeBatches(void);
    void writeBlockData(void);
    void processAndCommitTxHints(ParserBatch*);
    void preloadUtxos(void);
+   bool getEvictedUtxo(StoredTxOut&) const;
 
    int32_t check_merkle(int32_t startHeight);
+   int32_t getCheckpointHeight(void) const;
+   void verifyCheckpoint(int32_t startHeight);
 
    void getFilterHitsThread(
       const std::set<BinaryData>& hashSet,
@@ -147,7 +214,13 @@ private:
    void processOutputsThread(ParserBatch*);
 
    void processInputs(void);
-   void processInputsThread(ParserBatch*);
+   void processInputsThread(ParserBatch*,
+      const std::vector<BinaryDataRef>* outpoints);
+
+   void setupBlockFilters(int32_t startHeight);
+   static BinaryData getBlockFilter(const BlockData&);
+   void setupBlockUndo(int32_t);
+   void getBlockUndo(ParserBatch*);
 
 
 public:
@@ -160,8 +233,24 @@ public:
       blockDataLoader_(bf.folderPath()),
       totalThreadCount_(threadcount), writeQueueDepth_(queue_depth),
       totalBlockFileCount_(bf.fileCount()),
-      progress_(prg), reportProgress_(reportProgress)
-   {}
+      progress_(prg), reportProgress_(reportProgress),
+      utxoCache_(DEFAULT_UTXOCACHE_SIZE * 1024 * 1024ULL),
+      readQueue_(SCAN_STAGE_QUEUE_DEPTH), parseQueue_(SCAN_STAGE_QUEUE_DEPTH),
+      outputQueue_(SCAN_STAGE_QUEUE_DEPTH), inputQueue_(SCAN_STAGE_QUEUE_DEPTH),
+      serializeQueue_(SCAN_STAGE_QUEUE_DEPTH),
+      commitQueue_(SCAN_STAGE_QUEUE_DEPTH)
+   {
+      committedHeight_.store(-1, std::memory_order_relaxed);
+      skippedBlockCount_.store(0, std::memory_order_relaxed);
+   }
+
+   void setUtxoCacheSize(size_t size) { utxoCache_.setBudget(size); }
+   void setReadahead(unsigned ioThreads, unsigned fileCount)
+   {
+      ioThreadCount_ = ioThreads;
+      readaheadFiles_ = fileCount;
+   }
+   void setVerifyCheckpoint(bool val) { verifyCheckpoint_ = val; }
 
    void scan(int32_t startHeight);
    void scan_nocheck(int32_t startHeight);
@@ -615,7 +615,7 @@ void BlockchainScanner_Super::processInputsThread(
             auto&& txoutkey = stxo.getDBKey();
             txio.setTxOut(txoutkey);
             txio.setTxIn(txinkey);
-            txio.setValue(*stxo.valuePtr_);
+            txio.setValue(stxo.value_);
             subssh.txioMap_[txoutkey] = move(txio);
 
             spent_offset = min(spent_offset, stxo.height_);
@@ -693,7 +693,23 @@ void BlockchainScanner_Super::serializeSubSshThread(ParserBatch_Ssh* batch)
 ////////////////////////////////////////////////////////////////////////////////
 void BlockchainScanner_Super::writeSubSsh(ParserBatch_Ssh* batch)
 {
+   //all entries of a batch land in the shard of its batch id
    batch->writeSshStart_ = chrono::system_clock::now();
+   auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadWrite);
+
+   for (auto& ssh_pair : batch->serializedSubSsh_)
+   {
+      db_->putValue(SUBSSH,
+         ssh_pair.second.first.getDataRef(),
+         ssh_pair.second.second.getDataRef());
+   }
+
+   batch->writeSshEnd_ = chrono::system_clock::now();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner_Super::writeSubSshMeta(ParserBatch_Ssh* batch)
+{
    auto ctr = batch->batch_id_;
    auto&& tx = db_->beginTransaction(SUBSSH, LMDB::ReadWrite);
    auto&& meta_tx = db_->beginTransaction(SUBSSH_META, LMDB::ReadWrite);
@@ -712,13 +728,6 @@ void BlockchainScanner_Super::writeSubSsh(ParserBatch_Ssh* batch)
          meta_key.getDataRef(), meta_data.getDataRef());
    }
 
-   for (auto& ssh_pair : batch->serializedSubSsh_)
-   {
-      db_->putValue(SUBSSH,
-         ssh_pair.second.first.getDataRef(),
-         ssh_pair.second.second.getDataRef());
-   }
-
    //sdbi
    auto topheader = batch->bdb_->blockMap_.rbegin()->second->getHeaderPtr();
    auto&& subssh_sdbi = db_->getStoredDBInfo(SUBSSH, 0);
@@ -753,36 +762,40 @@ void BlockchainScanner_Super::commitSshBatch()
       calc.fractionCompleted(), UINT32_MAX,
       initVal);
 
-   while (1)
+   /*
+   SUBSSH shards are separate envs: a batch's subssh entries are written 
+   from their own thread, so that batches landing in different shards 
+   commit concurrently. Batches are finalized (meta, sdbi, promise) in 
+   order, once their write has completed.
+   */
+   struct PendingWrite
    {
-      unique_ptr<ParserBatch_Ssh> batch;
-      try
-      {
-         batch = move(commitQueue_.pop_front());
-      }
-      catch (StopBlockingLoop&)
+      unique_ptr<ParserBatch_Ssh> batch_;
+      unsigned shardId_;
+      thread thr_;
+      exception_ptr error_;
+      chrono::system_clock::time_point gotBatch_;
+
+      ~PendingWrite(void)
       {
-         break;
+         if (thr_.joinable())
+            thr_.join();
       }
+   };
+   deque<unique_ptr<PendingWrite>> pendingWrites;
 
-      //sanity check
-      if (batch->bdb_->blockMap_.size() == 0)
-         continue;
+   auto finalizeBatch = [&](void)->void
+   {
+      auto pending = move(pendingWrites.front());
+      pendingWrites.pop_front();
 
-      auto got_batch = chrono::system_clock::now();
+      if (pending->thr_.joinable())
+         pending->thr_.join();
+      if (pending->error_ != nullptr)
+         rethrow_exception(pending->error_);
 
-      auto topheader = batch->bdb_->blockMap_.rbegin()->second->getHeaderPtr();
-      if (topheader == nullptr)
-      {
-         LOGERR << "empty top block header ptr, aborting scan";
-         throw runtime_error("nullptr header");
-      }
-
-      {
-         //subssh
-         writeSubSsh(batch.get());
-         batch->writeSshEnd_ = chrono::system_clock::now();
-      }
+      auto& batch = pending->batch_;
+      writeSubSshMeta(batch.get());
 
       if (batch->bdb_->start_ != batch->bdb_->end_)
       {
@@ -814,7 +827,7 @@ void BlockchainScanner_Super::commitSshBatch()
             batch->writeSshEnd_ - batch->writeSshStart_;
          LOGINFO << "   put subssh in " << total.count() << "s";
 
-         total = got_batch - batch->insertToCommitQueue_;
+         total = pending->gotBatch_ - batch->insertToCommitQueue_;
          LOGINFO << "   waited on batch for " << total.count() << "s";
       }
 
@@ -825,10 +838,82 @@ void BlockchainScanner_Super::commitSshBatch()
          calc.fractionCompleted(), calc.remainingSeconds(),
          progVal);
 
+      auto topheader = 
+         batch->bdb_->blockMap_.rbegin()->second->getHeaderPtr();
       topScannedBlockHash_ = topheader->getThisHash();
       completedBatches_.fetch_add(1, memory_order_relaxed);
       batch->completedPromise_.set_value(true);
+   };
+
+   auto hasPendingWrite = [&pendingWrites](unsigned shardId)->bool
+   {
+      for (auto& pending : pendingWrites)
+      {
+         if (pending->shardId_ == shardId)
+            return true;
+      }
+
+      return false;
+   };
+
+   while (1)
+   {
+      unique_ptr<ParserBatch_Ssh> batch;
+      try
+      {
+         batch = move(commitQueue_.pop_front());
+      }
+      catch (StopBlockingLoop&)
+      {
+         break;
+      }
+
+      //sanity check
+      if (batch->bdb_->blockMap_.size() == 0)
+         continue;
+
+      auto got_batch = chrono::system_clock::now();
+
+      auto topheader = batch->bdb_->blockMap_.rbegin()->second->getHeaderPtr();
+      if (topheader == nullptr)
+      {
+         LOGERR << "empty top block header ptr, aborting scan";
+         throw runtime_error("nullptr header");
+      }
+
+      //one writer per shard, wait on earlier batches to the same shard
+      auto&& idKey = WRITE_UINT32_BE(batch->batch_id_);
+      auto shardId = db_->getShardIdForKey(SUBSSH, idKey.getRef());
+      while (pendingWrites.size() > 0 && (hasPendingWrite(shardId) ||
+         pendingWrites.size() >= totalThreadCount_))
+      {
+         finalizeBatch();
+      }
+
+      auto pending = make_unique<PendingWrite>();
+      pending->shardId_ = shardId;
+      pending->gotBatch_ = got_batch;
+      pending->batch_ = move(batch);
+
+      auto pendingPtr = pending.get();
+      auto write_lbd = [this, pendingPtr](void)->void
+      {
+         try
+         {
+            writeSubSsh(pendingPtr->batch_.get());
+         }
+         catch (...)
+         {
+            pendingPtr->error_ = current_exception();
+         }
+      };
+
+      pending->thr_ = thread(write_lbd);
+      pendingWrites.push_back(move(pending));
    }
+
+   while (pendingWrites.size() > 0)
+      finalizeBatch();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -872,6 +957,7 @@ void BlockchainScanner_Super::scanSpentness()
       end = sdbi.metaInt_ + 1;
 
    int start = blockchain_->top()->getBlockHeight();
+   undoFloor_ = start - BLOCK_UNDO_DEPTH;
 
    //run from current top to last commited
    while (start >= end)
@@ -939,6 +1025,9 @@ void BlockchainScanner_Super::scanSpentness()
       db_->putStoredDBInfo(SPENTNESS, sdbi, UINT32_MAX);
    }
 
+   if (undoFloor_ >= 0)
+      db_->pruneBlockUndo(undoFloor_ + 1);
+
    TIMER_STOP("spentness");
    auto timeSpent = TIMER_READ_SEC("spentness");
    LOGINFO << "parsed spentness in " << timeSpent << "s";
@@ -976,6 +1065,7 @@ void BlockchainScanner_Super::parseSpentnessThread(ParserBatch_Spentness* batch)
 {
    map<BinaryData, BinaryData> keysToCommit;
    map<BinaryData, BinaryData> keysToCommitLater;
+   vector<StoredBlockUndo> blockUndo;
 
    auto hint_tx = db_->beginTransaction(TXHINTS, LMDB::ReadOnly);
    auto stxo_tx = db_->beginTransaction(STXO, LMDB::ReadOnly);
@@ -990,6 +1080,13 @@ void BlockchainScanner_Super::parseSpentnessThread(ParserBatch_Spentness* batch)
       auto dup = block->getHeaderPtr()->getDuplicateID();
       auto&& hgtx = DBUtils::getBlkDataKeyNoPrefix(height, dup);
 
+      StoredBlockUndo* sbu = nullptr;
+      if ((int)height > undoFloor_)
+      {
+         blockUndo.push_back(StoredBlockUndo(height, dup));
+         sbu = &blockUndo.back();
+      }
+
       BinaryWriter bw(8);
       bw.put_BinaryData(hgtx);
       bw.put_uint32_t(0);
@@ -1060,6 +1157,9 @@ void BlockchainScanner_Super::parseSpentnessThread(ParserBatch_Spentness* batch)
                converted_height, height_iter->second.dup_,
                txid, txOutId);
 
+            if (sbu != nullptr)
+               sbu->spentTxOuts_[txoutkey];
+
             auto spentness_pair = make_pair(move(txoutkey), bw.getData());
 
             //figure out which bucket this key goes in
@@ -1084,26 +1184,69 @@ void BlockchainScanner_Super::parseSpentnessThread(ParserBatch_Spentness* batch)
    batch->keysToCommit_.insert(keysToCommit.begin(), keysToCommit.end());
    batch->keysToCommitLater_.insert(
       keysToCommitLater.begin(), keysToCommitLater.end());
+   batch->blockUndo_.insert(batch->blockUndo_.end(),
+      blockUndo.begin(), blockUndo.end());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void BlockchainScanner_Super::writeSpentness()
+void BlockchainScanner_Super::commitSpentness(
+   const vector<pair<SpentnessIter, SpentnessIter>>& ranges)
 {
-   map<BinaryData, BinaryData> spentnessLeftOver;
+   //spentness shards are separate envs, group the keys per shard and
+   //commit the groups concurrently
+   map<unsigned, vector<SpentnessIter>> shardMap;
+   for (auto& range : ranges)
+   {
+      for (auto iter = range.first; iter != range.second; ++iter)
+      {
+         auto shardId = db_->getShardIdForKey(SPENTNESS, iter->first);
+         shardMap[shardId].push_back(iter);
+      }
+   }
+
+   if (shardMap.size() == 0)
+      return;
+
+   vector<vector<SpentnessIter>*> shardVec;
+   for (auto& shardPair : shardMap)
+      shardVec.push_back(&shardPair.second);
+
+   atomic<unsigned> shardCounter;
+   shardCounter.store(0, memory_order_relaxed);
 
    auto dbPtr = db_;
-   auto commit = [dbPtr](
-      map<BinaryData, BinaryData>::iterator begin, 
-      map<BinaryData, BinaryData>::iterator end)
+   auto commit_lbd = [dbPtr, &shardVec, &shardCounter](void)->void
    {
-      while (begin != end)
+      while (true)
       {
-         dbPtr->putValue(SPENTNESS, 
-            begin->first, begin->second);
-         ++begin;
+         auto id = shardCounter.fetch_add(1, memory_order_relaxed);
+         if (id >= shardVec.size())
+            break;
+
+         auto dbtx = dbPtr->beginTransaction(SPENTNESS, LMDB::ReadWrite);
+         for (auto& iter : *shardVec[id])
+            dbPtr->putValue(SPENTNESS, iter->first, iter->second);
       }
    };
 
+   auto threadCount = min(totalThreadCount_, (unsigned)shardVec.size());
+   vector<thread> threads;
+   for (unsigned i = 1; i < threadCount; i++)
+      threads.push_back(thread(commit_lbd));
+   commit_lbd();
+
+   for (auto& thr : threads)
+   {
+      if (thr.joinable())
+         thr.join();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockchainScanner_Super::writeSpentness()
+{
+   map<BinaryData, BinaryData> spentnessLeftOver;
+
    while (true)
    {
       unique_ptr<ParserBatch_Spentness> batch;
@@ -1120,29 +1263,36 @@ void BlockchainScanner_Super::writeSpentness()
       auto&& bw_cutoff = DBUtils::getBlkDataKeyNoPrefix(
          UINT32_MAX - batch->bdb_->end_, 0, 0, 0);
 
-      auto dbtx = db_->beginTransaction(SPENTNESS, LMDB::ReadWrite);
-      commit(batch->keysToCommit_.begin(), batch->keysToCommit_.end());
+      vector<pair<SpentnessIter, SpentnessIter>> ranges;
+      ranges.push_back(make_pair(
+         batch->keysToCommit_.cbegin(), batch->keysToCommit_.cend()));
 
-      //tally leftover size, commit if it breaches threshold
+      //tally leftover size, commit if it breaches threshold, otherwise
+      //check leftovers for eligible spentness to commit
+      SpentnessIter eligible_spentness;
       if (spentnessLeftOver.size() > LEFTOVER_THRESHOLD)
-      {
-         commit(spentnessLeftOver.begin(), spentnessLeftOver.end());
-         spentnessLeftOver.clear();
-      }
+         eligible_spentness = spentnessLeftOver.cend();
+      else
+         eligible_spentness = spentnessLeftOver.lower_bound(bw_cutoff);
 
-      //check leftovers for eligible spentness to commit
-      auto eligible_spentness = spentnessLeftOver.lower_bound(bw_cutoff);
-      if (eligible_spentness != spentnessLeftOver.begin())
-      {
-         //grab valid range, remove from leftovers
-         commit(spentnessLeftOver.begin(), eligible_spentness);
-         spentnessLeftOver.erase(spentnessLeftOver.begin(), eligible_spentness);
-      }
+      ranges.push_back(make_pair(
+         spentnessLeftOver.cbegin(), eligible_spentness));
+      commitSpentness(ranges);
+
+      //remove commited range from leftovers
+      spentnessLeftOver.erase(spentnessLeftOver.cbegin(), eligible_spentness);
 
       //merge in new leftovers from current batch
       for (auto& keyVal : batch->keysToCommitLater_)
          spentnessLeftOver.emplace(keyVal);
 
+      if (batch->blockUndo_.size() > 0)
+      {
+         auto&& tx = db_->beginTransaction(BLKUNDO, LMDB::ReadWrite);
+         for (auto& sbu : batch->blockUndo_)
+            db_->putStoredBlockUndo(sbu);
+      }
+
       batch->prom_.set_value(true);
       completedBatches_.fetch_add(1, memory_order_relaxed);
 
@@ -1153,8 +1303,10 @@ void BlockchainScanner_Super::writeSpentness()
    //commit leftovers
    if (spentnessLeftOver.size())
    {
-      auto dbtx = db_->beginTransaction(SPENTNESS, LMDB::ReadWrite);
-      commit(spentnessLeftOver.begin(), spentnessLeftOver.end());
+      vector<pair<SpentnessIter, SpentnessIter>> ranges;
+      ranges.push_back(make_pair(
+         spentnessLeftOver.cbegin(), spentnessLeftOver.cend()));
+      commitSpentness(ranges);
    }
 }
 
@@ -1241,16 +1393,36 @@ void BlockchainScanner_Super::undo(Blockchain::ReorganizationState& reorgState)
 
    set<unsigned> undoneHeights;
 
+   set<BinaryData> undoKeys;
+
    while (blockPtr != reorgState.reorgBranchPoint_)
    {
-      int currentHeight = blockPtr->getBlockHeight();
-      auto&& hintsTx = db_->beginTransaction(TXHINTS, LMDB::ReadOnly);
-
       //grab blocks from previous top until branch point
       if (blockPtr == nullptr)
          throw runtime_error("reorg failed while tracing back to "
             "branch point");
 
+      int currentHeight = blockPtr->getBlockHeight();
+      undoneHeights.insert(currentHeight);
+
+      //the undo record carries the spentness keys, no need for the block
+      {
+         StoredBlockUndo sbu;
+         auto&& undoTx = db_->beginTransaction(BLKUNDO, LMDB::ReadOnly);
+         if (db_->getStoredBlockUndo(
+            sbu, currentHeight, blockPtr->getDuplicateID()))
+         {
+            for (auto& spent : sbu.spentTxOuts_)
+               undoSpentness.insert(spent.first);
+
+            undoKeys.insert(sbu.getDBKey());
+            blockPtr = blockchain_->getHeaderByHash(blockPtr->getPrevHashRef());
+            continue;
+         }
+      }
+
+      auto&& hintsTx = db_->beginTransaction(TXHINTS, LMDB::ReadOnly);
+
       auto filenum = blockPtr->getBlockFileNum();
       auto fileIter = fileMaps_.find(filenum);
       if (fileIter == fileMaps_.end())
@@ -1300,7 +1472,6 @@ void BlockchainScanner_Super::undo(Blockchain::ReorganizationState& reorgState)
       }
 
       //set blockPtr to prev block
-      undoneHeights.insert(currentHeight);
       blockPtr = blockchain_->getHeaderByHash(blockPtr->getPrevHashRef());
    }
 
@@ -1318,6 +1489,13 @@ void BlockchainScanner_Super::undo(Blockchain::ReorganizationState& reorgState)
       db_->putStoredDBInfo(SPENTNESS, sdbi, UINT32_MAX);
    }
 
+   {
+      //undo records of the blocks off the main branch
+      auto&& undo_tx = db_->beginTransaction(BLKUNDO, LMDB::ReadWrite);
+      for (auto& key : undoKeys)
+         db_->deleteValue(BLKUNDO, key);
+   }
+
    {
       //update SSH sdbi      
       auto&& tx = db_->beginTransaction(SSH, LMDB::ReadWrite);
@@ -1327,6 +1505,8 @@ void BlockchainScanner_Super::undo(Blockchain::ReorganizationState& reorgState)
       db_->putStoredDBInfo(SSH, sdbi, 0);
    }
 
+   //undo records carry spentness only, summaries are reparsed from the
+   //SUBSSH shards of the undone heights rather than replayed
    ShardedSshParser sshParser(db_, *undoneHeights.begin(), 
       totalThreadCount_, false);
    sshParser.undo();
@@ -1339,10 +1519,19 @@ void BlockchainScanner_Super::undo(Blockchain::ReorganizationState& reorgState)
 ////////////////////////////////////////////////////////////////////////////////
 void StxoRef::unserializeDBValue(const BinaryDataRef& bdr)
 {
-   auto ptr = bdr.getPtr() + 2;
-   valuePtr_ = (uint64_t*)ptr;
-   
-   BinaryRefReader brr(ptr + 8, bdr.getSize() - 8);
+   //version nibble leads the 2 bytes bitpack
+   auto ptr = bdr.getPtr();
+   compressed_ = (ptr[0] >> 4) == STXO_VALUE_COMPRESSED;
+
+   BinaryRefReader brr(ptr + 2, bdr.getSize() - 2);
+   if (compressed_)
+   {
+      //leave the script template as is, scrAddr is pulled from it directly
+      value_ = ScriptCompression::readTxOut(brr, scriptRef_);
+      return;
+   }
+
+   value_ = brr.get_uint64_t();
    auto len = brr.get_var_int();
    scriptRef_ = brr.get_BinaryDataRef(len);
 }
@@ -1350,6 +1539,9 @@ void StxoRef::unserializeDBValue(const BinaryDataRef& bdr)
 ////////////////////////////////////////////////////////////////////////////////
 BinaryData StxoRef::getScrAddressCopy() const
 {
+   if (compressed_)
+      return ScriptCompression::getScrAddr(scriptRef_);
+
    auto&& ref = BtcUtils::getTxOutScrAddrNoCopy(scriptRef_);
    return ref.getScrAddr();
 }
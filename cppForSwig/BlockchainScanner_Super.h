@@ -123,6 +123,9 @@ struct ParserBatch_Spentness
 
    std::map<BinaryData, BinaryData> keysToCommit_;
    std::map<BinaryData, BinaryData> keysToCommitLater_;
+
+   //spentness keys of the blocks within BLOCK_UNDO_DEPTH of the top
+   std::vector<StoredBlockUndo> blockUndo_;
    std::mutex mergeMutex_;
 
    std::promise<bool> prom_;
@@ -135,11 +138,13 @@ struct ParserBatch_Spentness
 ////////////////////////////////////////////////////////////////////////////////
 struct StxoRef
 {
-   uint64_t* valuePtr_;
+   uint64_t value_;
    uint16_t* indexPtr_;
 
+   //raw script, or the script template for compressed values
    BinaryDataRef scriptRef_;
    BinaryDataRef hashRef_;
+   bool compressed_ = false;
 
    unsigned height_;
    uint8_t dup_;
@@ -181,6 +186,7 @@ private:
    const unsigned writeQueueDepth_;
    const unsigned totalBlockFileCount_;
    std::map<unsigned, HeightAndDup> heightAndDupMap_;
+   int undoFloor_ = -1;
 
    BinaryData topScannedBlockHash_;
 
@@ -193,9 +199,12 @@ private:
    
    std::map<unsigned, unsigned> heightToId_;
 
+   typedef std::map<BinaryData, BinaryData>::const_iterator SpentnessIter;
+
 private:  
    void commitSshBatch(void);
    void writeSubSsh(ParserBatch_Ssh*);
+   void writeSubSshMeta(ParserBatch_Ssh*);
 
    void processOutputs(ParserBatch_Ssh*);
    void processOutputsThread(ParserBatch_Ssh*, unsigned);
@@ -207,6 +216,8 @@ private:
    void serializeSubSshThread(ParserBatch_Ssh*);
 
    void writeSpentness(void);
+   void commitSpentness(
+      const std::vector<std::pair<SpentnessIter, SpentnessIter>>&);
 
    bool getTxKeyForHash(const BinaryDataRef&, BinaryData&);
    StxoRef getStxoByHash(
@@ -33,6 +33,7 @@
 #include "log.h"
 #include "NetworkConfig.h"
 #include "EncryptionUtils.h"
+#include "Sha256Multi.h"
 
 #include "btc/base58.h"
 
@@ -537,6 +538,24 @@ public:
       return hashOutput;
    }
 
+   /////////////////////////////////////////////////////////////////////////////
+   // Hashes all messages in one pass over the SIMD lanes, prefer this to
+   // getHash256 in loops
+   static std::vector<BinaryData> getHash256Many(
+      const std::vector<BinaryDataRef>& msgs)
+   {
+      std::vector<BinaryData> hashes(msgs.size());
+      std::vector<uint8_t*> digests(msgs.size());
+      for (size_t i = 0; i < msgs.size(); i++)
+      {
+         hashes[i].resize(32);
+         digests[i] = hashes[i].getPtr();
+      }
+
+      Sha256Multi::getHash256(msgs.data(), digests.data(), msgs.size());
+      return hashes;
+   }
+
    /////////////////////////////////////////////////////////////////////////////
    static void getHash160(uint8_t const * strToHash,
                           size_t          nBytes,
@@ -613,49 +632,54 @@ public:
    /////////////////////////////////////////////////////////////////////////////
    static std::vector<BinaryData> calculateMerkleTree(std::vector<BinaryData> const & txhashlist)
    {
-      // Don't know in advance how big this list will be, make a list too big
-      // and copy the result to the right size list afterwards
       size_t numTx = txhashlist.size();
-      std::vector<BinaryData> merkleTree(3*numTx);
-      BinaryData hashInput(64);
-   
-      for(uint32_t i=0; i<numTx; i++)
-         merkleTree[i] = txhashlist[i];
-   
+      std::vector<BinaryData> merkleTree(txhashlist);
+      merkleTree.reserve(2*numTx + 16);
+
+      //each level is hashed in one batch, an odd last node pairs with itself
+      BinaryData hashInput;
+      std::vector<BinaryDataRef> inputRefs;
+      std::vector<uint8_t*> digests;
+
       size_t thisLevelStart = 0;
-      size_t nextLevelStart = numTx;
       size_t levelSize = numTx;
-      BinaryData hashOutput(32);
       while(levelSize>1)
       {
-         for(uint32_t j=0; j<(levelSize+1)/2; j++)
+         size_t pairCount = (levelSize+1)/2;
+         hashInput.resize(pairCount*64);
+         inputRefs.clear();
+         digests.clear();
+
+         for(size_t j=0; j<pairCount; j++)
          {
-            uint8_t* half1Ptr = hashInput.getPtr();
-            uint8_t* half2Ptr = hashInput.getPtr()+32;
-         
-            if(j < levelSize/2)
-            {
-               merkleTree[thisLevelStart+(2*j)  ].copyTo(half1Ptr, 32);
+            uint8_t* half1Ptr = hashInput.getPtr() + j*64;
+            uint8_t* half2Ptr = half1Ptr + 32;
+
+            auto& left = merkleTree[thisLevelStart+(2*j)];
+            left.copyTo(half1Ptr, 32);
+            if(2*j+1 < levelSize)
                merkleTree[thisLevelStart+(2*j)+1].copyTo(half2Ptr, 32);
-            }
-            else 
-            {
-               merkleTree[nextLevelStart-1].copyTo(half1Ptr, 32);
-               merkleTree[nextLevelStart-1].copyTo(half2Ptr, 32);
-            }
-            
-            CryptoSHA2::getHash256(hashInput.getRef(), hashOutput.getPtr());
-            merkleTree[nextLevelStart+j] = hashOutput;
+            else
+               left.copyTo(half2Ptr, 32);
+
+            inputRefs.push_back(BinaryDataRef(half1Ptr, 64));
+         }
+
+         size_t nextLevelStart = merkleTree.size();
+         merkleTree.resize(nextLevelStart + pairCount);
+         for(size_t j=0; j<pairCount; j++)
+         {
+            merkleTree[nextLevelStart+j].resize(32);
+            digests.push_back(merkleTree[nextLevelStart+j].getPtr());
          }
-         levelSize = (levelSize+1)/2;
+
+         Sha256Multi::getHash256(inputRefs.data(), digests.data(), pairCount);
+
          thisLevelStart = nextLevelStart;
-         nextLevelStart = nextLevelStart+levelSize;
+         levelSize = pairCount;
       }
 
-      // nextLevelStart is the size of the merkle tree
-      merkleTree.erase(merkleTree.begin()+nextLevelStart, merkleTree.end());
       return merkleTree;
-   
    }
    
    /////////////////////////////////////////////////////////////////////////////
@@ -1670,38 +1694,51 @@ public:
       return *vbd;
    }
 
-   /*
-   static bool verifyProofOfWork(BinaryDataRef bh80)
+   /////////////////////////////////////////////////////////////////////////////
+   // Checks the header hash against the target encoded in its diff bits.
+   // Does not check the diff bits against the network's difficulty rules.
+   static bool verifyProofOfWork(BinaryDataRef bh80, BinaryDataRef bhrHash)
    {
-      BinaryData theHash = getHash256(bh80);
-      return verifyProofOfWork(bh80, theHash.getRef());
-   }
+      if (bh80.getSize() < HEADER_SIZE || bhrHash.getSize() != 32)
+         return false;
 
-   static bool verifyProofOfWork(BinaryData bh80,
-                                 BinaryData const & theHash)
-   {
-      return verifyProofOfWork(bh80.getRef(), theHash.getRef());
-   }
+      uint32_t bits = READ_UINT32_LE(bh80.getPtr() + 72);
+      int exponent = bits >> 24;
+      uint32_t mantissa = bits & 0x007FFFFF;
 
-   static bool verifyProofOfWork(BinaryDataRef bh80, BinaryDataRef bhrHash)
-   {
-      // This is only approximate.  I can put in an exact verifier once 
-      // I figure out big integers better in C++, or another way to do
-      // the calculation.  I just want to make sure this isn't a completely
-      // bogus proof of work.
-      double diff = convertDiffBitsToDouble( BinaryDataRef(bh80.getPtr()+72, 4) );
-      double diffFactor = diff * (double)UINT32_MAX;
-      double nZeroBits  = int( log(diffFactor) / log(2.0));
-      int    nZeroBytes = int( log(diffFactor) / log(2.0) / 8.0);
+      //negative and null targets are never met
+      if ((bits & 0x00800000) != 0 || mantissa == 0)
+         return false;
+
+      //target = mantissa * 256^(exponent - 3), as 32 bytes little endian
+      uint8_t target[32] = { 0 };
+      for (int i = 0; i < 3; i++)
+      {
+         uint8_t val = (mantissa >> (8 * i)) & 0xFF;
+         int pos = exponent - 3 + i;
+         if (pos < 0)
+            continue;
 
-      // TODO: check that I'm comparing the correct end of the hash
-      for(uint32_t i=0; i<nZeroBytes; i++)
-         if(bhrHash[31-i]!=0)
-            return false;
+         if (pos >= 32)
+         {
+            if (val != 0)
+               return false;
+            continue;
+         }
+
+         target[pos] = val;
+      }
+
+      //the hash is a little endian number too, compare from the top byte
+      auto hashPtr = bhrHash.getPtr();
+      for (int i = 31; i >= 0; i--)
+      {
+         if (hashPtr[i] != target[i])
+            return hashPtr[i] < target[i];
+      }
 
       return true;
    }
-   */
    
    static std::string scrAddrToBase58(const BinaryData& scrAddr)
    {
@@ -389,7 +389,9 @@ vector<AddressBookEntry> BtcWallet::createAddressBook(void)
             continue;
 
          //grab tx
-         auto&& fullTx = bdvPtr_->getDB()->getFullTxCopy(dbKey.getSliceRef(0, 6));
+         auto fullTxPtr = 
+            bdvPtr_->getDB()->getFullTxPtr(dbKey.getSliceRef(0, 6));
+         auto& fullTx = *fullTxPtr;
          txHash = fullTx.getThisHash();
 
          auto nOut = fullTx.getNumTxOut();
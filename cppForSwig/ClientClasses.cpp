@@ -459,6 +459,74 @@ RpcStatus ClientClasses::NodeStatusStruct::rpcStatus() const
    return NodeChainState(ptr_);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+map<string, pair<uint64_t, uint64_t>> 
+   ClientClasses::NodeStatusStruct::dbMapUsage() const
+{
+   map<string, pair<uint64_t, uint64_t>> result;
+   for (int i = 0; i < ptr_->dbmapusage_size(); i++)
+   {
+      auto& usage = ptr_->dbmapusage(i);
+      result.insert(make_pair(usage.name(),
+         make_pair(usage.mapsize(), usage.usedsize())));
+   }
+
+   return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+map<string, DBObjectCacheStats> 
+   ClientClasses::NodeStatusStruct::dbCacheStats() const
+{
+   map<string, DBObjectCacheStats> result;
+   for (int i = 0; i < ptr_->dbcachestats_size(); i++)
+   {
+      auto& stats_proto = ptr_->dbcachestats(i);
+
+      DBObjectCacheStats stats;
+      stats.hits_ = stats_proto.hits();
+      stats.misses_ = stats_proto.misses();
+      stats.size_ = stats_proto.cachedbytes();
+      stats.count_ = stats_proto.entrycount();
+      result.insert(make_pair(stats_proto.name(), stats));
+   }
+
+   return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+map<string, DBMetricsStats> 
+   ClientClasses::NodeStatusStruct::dbMetrics() const
+{
+   map<string, DBMetricsStats> result;
+   for (int i = 0; i < ptr_->dbmetrics_size(); i++)
+   {
+      auto& metrics_proto = ptr_->dbmetrics(i);
+
+      DBMetricsStats stats;
+      for (int y = 0; 
+         y < metrics_proto.counters_size() && y < DBMetrics_CounterCount; y++)
+         stats.counters_[y] = metrics_proto.counters(y);
+
+      for (int y = 0; y < metrics_proto.histograms_size(); y++)
+      {
+         auto& hist_proto = metrics_proto.histograms(y);
+         if (hist_proto.type() >= DBMetrics_HistogramCount)
+            continue;
+
+         auto& hist = stats.histograms_[hist_proto.type()];
+         hist.totalNs_ = hist_proto.totalns();
+         for (int z = 0; 
+            z < hist_proto.buckets_size() && z < DBMETRICS_BUCKETS; z++)
+            hist.buckets_[z] = hist_proto.buckets(z);
+      }
+
+      result.insert(make_pair(metrics_proto.name(), stats));
+   }
+
+   return result;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 shared_ptr<ClientClasses::NodeStatusStruct> 
 ClientClasses::NodeStatusStruct::make_new(
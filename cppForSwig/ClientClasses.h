@@ -189,6 +189,14 @@ namespace ClientClasses
       RpcStatus rpcStatus(void) const;
       NodeChainState chainState(void) const;
 
+      //db name -> {map size, used size}
+      std::map<std::string, std::pair<uint64_t, uint64_t>> 
+         dbMapUsage(void) const;
+
+      //cache name -> hit/miss counters and size
+      std::map<std::string, DBObjectCacheStats> dbCacheStats(void) const;
+      std::map<std::string, DBMetricsStats> dbMetrics(void) const;
+
       static std::shared_ptr<NodeStatusStruct> make_new(
          std::shared_ptr<::Codec_BDVCommand::BDVCallback>, unsigned);
    };
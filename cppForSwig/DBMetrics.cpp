@@ -0,0 +1,247 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <mutex>
+#include <set>
+
+#include "DBMetrics.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+   ////
+   struct ThreadBlock
+   {
+      //only the owning thread writes, readers load as they go
+      atomic<uint64_t> counters_[COUNT][DBMetrics_CounterCount];
+      atomic<uint64_t> buckets_[COUNT][DBMetrics_HistogramCount][DBMETRICS_BUCKETS];
+      atomic<uint64_t> totalNs_[COUNT][DBMetrics_HistogramCount];
+
+      ThreadBlock(void)
+      {
+         for (unsigned db = 0; db < COUNT; db++)
+         {
+            for (auto& val : counters_[db])
+               val.store(0, memory_order_relaxed);
+
+            for (unsigned h = 0; h < DBMetrics_HistogramCount; h++)
+            {
+               for (auto& val : buckets_[db][h])
+                  val.store(0, memory_order_relaxed);
+               totalNs_[db][h].store(0, memory_order_relaxed);
+            }
+         }
+      }
+
+      void addTo(DBMetricsStats& stats, unsigned db) const
+      {
+         for (unsigned c = 0; c < DBMetrics_CounterCount; c++)
+            stats.counters_[c] += counters_[db][c].load(memory_order_relaxed);
+
+         for (unsigned h = 0; h < DBMetrics_HistogramCount; h++)
+         {
+            auto& hist = stats.histograms_[h];
+            for (unsigned b = 0; b < DBMETRICS_BUCKETS; b++)
+               hist.buckets_[b] += buckets_[db][h][b].load(memory_order_relaxed);
+            hist.totalNs_ += totalNs_[db][h].load(memory_order_relaxed);
+         }
+      }
+   };
+
+   ////
+   struct Registry
+   {
+      mutex mu_;
+      set<ThreadBlock*> live_;
+
+      //totals of exited threads
+      DBMetricsStats retired_[COUNT];
+   };
+
+   //never destroyed, threads may still be writing on exit
+   Registry& getRegistry(void)
+   {
+      static Registry* registry = new Registry();
+      return *registry;
+   }
+
+   ////
+   struct ThreadHolder
+   {
+      ThreadBlock* block_ = nullptr;
+
+      ~ThreadHolder(void)
+      {
+         if (block_ == nullptr)
+            return;
+
+         auto& registry = getRegistry();
+         {
+            unique_lock<mutex> lock(registry.mu_);
+            for (unsigned db = 0; db < COUNT; db++)
+               block_->addTo(registry.retired_[db], db);
+            registry.live_.erase(block_);
+         }
+
+         delete block_;
+      }
+   };
+
+   ThreadBlock& getThreadBlock(void)
+   {
+      thread_local ThreadHolder holder;
+      if (holder.block_ == nullptr)
+      {
+         holder.block_ = new ThreadBlock();
+
+         auto& registry = getRegistry();
+         unique_lock<mutex> lock(registry.mu_);
+         registry.live_.insert(holder.block_);
+      }
+
+      return *holder.block_;
+   }
+
+   //no lock prefix, this thread is the only writer
+   inline void add(atomic<uint64_t>& val, uint64_t inc)
+   {
+      val.store(val.load(memory_order_relaxed) + inc, memory_order_relaxed);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DBLatencyHistogram
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+unsigned DBLatencyHistogram::getBucket(uint64_t ns)
+{
+   if (ns == 0)
+      return 0;
+
+   //floor(log2(ns)) + 1
+   unsigned bucket = 1;
+   for (unsigned shift = 32; shift > 0; shift >>= 1)
+   {
+      if ((ns >> shift) != 0)
+      {
+         ns >>= shift;
+         bucket += shift;
+      }
+   }
+
+   if (bucket >= DBMETRICS_BUCKETS)
+      return DBMETRICS_BUCKETS - 1;
+   return bucket;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t DBLatencyHistogram::getBucketUpperBound(unsigned bucket)
+{
+   if (bucket == 0)
+      return 0;
+
+   if (bucket >= DBMETRICS_BUCKETS - 1)
+      return UINT64_MAX;
+
+   return 1ULL << bucket;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t DBLatencyHistogram::getCount() const
+{
+   uint64_t count = 0;
+   for (auto& val : buckets_)
+      count += val;
+   return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t DBLatencyHistogram::getPercentile(double pct) const
+{
+   auto count = getCount();
+   if (count == 0)
+      return 0;
+
+   uint64_t target = uint64_t(pct * count + 0.5);
+   if (target == 0)
+      target = 1;
+
+   uint64_t total = 0;
+   for (unsigned i = 0; i < DBMETRICS_BUCKETS; i++)
+   {
+      total += buckets_[i];
+      if (total >= target)
+         return getBucketUpperBound(i);
+   }
+
+   return UINT64_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DBMetricsStats
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+DBMetricsStats& DBMetricsStats::operator+=(const DBMetricsStats& rhs)
+{
+   for (unsigned c = 0; c < DBMetrics_CounterCount; c++)
+      counters_[c] += rhs.counters_[c];
+
+   for (unsigned h = 0; h < DBMetrics_HistogramCount; h++)
+   {
+      for (unsigned b = 0; b < DBMETRICS_BUCKETS; b++)
+         histograms_[h].buckets_[b] += rhs.histograms_[h].buckets_[b];
+      histograms_[h].totalNs_ += rhs.histograms_[h].totalNs_;
+   }
+
+   return *this;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DBMetrics
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+void DBMetrics::count(DB_SELECT db, DBMetricsCounter counter, uint64_t val)
+{
+   add(getThreadBlock().counters_[db][counter], val);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBMetrics::record(DB_SELECT db, DBMetricsHistogram hist, uint64_t ns)
+{
+   auto& block = getThreadBlock();
+   add(block.buckets_[db][hist][DBLatencyHistogram::getBucket(ns)], 1);
+   add(block.totalNs_[db][hist], ns);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBMetrics::recordSince(
+   DB_SELECT db, DBMetricsHistogram hist, const TimePoint& start)
+{
+   auto ns = chrono::duration_cast<chrono::nanoseconds>(now() - start);
+   record(db, hist, (uint64_t)ns.count());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DBMetricsStats DBMetrics::getStats(DB_SELECT db)
+{
+   auto& registry = getRegistry();
+   unique_lock<mutex> lock(registry.mu_);
+
+   auto stats = registry.retired_[db];
+   for (auto blockPtr : registry.live_)
+      blockPtr->addTo(stats, db);
+
+   return stats;
+}
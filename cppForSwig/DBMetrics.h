@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_DBMETRICS
+#define _H_DBMETRICS
+
+#include <chrono>
+
+#include "StoredBlockObj.h"
+
+//bucket 0 is for 0ns, bucket i counts [2^(i-1), 2^i) ns, the last one
+//takes everything past ~4.5 minutes
+#define DBMETRICS_BUCKETS 40
+
+enum DBMetricsCounter
+{
+   DBMetrics_Get = 0,
+   DBMetrics_Put,
+   DBMetrics_Delete,
+   DBMetrics_Seek,
+   DBMetrics_BytesRead,
+   DBMetrics_BytesWritten,
+   DBMetrics_CounterCount
+};
+
+enum DBMetricsHistogram
+{
+   DBMetrics_GetLatency = 0,
+   DBMetrics_ReadTxDuration,
+   DBMetrics_WriteTxDuration,
+   DBMetrics_WriteLockWait,
+   DBMetrics_HistogramCount
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct DBLatencyHistogram
+{
+   uint64_t buckets_[DBMETRICS_BUCKETS] = {};
+   uint64_t totalNs_ = 0;
+
+   uint64_t getCount(void) const;
+
+   //upper bound in ns of the bucket holding the pct (0 to 1) sample
+   uint64_t getPercentile(double pct) const;
+
+   static unsigned getBucket(uint64_t ns);
+   static uint64_t getBucketUpperBound(unsigned);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct DBMetricsStats
+{
+   uint64_t counters_[DBMetrics_CounterCount] = {};
+   DBLatencyHistogram histograms_[DBMetrics_HistogramCount];
+
+   DBMetricsStats& operator+=(const DBMetricsStats&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class DBMetrics
+{
+   /***
+   Process wide per DB_SELECT op counters and latency histograms. Each
+   thread accumulates in its own block, readers sum the live blocks with
+   what exited threads left behind. Totals only ever grow, diff two reads
+   to get rates.
+   ***/
+
+public:
+   typedef std::chrono::steady_clock::time_point TimePoint;
+
+public:
+   static TimePoint now(void) { return std::chrono::steady_clock::now(); }
+
+   static void count(DB_SELECT, DBMetricsCounter, uint64_t val = 1);
+   static void record(DB_SELECT, DBMetricsHistogram, uint64_t ns);
+   static void recordSince(DB_SELECT, DBMetricsHistogram, const TimePoint&);
+
+   static DBMetricsStats getStats(DB_SELECT);
+};
+
+#endif
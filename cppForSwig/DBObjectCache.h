@@ -0,0 +1,189 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_DBOBJECTCACHE
+#define _H_DBOBJECTCACHE
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+
+#include "BinaryData.h"
+
+#define DBOBJECTCACHE_SHARDS 16
+
+////////////////////////////////////////////////////////////////////////////////
+struct DBObjectCacheStats
+{
+   uint64_t hits_ = 0;
+   uint64_t misses_ = 0;
+   uint64_t size_ = 0;
+   uint64_t count_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename T> class DBObjectCache
+{
+   /***
+   Byte budgeted LRU of immutable db objects, keyed by db key (up to 8
+   bytes). Split in shards with their own lock so concurrent BDV readers
+   don't contend on a single mutex. A budget of 0 disables the cache.
+   ***/
+
+private:
+   struct Entry
+   {
+      uint64_t key_;
+      std::shared_ptr<const T> obj_;
+      size_t size_;
+   };
+
+   struct Shard
+   {
+      std::mutex mu_;
+
+      //most recently used entries at the front
+      std::list<Entry> lru_;
+      std::unordered_map<uint64_t, typename std::list<Entry>::iterator> map_;
+      size_t size_ = 0;
+   };
+
+private:
+   Shard shards_[DBOBJECTCACHE_SHARDS];
+   size_t shardBudget_ = 0;
+
+   std::atomic<uint64_t> hits_;
+   std::atomic<uint64_t> misses_;
+
+private:
+   static uint64_t getKey(BinaryDataRef dbKey)
+   {
+      if (dbKey.getSize() == 0 || dbKey.getSize() > 8)
+         throw std::range_error("invalid cache key length");
+
+      uint64_t key = 0;
+      for (unsigned i = 0; i < dbKey.getSize(); i++)
+         key = (key << 8) | dbKey.getPtr()[i];
+      return key;
+   }
+
+   Shard& getShard(uint64_t key)
+   {
+      //keys share their leading bytes (height), spread on the mixed key
+      key ^= key >> 29;
+      key *= 0xbf58476d1ce4e5b9ULL;
+      key ^= key >> 32;
+      return shards_[key % DBOBJECTCACHE_SHARDS];
+   }
+
+   void evict(Shard& shard)
+   {
+      while (shard.size_ > shardBudget_ && shard.lru_.size() > 0)
+      {
+         auto& last = shard.lru_.back();
+         shard.size_ -= last.size_;
+         shard.map_.erase(last.key_);
+         shard.lru_.pop_back();
+      }
+   }
+
+public:
+   DBObjectCache(void) :
+      hits_(0), misses_(0)
+   {}
+
+   void setBudget(size_t bytes)
+   {
+      shardBudget_ = bytes / DBOBJECTCACHE_SHARDS;
+      clear();
+   }
+
+   bool enabled(void) const { return shardBudget_ != 0; }
+
+   std::shared_ptr<const T> get(BinaryDataRef dbKey)
+   {
+      if (!enabled())
+         return nullptr;
+
+      auto key = getKey(dbKey);
+      auto& shard = getShard(key);
+
+      std::unique_lock<std::mutex> lock(shard.mu_);
+      auto iter = shard.map_.find(key);
+      if (iter == shard.map_.end())
+      {
+         misses_.fetch_add(1, std::memory_order_relaxed);
+         return nullptr;
+      }
+
+      //move to front
+      shard.lru_.splice(shard.lru_.begin(), shard.lru_, iter->second);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return iter->second->obj_;
+   }
+
+   void put(BinaryDataRef dbKey, std::shared_ptr<const T> obj, size_t size)
+   {
+      if (!enabled() || obj == nullptr || size > shardBudget_)
+         return;
+
+      auto key = getKey(dbKey);
+      auto& shard = getShard(key);
+
+      std::unique_lock<std::mutex> lock(shard.mu_);
+      auto iter = shard.map_.find(key);
+      if (iter != shard.map_.end())
+      {
+         shard.size_ -= iter->second->size_;
+         shard.lru_.erase(iter->second);
+         shard.map_.erase(iter);
+      }
+
+      Entry entry;
+      entry.key_ = key;
+      entry.obj_ = std::move(obj);
+      entry.size_ = size;
+
+      shard.lru_.push_front(std::move(entry));
+      shard.map_.insert(std::make_pair(key, shard.lru_.begin()));
+      shard.size_ += size;
+
+      evict(shard);
+   }
+
+   void clear(void)
+   {
+      for (auto& shard : shards_)
+      {
+         std::unique_lock<std::mutex> lock(shard.mu_);
+         shard.lru_.clear();
+         shard.map_.clear();
+         shard.size_ = 0;
+      }
+   }
+
+   DBObjectCacheStats getStats(void)
+   {
+      DBObjectCacheStats stats;
+      stats.hits_ = hits_.load(std::memory_order_relaxed);
+      stats.misses_ = misses_.load(std::memory_order_relaxed);
+
+      for (auto& shard : shards_)
+      {
+         std::unique_lock<std::mutex> lock(shard.mu_);
+         stats.size_ += shard.size_;
+         stats.count_ += shard.lru_.size();
+      }
+
+      return stats;
+   }
+};
+
+#endif
@@ -288,6 +288,13 @@ BinaryData DBUtils::getFilterPoolKey(uint32_t filenum)
    return WRITE_UINT32_BE(bucketKey);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+BinaryData DBUtils::getPrefilterKey(uint32_t filenum)
+{
+   uint32_t bucketKey = (DB_PREFIX_PREFILTER << 24) | (uint32_t)filenum;
+   return WRITE_UINT32_BE(bucketKey);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 BinaryData DBUtils::getMissingHashesKey(uint32_t id)
 {
@@ -585,6 +592,29 @@ int DBUtils::removeDirectory(const string& path)
    return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+vector<string> DBUtils::getDirectoryContent(const string& path)
+{
+   //file and folder names in path, without . and ..
+   vector<string> result;
+   DIR* current_dir = opendir(path.c_str());
+   if (current_dir == nullptr)
+      return result;
+
+   dirent* filename = nullptr;
+   while ((filename = readdir(current_dir)) != nullptr)
+   {
+      string name(filename->d_name);
+      if (name == "." || name == "..")
+         continue;
+
+      result.push_back(move(name));
+   }
+
+   closedir(current_dir);
+   return result;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 size_t DBUtils::getFileSize(const string& path)
 {
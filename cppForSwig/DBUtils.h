@@ -40,7 +40,8 @@ enum DB_PREFIX
    DB_PREFIX_POOL,
    DB_PREFIX_MISSING_HASHES,
    DB_PREFIX_SUBSSH,
-   DB_PREFIX_TEMPSCRIPT
+   DB_PREFIX_TEMPSCRIPT,
+   DB_PREFIX_PREFILTER
 };
 
 struct FileMap
@@ -145,6 +146,7 @@ public:
       bool rewindWhenDone = false);
 
    static BinaryData getFilterPoolKey(uint32_t filenum);
+   static BinaryData getPrefilterKey(uint32_t filenum);
    static BinaryData getMissingHashesKey(uint32_t id);
 
    static bool fileExists(const std::string& path, int mode);
@@ -152,6 +154,7 @@ public:
    static FileMap getMmapOfFile(const std::string&, bool write = false);
    
    static int removeDirectory(const std::string&);
+   static std::vector<std::string> getDirectoryContent(const std::string&);
    static struct stat getPathStat(const std::string& path);
    static struct stat getPathStat(const char* path, unsigned len);
    static size_t getFileSize(const std::string& path);
@@ -12,6 +12,7 @@
 #include "BlockchainScanner_Super.h"
 #include "ScrAddrFilter.h"
 #include "Transactions.h"
+#include "HeaderSnapshot.h"
 
 using namespace std;
 
@@ -65,7 +66,7 @@ DatabaseBuilder::DatabaseBuilder(BlockFiles& blockFiles,
    db_(bdm.getIFace()), scrAddrFilter_(bdm.getScrAddrFilter()),
    progress_(progress), topBlockOffset_(0, 0),
    bdmConfig_(bdm.config()), 
-   forceRescanSSH_(forceRescanSSH)
+   forceRescanSSH_(forceRescanSSH), processNode_(bdm.processNode_)
 {}
 
 /////////////////////////////////////////////////////////////////////////////
@@ -82,14 +83,21 @@ void DatabaseBuilder::init()
    //list all files in block data folder
    blockFiles_.detectAllBlockFiles();
 
-   //read all blocks already in DB and populate blockchain
-   topBlockOffset_ = loadBlockHeadersFromDB(progress_);
-   
-   if (bdmConfig_.reportProgress_)
-      progress_(BDMPhase_OrganizingChain, 0, UINT32_MAX, 0);
+   //start from the header snapshot of the last clean shutdown if there is
+   //one, it is checked against the HEADERS db once init is done
+   Blockchain::ReorganizationState initialReorgState;
+   if (!loadHeaderSnapshot(initialReorgState))
+   {
+      //read all blocks already in DB and populate blockchain
+      topBlockOffset_ = loadBlockHeadersFromDB(progress_);
+
+      if (bdmConfig_.reportProgress_)
+         progress_(BDMPhase_OrganizingChain, 0, UINT32_MAX, 0);
+
+      LOGINFO << "organizing chain";
+      initialReorgState = blockchain_->forceOrganize();
+   }
 
-   LOGINFO << "organizing chain";
-   auto&& initialReorgState = blockchain_->forceOrganize();
    LOGINFO << "updating branches";
    blockchain_->updateBranchingMaps(db_, initialReorgState);
 
@@ -117,7 +125,7 @@ void DatabaseBuilder::init()
    //update db
    TIMER_START("updateblocksindb");
    LOGINFO << "updating HEADERS db";
-   auto reorgState = updateBlocksInDB(
+   auto&& reorgState = updateBlocksInDB(
       progress_, bdmConfig_.reportProgress_, 
       BlockDataManagerConfig::getDbType() == ARMORY_DB_SUPER);
    TIMER_STOP("updateblocksindb");
@@ -139,30 +147,21 @@ void DatabaseBuilder::init()
 
       //don't scan without any registered addresses
       if (scrAddrFilter_->getScanFilterAddrMap()->size() == 0)
+      {
+         startHeaderSnapshotCheck();
          return;
+      }
 
       //determine from which block to start scanning
       scrAddrFilter_->getScrAddrCurrentSyncState();
       scanFrom = scrAddrFilter_->scanFrom();
 
-      //DatabaseBuilder objects always operate on sdbi index 0
-      //BlockchainScanner object depend on the underlying ScrAddrFilter uniqueID
-      auto&& subsshSdbi = db_->getStoredDBInfo(SUBSSH, 0);
-      auto&& sshsdbi = db_->getStoredDBInfo(SSH, 0);
-
-      //check merkle of registered addresses vs what's in the DB
-      if (!scrAddrFilter_->hasNewAddresses())
-      {
-         //no new addresses were registered in between runs.
-
-         if (subsshSdbi.topBlkHgt_ > sshsdbi.topBlkHgt_)
-         {
-            //SUBSSH db has scanned ahead of SSH db, no point rescanning these
-            //blocks
-            scanFrom = subsshSdbi.topBlkHgt_;
-         }
-      }
-      else
+      //check merkle of registered addresses vs what's in the DB.
+      //
+      //If no new addresses were registered in between runs and the SUBSSH
+      //db has scanned ahead of the SSH db, the scanner resumes from its 
+      //checkpoint. scanFrom stays on the SSH db, updateSSH starts there.
+      if (scrAddrFilter_->hasNewAddresses())
       {
          //we have newly registered addresses this run, force a full rescan
          resetHistory();
@@ -234,6 +233,8 @@ void DatabaseBuilder::init()
    TIMER_STOP("initdb");
    double timeSpent = TIMER_READ_SEC("initdb");
    LOGINFO << "init db in " << timeSpent << "s";
+
+   startHeaderSnapshotCheck();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -243,7 +244,6 @@ BlockOffset DatabaseBuilder::loadBlockHeadersFromDB(
    //TODO: preload the headers db file to speed process up
 
    LOGINFO << "Reading headers from db";
-   blockchain_->clear();
 
    unsigned counter = 0;
    BlockOffset topBlockOffet(0, 0);
@@ -282,8 +282,12 @@ BlockOffset DatabaseBuilder::loadBlockHeadersFromDB(
          calc.fractionCompleted(), calc.remainingSeconds(), counter);
    };
 
-   db_->readAllHeaders(callback);
+   db_->readAllHeaders(callback, bdmConfig_.threadCount_);
    LOGINFO << "grabbed all headers in db";
+
+   //the chain may be in use when replacing a snapshot one, keep the 
+   //window without headers short
+   blockchain_->clear();
    blockchain_->addBlocksInBulk(headerMap, false);
 
    LOGINFO << "Found " << headerMap.size() << " headers in db";
@@ -291,6 +295,162 @@ BlockOffset DatabaseBuilder::loadBlockHeadersFromDB(
    return topBlockOffet;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+bool DatabaseBuilder::loadHeaderSnapshot(
+   Blockchain::ReorganizationState& reorgState)
+{
+   auto&& path = DatabaseContainer::getDbPath(HEADERSNAPSHOT_FILENAME);
+   if (!DBUtils::fileExists(path, 0))
+      return false;
+
+   TIMER_START("loadHeaderSnapshot");
+   shared_ptr<HeaderSnapshot> snapshot;
+   try
+   {
+      snapshot = make_shared<HeaderSnapshot>(path);
+
+      //the snapshot is only good for the HEADERS db it was written with
+      auto&& sdbi = db_->getStoredDBInfo(HEADERS, 0);
+      if (snapshot->getTipHash() != sdbi.topScannedBlkHash_.getRef())
+         throw HeaderSnapshotException("snapshot tip is not the db top");
+
+      LOGINFO << "Reading headers from snapshot";
+      blockchain_->clear();
+
+      vector<shared_ptr<BlockHeader>> headers;
+      headers.reserve(snapshot->size());
+      BlockOffset topBlockOffset(0, 0);
+
+      for (size_t i = 0; i < snapshot->size(); i++)
+      {
+         auto header = snapshot->getHeader(i);
+
+         BlockOffset currblock(header->getBlockFileNum(), header->getOffset());
+         if (currblock > topBlockOffset)
+            topBlockOffset = currblock;
+
+         headers.push_back(header);
+      }
+
+      reorgState = blockchain_->setOrganizedHeaders(
+         headers, snapshot->getTipHash());
+      topBlockOffset_ = topBlockOffset;
+   }
+   catch (exception& e)
+   {
+      LOGWARN << "failed to load header snapshot: " << e.what();
+      snapshot.reset();
+      blockchain_->clear();
+      remove(path.c_str());
+      return false;
+   }
+
+   TIMER_STOP("loadHeaderSnapshot");
+   LOGINFO << "Found " << snapshot->size() << " headers in snapshot, " <<
+      "loaded in " << TIMER_READ_SEC("loadHeaderSnapshot") << "s";
+
+   //the map stays valid until the check is done, only a clean shutdown
+   //writes a new file
+   remove(path.c_str());
+   headerSnapshot_ = snapshot;
+   return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void DatabaseBuilder::startHeaderSnapshotCheck()
+{
+   /***
+   Init closes and reopens the dbs, the check can't run before it is done. 
+   The chain is in use by then, a mismatch signals the block stack so that
+   the next update swaps it for the one in the db.
+   ***/
+
+   if (headerSnapshot_ == nullptr)
+      return;
+
+   auto snapshot = headerSnapshot_;
+   headerSnapshot_.reset();
+
+   auto db = db_;
+   auto bc = blockchain_;
+   auto processNode = processNode_;
+
+   auto checkLbd = [db, bc, snapshot, processNode](void) mutable->bool
+   {
+      //headers init parsed are in the chain under the same id and offset
+      auto isNewLbd = [bc](const StoredHeader& sbh)->bool
+      {
+         try
+         {
+            auto header = bc->getHeaderByHash(sbh.thisHash_);
+            return header->getThisID() == sbh.uniqueID_ &&
+               header->getBlockFileNum() == sbh.fileID_ &&
+               header->getOffset() == sbh.offset_;
+         }
+         catch (exception&)
+         {
+            return false;
+         }
+      };
+
+      bool result = false;
+      try
+      {
+         result = db->checkHeaderSnapshot(*snapshot, isNewLbd);
+      }
+      catch (exception& e)
+      {
+         LOGWARN << "failed to check header snapshot: " << e.what();
+      }
+
+      snapshot.reset();
+      if (!result && processNode != nullptr)
+      {
+         //an empty entry will do, it only signals a chain update is due
+         processNode->getInvBlockStack()->push_back(vector<InvEntry>());
+      }
+
+      return result;
+   };
+
+   snapshotCheck_ = async(launch::async, checkLbd);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool DatabaseBuilder::headerSnapshotFailed()
+{
+   //doesn't wait on the check, the result is consumed once
+   if (!snapshotCheck_.valid() ||
+      snapshotCheck_.wait_for(chrono::seconds(0)) != future_status::ready)
+      return false;
+
+   return !snapshotCheck_.get();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void DatabaseBuilder::writeHeaderSnapshot()
+{
+   //a chain that has yet to pass its check isn't carried over
+   if (snapshotCheck_.valid() && !snapshotCheck_.get())
+      return;
+
+   auto&& headers = blockchain_->getCommittedHeaders();
+   if (headers.size() == 0)
+      return;
+
+   auto&& path = DatabaseContainer::getDbPath(HEADERSNAPSHOT_FILENAME);
+   try
+   {
+      HeaderSnapshot::write(path, headers, blockchain_->top()->getThisHash());
+      LOGINFO << "wrote header snapshot with " << headers.size() << " headers";
+   }
+   catch (exception& e)
+   {
+      LOGWARN << "failed to write header snapshot: " << e.what();
+      remove(path.c_str());
+   }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 Blockchain::ReorganizationState DatabaseBuilder::updateBlocksInDB(
    const ProgressCallback &progress, bool verbose, bool fullHints)
@@ -380,12 +540,41 @@ Blockchain::ReorganizationState DatabaseBuilder::updateBlocksInDB(
    return reorgState;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockDataFileMap> DatabaseBuilder::getBlockFileMap(
+   BlockDataLoader& bdl, uint16_t fileID)
+{
+   /***
+   New blocks land at the end of the last blk file. Its map outlives the
+   update and is grown over the appended bytes on the next one, parsing
+   then resumes at topBlockOffset_. A new block costs about its own size
+   instead of a fresh map of the whole file.
+   ***/
+
+   unique_lock<mutex> lock(tailMutex_);
+   if (tailMap_ != nullptr && tailFileID_ == fileID)
+   {
+      tailMap_->grow();
+      return tailMap_;
+   }
+
+   auto fileMap = bdl.get(fileID);
+   if (fileMap->getPtr() != nullptr && 
+      fileID + 1U == blockFiles_.fileCount())
+   {
+      tailMap_ = fileMap;
+      tailFileID_ = fileID;
+   }
+
+   return fileMap;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 bool DatabaseBuilder::addBlocksToDB(BlockDataLoader& bdl, 
    uint16_t fileID, size_t startOffset, shared_ptr<BlockOffset> bo,
    bool fullHints)
 {
-   auto&& blockfilemappointer = bdl.get(fileID);
+   auto&& blockfilemappointer = getBlockFileMap(bdl, fileID);
    auto ptr = blockfilemappointer->getPtr();
 
    //ptr is null if we're out of block files
@@ -598,6 +787,9 @@ BinaryData DatabaseBuilder::scanHistory(int32_t startHeight,
       BlockchainScanner bcs(blockchain_, db_, scrAddrFilter_.get(),
          blockFiles_, bdmConfig_.threadCount_, bdmConfig_.ramUsage_,
          progress_, reportprogress);
+      bcs.setUtxoCacheSize((size_t)bdmConfig_.utxoCacheSize_ * 1024 * 1024);
+      bcs.setReadahead(bdmConfig_.ioThreadCount_, bdmConfig_.readaheadFiles_);
+      bcs.setVerifyCheckpoint(bdmConfig_.verifyCheckpoint_);
 
       bcs.scan(startHeight);
       bcs.updateSSH(forceRescanSSH_, startHeight);
@@ -615,6 +807,8 @@ BinaryData DatabaseBuilder::scanHistory(int32_t startHeight,
          }
       }
 
+      db_->updateTxHashIndex();
+
       return bcs.getTopScannedBlockHash();
    }
    else
@@ -641,10 +835,34 @@ Blockchain::ReorganizationState DatabaseBuilder::update(void)
    //list all files in block data folder
    blockFiles_.detectAllBlockFiles();
 
+   //the chain came from a header snapshot that failed its check, swap it
+   //for the one in the HEADERS db before parsing new blocks
+   BinaryData snapshotTopHash;
+   if (headerSnapshotFailed())
+   {
+      LOGWARN << "header snapshot does not match the HEADERS db, " <<
+         "reloading headers from db";
+
+      snapshotTopHash = blockchain_->top()->getThisHash();
+      topBlockOffset_ = loadBlockHeadersFromDB(progress_);
+      auto&& organizeState = blockchain_->forceOrganize();
+      blockchain_->updateBranchingMaps(db_, organizeState);
+   }
+
    //update db
    auto&& reorgState = updateBlocksInDB(progress_, false, 
       BlockDataManagerConfig::getDbType() == ARMORY_DB_SUPER);
 
+   if (snapshotTopHash.getSize() != 0)
+   {
+      //history was scanned along the snapshot chain, roll it back to 
+      //where it meets the db one. The snapshot tip is the HEADERS db top,
+      //it is in the reloaded chain. Bdvs are notified either way, the
+      //headers they hold were replaced
+      reorgState = blockchain_->findReorgPointFromBlock(snapshotTopHash);
+      reorgState.hasNewTop_ = true;
+   }
+
    if (!reorgState.hasNewTop_)
       return reorgState;
 
@@ -658,6 +876,12 @@ Blockchain::ReorganizationState DatabaseBuilder::update(void)
    }
 
    //scan new blocks   
+   if (startHeight > blockchain_->top()->getBlockHeight())
+   {
+      db_->invalidateObjectCache(!reorgState.prevTopStillValid_);
+      return reorgState;
+   }
+
    BinaryData&& topScannedHash = scanHistory(startHeight, false, false);
    if (topScannedHash != blockchain_->top()->getThisHash())
    {
@@ -665,6 +889,9 @@ Blockchain::ReorganizationState DatabaseBuilder::update(void)
       throw runtime_error("scan failure during DatabaseBuilder::update");
    }
 
+   //drop cached db objects that the new blocks may have changed
+   db_->invalidateObjectCache(!reorgState.prevTopStillValid_);
+
    //TODO: recover from failed scan 
 
    return reorgState;
@@ -1067,12 +1294,21 @@ void DatabaseBuilder::verifyTransactions()
       auto getUtxoMap = [&bdl, stateStruct, getFileMap, this]
          (shared_ptr<BCTX> txn)->TransactionVerifier::utxoMap
       {
-         TransactionVerifier::utxoMap utxomap;
-         for (auto& txin : txn->txins_)
+         //txns the hints point to for each input, their hashes are
+         //checked in one batch
+         struct Candidate
          {
+            unsigned inputId_;
+            shared_ptr<BCTX> txn_;
+         };
+         vector<Candidate> candidates;
+
+         for (unsigned i = 0; i < txn->txins_.size(); i++)
+         {
+            auto& txin = txn->txins_[i];
+
             //get output hash
             BinaryDataRef hashref(txn->data_ + txin.first, 32);
-            auto outputID = (uint32_t*)(txn->data_ + txin.first + 32);
 
             //resolve hash
             StoredTxHints sths;
@@ -1082,7 +1318,6 @@ void DatabaseBuilder::verifyTransactions()
                throw UnresolvedHashException();
             }
 
-            bool foundtx = false;
             for (auto& outpointkey : sths.dbKeyList_)
             {
                if (outpointkey.getSize() == 0)
@@ -1126,18 +1361,38 @@ void DatabaseBuilder::verifyTransactions()
                   bhPtr, getID, false, false);
 
                auto& txns = bdata.getTxns();
-               if (txid > txns.size())
+               if (txid >= txns.size())
                   continue;
 
+               candidates.push_back({ i, txns[txid] });
+            }
+         }
+
+         vector<shared_ptr<BCTX>> candidateTxns;
+         for (auto& candidate : candidates)
+            candidateTxns.push_back(candidate.txn_);
+         BCTX::computeHashes(candidateTxns);
+
+         TransactionVerifier::utxoMap utxomap;
+         auto candidateIter = candidates.begin();
+         for (unsigned i = 0; i < txn->txins_.size(); i++)
+         {
+            auto& txin = txn->txins_[i];
+            BinaryDataRef hashref(txn->data_ + txin.first, 32);
+            auto outputID = (uint32_t*)(txn->data_ + txin.first + 32);
+
+            bool foundtx = false;
+            for (; candidateIter != candidates.end() &&
+               candidateIter->inputId_ == i; ++candidateIter)
+            {
                //check hash
-               auto _txn = txns[txid];
-               const auto& txhash = _txn->getHash();
-               if (hashref != txhash.getRef())
+               auto& _txn = candidateIter->txn_;
+               if (foundtx || hashref != _txn->getHash().getRef())
                   continue;
 
                //grab output
                auto txoutcount = _txn->txouts_.size();
-               if (*outputID > txoutcount)
+               if (*outputID >= txoutcount)
                   break;
 
                BinaryDataRef output(_txn->data_ + _txn->txouts_[*outputID].first,
@@ -1149,7 +1404,6 @@ void DatabaseBuilder::verifyTransactions()
                idmap[*outputID] = move(utxo);
 
                foundtx = true;
-               break;
             }
 
             if (!foundtx)
@@ -1293,6 +1547,8 @@ void DatabaseBuilder::verifyTxFilters()
    fileCounter.store(0, memory_order_relaxed);
 
    set<unsigned> damagedFilters;
+   set<unsigned> missingPrefilters;
+   mutex resultMutex;
 
    auto&& file_id_map = blockchain_->mapIDsPerBlockFile();
 
@@ -1301,6 +1557,7 @@ void DatabaseBuilder::verifyTxFilters()
       auto&& tx = db_->beginTransaction(TXFILTERS, LMDB::ReadOnly);
 
       set<unsigned> mismatchedFilters;
+      set<unsigned> noPrefilters;
 
       while (1)
       {
@@ -1316,12 +1573,11 @@ void DatabaseBuilder::verifyTxFilters()
                continue;
             }
 
-            if (mismatchedFilters.size() > 0)
-            {
-               unique_lock<mutex>(resultMutex);
-               damagedFilters.insert(
-                  mismatchedFilters.begin(), mismatchedFilters.end());
-            }
+            unique_lock<mutex> lock(resultMutex);
+            damagedFilters.insert(
+               mismatchedFilters.begin(), mismatchedFilters.end());
+            missingPrefilters.insert(
+               noPrefilters.begin(), noPrefilters.end());
 
             return;
          }
@@ -1349,6 +1605,10 @@ void DatabaseBuilder::verifyTxFilters()
                mismatchedFilters.insert(fileNum);
                LOGWARN << mismatchCount << " mismatches in txfilter for file #" << fileNum;
             }
+            else if (!db_->getPrefilterRefForFileNum(fileNum).isValid())
+            {
+               noPrefilters.insert(fileNum);
+            }
          }
          catch (runtime_error&)
          {
@@ -1366,6 +1626,19 @@ void DatabaseBuilder::verifyTxFilters()
    for (auto& thr : thrs)
       if (thr.joinable())
          thr.join();
+
+   //pools from older dbs have no prefilter, build it from the pool
+   if (missingPrefilters.size() > 0)
+   {
+      LOGINFO << "building " << missingPrefilters.size() << " txfilter prefilters";
+
+      for (auto& fileNum : missingPrefilters)
+      {
+         auto&& pool = db_->getFilterPoolForFileNum<TxFilterType>(fileNum);
+         if (pool.isValid())
+            db_->putPrefilterForFileNum(fileNum, pool.getPrefilter());
+      }
+   }
    
    if (damagedFilters.size() == 0)
    {
@@ -1386,10 +1659,7 @@ void DatabaseBuilder::repairTxFilters(const set<unsigned>& badFilters)
       auto&& tx = db_->beginTransaction(TXFILTERS, LMDB::ReadWrite);
 
       for (auto& filter : badFilters)
-      {
-         auto&& dbkey = DBUtils::getFilterPoolKey(filter);
-         db_->deleteValue(TXFILTERS, dbkey);
-      }
+         db_->deleteFilterPoolForFileNum(filter);
    }
 
    //no preload nor prefetch
@@ -1493,10 +1763,9 @@ void DatabaseBuilder::reprocessTxFilter(
 
 
    {
-      //delete existing txfilter
+      //delete existing txfilter and prefilter
       auto&& tx = db_->beginTransaction(TXFILTERS, LMDB::ReadWrite);
-      auto&& dbkey = DBUtils::getFilterPoolKey(fileID);
-      db_->deleteValue(TXFILTERS, dbkey);
+      db_->deleteFilterPoolForFileNum(fileID);
 
       //tally all block filters
       set<TxFilter<TxFilterType>> allFilters;
@@ -6,6 +6,8 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <future>
+
 #include "BlockDataMap.h"
 #include "Blockchain.h"
 #include "bdmenums.h"
@@ -13,6 +15,8 @@
 
 class BlockDataManager;
 class ScrAddrFilter;
+class BitcoinNodeInterface;
+class HeaderSnapshot;
 class UnresolvedHashException {};
 
 typedef std::function<void(BDMPhase, double, unsigned, unsigned)> ProgressCallback;
@@ -33,9 +37,27 @@ private:
    unsigned checkedTransactions_ = 0;
    const bool forceRescanSSH_;
 
+   //the chain is loaded from a header snapshot and used right away, the
+   //check against the HEADERS db runs in the background once init is 
+   //done with the db. A failed check signals the node's block stack, the
+   //next update swaps the chain
+   std::shared_ptr<HeaderSnapshot> headerSnapshot_;
+   std::future<bool> snapshotCheck_;
+   std::shared_ptr<BitcoinNodeInterface> processNode_;
+
+   //map of the blk file the node appends to, kept between updates
+   std::mutex tailMutex_;
+   std::shared_ptr<BlockDataFileMap> tailMap_;
+   uint16_t tailFileID_ = UINT16_MAX;
+
 private:
    BlockOffset loadBlockHeadersFromDB(const ProgressCallback &progress);
+   bool loadHeaderSnapshot(Blockchain::ReorganizationState&);
+   void startHeaderSnapshotCheck(void);
+   bool headerSnapshotFailed(void);
    
+   std::shared_ptr<BlockDataFileMap> getBlockFileMap(
+      BlockDataLoader&, uint16_t fileID);
    bool addBlocksToDB(
       BlockDataLoader& bdl, uint16_t fileID, size_t startOffset,
       std::shared_ptr<BlockOffset> bo, bool fullHints);
@@ -75,4 +97,7 @@ public:
    unsigned getCheckedTxCount(void) const { return checkedTransactions_; }
 
    void verifyTxFilters(void);
+
+   //snapshot of the organized chain for the next start, call on shutdown
+   void writeHeaderSnapshot(void);
 };
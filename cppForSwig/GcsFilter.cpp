@@ -0,0 +1,314 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "GcsFilter.h"
+#include "BinaryData.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+static inline uint64_t rotl64(uint64_t x, int b)
+{
+   return (x << b) | (x >> (64 - b));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline void sipRound(
+   uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3)
+{
+   v0 += v1; v1 = rotl64(v1, 13); v1 ^= v0; v0 = rotl64(v0, 32);
+   v2 += v3; v3 = rotl64(v3, 16); v3 ^= v2;
+   v0 += v3; v3 = rotl64(v3, 21); v3 ^= v0;
+   v2 += v1; v1 = rotl64(v1, 17); v1 ^= v2; v2 = rotl64(v2, 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static uint64_t sipHash24(uint64_t k0, uint64_t k1, BinaryDataRef data)
+{
+   uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+   uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+   uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+   uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+   auto ptr = data.getPtr();
+   auto len = data.getSize();
+   auto end = ptr + (len & ~(size_t)7);
+
+   for (; ptr != end; ptr += 8)
+   {
+      uint64_t m = 0;
+      for (unsigned i = 0; i < 8; i++)
+         m |= (uint64_t)ptr[i] << (8 * i);
+
+      v3 ^= m;
+      sipRound(v0, v1, v2, v3);
+      sipRound(v0, v1, v2, v3);
+      v0 ^= m;
+   }
+
+   uint64_t b = (uint64_t)len << 56;
+   for (unsigned i = 0; i < (len & 7); i++)
+      b |= (uint64_t)ptr[i] << (8 * i);
+
+   v3 ^= b;
+   sipRound(v0, v1, v2, v3);
+   sipRound(v0, v1, v2, v3);
+   v0 ^= b;
+
+   v2 ^= 0xff;
+   for (unsigned i = 0; i < 4; i++)
+      sipRound(v0, v1, v2, v3);
+
+   return v0 ^ v1 ^ v2 ^ v3;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline uint64_t mulHigh64(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+   return (uint64_t)(((unsigned __int128)a * b) >> 64);
+#else
+   uint64_t aLo = (uint32_t)a, aHi = a >> 32;
+   uint64_t bLo = (uint32_t)b, bHi = b >> 32;
+
+   uint64_t lolo = aLo * bLo;
+   uint64_t hilo = aHi * bLo;
+   uint64_t lohi = aLo * bHi;
+   uint64_t hihi = aHi * bHi;
+
+   uint64_t mid = (lolo >> 32) + (uint32_t)hilo + (uint32_t)lohi;
+   return hihi + (hilo >> 32) + (lohi >> 32) + (mid >> 32);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+   //msb first
+   class BitWriter
+   {
+   private:
+      vector<uint8_t> data_;
+      uint8_t current_ = 0;
+      unsigned bits_ = 0;
+
+   public:
+      void write(uint64_t val, unsigned count)
+      {
+         while (count > 0)
+         {
+            auto chunk = min(8 - bits_, count);
+            auto shift = count - chunk;
+            current_ |=
+               ((val >> shift) & ((1U << chunk) - 1)) << (8 - bits_ - chunk);
+            bits_ += chunk;
+            count -= chunk;
+
+            if (bits_ == 8)
+            {
+               data_.push_back(current_);
+               current_ = 0;
+               bits_ = 0;
+            }
+         }
+      }
+
+      void golombEncode(uint64_t val)
+      {
+         auto q = val >> GCS_FILTER_P;
+         while (q > 0)
+         {
+            auto ones = (unsigned)min(q, (uint64_t)32);
+            write(0xFFFFFFFFULL, ones);
+            q -= ones;
+         }
+
+         write(0, 1);
+         write(val, GCS_FILTER_P);
+      }
+
+      const vector<uint8_t>& flush(void)
+      {
+         if (bits_ > 0)
+         {
+            data_.push_back(current_);
+            current_ = 0;
+            bits_ = 0;
+         }
+
+         return data_;
+      }
+   };
+
+   ////
+   class BitReader
+   {
+   private:
+      const uint8_t* ptr_;
+      const uint8_t* end_;
+      unsigned bits_ = 0;
+
+   public:
+      BitReader(BinaryDataRef data) :
+         ptr_(data.getPtr()), end_(data.getPtr() + data.getSize())
+      {}
+
+      uint64_t read(unsigned count)
+      {
+         uint64_t val = 0;
+         while (count > 0)
+         {
+            if (ptr_ == end_)
+               throw runtime_error("gcs filter overrun");
+
+            auto chunk = min(8 - bits_, count);
+            auto bits = (*ptr_ >> (8 - bits_ - chunk)) & ((1U << chunk) - 1);
+            val = (val << chunk) | bits;
+
+            bits_ += chunk;
+            count -= chunk;
+
+            if (bits_ == 8)
+            {
+               ++ptr_;
+               bits_ = 0;
+            }
+         }
+
+         return val;
+      }
+
+      uint64_t golombDecode(void)
+      {
+         uint64_t q = 0;
+         while (read(1) == 1)
+            ++q;
+
+         return (q << GCS_FILTER_P) | read(GCS_FILTER_P);
+      }
+   };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GcsFilter::GcsFilter(const BinaryData& blockHash, BinaryDataRef data) :
+   data_(data)
+{
+   setKey(blockHash);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GcsFilter::setKey(const BinaryData& blockHash)
+{
+   if (blockHash.getSize() < 16)
+      throw runtime_error("invalid gcs filter key");
+
+   k0_ = READ_UINT64_LE(blockHash.getPtr());
+   k1_ = READ_UINT64_LE(blockHash.getPtr() + 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData GcsFilter::build(const BinaryData& blockHash,
+   const vector<BinaryDataRef>& items)
+{
+   GcsFilter filter;
+   filter.setKey(blockHash);
+
+   //N counts distinct items
+   auto uniqueItems = items;
+   sort(uniqueItems.begin(), uniqueItems.end());
+   uniqueItems.erase(
+      unique(uniqueItems.begin(), uniqueItems.end()), uniqueItems.end());
+
+   uint64_t n = uniqueItems.size();
+   auto range = n * GCS_FILTER_M;
+
+   vector<uint64_t> values;
+   values.reserve(n);
+   for (auto& item : uniqueItems)
+      values.push_back(mulHigh64(sipHash24(filter.k0_, filter.k1_, item), range));
+   sort(values.begin(), values.end());
+
+   BitWriter bits;
+   uint64_t last = 0;
+   for (auto& val : values)
+   {
+      bits.golombEncode(val - last);
+      last = val;
+   }
+
+   auto& coded = bits.flush();
+
+   BinaryWriter bw;
+   bw.put_var_int(n);
+   if (coded.size() > 0)
+      bw.put_BinaryData(coded.data(), coded.size());
+
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t GcsFilter::getItemCount() const
+{
+   if (data_.getSize() == 0)
+      return 0;
+
+   BinaryRefReader brr(data_.getRef());
+   return brr.get_var_int();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GcsFilter::match(BinaryDataRef item) const
+{
+   vector<BinaryDataRef> items;
+   items.push_back(item);
+   return matchAny(items);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GcsFilter::matchAny(const vector<BinaryDataRef>& items) const
+{
+   if (data_.getSize() == 0 || items.size() == 0)
+      return false;
+
+   BinaryRefReader brr(data_.getRef());
+   uint64_t n = brr.get_var_int();
+   if (n == 0)
+      return false;
+
+   auto range = n * GCS_FILTER_M;
+
+   vector<uint64_t> query;
+   query.reserve(items.size());
+   for (auto& item : items)
+      query.push_back(mulHigh64(sipHash24(k0_, k1_, item), range));
+   sort(query.begin(), query.end());
+
+   //walk both sorted sets
+   BitReader bits(brr.get_BinaryDataRef((uint32_t)brr.getSizeRemaining()));
+   auto queryIter = query.begin();
+   uint64_t val = 0;
+
+   for (uint64_t i = 0; i < n; i++)
+   {
+      val += bits.golombDecode();
+
+      while (*queryIter < val)
+      {
+         if (++queryIter == query.end())
+            return false;
+      }
+
+      if (*queryIter == val)
+         return true;
+   }
+
+   return false;
+}
@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_GCSFILTER
+#define _H_GCSFILTER
+
+#include <vector>
+
+#include "BinaryData.h"
+
+/*
+Golomb coded set of the items touched by a block, as in BIP158: items are
+siphashed with a key taken from the block hash, mapped to [0, N * M),
+sorted, and the deltas are Golomb-Rice coded with parameter P. False
+positives come up at 1/M per queried item, there are no false negatives.
+
+The scanner stores one per block in BLKFILTERS, with the scrAddr of each
+txout and the outpoint (hash | index) of each txin as items. Scans for a
+small set of addresses test these before deserializing the block.
+
+Serialized as varint N | coded deltas.
+*/
+
+#define GCS_FILTER_P 19
+#define GCS_FILTER_M 784931
+
+////////////////////////////////////////////////////////////////////////////////
+class GcsFilter
+{
+private:
+   BinaryData data_;
+   uint64_t k0_ = 0;
+   uint64_t k1_ = 0;
+
+private:
+   void setKey(const BinaryData& blockHash);
+
+public:
+   GcsFilter(void) {}
+   GcsFilter(const BinaryData& blockHash, BinaryDataRef data);
+
+   static BinaryData build(const BinaryData& blockHash,
+      const std::vector<BinaryDataRef>& items);
+
+   //true if any of the items may be in the set
+   bool matchAny(const std::vector<BinaryDataRef>& items) const;
+   bool match(BinaryDataRef item) const;
+
+   uint64_t getItemCount(void) const;
+   const BinaryData& getData(void) const { return data_; }
+};
+
+#endif
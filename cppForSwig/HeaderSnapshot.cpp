@@ -0,0 +1,291 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include "HeaderSnapshot.h"
+
+using namespace std;
+
+#define HEADERSNAPSHOT_MAGIC 0x706e7368 //"hsnp"
+#define HEADERSNAPSHOT_HEADER_SIZE 52
+
+#define HEADERSNAPSHOT_MAINBRANCH   0x01
+#define HEADERSNAPSHOT_ORPHAN       0x02
+#define HEADERSNAPSHOT_FINISHEDCALC 0x04
+
+////////////////////////////////////////////////////////////////////////////////
+HeaderSnapshot::HeaderSnapshot(const string& path)
+{
+   fileMap_ = DBUtils::getMmapOfFile(path);
+   if (fileMap_.size_ < HEADERSNAPSHOT_HEADER_SIZE)
+   {
+      fileMap_.unmap();
+      throw HeaderSnapshotException("header snapshot file is too short");
+   }
+
+   BinaryRefReader brr(fileMap_.filePtr_, HEADERSNAPSHOT_HEADER_SIZE);
+   auto magic = brr.get_uint32_t();
+   auto version = brr.get_uint32_t();
+   count_ = brr.get_uint32_t();
+   tipHash_ = brr.get_BinaryDataRef(32);
+   auto checksum = brr.get_uint64_t();
+
+   size_t recordsSize = (size_t)count_ * HEADERSNAPSHOT_RECORD_SIZE;
+   if (magic != HEADERSNAPSHOT_MAGIC || version != HEADERSNAPSHOT_VERSION ||
+      fileMap_.size_ != HEADERSNAPSHOT_HEADER_SIZE + recordsSize)
+   {
+      fileMap_.unmap();
+      throw HeaderSnapshotException("invalid header snapshot file");
+   }
+
+   records_ = fileMap_.filePtr_ + HEADERSNAPSHOT_HEADER_SIZE;
+   if (getChecksum(records_, recordsSize) != checksum)
+   {
+      fileMap_.unmap();
+      throw HeaderSnapshotException("header snapshot checksum mismatch");
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+HeaderSnapshot::~HeaderSnapshot()
+{
+   try
+   {
+      fileMap_.unmap();
+   }
+   catch (runtime_error&)
+   {}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t HeaderSnapshot::getChecksum(const uint8_t* ptr, size_t size)
+{
+   /***
+   This guards against truncated and damaged files, not tampering. A
+   cryptographic hash over the records would cost about as much as
+   hashing the headers, which is what the snapshot saves us from.
+   ***/
+
+   uint64_t sum = 0xcbf29ce484222325ULL;
+   size_t i = 0;
+   for (; i + 8 <= size; i += 8)
+   {
+      uint64_t word;
+      memcpy(&word, ptr + i, 8);
+      sum = (sum ^ word) * 0x100000001b3ULL;
+      sum ^= sum >> 29;
+   }
+
+   for (; i < size; i++)
+      sum = (sum ^ ptr[i]) * 0x100000001b3ULL;
+
+   return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef HeaderSnapshot::getRecord(size_t i) const
+{
+   if (i >= count_)
+      throw HeaderSnapshotException("header snapshot record out of range");
+
+   return BinaryDataRef(
+      records_ + i * HEADERSNAPSHOT_RECORD_SIZE, HEADERSNAPSHOT_RECORD_SIZE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef HeaderSnapshot::getHash(size_t i) const
+{
+   return getRecord(i).getSliceRef(HEADER_SIZE, 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<BlockHeader> HeaderSnapshot::getHeader(size_t i) const
+{
+   BinaryRefReader brr(getRecord(i));
+   auto header = make_shared<BlockHeader>();
+
+   header->dataCopy_ = brr.get_BinaryData(HEADER_SIZE);
+   header->thisHash_ = brr.get_BinaryData(32);
+   header->isInitialized_ = true;
+   header->difficultyDbl_ = BtcUtils::convertDiffBitsToDouble(
+      header->getDiffBitsRef());
+
+   header->blockHeight_ = brr.get_uint32_t();
+   header->uniqueID_ = brr.get_uint32_t();
+   header->blkFileNum_ = brr.get_uint32_t();
+   header->blkFileOffset_ = brr.get_uint64_t();
+   header->numTx_ = brr.get_uint32_t();
+   header->numBlockBytes_ = brr.get_uint32_t();
+
+   auto diffSum = brr.get_uint64_t();
+   memcpy(&header->difficultySum_, &diffSum, sizeof(double));
+
+   header->duplicateID_ = brr.get_uint8_t();
+   auto flags = brr.get_uint8_t();
+   header->isMainBranch_ = (flags & HEADERSNAPSHOT_MAINBRANCH) != 0;
+   header->isOrphan_ = (flags & HEADERSNAPSHOT_ORPHAN) != 0;
+   header->isFinishedCalc_ = (flags & HEADERSNAPSHOT_FINISHEDCALC) != 0;
+
+   return header;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool HeaderSnapshot::matches(size_t i, const StoredHeader& sbh) const
+{
+   /***
+   Heights are left out, organizing the chain recomputes them. Everything
+   the HEADERS db is the authority for has to match.
+   ***/
+
+   BinaryRefReader brr(getRecord(i));
+   if (brr.get_BinaryDataRef(HEADER_SIZE) != sbh.dataCopy_.getRef())
+      return false;
+   if (brr.get_BinaryDataRef(32) != sbh.thisHash_.getRef())
+      return false;
+
+   brr.advance(4);
+   if (brr.get_uint32_t() != sbh.uniqueID_ ||
+      brr.get_uint32_t() != sbh.fileID_ ||
+      brr.get_uint64_t() != sbh.offset_ ||
+      brr.get_uint32_t() != sbh.numTx_ ||
+      brr.get_uint32_t() != sbh.numBytes_)
+      return false;
+
+   brr.advance(8);
+   return brr.get_uint8_t() == sbh.duplicateID_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderSnapshot::write(const string& path,
+   vector<shared_ptr<BlockHeader>>& headers, const BinaryData& tipHash)
+{
+   if (tipHash.getSize() != 32)
+      throw HeaderSnapshotException("invalid tip hash");
+
+   sort(headers.begin(), headers.end(),
+      [](const shared_ptr<BlockHeader>& lhs,
+         const shared_ptr<BlockHeader>& rhs)->bool
+   {
+      return lhs->getThisHash() < rhs->getThisHash();
+   });
+
+   BinaryWriter records;
+   records.reserve(headers.size() * HEADERSNAPSHOT_RECORD_SIZE);
+   for (auto& header : headers)
+   {
+      if (header->dataCopy_.getSize() != HEADER_SIZE)
+         throw HeaderSnapshotException("cannot snapshot incomplete header");
+
+      records.put_BinaryData(header->dataCopy_);
+      records.put_BinaryData(header->thisHash_);
+      records.put_uint32_t(header->blockHeight_);
+      records.put_uint32_t(header->uniqueID_);
+      records.put_uint32_t(header->blkFileNum_);
+      records.put_uint64_t(header->blkFileOffset_);
+      records.put_uint32_t(header->numTx_);
+      records.put_uint32_t(header->numBlockBytes_);
+
+      uint64_t diffSum;
+      memcpy(&diffSum, &header->difficultySum_, sizeof(double));
+      records.put_uint64_t(diffSum);
+
+      records.put_uint8_t(header->duplicateID_);
+
+      uint8_t flags = 0;
+      if (header->isMainBranch_)
+         flags |= HEADERSNAPSHOT_MAINBRANCH;
+      if (header->isOrphan_)
+         flags |= HEADERSNAPSHOT_ORPHAN;
+      if (header->isFinishedCalc_)
+         flags |= HEADERSNAPSHOT_FINISHEDCALC;
+      records.put_uint8_t(flags);
+   }
+
+   auto recordsRef = records.getDataRef();
+
+   BinaryWriter bw;
+   bw.put_uint32_t(HEADERSNAPSHOT_MAGIC);
+   bw.put_uint32_t(HEADERSNAPSHOT_VERSION);
+   bw.put_uint32_t(headers.size());
+   bw.put_BinaryData(tipHash);
+   bw.put_uint64_t(getChecksum(recordsRef.getPtr(), recordsRef.getSize()));
+
+   /***
+   The live snapshot is never written in place: a crash halfway through
+   would leave a truncated file behind, or none at all. Write a temp file,
+   flush it to disk, then swap it in.
+   ***/
+   auto tempPath = path + ".tmp";
+   try
+   {
+      {
+         ofstream file(tempPath, ios::binary | ios::trunc);
+         if (!file.is_open())
+            throw HeaderSnapshotException(
+               "failed to open header snapshot file");
+
+         auto headerRef = bw.getDataRef();
+         file.write((const char*)headerRef.getPtr(), headerRef.getSize());
+         file.write((const char*)recordsRef.getPtr(), recordsRef.getSize());
+         file.close();
+         if (!file.good())
+            throw HeaderSnapshotException(
+               "failed to write header snapshot file");
+      }
+
+      syncFile(tempPath);
+
+#ifdef _WIN32
+      //rename does not overwrite on windows
+      remove(path.c_str());
+#endif
+      if (rename(tempPath.c_str(), path.c_str()) != 0)
+         throw HeaderSnapshotException(
+            "failed to rename header snapshot file");
+   }
+   catch (...)
+   {
+      remove(tempPath.c_str());
+      throw;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HeaderSnapshot::syncFile(const string& path)
+{
+#ifdef _WIN32
+   auto fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+   if (fd == -1)
+      throw HeaderSnapshotException("failed to reopen header snapshot file");
+
+   auto result = _commit(fd);
+   _close(fd);
+#else
+   auto fd = open(path.c_str(), O_WRONLY);
+   if (fd == -1)
+      throw HeaderSnapshotException("failed to reopen header snapshot file");
+
+   auto result = fsync(fd);
+   close(fd);
+#endif
+
+   if (result != 0)
+      throw HeaderSnapshotException("failed to sync header snapshot file");
+}
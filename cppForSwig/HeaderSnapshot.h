@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_HEADERSNAPSHOT
+#define _H_HEADERSNAPSHOT
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+#include "BinaryData.h"
+#include "DBUtils.h"
+#include "StoredBlockObj.h"
+
+/*
+Flat copy of the organized chain, written on clean shutdown and mmapped on
+the next start in place of reading and organizing the HEADERS db. Records
+carry the header hash and chain state, so loading does no hashing and the
+chain doesn't need organizing.
+
+Records are sorted by hash, in the order the HEADERS db iterates them, so
+the snapshot can be checked against the db in a single pass.
+
+On disk layout:
+   magic (4) | version (4) | record count (4) | tip hash (32) |
+   checksum (8) | records (count x 150)
+
+   record:
+   raw header (80) | hash (32) | height (4) | id (4) | file num (4) |
+   file offset (8) | tx count (4) | block size (4) | difficulty sum (8) |
+   dup id (1) | flags (1)
+*/
+
+#define HEADERSNAPSHOT_FILENAME "headersnapshot"
+#define HEADERSNAPSHOT_VERSION 1
+#define HEADERSNAPSHOT_RECORD_SIZE 150
+
+////////////////////////////////////////////////////////////////////////////////
+class HeaderSnapshotException : public std::runtime_error
+{
+public:
+   HeaderSnapshotException(const std::string& err) :
+      std::runtime_error(err)
+   {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class HeaderSnapshot
+{
+private:
+   FileMap fileMap_;
+
+   uint32_t count_ = 0;
+   BinaryDataRef tipHash_;
+   const uint8_t* records_ = nullptr;
+
+private:
+   static void syncFile(const std::string&);
+
+public:
+   //mmaps the snapshot at path, throws on missing or invalid files
+   HeaderSnapshot(const std::string& path);
+   ~HeaderSnapshot(void);
+
+   size_t size(void) const { return count_; }
+   BinaryDataRef getTipHash(void) const { return tipHash_; }
+
+   BinaryDataRef getRecord(size_t) const;
+   BinaryDataRef getHash(size_t) const;
+
+   //header for the record at this index, with the chain state it was
+   //saved with
+   std::shared_ptr<BlockHeader> getHeader(size_t) const;
+
+   //true if the HEADERS db entry for hash carries the same header as
+   //the record at this index
+   bool matches(size_t, const StoredHeader&) const;
+
+   //sorts headers by hash and writes them to path. The file is written
+   //next to path and renamed over it once on disk, a failed write leaves
+   //the existing snapshot untouched
+   static void write(const std::string& path,
+      std::vector<std::shared_ptr<BlockHeader>>& headers,
+      const BinaryData& tipHash);
+
+   static uint64_t getChecksum(const uint8_t*, size_t);
+};
+
+#endif
@@ -306,12 +306,12 @@ map<BinaryData, LedgerEntry> LedgerEntry::computeLedgerMap(
          try
          {
             //grab tx by hash
-            auto&& payout_tx = db->getFullTxCopy(txioVec.first);
+            auto payout_tx = db->getFullTxPtr(txioVec.first);
          
             //get scrAddr for each txout
-            for (unsigned i=0; i < payout_tx.getNumTxOut(); i++)
+            for (unsigned i=0; i < payout_tx->getNumTxOut(); i++)
             {
-               auto&& txout = payout_tx.getTxOutCopy(i);
+               auto&& txout = payout_tx->getTxOutCopy(i);
                scrAddrSet.insert(txout.getScrAddressStr());
             }
          }
@@ -0,0 +1,212 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+
+#include "ScanPipeline.h"
+
+using namespace std;
+using namespace ArmoryThreading;
+
+////////////////////////////////////////////////////////////////////////////////
+ScanPipeline::ScanPipeline(unsigned threadCount) :
+   threadCount_(threadCount == 0 ? 1 : threadCount)
+{
+   //run() callers work too, keep one thread for them
+   auto workerLambda = [this](void)->void
+   {
+      while (true)
+      {
+         shared_ptr<Job> job;
+         try
+         {
+            job = move(jobQueue_.pop_front());
+         }
+         catch (StopBlockingLoop&)
+         {
+            break;
+         }
+
+         runJob(job);
+      }
+   };
+
+   for (unsigned i = 1; i < threadCount_; i++)
+      workers_.push_back(thread(workerLambda));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ScanPipeline::~ScanPipeline()
+{
+   jobQueue_.terminate();
+   for (auto& thr : workers_)
+   {
+      if (thr.joinable())
+         thr.join();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanPipeline::runJob(shared_ptr<Job> job)
+{
+   {
+      //the caller is done, whatever is left was claimed already
+      unique_lock<mutex> lock(job->mu_);
+      if (job->closed_)
+         return;
+      ++job->active_;
+   }
+
+   exception_ptr except = nullptr;
+   auto start = chrono::steady_clock::now();
+   try
+   {
+      job->work_();
+   }
+   catch (...)
+   {
+      except = current_exception();
+   }
+
+   auto ns = chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - start);
+
+   {
+      unique_lock<mutex> lock(job->mu_);
+      job->workerNs_ += ns.count();
+      if (except != nullptr && job->except_ == nullptr)
+         job->except_ = except;
+      --job->active_;
+   }
+
+   job->condVar_.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned ScanPipeline::allocate(ScanStage stage) const
+{
+   //no history yet, take everything
+   if (cost_[stage] <= 0)
+      return threadCount_;
+
+   double total = 0;
+   for (unsigned i = 0; i < ScanStage_Count; i++)
+   {
+      if (running_[i] > 0)
+         total += cost_[i];
+   }
+
+   auto count = (unsigned)(threadCount_ * cost_[stage] / total + 0.5);
+   if (count == 0)
+      return 1;
+   if (count > threadCount_)
+      return threadCount_;
+   return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanPipeline::run(ScanStage stage, const function<void(void)>& work)
+{
+   unsigned count;
+   {
+      unique_lock<mutex> lock(statsMutex_);
+      ++running_[stage];
+      count = allocate(stage);
+      stats_[stage].lastWorkers_ = count;
+   }
+
+   auto job = make_shared<Job>();
+   job->work_ = work;
+
+   for (unsigned i = 1; i < count; i++)
+   {
+      auto jobCopy = job;
+      jobQueue_.push_back(move(jobCopy));
+   }
+
+   runJob(job);
+
+   {
+      //copies that haven't started yet have nothing left to do
+      unique_lock<mutex> lock(job->mu_);
+      job->closed_ = true;
+      while (job->active_ > 0)
+         job->condVar_.wait(lock);
+   }
+
+   {
+      unique_lock<mutex> lock(statsMutex_);
+      --running_[stage];
+      pendingNs_[stage] += job->workerNs_;
+   }
+
+   if (job->except_ != nullptr)
+      rethrow_exception(job->except_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanPipeline::record(ScanStage stage, uint64_t wallNs)
+{
+   unique_lock<mutex> lock(statsMutex_);
+
+   auto& stats = stats_[stage];
+   ++stats.batches_;
+   stats.wallNs_ += wallNs;
+   stats.lastWallNs_ = wallNs;
+
+   //stages that never called run() worked on their driver alone
+   auto workerNs = pendingNs_[stage];
+   if (workerNs == 0)
+   {
+      workerNs = wallNs;
+      stats.lastWorkers_ = 1;
+   }
+
+   stats.workerNs_ += workerNs;
+   pendingNs_[stage] = 0;
+
+   if (cost_[stage] <= 0)
+      cost_[stage] = (double)workerNs;
+   else
+      cost_[stage] = cost_[stage] * 0.7 + workerNs * 0.3;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ScanStageStats ScanPipeline::getStats(ScanStage stage) const
+{
+   unique_lock<mutex> lock(statsMutex_);
+   return stats_[stage];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const char* ScanPipeline::getStageName(ScanStage stage)
+{
+   switch (stage)
+   {
+   case ScanStage_Read:
+      return "read";
+
+   case ScanStage_Parse:
+      return "parse";
+
+   case ScanStage_Outputs:
+      return "outputs";
+
+   case ScanStage_Inputs:
+      return "inputs";
+
+   case ScanStage_Serialize:
+      return "serialize";
+
+   case ScanStage_Commit:
+      return "commit";
+
+   default:
+      return "unknown";
+   }
+}
@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_SCANPIPELINE
+#define _H_SCANPIPELINE
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ThreadSafeClasses.h"
+
+//batches queued between 2 stages
+#define SCAN_STAGE_QUEUE_DEPTH 2
+
+enum ScanStage
+{
+   ScanStage_Read = 0,
+   ScanStage_Parse,
+   ScanStage_Outputs,
+   ScanStage_Inputs,
+   ScanStage_Serialize,
+   ScanStage_Commit,
+   ScanStage_Count
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct ScanStageStats
+{
+   uint64_t batches_ = 0;
+
+   //time spent on batches by the stage driver
+   uint64_t wallNs_ = 0;
+
+   //summed over the workers the stage ran on
+   uint64_t workerNs_ = 0;
+
+   uint64_t lastWallNs_ = 0;
+   unsigned lastWorkers_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class ScanPipeline
+{
+   /***
+   Worker pool shared by the scanner stages. Each stage has a driver thread
+   that handles one batch at a time and fans the batch work out with run().
+
+   Work functions have to pull their work items from the batch (atomic
+   counters) and only return once there is nothing left to claim, so that
+   they can run on any number of workers.
+
+   Workers are handed out in proportion to the worker time each stage took
+   on previous batches, among the stages that are running at that point.
+   The bottleneck stage ends up with the most threads.
+   ***/
+
+private:
+   struct Job
+   {
+      std::function<void(void)> work_;
+
+      std::mutex mu_;
+      std::condition_variable condVar_;
+      unsigned active_ = 0;
+      bool closed_ = false;
+
+      uint64_t workerNs_ = 0;
+      std::exception_ptr except_ = nullptr;
+   };
+
+private:
+   const unsigned threadCount_;
+   std::vector<std::thread> workers_;
+   ArmoryThreading::BlockingQueue<std::shared_ptr<Job>> jobQueue_;
+
+   mutable std::mutex statsMutex_;
+   ScanStageStats stats_[ScanStage_Count];
+   unsigned running_[ScanStage_Count] = {};
+
+   //worker ns per batch, moving average
+   double cost_[ScanStage_Count] = {};
+
+   //worker ns of the batch in flight
+   uint64_t pendingNs_[ScanStage_Count] = {};
+
+private:
+   void runJob(std::shared_ptr<Job>);
+   unsigned allocate(ScanStage) const;
+
+public:
+   ScanPipeline(unsigned threadCount);
+   ~ScanPipeline(void);
+
+   //runs work on a share of the pool and the calling thread, returns once
+   //every copy is done. Rethrows the first exception a copy threw.
+   void run(ScanStage, const std::function<void(void)>&);
+
+   //stage drivers report each batch they are done with
+   void record(ScanStage, uint64_t wallNs);
+
+   ScanStageStats getStats(ScanStage) const;
+   unsigned getThreadCount(void) const { return threadCount_; }
+
+   static const char* getStageName(ScanStage);
+};
+
+#endif
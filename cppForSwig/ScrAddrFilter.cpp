@@ -448,18 +448,38 @@ void ScrAddrFilter::getAllScrAddrInDB()
    map<BinaryDataRef, shared_ptr<AddrAndHash>> scrAddrMap;
 
    //iterate over ssh DB
-   while(dbIter->advanceAndRead(DB_PREFIX_SCRIPT))
+   if (dbIter->seekToStartsWith(DB_PREFIX_SCRIPT))
    {
-      StoredScriptHistory ssh;
-      ssh.unserializeDBKey(dbIter->getKeyRef());
-      ssh.unserializeDBValue(dbIter->getValueReader());
-
-      auto aah = make_shared<AddrAndHash>(ssh.uniqueKey_.getRef());
-      aah->scannedHeight_ = ssh.scanHeight_;
-      
-      scrAddrMap.insert(
-         move(make_pair(aah->scrAddr_.getRef(), aah)));
-   } 
+      vector<LDBIterSpan> spans(LDBITER_BATCH_SIZE);
+      bool done = false;
+      while (!done)
+      {
+         auto count = dbIter->readBatch(
+            spans.data(), spans.size(), LDBITER_PREFETCH_BYTES);
+         if (count == 0)
+            break;
+
+         for (size_t i = 0; i < count; i++)
+         {
+            auto& span = spans[i];
+            if (span.key_.getPtr()[0] != DB_PREFIX_SCRIPT)
+            {
+               done = true;
+               break;
+            }
+
+            StoredScriptHistory ssh;
+            ssh.unserializeDBKey(span.key_);
+            ssh.unserializeDBValue(span.value_);
+
+            auto aah = make_shared<AddrAndHash>(ssh.uniqueKey_.getRef());
+            aah->scannedHeight_ = ssh.scanHeight_;
+
+            scrAddrMap.insert(
+               move(make_pair(aah->scrAddr_.getRef(), aah)));
+         }
+      }
+   }
 
    //the zc filter map is only update once when users register address explictly
    scanFilterAddrMap_->update(scrAddrMap);
@@ -210,6 +210,7 @@ public:
    virtual ~ScrAddrFilter() { shutdown(); }
    
    LMDBBlockDatabase* db() { return lmdb_; }
+   bool isSideScan(void) const { return sdbiKey_ == SIDESCAN_ID; }
 
    ////
    std::shared_ptr<const std::map<BinaryDataRef, std::shared_ptr<AddrAndHash>>>
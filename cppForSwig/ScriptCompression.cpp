@@ -0,0 +1,328 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include "ScriptCompression.h"
+
+using namespace std;
+
+atomic<bool> ScriptCompression::enabled_(false);
+
+////////////////////////////////////////////////////////////////////////////////
+static size_t getTemplateBodySize(uint8_t type)
+{
+   switch (type)
+   {
+   case SCRIPTCOMPRESSION_P2PKH:
+   case SCRIPTCOMPRESSION_P2SH:
+   case SCRIPTCOMPRESSION_P2WPKH:
+      return 20;
+
+   case SCRIPTCOMPRESSION_P2PK_EVEN:
+   case SCRIPTCOMPRESSION_P2PK_ODD:
+   case SCRIPTCOMPRESSION_P2WSH:
+      return 32;
+
+   default:
+      throw ScriptCompressionException("invalid script template");
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScriptCompression::setEnabled(bool val)
+{
+   enabled_.store(val, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ScriptCompression::isEnabled()
+{
+   return enabled_.load(memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t ScriptCompression::compressAmount(uint64_t n)
+{
+   //strip trailing zeroes into the exponent, fold the last non zero
+   //digit in base 9
+   if (n == 0)
+      return 0;
+
+   unsigned e = 0;
+   while ((n % 10) == 0 && e < 9)
+   {
+      n /= 10;
+      ++e;
+   }
+
+   if (e < 9)
+   {
+      auto d = n % 10;
+      n /= 10;
+      return 1 + (n * 9 + d - 1) * 10 + e;
+   }
+
+   return 1 + (n - 1) * 10 + 9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t ScriptCompression::decompressAmount(uint64_t x)
+{
+   if (x == 0)
+      return 0;
+
+   --x;
+   unsigned e = x % 10;
+   x /= 10;
+
+   uint64_t n = 0;
+   if (e < 9)
+   {
+      auto d = (x % 9) + 1;
+      x /= 9;
+      n = x * 10 + d;
+   }
+   else
+   {
+      n = x + 1;
+   }
+
+   while (e > 0)
+   {
+      n *= 10;
+      --e;
+   }
+
+   return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ScriptCompression::compressTxOut(BinaryWriter& bw, BinaryDataRef txout)
+{
+   if (txout.getSize() < 9)
+      return false;
+
+   BinaryRefReader brr(txout);
+   auto value = brr.get_uint64_t();
+   auto scriptLen = brr.get_var_int();
+   if (scriptLen != brr.getSizeRemaining())
+      return false;
+
+   //out of range amounts don't round trip
+   if (value > SCRIPTCOMPRESSION_MAX_MONEY)
+      return false;
+
+   auto script = brr.get_BinaryDataRef((uint32_t)scriptLen);
+   auto ptr = script.getPtr();
+
+   bw.put_var_int(compressAmount(value));
+
+   switch (script.getSize())
+   {
+   case 25:
+   {
+      if (ptr[0] == 0x76 && ptr[1] == 0xa9 && ptr[2] == 0x14 &&
+         ptr[23] == 0x88 && ptr[24] == 0xac)
+      {
+         bw.put_uint8_t(SCRIPTCOMPRESSION_P2PKH);
+         bw.put_BinaryDataRef(script.getSliceRef(3, 20));
+         return true;
+      }
+
+      break;
+   }
+
+   case 23:
+   {
+      if (ptr[0] == 0xa9 && ptr[1] == 0x14 && ptr[22] == 0x87)
+      {
+         bw.put_uint8_t(SCRIPTCOMPRESSION_P2SH);
+         bw.put_BinaryDataRef(script.getSliceRef(2, 20));
+         return true;
+      }
+
+      break;
+   }
+
+   case 35:
+   {
+      //the pubkey's first byte doubles as the template type
+      if (ptr[0] == 0x21 && ptr[34] == 0xac &&
+         (ptr[1] == 0x02 || ptr[1] == 0x03))
+      {
+         bw.put_BinaryDataRef(script.getSliceRef(1, 33));
+         return true;
+      }
+
+      break;
+   }
+
+   case 22:
+   {
+      if (ptr[0] == 0x00 && ptr[1] == 0x14)
+      {
+         bw.put_uint8_t(SCRIPTCOMPRESSION_P2WPKH);
+         bw.put_BinaryDataRef(script.getSliceRef(2, 20));
+         return true;
+      }
+
+      break;
+   }
+
+   case 34:
+   {
+      if (ptr[0] == 0x00 && ptr[1] == 0x20)
+      {
+         bw.put_uint8_t(SCRIPTCOMPRESSION_P2WSH);
+         bw.put_BinaryDataRef(script.getSliceRef(2, 32));
+         return true;
+      }
+
+      break;
+   }
+
+   default:
+      break;
+   }
+
+   //non template script, carry it as is
+   bw.put_var_int(script.getSize() + SCRIPTCOMPRESSION_SPECIALCOUNT);
+   bw.put_BinaryDataRef(script);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t ScriptCompression::readTxOut(
+   BinaryRefReader& brr, BinaryDataRef& templateRef)
+{
+   auto value = decompressAmount(brr.get_var_int());
+
+   //templates are a type byte and a fixed size body, raw scripts are
+   //prefixed with their offset size
+   auto start = brr.getCurrPtr();
+   auto type = brr.get_var_int();
+   size_t bodySize;
+   if (type < SCRIPTCOMPRESSION_SPECIALCOUNT)
+      bodySize = getTemplateBodySize((uint8_t)type);
+   else
+      bodySize = type - SCRIPTCOMPRESSION_SPECIALCOUNT;
+
+   if (brr.getSizeRemaining() < bodySize)
+      throw ScriptCompressionException("compressed txout is too short");
+
+   brr.advance((uint32_t)bodySize);
+   templateRef.setRef(start, brr.getCurrPtr());
+   return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData ScriptCompression::decompressTxOut(BinaryRefReader& brr)
+{
+   BinaryDataRef templateRef;
+   auto value = readTxOut(brr, templateRef);
+
+   BinaryRefReader brrTemplate(templateRef);
+   auto type = brrTemplate.get_var_int();
+   auto body = brrTemplate.get_BinaryDataRef(
+      (uint32_t)brrTemplate.getSizeRemaining());
+
+   BinaryWriter bw(8 + 1 + 35);
+   bw.put_uint64_t(value);
+
+   switch (type)
+   {
+   case SCRIPTCOMPRESSION_P2PKH:
+      bw.put_var_int(25);
+      bw.put_uint8_t(0x76);
+      bw.put_uint8_t(0xa9);
+      bw.put_uint8_t(0x14);
+      bw.put_BinaryDataRef(body);
+      bw.put_uint8_t(0x88);
+      bw.put_uint8_t(0xac);
+      break;
+
+   case SCRIPTCOMPRESSION_P2SH:
+      bw.put_var_int(23);
+      bw.put_uint8_t(0xa9);
+      bw.put_uint8_t(0x14);
+      bw.put_BinaryDataRef(body);
+      bw.put_uint8_t(0x87);
+      break;
+
+   case SCRIPTCOMPRESSION_P2PK_EVEN:
+   case SCRIPTCOMPRESSION_P2PK_ODD:
+      bw.put_var_int(35);
+      bw.put_uint8_t(0x21);
+      bw.put_BinaryDataRef(templateRef);
+      bw.put_uint8_t(0xac);
+      break;
+
+   case SCRIPTCOMPRESSION_P2WPKH:
+      bw.put_var_int(22);
+      bw.put_uint8_t(0x00);
+      bw.put_uint8_t(0x14);
+      bw.put_BinaryDataRef(body);
+      break;
+
+   case SCRIPTCOMPRESSION_P2WSH:
+      bw.put_var_int(34);
+      bw.put_uint8_t(0x00);
+      bw.put_uint8_t(0x20);
+      bw.put_BinaryDataRef(body);
+      break;
+
+   default:
+      bw.put_var_int(body.getSize());
+      bw.put_BinaryDataRef(body);
+   }
+
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData ScriptCompression::getScrAddr(BinaryDataRef templateRef)
+{
+   BinaryRefReader brr(templateRef);
+   auto type = brr.get_var_int();
+   auto body = brr.get_BinaryDataRef((uint32_t)brr.getSizeRemaining());
+
+   BinaryWriter bw(33);
+   switch (type)
+   {
+   case SCRIPTCOMPRESSION_P2PKH:
+      bw.put_uint8_t(NetworkConfig::getPubkeyHashPrefix());
+      bw.put_BinaryDataRef(body);
+      break;
+
+   case SCRIPTCOMPRESSION_P2SH:
+      bw.put_uint8_t(NetworkConfig::getScriptHashPrefix());
+      bw.put_BinaryDataRef(body);
+      break;
+
+   case SCRIPTCOMPRESSION_P2PK_EVEN:
+   case SCRIPTCOMPRESSION_P2PK_ODD:
+      //type byte and body are the pubkey
+      bw.put_uint8_t(NetworkConfig::getPubkeyHashPrefix());
+      bw.put_BinaryData(BtcUtils::getHash160(templateRef));
+      break;
+
+   case SCRIPTCOMPRESSION_P2WPKH:
+      bw.put_uint8_t(SCRIPT_PREFIX_P2WPKH);
+      bw.put_BinaryDataRef(body);
+      break;
+
+   case SCRIPTCOMPRESSION_P2WSH:
+      bw.put_uint8_t(SCRIPT_PREFIX_P2WSH);
+      bw.put_BinaryDataRef(body);
+      break;
+
+   default:
+      return BtcUtils::getTxOutScrAddrNoCopy(body).getScrAddr();
+   }
+
+   return bw.getData();
+}
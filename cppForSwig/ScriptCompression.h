@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_SCRIPTCOMPRESSION
+#define _H_SCRIPTCOMPRESSION
+
+#include <atomic>
+#include <stdexcept>
+
+#include "BtcUtils.h"
+
+/*
+Compact on disk encoding of txouts, in the spirit of Core's
+ScriptCompression/CompressAmount.
+
+Compressed txout layout:
+   var_int(compressed amount) | script template
+
+Script templates:
+   0x00 | hash160         P2PKH
+   0x01 | hash160         P2SH
+   0x02/0x03 | x coord    P2PK, compressed pubkey
+   0x04 | hash160         P2WPKH
+   0x05 | sha256          P2WSH
+   var_int(size + 6) | script, for everything else
+*/
+
+#define SCRIPTCOMPRESSION_P2PKH        0x00
+#define SCRIPTCOMPRESSION_P2SH         0x01
+#define SCRIPTCOMPRESSION_P2PK_EVEN    0x02
+#define SCRIPTCOMPRESSION_P2PK_ODD     0x03
+#define SCRIPTCOMPRESSION_P2WPKH       0x04
+#define SCRIPTCOMPRESSION_P2WSH        0x05
+#define SCRIPTCOMPRESSION_SPECIALCOUNT 6
+
+#define SCRIPTCOMPRESSION_MAX_MONEY    2100000000000000ULL
+
+////////////////////////////////////////////////////////////////////////////////
+class ScriptCompressionException : public std::runtime_error
+{
+public:
+   ScriptCompressionException(const std::string& err) :
+      std::runtime_error(err)
+   {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class ScriptCompression
+{
+private:
+   //set from the db version on open, legacy dbs keep the old encoding
+   static std::atomic<bool> enabled_;
+
+public:
+   static void setEnabled(bool);
+   static bool isEnabled(void);
+
+   static uint64_t compressAmount(uint64_t);
+   static uint64_t decompressAmount(uint64_t);
+
+   //false if the txout can't be compressed, nothing is written then
+   static bool compressTxOut(BinaryWriter&, BinaryDataRef txout);
+
+   //returns the txout in its regular serialized form
+   static BinaryData decompressTxOut(BinaryRefReader&);
+
+   //splits a compressed txout without decompressing the script,
+   //templateRef is only valid as long as the underlying data
+   static uint64_t readTxOut(BinaryRefReader&, BinaryDataRef& templateRef);
+
+   //scrAddr straight from the template, matches
+   //BtcUtils::getTxOutScrAddrNoCopy on the decompressed script
+   static BinaryData getScrAddr(BinaryDataRef templateRef);
+};
+
+#endif
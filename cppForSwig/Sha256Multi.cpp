@@ -0,0 +1,662 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <stdexcept>
+
+#include "Sha256Multi.h"
+
+#if defined(__x86_64__) || defined(__i386__) || \
+   defined(_M_X64) || defined(_M_IX86)
+#define SHA256_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//msvc lets any function use any intrinsic, gcc and clang need the
+//instruction set enabled per function
+#if defined(_MSC_VER)
+#define SHA256_TARGET(x)
+#else
+#define SHA256_TARGET(x) __attribute__((target(x)))
+#endif
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////
+static const uint32_t sha256K[64] =
+{
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+   0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+   0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+   0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+   0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+   0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+   0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+   0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+   0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256IV[8] =
+{
+   0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+//idle lanes hash this
+static const uint8_t zeroBlock[64] = { 0 };
+
+////////////////////////////////////////////////////////////////////////////////
+static inline uint32_t readBE32(const uint8_t* ptr)
+{
+   return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) |
+      ((uint32_t)ptr[2] << 8) | (uint32_t)ptr[3];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline void writeBE32(uint8_t* ptr, uint32_t val)
+{
+   ptr[0] = (uint8_t)(val >> 24);
+   ptr[1] = (uint8_t)(val >> 16);
+   ptr[2] = (uint8_t)(val >> 8);
+   ptr[3] = (uint8_t)val;
+}
+
+/*
+Kernels compress one 64 byte block per lane. The state of word w for lane l
+sits at state[w * lanes + l].
+*/
+typedef void(*Sha256Transform)(uint32_t*, const uint8_t* const*);
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// scalar
+////
+////////////////////////////////////////////////////////////////////////////////
+static inline uint32_t rotr32(uint32_t x, unsigned n)
+{
+   return (x >> n) | (x << (32 - n));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void transformScalar(uint32_t* state, const uint8_t* const* blocks)
+{
+   uint32_t w[64];
+   for (unsigned i = 0; i < 16; i++)
+      w[i] = readBE32(blocks[0] + i * 4);
+
+   for (unsigned i = 16; i < 64; i++)
+   {
+      auto s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      auto s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+   }
+
+   auto a = state[0], b = state[1], c = state[2], d = state[3];
+   auto e = state[4], f = state[5], g = state[6], h = state[7];
+
+   for (unsigned i = 0; i < 64; i++)
+   {
+      auto s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+      auto ch = (e & f) ^ (~e & g);
+      auto t1 = h + s1 + ch + sha256K[i] + w[i];
+      auto s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+      auto maj = (a & b) ^ (a & c) ^ (b & c);
+      auto t2 = s0 + maj;
+
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+   }
+
+   state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+   state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#ifdef SHA256_X86
+////////////////////////////////////////////////////////////////////////////////
+////
+//// SSE4.1, 4 lanes
+////
+////////////////////////////////////////////////////////////////////////////////
+#define ROTR_128(x, n) \
+   _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n))
+
+////////////////////////////////////////////////////////////////////////////////
+SHA256_TARGET("sse4.1")
+static void transformSSE4(uint32_t* state, const uint8_t* const* blocks)
+{
+   __m128i w[16];
+   for (unsigned i = 0; i < 16; i++)
+   {
+      w[i] = _mm_set_epi32(
+         readBE32(blocks[3] + i * 4), readBE32(blocks[2] + i * 4),
+         readBE32(blocks[1] + i * 4), readBE32(blocks[0] + i * 4));
+   }
+
+   __m128i s[8];
+   for (unsigned i = 0; i < 8; i++)
+      s[i] = _mm_loadu_si128((const __m128i*)(state + i * 4));
+
+   auto a = s[0], b = s[1], c = s[2], d = s[3];
+   auto e = s[4], f = s[5], g = s[6], h = s[7];
+
+   for (unsigned i = 0; i < 64; i++)
+   {
+      auto& wi = w[i & 15];
+      if (i >= 16)
+      {
+         auto w15 = w[(i - 15) & 15];
+         auto w2 = w[(i - 2) & 15];
+         auto s0 = _mm_xor_si128(_mm_xor_si128(
+            ROTR_128(w15, 7), ROTR_128(w15, 18)), _mm_srli_epi32(w15, 3));
+         auto s1 = _mm_xor_si128(_mm_xor_si128(
+            ROTR_128(w2, 17), ROTR_128(w2, 19)), _mm_srli_epi32(w2, 10));
+         wi = _mm_add_epi32(_mm_add_epi32(wi, s0),
+            _mm_add_epi32(w[(i - 7) & 15], s1));
+      }
+
+      auto s1 = _mm_xor_si128(_mm_xor_si128(
+         ROTR_128(e, 6), ROTR_128(e, 11)), ROTR_128(e, 25));
+      auto ch = _mm_xor_si128(_mm_and_si128(e, f), _mm_andnot_si128(e, g));
+      auto t1 = _mm_add_epi32(_mm_add_epi32(h, s1),
+         _mm_add_epi32(ch, _mm_add_epi32(
+            _mm_set1_epi32((int)sha256K[i]), wi)));
+      auto s0 = _mm_xor_si128(_mm_xor_si128(
+         ROTR_128(a, 2), ROTR_128(a, 13)), ROTR_128(a, 22));
+      auto maj = _mm_xor_si128(_mm_xor_si128(
+         _mm_and_si128(a, b), _mm_and_si128(a, c)), _mm_and_si128(b, c));
+      auto t2 = _mm_add_epi32(s0, maj);
+
+      h = g; g = f; f = e; e = _mm_add_epi32(d, t1);
+      d = c; c = b; b = a; a = _mm_add_epi32(t1, t2);
+   }
+
+   s[0] = _mm_add_epi32(s[0], a); s[1] = _mm_add_epi32(s[1], b);
+   s[2] = _mm_add_epi32(s[2], c); s[3] = _mm_add_epi32(s[3], d);
+   s[4] = _mm_add_epi32(s[4], e); s[5] = _mm_add_epi32(s[5], f);
+   s[6] = _mm_add_epi32(s[6], g); s[7] = _mm_add_epi32(s[7], h);
+
+   for (unsigned i = 0; i < 8; i++)
+      _mm_storeu_si128((__m128i*)(state + i * 4), s[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// AVX2, 8 lanes
+////
+////////////////////////////////////////////////////////////////////////////////
+#define ROTR_256(x, n) \
+   _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n))
+
+////////////////////////////////////////////////////////////////////////////////
+SHA256_TARGET("avx2")
+static void transformAVX2(uint32_t* state, const uint8_t* const* blocks)
+{
+   __m256i w[16];
+   for (unsigned i = 0; i < 16; i++)
+   {
+      w[i] = _mm256_set_epi32(
+         readBE32(blocks[7] + i * 4), readBE32(blocks[6] + i * 4),
+         readBE32(blocks[5] + i * 4), readBE32(blocks[4] + i * 4),
+         readBE32(blocks[3] + i * 4), readBE32(blocks[2] + i * 4),
+         readBE32(blocks[1] + i * 4), readBE32(blocks[0] + i * 4));
+   }
+
+   __m256i s[8];
+   for (unsigned i = 0; i < 8; i++)
+      s[i] = _mm256_loadu_si256((const __m256i*)(state + i * 8));
+
+   auto a = s[0], b = s[1], c = s[2], d = s[3];
+   auto e = s[4], f = s[5], g = s[6], h = s[7];
+
+   for (unsigned i = 0; i < 64; i++)
+   {
+      auto& wi = w[i & 15];
+      if (i >= 16)
+      {
+         auto w15 = w[(i - 15) & 15];
+         auto w2 = w[(i - 2) & 15];
+         auto s0 = _mm256_xor_si256(_mm256_xor_si256(
+            ROTR_256(w15, 7), ROTR_256(w15, 18)), _mm256_srli_epi32(w15, 3));
+         auto s1 = _mm256_xor_si256(_mm256_xor_si256(
+            ROTR_256(w2, 17), ROTR_256(w2, 19)), _mm256_srli_epi32(w2, 10));
+         wi = _mm256_add_epi32(_mm256_add_epi32(wi, s0),
+            _mm256_add_epi32(w[(i - 7) & 15], s1));
+      }
+
+      auto s1 = _mm256_xor_si256(_mm256_xor_si256(
+         ROTR_256(e, 6), ROTR_256(e, 11)), ROTR_256(e, 25));
+      auto ch = _mm256_xor_si256(
+         _mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      auto t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1),
+         _mm256_add_epi32(ch, _mm256_add_epi32(
+            _mm256_set1_epi32((int)sha256K[i]), wi)));
+      auto s0 = _mm256_xor_si256(_mm256_xor_si256(
+         ROTR_256(a, 2), ROTR_256(a, 13)), ROTR_256(a, 22));
+      auto maj = _mm256_xor_si256(_mm256_xor_si256(
+         _mm256_and_si256(a, b), _mm256_and_si256(a, c)),
+         _mm256_and_si256(b, c));
+      auto t2 = _mm256_add_epi32(s0, maj);
+
+      h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+      d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+   }
+
+   s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+   s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+   s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+   s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+
+   for (unsigned i = 0; i < 8; i++)
+      _mm256_storeu_si256((__m256i*)(state + i * 8), s[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// SHA extensions, 1 lane
+////
+////////////////////////////////////////////////////////////////////////////////
+SHA256_TARGET("sha,sse4.1")
+static void transformSHANI(uint32_t* state, const uint8_t* const* blocks)
+{
+   const __m128i byteSwap = _mm_set_epi64x(
+      0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+   //the rounds work on ABEF and CDGH
+   auto tmp = _mm_loadu_si128((const __m128i*)state);
+   auto state1 = _mm_loadu_si128((const __m128i*)(state + 4));
+
+   tmp = _mm_shuffle_epi32(tmp, 0xB1);
+   state1 = _mm_shuffle_epi32(state1, 0x1B);
+   auto state0 = _mm_alignr_epi8(tmp, state1, 8);
+   state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+   auto abefSave = state0;
+   auto cdghSave = state1;
+
+   __m128i msgs[4];
+   for (unsigned i = 0; i < 16; i++)
+   {
+      auto& current = msgs[i & 3];
+      if (i < 4)
+      {
+         current = _mm_shuffle_epi8(_mm_loadu_si128(
+            (const __m128i*)(blocks[0] + i * 16)), byteSwap);
+      }
+
+      auto msg = _mm_add_epi32(current,
+         _mm_loadu_si128((const __m128i*)(sha256K + i * 4)));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+      //extend the schedule for 4 rounds ahead
+      if (i >= 3 && i < 15)
+      {
+         auto& next = msgs[(i + 1) & 3];
+         tmp = _mm_alignr_epi8(current, msgs[(i - 1) & 3], 4);
+         next = _mm_add_epi32(next, tmp);
+         next = _mm_sha256msg2_epu32(next, current);
+      }
+
+      msg = _mm_shuffle_epi32(msg, 0x0E);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+      if (i >= 1 && i < 13)
+      {
+         auto& prev = msgs[(i - 1) & 3];
+         prev = _mm_sha256msg1_epu32(prev, current);
+      }
+   }
+
+   state0 = _mm_add_epi32(state0, abefSave);
+   state1 = _mm_add_epi32(state1, cdghSave);
+
+   //back to ABCD and EFGH
+   tmp = _mm_shuffle_epi32(state0, 0x1B);
+   state1 = _mm_shuffle_epi32(state1, 0xB1);
+   state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+   state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+   _mm_storeu_si128((__m128i*)state, state0);
+   _mm_storeu_si128((__m128i*)(state + 4), state1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// cpu features
+////
+////////////////////////////////////////////////////////////////////////////////
+struct CpuFeatures
+{
+   bool sse41_ = false;
+   bool avx2_ = false;
+   bool sha_ = false;
+
+   CpuFeatures(void)
+   {
+      uint32_t regs[4];
+      cpuid(0, 0, regs);
+      auto maxLeaf = regs[0];
+      if (maxLeaf < 1)
+         return;
+
+      cpuid(1, 0, regs);
+      sse41_ = (regs[2] & (1 << 19)) != 0;
+      bool ssse3 = (regs[2] & (1 << 9)) != 0;
+      bool osxsave = (regs[2] & (1 << 27)) != 0;
+      bool avx = (regs[2] & (1 << 28)) != 0;
+
+      //the os has to save the ymm registers
+      bool ymmState = false;
+      if (osxsave && avx)
+         ymmState = (xgetbv0() & 6) == 6;
+
+      if (maxLeaf < 7)
+         return;
+
+      cpuid(7, 0, regs);
+      avx2_ = ymmState && (regs[1] & (1 << 5)) != 0;
+      sha_ = sse41_ && ssse3 && (regs[1] & (1 << 29)) != 0;
+   }
+
+   static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* regs)
+   {
+#ifdef _MSC_VER
+      int result[4];
+      __cpuidex(result, (int)leaf, (int)subleaf);
+      for (unsigned i = 0; i < 4; i++)
+         regs[i] = (uint32_t)result[i];
+#else
+      __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+   }
+
+   static uint64_t xgetbv0(void)
+   {
+#ifdef _MSC_VER
+      return _xgetbv(0);
+#else
+      uint32_t lo, hi;
+      __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+      return ((uint64_t)hi << 32) | lo;
+#endif
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+static const CpuFeatures& getCpuFeatures(void)
+{
+   static const CpuFeatures features;
+   return features;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// lanes
+////
+////////////////////////////////////////////////////////////////////////////////
+struct Sha256Lane
+{
+   /***
+   Walks a message block by block, then runs the second pass over the
+   digest of the first. The padded tail of the message, and later the
+   second pass block, are built in tail_.
+   ***/
+
+   const uint8_t* data_ = nullptr;
+   size_t fullBlocks_ = 0;
+   size_t blockCount_ = 0;
+   size_t current_ = 0;
+   bool secondPass_ = false;
+   uint8_t* digest_ = nullptr;
+
+   uint8_t tail_[128];
+
+   void start(const BinaryDataRef& msg, uint8_t* digest)
+   {
+      data_ = msg.getPtr();
+      fullBlocks_ = msg.getSize() / 64;
+      current_ = 0;
+      secondPass_ = false;
+      digest_ = digest;
+
+      auto remainder = msg.getSize() % 64;
+      auto tailBlocks = remainder < 56 ? 1 : 2;
+      blockCount_ = fullBlocks_ + tailBlocks;
+
+      memset(tail_, 0, sizeof(tail_));
+      if (remainder > 0)
+         memcpy(tail_, data_ + fullBlocks_ * 64, remainder);
+      tail_[remainder] = 0x80;
+
+      uint64_t bitLength = (uint64_t)msg.getSize() * 8;
+      auto lengthPtr = tail_ + tailBlocks * 64 - 8;
+      writeBE32(lengthPtr, (uint32_t)(bitLength >> 32));
+      writeBE32(lengthPtr + 4, (uint32_t)bitLength);
+   }
+
+   const uint8_t* getBlock(void) const
+   {
+      if (current_ < fullBlocks_)
+         return data_ + current_ * 64;
+
+      return tail_ + (current_ - fullBlocks_) * 64;
+   }
+
+   //returns true once the digest is written
+   bool advance(uint32_t* state, unsigned lane, unsigned laneCount)
+   {
+      if (++current_ < blockCount_)
+         return false;
+
+      if (secondPass_)
+      {
+         for (unsigned i = 0; i < 8; i++)
+            writeBE32(digest_ + i * 4, state[i * laneCount + lane]);
+         return true;
+      }
+
+      //hash the 32 byte digest of the first pass
+      memset(tail_, 0, 64);
+      for (unsigned i = 0; i < 8; i++)
+      {
+         writeBE32(tail_ + i * 4, state[i * laneCount + lane]);
+         state[i * laneCount + lane] = sha256IV[i];
+      }
+
+      tail_[32] = 0x80;
+      tail_[62] = 0x01;
+
+      data_ = nullptr;
+      fullBlocks_ = 0;
+      blockCount_ = 1;
+      current_ = 0;
+      secondPass_ = true;
+      return false;
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template <unsigned N>
+static void hashLanes(Sha256Transform transform,
+   const BinaryDataRef* msgs, uint8_t* const* digests, size_t count)
+{
+   Sha256Lane lanes[N];
+   bool active[N];
+   uint32_t state[8 * N];
+   const uint8_t* blocks[N];
+
+   size_t next = 0;
+   auto load = [&](unsigned lane)->void
+   {
+      if (next >= count)
+      {
+         active[lane] = false;
+         return;
+      }
+
+      lanes[lane].start(msgs[next], digests[next]);
+      for (unsigned i = 0; i < 8; i++)
+         state[i * N + lane] = sha256IV[i];
+
+      active[lane] = true;
+      ++next;
+   };
+
+   for (unsigned i = 0; i < N; i++)
+      load(i);
+
+   unsigned activeCount = 0;
+   for (unsigned i = 0; i < N; i++)
+      activeCount += active[i] ? 1 : 0;
+
+   while (activeCount > 0)
+   {
+      for (unsigned i = 0; i < N; i++)
+         blocks[i] = active[i] ? lanes[i].getBlock() : zeroBlock;
+
+      transform(state, blocks);
+
+      for (unsigned i = 0; i < N; i++)
+      {
+         if (!active[i] || !lanes[i].advance(state, i, N))
+            continue;
+
+         load(i);
+         if (!active[i])
+            --activeCount;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// Sha256Multi
+////
+////////////////////////////////////////////////////////////////////////////////
+bool Sha256Multi::isSupported(Sha256Kernel kernel)
+{
+   switch (kernel)
+   {
+   case Sha256Kernel_Scalar:
+      return true;
+
+#ifdef SHA256_X86
+   case Sha256Kernel_SSE4:
+      return getCpuFeatures().sse41_;
+
+   case Sha256Kernel_AVX2:
+      return getCpuFeatures().avx2_;
+
+   case Sha256Kernel_SHANI:
+      return getCpuFeatures().sha_;
+#endif
+
+   default:
+      return false;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+Sha256Kernel Sha256Multi::getKernel()
+{
+   if (isSupported(Sha256Kernel_AVX2))
+      return Sha256Kernel_AVX2;
+
+   if (isSupported(Sha256Kernel_SHANI))
+      return Sha256Kernel_SHANI;
+
+   if (isSupported(Sha256Kernel_SSE4))
+      return Sha256Kernel_SSE4;
+
+   return Sha256Kernel_Scalar;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const char* Sha256Multi::getKernelName(Sha256Kernel kernel)
+{
+   switch (kernel)
+   {
+   case Sha256Kernel_Scalar:
+      return "scalar";
+
+   case Sha256Kernel_SSE4:
+      return "sse4.1 x4";
+
+   case Sha256Kernel_AVX2:
+      return "avx2 x8";
+
+   case Sha256Kernel_SHANI:
+      return "sha-ni";
+
+   default:
+      return "unknown";
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Sha256Multi::getHash256(
+   const BinaryDataRef* msgs, uint8_t* const* digests, size_t count)
+{
+   static const Sha256Kernel kernel = getKernel();
+   static const bool hasShaNI = isSupported(Sha256Kernel_SHANI);
+   static const bool hasSSE4 = isSupported(Sha256Kernel_SSE4);
+
+   //don't run mostly idle lanes
+   auto selected = kernel;
+   if (selected == Sha256Kernel_AVX2 && count < 8)
+      selected = hasShaNI ? Sha256Kernel_SHANI : Sha256Kernel_SSE4;
+
+   if (selected == Sha256Kernel_SSE4 && (count < 4 || !hasSSE4))
+      selected = Sha256Kernel_Scalar;
+
+   getHash256(selected, msgs, digests, count);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Sha256Multi::getHash256(Sha256Kernel kernel,
+   const BinaryDataRef* msgs, uint8_t* const* digests, size_t count)
+{
+   if (count == 0)
+      return;
+
+   if (!isSupported(kernel))
+      throw runtime_error("unsupported sha256 kernel");
+
+   switch (kernel)
+   {
+#ifdef SHA256_X86
+   case Sha256Kernel_SSE4:
+      hashLanes<4>(transformSSE4, msgs, digests, count);
+      break;
+
+   case Sha256Kernel_AVX2:
+      hashLanes<8>(transformAVX2, msgs, digests, count);
+      break;
+
+   case Sha256Kernel_SHANI:
+      hashLanes<1>(transformSHANI, msgs, digests, count);
+      break;
+#endif
+
+   default:
+      hashLanes<1>(transformScalar, msgs, digests, count);
+   }
+}
@@ -0,0 +1,56 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_SHA256MULTI
+#define _H_SHA256MULTI
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "BinaryData.h"
+
+/*
+Double sha256 over many messages at once. The SIMD kernels run one message
+per lane, 4 lanes with SSE4.1 and 8 with AVX2. A lane picks up the next
+message as soon as it's done with its own, so messages of uneven length
+keep all lanes busy until the last few.
+
+The SHA extensions kernel is single lane. It trails the 8 AVX2 lanes on
+full batches but takes the batches too small to fill them, and replaces
+SSE4.1 where there is no AVX2.
+
+The kernel is picked at runtime from cpuid. Small batches without the SHA
+extensions go to the scalar kernel.
+*/
+
+enum Sha256Kernel
+{
+   Sha256Kernel_Scalar = 0,
+   Sha256Kernel_SSE4,
+   Sha256Kernel_AVX2,
+   Sha256Kernel_SHANI
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class Sha256Multi
+{
+public:
+   //hash256 of msgs[i] written to the 32 bytes at digests[i]
+   static void getHash256(
+      const BinaryDataRef* msgs, uint8_t* const* digests, size_t count);
+   static void getHash256(Sha256Kernel,
+      const BinaryDataRef* msgs, uint8_t* const* digests, size_t count);
+
+   static bool isSupported(Sha256Kernel);
+
+   //kernel for full batches on this cpu
+   static Sha256Kernel getKernel(void);
+   static const char* getKernelName(Sha256Kernel);
+};
+
+#endif
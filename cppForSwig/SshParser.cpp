@@ -6,6 +6,9 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <functional>
+
 #include "SshParser.h"
 
 using namespace std;
@@ -182,27 +185,7 @@ void ShardedSshParser::updateSsh()
    firstShard_ = db_->getShardIdForHeight(firstHeight_);
    setupBounds();
 
-
-   //parser lambda
-   auto ssh_lambda = [this](void)->void
-   {
-      parseSshThread();
-   };
-
-   vector<thread> threads;
-   unsigned count = threadCount_;
-   if (threadCount_ > 1)
-      --count;
-   for (unsigned i = 0; i < count; i++)
-      threads.push_back(thread(ssh_lambda));
-
-   putSSH();
-
-   for (auto& thr : threads)
-   {
-      if (thr.joinable())
-         thr.join();
-   }
+   parseSsh();
 
    chrono::duration<double> length = chrono::system_clock::now() - now;
    LOGINFO << "Updated SSH in " << length.count() << "s";
@@ -219,15 +202,36 @@ void ShardedSshParser::undo()
    undo_ = true;
    setupBounds();
 
+   parseSsh();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShardedSshParser::parseSsh()
+{
+   //get top batch id
+   {
+      auto&& subssh_sdbi = db_->getStoredDBInfo(SUBSSH, 0);
+      idMax_ = subssh_sdbi.metaInt_;
+   }
+
    //parser lambda
-   auto ssh_lambda = [this](void)->void
+   auto ssh_lambda = [this](unsigned index)->void
    {
-      parseSshThread();
+      parseSshThread(index);
    };
 
+   unsigned count = threadCount_;
+   if (threadCount_ > 1)
+      --count;
+
+   activeTasks_.resize(count);
+   busyTime_.resize(count);
+   stealCount_.resize(count);
+
    vector<thread> threads;
-   for (unsigned i = 1; i < threadCount_; i++)
-      threads.push_back(thread(ssh_lambda));
+   for (unsigned i = 0; i < count; i++)
+      threads.push_back(thread(ssh_lambda, i));
+
    putSSH();
 
    for (auto& thr : threads)
@@ -235,6 +239,26 @@ void ShardedSshParser::undo()
       if (thr.joinable())
          thr.join();
    }
+
+   //report thread load
+   chrono::duration<double> busyMin(0), busyMax(0), busyTotal(0);
+   unsigned steals = 0;
+   for (unsigned i = 0; i < count; i++)
+   {
+      LOGDEBUG << "ssh thread #" << i << ": busy " << 
+         busyTime_[i].count() << "s, " << stealCount_[i] << " steals";
+
+      if (i == 0 || busyTime_[i] < busyMin)
+         busyMin = busyTime_[i];
+      if (busyTime_[i] > busyMax)
+         busyMax = busyTime_[i];
+      busyTotal += busyTime_[i];
+      steals += stealCount_[i];
+   }
+
+   LOGINFO << "ssh threads busy min/avg/max: " << busyMin.count() << "/" <<
+      busyTotal.count() / count << "/" << busyMax.count() << "s, " <<
+      steals << " steals";
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -287,6 +311,7 @@ void ShardedSshParser::setupBounds()
    {
       auto boundsPtr = make_unique<SshBounds>();
       boundsPtr->bounds_ = move(make_pair(start, end));
+      boundsPtr->index_ = boundsVector_.size();
       boundsVector_.push_back(move(boundsPtr));
    };
 
@@ -352,8 +377,8 @@ void ShardedSshParser::setupBounds()
       }
    };
 
-   auto&& sshMapping = mapSubSshDB();
-   mapToBounds(sshMapping, BinaryData());
+   sshMapping_ = mapSubSshDB();
+   mapToBounds(sshMapping_, BinaryData());
 
    //add last entry
    if (startKey.getSize() != 0)
@@ -477,41 +502,195 @@ void ShardedSshParser::mapSubSshDBThread(unsigned index)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-SshBounds* ShardedSshParser::getNext()
+shared_ptr<SshTask> ShardedSshParser::getNext(unsigned index)
 {
-   //if write queue is too long, wait on condvar, otherwise break
-   while (fetchBoundsCounter_.load(memory_order_relaxed) - 
-          commitedBoundsCounter_.load(memory_order_relaxed) > 
-          threadCount_ * 2)
+   auto setActive = [this, index](shared_ptr<SshTask> task)->void
+   {
+      unique_lock<mutex> lock(tasksMutex_);
+      activeTasks_[index] = task;
+   };
+
+   while (true)
    {
+      //all bounds handed out, help with what's left
+      if (fetchBoundsCounter_.load(memory_order_relaxed) >= 
+          boundsVector_.size())
+         return steal(index);
+
+      //if write queue is too long, steal from the tasks holding it up,
+      //otherwise grab the next bounds
+      if (fetchBoundsCounter_.load(memory_order_relaxed) -
+          commitedBoundsCounter_.load(memory_order_relaxed) <=
+          threadCount_ * 2)
+      {
+         //increment counter, grab bound ptr from vector
+         auto id = fetchBoundsCounter_.fetch_add(1, memory_order_relaxed);
+         if (id >= boundsVector_.size())
+            return steal(index);
+
+         auto boundsPtr = boundsVector_[id].get();
+         boundsPtr->pending_.store(1, memory_order_relaxed);
+
+         auto task = make_shared<SshTask>(boundsPtr,
+            boundsPtr->bounds_.first, boundsPtr->bounds_.second,
+            firstShard_, idMax_);
+         setActive(task);
+         return task;
+      }
+
+      auto task = steal(index);
+      if (task != nullptr)
+         return task;
+
       unique_lock<mutex> lock(cvMutex_);
-      writeThreadCV_.wait(lock);
+      writeThreadCV_.wait_for(lock, chrono::milliseconds(10));
    }
+}
 
-   //increment counter, grab bound ptr from vector
-   auto id = fetchBoundsCounter_.fetch_add(1, memory_order_relaxed);
-   if (id >= boundsVector_.size())
-      return nullptr;
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<SshTask> ShardedSshParser::steal(unsigned index)
+{
+   unique_lock<mutex> lock(tasksMutex_);
+
+   //the writer commits bounds in order, help the oldest ones first
+   vector<SshTask*> victims;
+   for (auto& task : activeTasks_)
+   {
+      if (task != nullptr)
+         victims.push_back(task.get());
+   }
+
+   sort(victims.begin(), victims.end(), 
+      [](const SshTask* lhs, const SshTask* rhs)->bool
+   {
+      return lhs->bounds_->index_ < rhs->bounds_->index_;
+   });
+
+   for (auto victim : victims)
+   {
+      unique_lock<mutex> victimLock(victim->mu_);
+      auto task = victim->split(sshMapping_);
+      if (task == nullptr)
+         continue;
 
-   auto boundsPtr = boundsVector_[id].get();
-   return boundsPtr;
+      //the victim still holds its count, the bounds can't complete here
+      victim->bounds_->pending_.fetch_add(1, memory_order_relaxed);
+
+      activeTasks_[index] = task;
+      ++stealCount_[index];
+      return task;
+   }
+
+   return nullptr;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void ShardedSshParser::parseSshThread()
+static int comparePrefix(BinaryDataRef lhs, BinaryDataRef rhs)
 {
-   //get top batch id
-   auto&& subssh_sdbi = db_->getStoredDBInfo(SUBSSH, 0);
-   auto id_max = subssh_sdbi.metaInt_;
+   auto len = min(lhs.getSize(), rhs.getSize());
+   auto lhsRef = lhs.getSliceRef(0, len);
+   auto rhsRef = rhs.getSliceRef(0, len);
+
+   if (lhsRef < rhsRef)
+      return -1;
+   if (rhsRef < lhsRef)
+      return 1;
+   return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShardedSshParser::completeTask(unsigned index, SshTask& task,
+   map<BinaryDataRef, StoredScriptHistory>& sshMap, uint64_t count,
+   const chrono::duration<double>& time)
+{
+   auto bounds = task.bounds_;
+   {
+      unique_lock<mutex> lock(bounds->mergeMutex_);
+      bounds->mergeResult(sshMap);
+      bounds->count_ += count;
+      bounds->time_ += time;
+   }
+
+   /***
+   The writer frees the bounds once they are finalized. Drop the task from
+   the steal list before giving up our count, so that a thief can't reach
+   the bounds through it past that point.
+   ***/
+   {
+      unique_lock<mutex> lock(tasksMutex_);
+      activeTasks_[index] = nullptr;
+   }
+
+   if (bounds->pending_.fetch_sub(1, memory_order_acq_rel) == 1)
+      finalizeBounds(bounds);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShardedSshParser::finalizeBounds(SshBounds* bounds)
+{
+   auto& sshMap = bounds->sshMap_;
+   if (sshMap.size() > 0 && (firstShard_ != 0 || undo_))
+   {
+      //does the key exist in db already?
+      auto sshtx = db_->beginTransaction(SSH, LMDB::ReadOnly);
+      auto sshIter = db_->getIterator(SSH);
+
+      map<BinaryDataRef, StoredScriptHistory> substractedMap;
+      auto subIter = sshMap.begin();
+      do
+      {
+         if (!sshIter->seekToExact(DB_PREFIX_SCRIPT, subIter->first))
+         {
+            if(undo_)
+               LOGWARN << "failed to find ssh to undo";
+
+            ++subIter;
+            continue;
+         }
+
+         StoredScriptHistory dbSsh;
+         dbSsh.unserializeDBKey(sshIter->getKeyRef());
+         dbSsh.unserializeDBValue(sshIter->getValueRef());
+
+         if (!undo_)
+         {
+            subIter->second.addSummary(dbSsh);
+            ++subIter;
+         }
+         else
+         {
+            dbSsh.substractSummary(subIter->second);
+            substractedMap.insert(make_pair(
+               dbSsh.uniqueKey_.getRef(), move(dbSsh)));
+            sshMap.erase(subIter++);
+         }
+      } 
+      while (subIter != sshMap.end());
+
+      for (auto& sub_pair : substractedMap)
+      {
+         sshMap.insert(make_pair(
+            sub_pair.first, move(sub_pair.second)));
+      }
+   }
 
+   //serialize result
+   bounds->serializeResult(sshMap);
+
+   //flag as completed
+   bounds->completed_->set_value(true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShardedSshParser::parseSshThread(unsigned index)
+{
    //seek lambda
-   auto seekToBoundsStart = [](LDBIter* iterPtr,
-      unsigned id, SshBounds* bounds,
-      BinaryData& keyStart, BinaryData& keyEnd)->bool
+   auto seekToShardStart = [](LDBIter* iterPtr,
+      unsigned id, const BinaryData& keyStart)->bool
    {
       BinaryWriter bw_start;
       bw_start.put_uint32_t(id, BE);
-      bw_start.put_BinaryData(bounds->bounds_.first);
+      bw_start.put_BinaryData(keyStart);
 
       if (!iterPtr->seekTo(bw_start.getDataRef()))
          return false;
@@ -521,33 +700,9 @@ void ShardedSshParser::parseSshThread()
       if (id_key != id)
          return false;
 
-      BinaryWriter bw_end;
-      bw_end.put_uint32_t(id, BE);
-      bw_end.put_BinaryData(bounds->bounds_.second);
-
-      keyStart = bw_start.getData();
-      keyEnd = bw_end.getData();
-
       return true;
    };
 
-   //key compare lambda
-   auto compareKeyToBounds = [](BinaryDataRef key, 
-      const BinaryData& start, const BinaryData& end)->int
-   {
-      auto len = min(key.getSize(), start.getSize());
-      auto keyRef = move(key.getSliceRef(0, len));
-      if (start.getSliceRef(0, len) > keyRef)
-         return -1;
-
-      len = min(key.getSize(), end.getSize());
-      keyRef = move(key.getSliceRef(0, len));
-      if (keyRef > end.getSliceRef(0, len))
-         return 1;
-
-      return 0;
-   };
-
    //dupId check
    auto dbPtr = db_;
    auto checkDupId = [dbPtr](unsigned height, uint8_t dupId)->bool
@@ -578,25 +733,23 @@ void ShardedSshParser::parseSshThread()
    while (true)
    {
       //grab range to work on
-      auto bounds = getNext();
-      if (bounds == nullptr)
+      auto task = getNext(index);
+      if (task == nullptr)
          break;
 
       auto now = chrono::system_clock::now();
       map<BinaryDataRef, StoredScriptHistory> sshMap;
+      uint64_t count = 0;
 
       //initialize db iterator
       auto dbIter = db_->getIterator(SUBSSH);
-      unsigned current_id = firstShard_;
-      BinaryData bound_start;
-      BinaryData bound_end;
+      unsigned current_id;
 
-      while (current_id <= id_max)
+      while (task->claimShard(current_id))
       {
-         if (!seekToBoundsStart(dbIter.get(), current_id,
-            bounds, bound_start, bound_end))
+         if (!seekToShardStart(dbIter.get(), current_id, task->keyStart_))
          {
-            ++current_id;
+            task->completeShard();
             continue;
          }
 
@@ -605,19 +758,19 @@ void ShardedSshParser::parseSshThread()
 
          do
          {
-            auto&& keyRef = dbIter->getKeyRef();
-
-            //compare key to bounds
-            if (compareKeyToBounds(keyRef, bound_start, bound_end) != 0)
-               break;
-
             //parse entry
             auto&& brr_key = dbIter->getKeyReader();
+            if (brr_key.getSize() < 4 || 
+                brr_key.get_uint32_t(BE) != current_id)
+               break;
 
-            //get ssh from map
-            brr_key.advance(4);
+            //compare key to bounds
             auto scrAddrRef =
                brr_key.get_BinaryDataRef(brr_key.getSizeRemaining());
+            if (!task->claimKey(scrAddrRef))
+               break;
+
+            //get ssh from map
             auto ssh_iter = sshMap.find(scrAddrRef);
             if (ssh_iter == sshMap.end())
             {
@@ -629,7 +782,7 @@ void ShardedSshParser::parseSshThread()
             }
             auto& ssh = ssh_iter->second;
 
-            ++bounds->count_;
+            ++count;
             size_t totalTxioCount = 0;
 
             //read through values
@@ -648,15 +801,14 @@ void ShardedSshParser::parseSshThread()
 
                for (unsigned y = 0; y < txio_count; y++)
                {
-                  //get value
-                  auto value = brr_data.get_var_int();
-
-                  //get spent flag
-                  auto spent_flag = brr_data.get_uint8_t();
+                  //get value and spent flag
+                  uint64_t value = brr_data.get_var_int();
+                  auto spent_flag = StoredSubHistory::readTxioFlag(
+                     brr_data.get_uint8_t(), value);
 
                   switch (spent_flag)
                   {
-                  case 0:
+                  case SUBSSH_FLAG_UNSPENT:
                   {
                      //unspent, add value to ssh
                      totalValue += value;
@@ -667,7 +819,7 @@ void ShardedSshParser::parseSshThread()
                      break;
                   }
 
-                  case 1:
+                  case SUBSSH_FLAG_SAMEBLOCK:
                   {
                      //funds and spends in same block, no effect 
                      //on value, skip 4 varints
@@ -681,7 +833,7 @@ void ShardedSshParser::parseSshThread()
                      break;
                   }
 
-                  case 0xFF:
+                  case SUBSSH_FLAG_SPENT:
                   {
                      //spent, substract value from ssh
                      totalValue -= value;
@@ -721,62 +873,176 @@ void ShardedSshParser::parseSshThread()
 
          } while (dbIter->advanceAndRead());
 
-         //increment batch id
-         ++current_id;
+         task->completeShard();
       }
 
-      if (sshMap.size() > 0 && (firstShard_ != 0 || undo_))
-      {
-         //does the key exist in db already?
-         auto sshtx = db_->beginTransaction(SSH, LMDB::ReadOnly);
-         auto sshIter = db_->getIterator(SSH);
+      chrono::duration<double> time = chrono::system_clock::now() - now;
+      busyTime_[index] += time;
+      completeTask(index, *task, sshMap, count, time);
+   }
+}
 
-         map<BinaryDataRef, StoredScriptHistory> substractedMap;
-         auto subIter = sshMap.begin();
-         do
-         {
-            if (!sshIter->seekToExact(DB_PREFIX_SCRIPT, subIter->first))
-            {
-               if(undo_)
-                  LOGWARN << "failed to find ssh to undo";
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// SshTask
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+bool SshTask::claimShard(unsigned& id)
+{
+   unique_lock<mutex> lock(mu_);
+   if (currentId_ > idEnd_)
+      return false;
 
-               ++subIter;
-               continue;
-            }
+   id = currentId_;
+   cursor_.reset();
+   return true;
+}
 
-            StoredScriptHistory dbSsh;
-            dbSsh.unserializeDBKey(sshIter->getKeyRef());
-            dbSsh.unserializeDBValue(sshIter->getValueRef());
+////////////////////////////////////////////////////////////////////////////////
+bool SshTask::claimKey(BinaryDataRef key)
+{
+   unique_lock<mutex> lock(mu_);
+   if (comparePrefix(key, keyEnd_) > 0)
+      return false;
 
-            if (!undo_)
-            {
-               subIter->second.addSummary(dbSsh);
-               ++subIter;
-            }
-            else
-            {
-               dbSsh.substractSummary(subIter->second);
-               substractedMap.insert(make_pair(
-                  dbSsh.uniqueKey_.getRef(), move(dbSsh)));
-               sshMap.erase(subIter++);
-            }
-         } 
-         while (subIter != sshMap.end());
+   cursor_ = key;
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SshTask::completeShard()
+{
+   unique_lock<mutex> lock(mu_);
+   ++currentId_;
+   cursor_.reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<SshTask> SshTask::split(const SshMapping& mapping)
+{
+   //owner is done
+   if (currentId_ > idEnd_)
+      return nullptr;
+
+   //give away the upper half of the shards past the one in progress
+   if (idEnd_ > currentId_)
+   {
+      auto mid = currentId_ + 1 + (idEnd_ - currentId_ - 1) / 2;
+      auto stolen = make_shared<SshTask>(bounds_,
+         keyStart_, keyEnd_, mid, idEnd_);
+
+      idEnd_ = mid - 1;
+      return stolen;
+   }
+
+   //last shard, split the keys left
+   BinaryData splitKey;
+   if (!getSplitKey(mapping, splitKey))
+      return nullptr;
+
+   auto stolen = make_shared<SshTask>(bounds_,
+      splitKey, keyEnd_, currentId_, idEnd_);
+
+   //owner stops right before the split key
+   auto ptr = splitKey.getPtr();
+   for (int i = splitKey.getSize() - 1; i >= 0; i--)
+   {
+      if (ptr[i]-- != 0)
+         break;
+   }
+
+   keyEnd_ = move(splitKey);
+   return stolen;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool SshTask::getSplitKey(
+   const SshMapping& mapping, BinaryData& splitKey) const
+{
+   /***
+   Picks a key prefix from the subssh mapping that splits the keys past
+   the owner's cursor in about half. The mapping counts entries across
+   all shards, this is an estimate for the last one.
+   ***/
+
+   BinaryDataRef lowerBound = cursor_;
+   bool hasCursor = lowerBound.getSize() > 0;
+   if (!hasCursor)
+      lowerBound = keyStart_.getRef();
+
+   //mapping leaves in range, in key order
+   vector<pair<BinaryData, uint64_t>> leaves;
+   function<void(const SshMapping&, BinaryData&)> getLeaves =
+      [&](const SshMapping& node, BinaryData& prefix)->void
+   {
+      for (auto& entry : node.map_)
+      {
+         if (entry.second == nullptr || entry.second->count_ == 0)
+            continue;
 
-         for (auto& sub_pair : substractedMap)
+         prefix.append(entry.first);
+         if (comparePrefix(prefix, keyEnd_) > 0)
          {
-            sshMap.insert(make_pair(
-               sub_pair.first, move(sub_pair.second)));
+            prefix.resize(prefix.getSize() - 1);
+            break;
+         }
+
+         auto cmp = comparePrefix(prefix, lowerBound);
+         if (cmp >= 0)
+         {
+            if (entry.second->map_.size() > 0)
+               getLeaves(*entry.second, prefix);
+            else if (cmp > 0 || !hasCursor)
+               leaves.push_back(make_pair(prefix, entry.second->count_));
          }
+
+         prefix.resize(prefix.getSize() - 1);
       }
+   };
+
+   BinaryData prefix;
+   getLeaves(mapping, prefix);
+
+   //the owner keeps the first leaf if it hasn't started on it
+   if (!hasCursor && leaves.size() > 0)
+      leaves.erase(leaves.begin());
+
+   uint64_t total = 0;
+   for (auto& leaf : leaves)
+      total += leaf.second;
+   if (total < 2)
+      return false;
+
+   uint64_t tally = 0;
+   auto iter = leaves.begin();
+   while (iter != leaves.end() - 1 && tally < total / 2)
+   {
+      tally += iter->second;
+      ++iter;
+   }
+
+   splitKey = iter->first;
+   return true;
+}
 
-      //serialize result
-      bounds->serializeResult(sshMap);
-      bounds->time_ = chrono::system_clock::now() - now;
+////////////////////////////////////////////////////////////////////////////////
+void SshBounds::mergeResult(map<BinaryDataRef, StoredScriptHistory>& sshMap)
+{
+   //tasks cover disjoint keys or shards, summaries add up
+   for (auto& ssh_pair : sshMap)
+   {
+      auto iter = sshMap_.find(ssh_pair.first);
+      if (iter != sshMap_.end())
+      {
+         iter->second.addSummary(ssh_pair.second);
+         continue;
+      }
 
-      //flag as completed
-      bounds->completed_->set_value(true);
+      auto keyRef = ssh_pair.second.uniqueKey_.getRef();
+      sshMap_.insert(make_pair(keyRef, move(ssh_pair.second)));
    }
+
+   sshMap.clear();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -11,6 +11,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 
 #include "lmdb_wrapper.h"
 #include "Blockchain.h"
@@ -41,19 +42,29 @@ struct SshBounds
    std::map<BinaryData, BinaryWriter> serializedSsh_;
    std::chrono::duration<double> time_;
    uint64_t count_ = 0;
+   unsigned index_ = 0;
+
+   //tasks left over these bounds, the last one to finish serializes
+   std::atomic<unsigned> pending_;
+   std::mutex mergeMutex_;
+   std::map<BinaryDataRef, StoredScriptHistory> sshMap_;
 
    std::unique_ptr<std::promise<bool>> completed_;
    std::shared_future<bool> fut_;
 
    SshBounds(void)
    {
+      time_ = std::chrono::duration<double>(0);
+      pending_.store(0, std::memory_order_relaxed);
       completed_ = make_unique<std::promise<bool>>();
       fut_ = completed_->get_future();
    }
 
+   void mergeResult(std::map<BinaryDataRef, StoredScriptHistory>&);
    void serializeResult(std::map<BinaryDataRef, StoredScriptHistory>&);
 };
 
+////////////////////////////////////////////////////////////////////////////////
 struct SshMapping
 {
    std::map<uint8_t, std::shared_ptr<SshMapping>> map_;
@@ -64,6 +75,46 @@ struct SshMapping
    void merge(SshMapping&);
 };
 
+////////////////////////////////////////////////////////////////////////////////
+struct SshTask
+{
+   /***
+   A slice of SshBounds: the scrAddr range [keyStart_, keyEnd_] over the 
+   shards [currentId_, idEnd_]. The owner walks the shards in order and 
+   the keys in order within a shard. An idle thread splits off the upper
+   half of the shards left, or, on the last shard, the keys past the 
+   owner's cursor.
+
+   The owner checks each key against keyEnd_ under the lock, so the 
+   split is exact: every entry is parsed by exactly one task.
+   ***/
+
+   SshBounds* const bounds_;
+   const BinaryData keyStart_;
+
+   std::mutex mu_;
+   BinaryData keyEnd_;
+   unsigned currentId_;
+   unsigned idEnd_;
+
+   //last key parsed in currentId_, points into the owner's read tx
+   BinaryDataRef cursor_;
+
+   SshTask(SshBounds* bounds, const BinaryData& keyStart,
+      const BinaryData& keyEnd, unsigned idStart, unsigned idEnd) :
+      bounds_(bounds), keyStart_(keyStart), keyEnd_(keyEnd),
+      currentId_(idStart), idEnd_(idEnd)
+   {}
+
+   bool claimShard(unsigned&);
+   bool claimKey(BinaryDataRef);
+   void completeShard(void);
+
+   //caller holds mu_, returns nullptr if there is nothing left to give away
+   std::shared_ptr<SshTask> split(const SshMapping&);
+   bool getSplitKey(const SshMapping&, BinaryData&) const;
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////
 class ShardedSshParser
@@ -86,16 +137,30 @@ private:
 
    std::atomic<unsigned> mapCount_;
    std::vector<SshMapping> mappingResults_;
+   SshMapping sshMapping_;
+   unsigned idMax_ = 0;
+
+   //work stealing, one slot per parser thread
+   std::mutex tasksMutex_;
+   std::vector<std::shared_ptr<SshTask>> activeTasks_;
+   std::vector<std::chrono::duration<double>> busyTime_;
+   std::vector<unsigned> stealCount_;
 
 private:
    void putSSH(void);
-   SshBounds* getNext();
+   std::shared_ptr<SshTask> getNext(unsigned);
+   std::shared_ptr<SshTask> steal(unsigned);
+   void completeTask(unsigned, SshTask&,
+      std::map<BinaryDataRef, StoredScriptHistory>&, uint64_t,
+      const std::chrono::duration<double>&);
+   void finalizeBounds(SshBounds*);
    
 private:
    void setupBounds();
    SshMapping mapSubSshDB();
    void mapSubSshDBThread(unsigned);
-   void parseSshThread(void);
+   void parseSsh(void);
+   void parseSshThread(unsigned);
 
 public:
    ShardedSshParser(
@@ -43,7 +43,8 @@ void StoredDBInfo::unserializeDBValue(BinaryRefReader & brr)
    
    BitUnpacker<uint32_t> bitunpack(brr);
    armoryVer_  =                 bitunpack.getBits(16);
-   if (armoryVer_ != ARMORY_DB_VERSION)
+   if (armoryVer_ != ARMORY_DB_VERSION && 
+      armoryVer_ != ARMORY_DB_VERSION_LEGACY)
    {
       stringstream ss;
       ss << "DB version mismatch. Use another dbdir or empty the current one!";
@@ -585,7 +586,8 @@ void DBBlock::unserializeDBValue( DB_SELECT         db,
       numTx_    = brr.get_uint32_t();
       numBytes_ = brr.get_uint32_t();
 
-      if(unserArmVer_ != ARMORY_DB_VERSION)
+      if(unserArmVer_ != ARMORY_DB_VERSION &&
+         unserArmVer_ != ARMORY_DB_VERSION_LEGACY)
          LOGWARN << "Version mismatch in unserialize DB header";
 
       if( !ignoreMerkle )
@@ -832,7 +834,8 @@ void DBTx::unserializeDBValue(BinaryRefReader & brr)
    unserTxVer_   =                    bitunpack.getBits(2);
    unserTxType_  = (TX_SERIALIZE_TYPE)bitunpack.getBits(4);
 
-   if(unserArmVer_ != ARMORY_DB_VERSION)
+   if(unserArmVer_ != ARMORY_DB_VERSION &&
+      unserArmVer_ != ARMORY_DB_VERSION_LEGACY)
       LOGWARN << "Version mismatch in unserialize DB tx";
    
    brr.get_BinaryData(thisHash_, 32);
@@ -1084,7 +1087,10 @@ void StoredTxOut::unserializeDBValue(BinaryRefReader & brr)
    spentness_   = (TXOUT_SPENTNESS)bitunpack.getBits(2);
    isCoinbase_  =                  bitunpack.getBit();
 
-   unserialize(brr);
+   if (unserArmVer_ == STXO_VALUE_COMPRESSED)
+      dataCopy_ = ScriptCompression::decompressTxOut(brr);
+   else
+      unserialize(brr);
 
    if (spentness_ == TXOUT_SPENT && brr.getSizeRemaining() >= 8)
       spentByTxInKey_ = brr.get_BinaryData(8);
@@ -1107,15 +1113,23 @@ void StoredTxOut::serializeDBValue(
    size_t len = 2 + dataRef.getSize();
    bw.reserve(len);
 
+   //compress into a side buffer, the version nibble comes first
+   BinaryWriter bwCompressed;
+   bool compressed = ScriptCompression::isEnabled() && 
+      ScriptCompression::compressTxOut(bwCompressed, dataRef);
+
    BitPacker<uint16_t> bitpack;
-   bitpack.putBits((uint16_t)ARMORY_DB_VERSION, 4);
+   bitpack.putBits(compressed ? STXO_VALUE_COMPRESSED : STXO_VALUE_RAW, 4);
    bitpack.putBits((uint16_t)txVersion, 2);
    bitpack.putBits((uint16_t)spentness, 2);
    bitpack.putBit(isCoinbase);
    bitpack.putBits(0, 2);
 
    bw.put_BitPacker(bitpack);
-   bw.put_BinaryData(dataRef);  // 8-byte value, var_int sz, pkscript
+   if (compressed)
+      bw.put_BinaryDataRef(bwCompressed.getDataRef());
+   else
+      bw.put_BinaryData(dataRef);  // 8-byte value, var_int sz, pkscript
 
    if (spentness == TXOUT_SPENT)
    {
@@ -1557,15 +1571,14 @@ void StoredScriptHistory::decompressManySubssh(const BinaryDataRef& data,
          TxIOPair p;
          BinaryData outputKey;
          
-         //value
-         p.setValue(brr.get_var_int());
-
-         //spent flag
-         auto flag = brr.get_uint8_t();
+         //value and spent flag
+         uint64_t value = brr.get_var_int();
+         auto flag = StoredSubHistory::readTxioFlag(brr.get_uint8_t(), value);
+         p.setValue(value);
 
          switch (flag)
          {
-         case 0:
+         case SUBSSH_FLAG_UNSPENT:
          {
             //unspent
             auto txid = brr.get_var_int();
@@ -1581,7 +1594,7 @@ void StoredScriptHistory::decompressManySubssh(const BinaryDataRef& data,
             break;
          }
 
-         case 1:
+         case SUBSSH_FLAG_SAMEBLOCK:
          {
             //funded and spent in same block
             auto txid_output = brr.get_var_int();
@@ -1601,7 +1614,7 @@ void StoredScriptHistory::decompressManySubssh(const BinaryDataRef& data,
             break;
          }
 
-         case 0xFF:
+         case SUBSSH_FLAG_SPENT:
          {
             //spent
 
@@ -1909,9 +1922,14 @@ void StoredSubHistory::unserializeDBValue(BinaryRefReader & brr)
       bool isSpent         = bitunpack.getBit();
       bool isMulti         = bitunpack.getBit();
       bool isUTXO          = bitunpack.getBit();
+      bool isCompressed    = bitunpack.getBit();
 
-      // We always include the 8-byte value
-      uint64_t txoValue  = brr.get_uint64_t();
+      // We always include the value, 8 bytes or a compressed var_int
+      uint64_t txoValue;
+      if (isCompressed)
+         txoValue = ScriptCompression::decompressAmount(brr.get_var_int());
+      else
+         txoValue = brr.get_uint64_t();
       TxIOPair txio;
       txio.setValue(txoValue);
       txio.setUTXO(isUTXO);
@@ -1997,18 +2015,37 @@ void StoredSubHistory::serializeDBValue(BinaryWriter & bw) const
 
       auto&& key8B = txio.getDBKeyOfOutput();
 
+      //compressed amounts only make it in when they beat the 8 bytes
+      auto value = txio.getValue();
+      bool compressValue = false;
+      if (ScriptCompression::isEnabled() && 
+         value <= SCRIPTCOMPRESSION_MAX_MONEY)
+      {
+         auto compressed = ScriptCompression::compressAmount(value);
+         if (BtcUtils::calcVarIntSize(compressed) < 8)
+         {
+            value = compressed;
+            compressValue = true;
+         }
+      }
+
       BitPacker<uint8_t> bitpack;
       bitpack.putBit(txio.isTxOutFromSelf());
       bitpack.putBit(txio.isFromCoinbase());
       bitpack.putBit(txio.hasTxIn());
       bitpack.putBit(txio.isMultisig());
       bitpack.putBit(txio.isUTXO());
+      bitpack.putBit(compressValue);
       bw.put_BitPacker(bitpack);
 
+      if (compressValue)
+         bw.put_var_int(value);
+      else
+         bw.put_uint64_t(value);
+
       if (!isSpent)
       {
          // Always write the value and last 4 bytes of dbkey (first 4 is in dbkey)
-         bw.put_uint64_t(txio.getValue());
          bw.put_BinaryDataRef(key8B.getSliceRef(4, 4));
       }
       else
@@ -2016,7 +2053,6 @@ void StoredSubHistory::serializeDBValue(BinaryWriter & bw) const
          //spent subssh entry that marks the spent TxOut at the TxIn hgtX
          
          //write the full TxOut dbkey, since this is saved at TxIn hgtX
-         bw.put_uint64_t(txio.getValue());
          bw.put_BinaryData(key8B);
 
          //Spent subssh are saved by TxIn hgtX, only write the last 4 bytes
@@ -2162,6 +2198,39 @@ void StoredSubHistory::markTxOutUnspent(const BinaryData& txOutKey8B,
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+static pair<uint64_t, uint8_t> getCompressedValue(uint64_t value)
+{
+   //returns the value to write and the bit to flip in the txio flag,
+   //compressed amounts are only used when they are shorter
+   if (!ScriptCompression::isEnabled() || 
+      value > SCRIPTCOMPRESSION_MAX_MONEY)
+      return make_pair(value, 0);
+
+   auto compressed = ScriptCompression::compressAmount(value);
+   if (BtcUtils::calcVarIntSize(compressed) >= 
+      BtcUtils::calcVarIntSize(value))
+      return make_pair(value, 0);
+
+   return make_pair(compressed, SUBSSH_FLAG_AMOUNT);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint8_t StoredSubHistory::readTxioFlag(uint8_t flag, uint64_t& value)
+{
+   switch (flag)
+   {
+   case SUBSSH_FLAG_UNSPENT ^ SUBSSH_FLAG_AMOUNT:
+   case SUBSSH_FLAG_SAMEBLOCK ^ SUBSSH_FLAG_AMOUNT:
+   case SUBSSH_FLAG_SPENT ^ SUBSSH_FLAG_AMOUNT:
+      value = ScriptCompression::decompressAmount(value);
+      return flag ^ SUBSSH_FLAG_AMOUNT;
+
+   default:
+      return flag;
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void StoredSubHistory::compressMany(
    const map<BinaryDataRef, StoredSubHistory*>& ssh, 
@@ -2183,7 +2252,8 @@ void StoredSubHistory::compressMany(
          const auto& txio = txio_pair.second;
 
          //value
-         len += BtcUtils::get_varint_len(txio.getValue());
+         len += BtcUtils::get_varint_len(
+            getCompressedValue(txio.getValue()).first);
 
          if (!txio.hasTxIn())
          {
@@ -2266,14 +2336,15 @@ void StoredSubHistory::compressMany(
       for (auto& txio_pair : subssh.second->txioMap_)
       {
          const auto& txio = txio_pair.second;
-         bw.put_var_int(txio.getValue());
+         auto&& value = getCompressedValue(txio.getValue());
+         bw.put_var_int(value.first);
 
          if (!txio.hasTxIn())
          {
             //unspent
             
             //flag
-            bw.put_uint8_t(0);
+            bw.put_uint8_t(SUBSSH_FLAG_UNSPENT ^ value.second);
             
             //tx and output id
             bw.put_var_int(txio.getTxRefOfOutput().getBlockTxIndex());
@@ -2299,7 +2370,7 @@ void StoredSubHistory::compressMany(
             {
 
                //flag
-               bw.put_uint8_t(0xFF);
+               bw.put_uint8_t(SUBSSH_FLAG_SPENT ^ value.second);
 
                //output
                auto height = output_height - spent_offset;
@@ -2317,7 +2388,7 @@ void StoredSubHistory::compressMany(
                //fund and spend happen in same block, only record ids
 
                //flag
-               bw.put_uint8_t(1);
+               bw.put_uint8_t(SUBSSH_FLAG_SAMEBLOCK ^ value.second);
 
                //output
                bw.put_var_int(txio.getTxRefOfOutput().getBlockTxIndex());
@@ -2458,6 +2529,88 @@ BinaryData StoredUndoData::getDBKey(bool withPrefix) const
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockUndo::merge(const StoredBlockUndo& sbu)
+{
+   createdTxOuts_.insert(sbu.createdTxOuts_.begin(), sbu.createdTxOuts_.end());
+   spentTxOuts_.insert(sbu.spentTxOuts_.begin(), sbu.spentTxOuts_.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockUndo::unserializeDBValue(BinaryRefReader & brr)
+{
+   auto readDeltas = [&brr](map<BinaryData, TxOutDelta>& deltaMap)->void
+   {
+      deltaMap.clear();
+      auto count = brr.get_var_int();
+      for (uint64_t i = 0; i < count; i++)
+      {
+         auto&& key = brr.get_BinaryData(8);
+         auto& delta = deltaMap[key];
+
+         auto scrAddrSize = brr.get_var_int();
+         brr.get_BinaryData(delta.scrAddr_, (uint32_t)scrAddrSize);
+         delta.value_ = brr.get_var_int();
+      }
+   };
+
+   readDeltas(createdTxOuts_);
+   readDeltas(spentTxOuts_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockUndo::serializeDBValue(BinaryWriter & bw) const
+{
+   //count | (key (8) | scrAddr size | scrAddr | value) for each set
+   auto writeDeltas = [&bw](const map<BinaryData, TxOutDelta>& deltaMap)->void
+   {
+      bw.put_var_int(deltaMap.size());
+      for (auto& delta : deltaMap)
+      {
+         bw.put_BinaryData(delta.first);
+         bw.put_var_int(delta.second.scrAddr_.getSize());
+         bw.put_BinaryData(delta.second.scrAddr_);
+         bw.put_var_int(delta.second.value_);
+      }
+   };
+
+   writeDeltas(createdTxOuts_);
+   writeDeltas(spentTxOuts_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockUndo::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockUndo::unserializeDBKey(BinaryDataRef key)
+{
+   BinaryRefReader brr(key);
+   if (key.getSize() == 5)
+      brr.advance(1);
+
+   auto hgtx = brr.get_BinaryDataRef(4);
+   blockHeight_ = DBUtils::hgtxToHeight(hgtx);
+   duplicateID_ = DBUtils::hgtxToDupID(hgtx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBlockUndo::getDBKey(bool withPrefix) const
+{
+   if (!withPrefix)
+      return DBUtils::getBlkDataKeyNoPrefix(blockHeight_, duplicateID_);
+
+   BinaryWriter bw(5);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_UNDODATA);
+   bw.put_BinaryData(
+      DBUtils::getBlkDataKeyNoPrefix(blockHeight_, duplicateID_));
+   return bw.getData();
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
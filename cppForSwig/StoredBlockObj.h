@@ -25,11 +25,27 @@
 #include "BlockObj.h"
 #include "txio.h"
 #include "BlockDataManagerConfig.h"
+#include "ScriptCompression.h"
 
-#define ARMORY_DB_VERSION   0x9701
+#define ARMORY_DB_VERSION   0x9702
+#define ARMORY_DB_VERSION_LEGACY 0x9701 //readable, written without compression
 #define ARMORY_DB_DEFAULT   ARMORY_DB_FULL
 #define UTXO_STORAGE        SCRIPT_UTXO_VECTOR
 
+//stxo value version nibble
+#define STXO_VALUE_RAW        1
+#define STXO_VALUE_COMPRESSED 2
+
+//compressed subssh txio flags, entries carrying a compressed amount
+//have SUBSSH_FLAG_AMOUNT flipped
+#define SUBSSH_FLAG_UNSPENT   0x00
+#define SUBSSH_FLAG_SAMEBLOCK 0x01
+#define SUBSSH_FLAG_SPENT     0xFF
+#define SUBSSH_FLAG_AMOUNT    0x10
+
+//blocks from the top that the scanners keep undo records for
+#define BLOCK_UNDO_DEPTH 2016
+
 enum DB_TX_AVAIL
 {
   DB_TX_EXISTS,
@@ -50,6 +66,8 @@ enum DB_SELECT
    ZERO_CONF,
    TXFILTERS,
    SPENTNESS,
+   BLKFILTERS,
+   BLKUNDO,
    COUNT
 };
 
@@ -472,6 +490,9 @@ public:
       unsigned heightOffset, unsigned spentOffset,
       BinaryWriter& bw);
 
+   //strips SUBSSH_FLAG_AMOUNT, decompresses the value if it was set
+   static uint8_t readTxioFlag(uint8_t flag, uint64_t& value);
+
    StoredSubHistory& operator=(const StoredSubHistory& copy)
    {
       if (&copy == this)
@@ -594,6 +615,52 @@ public:
    std::vector<OutPoint>     outPointsAddedByBlock_;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Compact undo record the scanners write in BLKUNDO for the last 
+// BLOCK_UNDO_DEPTH blocks: the tracked txouts a block created and the ones 
+// it spent, by txout key, with their scrAddr and value. Reorgs replay these
+// backwards instead of reparsing the block and looking up every spend.
+//
+// Supernode only carries the spentness keys of the outputs spent by the 
+// block in spentTxOuts_, without scrAddr and value. It replays those to
+// roll back SPENTNESS, but balances are not replayed: SSH is rebuilt from
+// the SUBSSH shards starting at the first undone height. Storing per 
+// scrAddr deltas for every block in the undo window would cost about as
+// much as the SUBSSH entries themselves.
+class StoredBlockUndo
+{
+public:
+   struct TxOutDelta
+   {
+      BinaryData scrAddr_;
+      uint64_t value_ = 0;
+   };
+
+public:
+   StoredBlockUndo(void) {}
+   StoredBlockUndo(uint32_t height, uint8_t dupID) :
+      blockHeight_(height), duplicateID_(dupID)
+   {}
+
+   bool isInitialized(void) const { return blockHeight_ != UINT32_MAX; }
+
+   void merge(const StoredBlockUndo&);
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   void       unserializeDBKey(BinaryDataRef key);
+
+   BinaryData getDBKey(bool withPrefix=true) const;
+
+   uint32_t blockHeight_ = UINT32_MAX;
+   uint8_t  duplicateID_ = UINT8_MAX;
+
+   //txout key (8 bytes, no prefix) to scrAddr and value
+   std::map<BinaryData, TxOutDelta> createdTxOuts_;
+   std::map<BinaryData, TxOutDelta> spentTxOuts_;
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////
 class StoredTxHints
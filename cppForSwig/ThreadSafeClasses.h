@@ -531,6 +531,80 @@ public:
    }
 };
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename T> class BoundedQueue
+{
+   /***
+   BlockingQueue with a cap on queued entries, push_back blocks as long as
+   the queue is full
+
+   terminate() releases blocked pushers, their entries are dropped
+   ***/
+
+private:
+   BlockingQueue<T> queue_;
+   const size_t capacity_;
+
+   std::mutex mu_;
+   std::condition_variable condVar_;
+   size_t size_ = 0;
+   bool halted_ = false;
+
+public:
+   BoundedQueue(size_t capacity) :
+      capacity_(capacity == 0 ? 1 : capacity)
+   {}
+
+   T pop_front(void)
+   {
+      auto&& retval = queue_.pop_front();
+
+      {
+         std::unique_lock<std::mutex> lock(mu_);
+         --size_;
+      }
+
+      condVar_.notify_all();
+      return std::move(retval);
+   }
+
+   void push_back(T&& obj)
+   {
+      {
+         std::unique_lock<std::mutex> lock(mu_);
+         while (size_ >= capacity_ && !halted_)
+            condVar_.wait(lock);
+
+         if (halted_)
+            return;
+         ++size_;
+      }
+
+      queue_.push_back(std::move(obj));
+   }
+
+   void terminate(std::exception_ptr exceptptr = nullptr)
+   {
+      {
+         std::unique_lock<std::mutex> lock(mu_);
+         halted_ = true;
+      }
+
+      condVar_.notify_all();
+      queue_.terminate(exceptptr);
+   }
+
+   void completed(std::exception_ptr exceptptr = nullptr)
+   {
+      queue_.completed(exceptptr);
+   }
+
+   size_t count(void) const
+   {
+      return queue_.count();
+   }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename T> class TimedQueue : public Queue<T>
 {
@@ -512,17 +512,18 @@ void SigHashDataSegWit::computePreState(const TransactionStub& txStub)
    if (initialized_)
       return;
 
-   //hashPrevouts
+   //hashPrevouts, hashSequence and hashOutputs, in one batch
    auto&& allOutpoints = txStub.serializeAllOutpoints();
-   hashPrevouts_ = move(BtcUtils::getHash256(allOutpoints));
-
-   //hashSequence
    auto&& allSequences = txStub.serializeAllSequences();
-   hashSequence_ = move(BtcUtils::getHash256(allSequences));
-
-   //hashOutputs
    auto allOutputs = txStub.getSerializedOutputScripts();
-   hashOutputs_ = move(BtcUtils::getHash256(allOutputs));
+
+   vector<BinaryDataRef> preimages = {
+      allOutpoints.getRef(), allSequences.getRef(), allOutputs };
+   auto&& hashes = BtcUtils::getHash256Many(preimages);
+
+   hashPrevouts_ = move(hashes[0]);
+   hashSequence_ = move(hashes[1]);
+   hashOutputs_ = move(hashes[2]);
 
    //flag
    initialized_ = true;
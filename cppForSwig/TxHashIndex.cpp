@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+
+#include "TxHashIndex.h"
+
+using namespace std;
+
+#define TXHASHINDEX_MAGIC 0x78646968 //"hidx"
+#define TXHASHINDEX_HEADER_SIZE 24
+#define TXHASHINDEX_BUCKET_SIZE 4
+
+////////////////////////////////////////////////////////////////////////////////
+static size_t fingerprintOffset(unsigned dirBits)
+{
+   //fingerprints are 8 byte aligned
+   size_t offset = TXHASHINDEX_HEADER_SIZE +
+      ((1ULL << dirBits) + 1) * sizeof(uint32_t);
+   return (offset + 7) & ~size_t(7);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+TxHashIndexEntry::TxHashIndexEntry(BinaryDataRef txHash, BinaryDataRef dbKey)
+{
+   if (dbKey.getSize() != TXHASHINDEX_KEY_LENGTH)
+      throw TxHashIndexException("invalid dbkey length");
+
+   fingerprint_ = TxHashIndex::getFingerprint(txHash);
+   check_ = TxHashIndex::getCheck(txHash);
+   memcpy(dbKey_, dbKey.getPtr(), TXHASHINDEX_KEY_LENGTH);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+TxHashIndex::TxHashIndex(const string& path)
+{
+   fileMap_ = DBUtils::getMmapOfFile(path);
+   if (fileMap_.size_ < TXHASHINDEX_HEADER_SIZE)
+   {
+      fileMap_.unmap();
+      throw TxHashIndexException("txhash index file is too short");
+   }
+
+   BinaryRefReader brr(fileMap_.filePtr_, TXHASHINDEX_HEADER_SIZE);
+   auto magic = brr.get_uint32_t();
+   auto version = brr.get_uint32_t();
+   coveredHeight_ = brr.get_uint32_t();
+   dirBits_ = brr.get_uint32_t();
+   count_ = brr.get_uint64_t();
+
+   if (magic != TXHASHINDEX_MAGIC || version != TXHASHINDEX_VERSION ||
+      dirBits_ > 32 || count_ > UINT32_MAX)
+   {
+      fileMap_.unmap();
+      throw TxHashIndexException("invalid txhash index file");
+   }
+
+   auto fpOffset = fingerprintOffset(dirBits_);
+   auto checkOffset = fpOffset + count_ * sizeof(uint64_t);
+   auto keyOffset = checkOffset + count_ * sizeof(uint64_t);
+   if (fileMap_.size_ != keyOffset + count_ * TXHASHINDEX_KEY_LENGTH)
+   {
+      fileMap_.unmap();
+      throw TxHashIndexException("invalid txhash index file");
+   }
+
+   directory_ = (const uint32_t*)
+      (fileMap_.filePtr_ + TXHASHINDEX_HEADER_SIZE);
+   fingerprints_ = (const uint64_t*)(fileMap_.filePtr_ + fpOffset);
+   checks_ = (const uint64_t*)(fileMap_.filePtr_ + checkOffset);
+   dbKeys_ = fileMap_.filePtr_ + keyOffset;
+
+   //lookups index the entries with the directory offsets as is
+   size_t dirSize = (1ULL << dirBits_) + 1;
+   bool valid = directory_[0] == 0 && directory_[dirSize - 1] == count_;
+   for (size_t i = 1; valid && i < dirSize; i++)
+      valid = directory_[i - 1] <= directory_[i];
+
+   if (!valid)
+   {
+      fileMap_.unmap();
+      throw TxHashIndexException("corrupt txhash index directory");
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TxHashIndex::~TxHashIndex()
+{
+   try
+   {
+      fileMap_.unmap();
+   }
+   catch (runtime_error&)
+   {}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t TxHashIndex::getFingerprint(BinaryDataRef txHash)
+{
+   if (txHash.getSize() < 8)
+      throw TxHashIndexException("hash too short for fingerprint");
+
+   return READ_UINT64_BE(txHash.getPtr());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t TxHashIndex::getCheck(BinaryDataRef txHash)
+{
+   if (txHash.getSize() < 16)
+      throw TxHashIndexException("hash too short for check");
+
+   return READ_UINT64_BE(txHash.getPtr() + 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+pair<size_t, size_t> TxHashIndex::find(BinaryDataRef txHash) const
+{
+   if (count_ == 0 || txHash.getSize() < 16)
+      return make_pair(0, 0);
+
+   auto fingerprint = getFingerprint(txHash);
+   auto bucket = dirBits_ == 0 ? 0 : fingerprint >> (64 - dirBits_);
+
+   auto first = fingerprints_ + directory_[bucket];
+   auto last = fingerprints_ + directory_[bucket + 1];
+
+   //entries of the same fingerprint are sorted by check
+   auto fpRange = equal_range(first, last, fingerprint);
+   auto range = equal_range(
+      checks_ + (fpRange.first - fingerprints_), 
+      checks_ + (fpRange.second - fingerprints_),
+      getCheck(txHash));
+
+   return make_pair(range.first - checks_, range.second - checks_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef TxHashIndex::getDBKey(size_t i) const
+{
+   if (i >= count_)
+      throw TxHashIndexException("txhash index entry out of range");
+
+   return BinaryDataRef(
+      dbKeys_ + i * TXHASHINDEX_KEY_LENGTH, TXHASHINDEX_KEY_LENGTH);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TxHashIndex::write(const string& path,
+   vector<TxHashIndexEntry>& entries, unsigned coveredHeight)
+{
+   sort(entries.begin(), entries.end());
+
+   //size the directory for ~TXHASHINDEX_BUCKET_SIZE entries per bucket
+   unsigned dirBits = 0;
+   while ((entries.size() >> dirBits) > TXHASHINDEX_BUCKET_SIZE &&
+      dirBits < 32)
+      ++dirBits;
+
+   vector<uint32_t> directory((1ULL << dirBits) + 1, 0);
+   for (auto& entry : entries)
+   {
+      auto bucket = dirBits == 0 ? 0 : entry.fingerprint_ >> (64 - dirBits);
+      ++directory[bucket + 1];
+   }
+
+   for (size_t i = 1; i < directory.size(); i++)
+      directory[i] += directory[i - 1];
+
+   //header
+   BinaryWriter bw;
+   bw.put_uint32_t(TXHASHINDEX_MAGIC);
+   bw.put_uint32_t(TXHASHINDEX_VERSION);
+   bw.put_uint32_t(coveredHeight);
+   bw.put_uint32_t(dirBits);
+   bw.put_uint64_t(entries.size());
+
+   for (auto& offset : directory)
+      bw.put_uint32_t(offset);
+
+   while (bw.getSize() < fingerprintOffset(dirBits))
+      bw.put_uint8_t(0);
+
+   //fingerprints and checks are read in place, write them in host byte 
+   //order
+   for (auto& entry : entries)
+   {
+      bw.put_BinaryData(
+         (const uint8_t*)&entry.fingerprint_, sizeof(uint64_t));
+   }
+
+   for (auto& entry : entries)
+      bw.put_BinaryData((const uint8_t*)&entry.check_, sizeof(uint64_t));
+
+   for (auto& entry : entries)
+      bw.put_BinaryData(entry.dbKey_, TXHASHINDEX_KEY_LENGTH);
+
+   ofstream file(path, ios::binary | ios::trunc);
+   if (!file.is_open())
+      throw TxHashIndexException("failed to open txhash index file");
+
+   auto data = bw.getDataRef();
+   file.write((const char*)data.getPtr(), data.getSize());
+   if (!file.good())
+      throw TxHashIndexException("failed to write txhash index file");
+}
@@ -0,0 +1,103 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_TXHASHINDEX
+#define _H_TXHASHINDEX
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "BinaryData.h"
+#include "DBUtils.h"
+
+/*
+Read only txhash to 6 byte dbkey index, for block ranges that are past reorg
+depth. Entries are sorted by an 8 byte fingerprint of the tx hash and
+bucketed by its leading bits, with about 4 entries per bucket, so a lookup
+costs a directory read and a probe of a single cache line.
+
+A txid can be ground to collide with one of the indexed fingerprints at 
+little cost, so entries also carry the next 8 bytes of the hash. Matching
+128 bits of a given hash is out of reach, hits are taken as is and the tx
+isn't read back to check it.
+
+On disk layout:
+   magic (4) | version (4) | covered height (4) | directory bits (4) |
+   entry count (8) | directory ((1 << bits) + 1 x uint32) |
+   fingerprints (count x uint64) | checks (count x uint64) |
+   dbkeys (count x 6 bytes)
+*/
+
+#define TXHASHINDEX_VERSION 2
+#define TXHASHINDEX_KEY_LENGTH 6
+
+////////////////////////////////////////////////////////////////////////////////
+class TxHashIndexException : public std::runtime_error
+{
+public:
+   TxHashIndexException(const std::string& err) :
+      std::runtime_error(err)
+   {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct TxHashIndexEntry
+{
+   uint64_t fingerprint_;
+   uint64_t check_;
+   uint8_t dbKey_[TXHASHINDEX_KEY_LENGTH];
+
+   TxHashIndexEntry(BinaryDataRef txHash, BinaryDataRef dbKey);
+
+   bool operator<(const TxHashIndexEntry& rhs) const
+   {
+      if (fingerprint_ != rhs.fingerprint_)
+         return fingerprint_ < rhs.fingerprint_;
+      return check_ < rhs.check_;
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class TxHashIndex
+{
+private:
+   FileMap fileMap_;
+
+   unsigned coveredHeight_ = 0;
+   unsigned dirBits_ = 0;
+   uint64_t count_ = 0;
+
+   const uint32_t* directory_ = nullptr;
+   const uint64_t* fingerprints_ = nullptr;
+   const uint64_t* checks_ = nullptr;
+   const uint8_t* dbKeys_ = nullptr;
+
+public:
+   //mmaps the index file at path, throws on missing or invalid files
+   TxHashIndex(const std::string& path);
+   ~TxHashIndex(void);
+
+   //returns the [first, last) range of entries matching the first 16 
+   //bytes of txHash
+   std::pair<size_t, size_t> find(BinaryDataRef txHash) const;
+   BinaryDataRef getDBKey(size_t) const;
+
+   //blocks below this height are covered by the index
+   unsigned getCoveredHeight(void) const { return coveredHeight_; }
+   size_t size(void) const { return count_; }
+
+   static uint64_t getFingerprint(BinaryDataRef txHash);
+   static uint64_t getCheck(BinaryDataRef txHash);
+
+   //sorts entries and writes them to path, overwriting existing files
+   static void write(const std::string& path,
+      std::vector<TxHashIndexEntry>& entries, unsigned coveredHeight);
+};
+
+#endif
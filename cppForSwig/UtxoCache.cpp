@@ -0,0 +1,324 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+#include "UtxoCache.h"
+#include "BtcUtils.h"
+#include "DBUtils.h"
+#include "TxHashIndex.h"
+
+using namespace std;
+
+#define SLOT_EMPTY   0
+#define SLOT_LIVE    1
+#define SLOT_EVICTED 2
+#define SLOT_DELETED 3
+
+#define FLAG_COINBASE 0x01
+#define FLAG_INDB     0x02
+#define FLAG_TXVERSION_SHIFT 2
+
+////////////////////////////////////////////////////////////////////////////////
+static inline size_t getProbeStart(
+   uint64_t fingerprint, uint16_t txOutIndex, size_t mask)
+{
+   return (fingerprint ^ (txOutIndex * 0x9E3779B97F4A7C15ULL)) & mask;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline unsigned getKeyHeight(uint64_t dbKey)
+{
+   return (unsigned)(dbKey >> 40);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline size_t getCapacity(size_t count)
+{
+   size_t capacity = UTXOCACHE_MIN_SLOTS;
+   while (capacity < count * 2)
+      capacity <<= 1;
+   return capacity;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+UtxoCache::UtxoCache(size_t budget)
+{
+   setBudget(budget);
+   slots_.resize(UTXOCACHE_MIN_SLOTS);
+   for (auto& slot : slots_)
+      slot.state_ = SLOT_EMPTY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool UtxoCache::matches(const Slot& slot, uint64_t fingerprint,
+   BinaryDataRef txHash, uint16_t txOutIndex)
+{
+   //outpoints that share a fingerprint sit side by side, only the full 
+   //hash tells them apart
+   return slot.fingerprint_ == fingerprint &&
+      (uint16_t)slot.dbKey_ == txOutIndex &&
+      memcmp(slot.hashTail_, txHash.getPtr() + 8, 24) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t UtxoCache::findSlot(BinaryDataRef txHash, uint16_t txOutIndex) const
+{
+   auto fingerprint = TxHashIndex::getFingerprint(txHash);
+   auto mask = slots_.size() - 1;
+   auto id = getProbeStart(fingerprint, txOutIndex, mask);
+
+   while (true)
+   {
+      auto& slot = slots_[id];
+      if (slot.state_ == SLOT_EMPTY)
+         return SIZE_MAX;
+
+      if (slot.state_ != SLOT_DELETED &&
+         matches(slot, fingerprint, txHash, txOutIndex))
+         return id;
+
+      id = (id + 1) & mask;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoCache::rehash(size_t capacity)
+{
+   vector<Slot> oldSlots(capacity);
+   for (auto& slot : oldSlots)
+      slot.state_ = SLOT_EMPTY;
+   oldSlots.swap(slots_);
+
+   auto mask = slots_.size() - 1;
+   for (auto& slot : oldSlots)
+   {
+      if (slot.state_ != SLOT_LIVE && slot.state_ != SLOT_EVICTED)
+         continue;
+
+      auto id = getProbeStart(
+         slot.fingerprint_, (uint16_t)slot.dbKey_, mask);
+      while (slots_[id].state_ != SLOT_EMPTY)
+         id = (id + 1) & mask;
+      slots_[id] = slot;
+   }
+
+   tombstones_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t UtxoCache::entrySize(uint32_t offset) const
+{
+   return BtcUtils::TxOutCalcLength(
+      &arena_[offset], arena_.size() - offset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoCache::insert(const StoredTxOut& stxo, bool inDb)
+{
+   if (stxo.parentHash_.getSize() != 32 || !stxo.isInitialized())
+      throw runtime_error("incomplete utxo");
+
+   //keep the load under 70%, tombstones included
+   if ((count_ + tombstones_ + 1) * 10 > slots_.size() * 7)
+      rehash(getCapacity(count_ + 1));
+
+   auto fingerprint = TxHashIndex::getFingerprint(stxo.parentHash_);
+   auto mask = slots_.size() - 1;
+   auto id = getProbeStart(fingerprint, stxo.txOutIndex_, mask);
+
+   size_t freeId = SIZE_MAX;
+   while (true)
+   {
+      auto& slot = slots_[id];
+      if (slot.state_ == SLOT_EMPTY)
+      {
+         if (freeId == SIZE_MAX)
+            freeId = id;
+         break;
+      }
+
+      if (slot.state_ == SLOT_DELETED)
+      {
+         if (freeId == SIZE_MAX)
+            freeId = id;
+      }
+      else if (matches(slot, fingerprint,
+         stxo.parentHash_, stxo.txOutIndex_))
+      {
+         //already tracked, first one in stays
+         return;
+      }
+
+      id = (id + 1) & mask;
+   }
+
+   auto dataRef = stxo.dataCopy_.getRef();
+   if (arena_.size() + dataRef.getSize() > UINT32_MAX)
+      throw runtime_error("utxo cache arena overflow");
+
+   auto& slot = slots_[freeId];
+   if (slot.state_ == SLOT_DELETED)
+      --tombstones_;
+
+   auto&& dbKey = DBUtils::getBlkDataKeyNoPrefix(
+      stxo.blockHeight_, stxo.duplicateID_,
+      stxo.txIndex_, stxo.txOutIndex_);
+
+   slot.fingerprint_ = fingerprint;
+   memcpy(slot.hashTail_, stxo.parentHash_.getPtr() + 8, 24);
+   slot.dbKey_ = READ_UINT64_BE(dbKey.getPtr());
+   slot.offset_ = (uint32_t)arena_.size();
+   slot.state_ = SLOT_LIVE;
+   slot.flags_ = (uint8_t)((stxo.txVersion_ & 0x03) << FLAG_TXVERSION_SHIFT);
+   if (stxo.isCoinbase_)
+      slot.flags_ |= FLAG_COINBASE;
+   if (inDb)
+      slot.flags_ |= FLAG_INDB;
+
+   arena_.insert(arena_.end(),
+      dataRef.getPtr(), dataRef.getPtr() + dataRef.getSize());
+   ++count_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+UtxoCacheResult UtxoCache::find(
+   BinaryDataRef txHash, uint16_t txOutIndex, StoredTxOut& stxo) const
+{
+   if (count_ == 0 || txHash.getSize() != 32)
+      return UtxoCache_Miss;
+
+   auto id = findSlot(txHash, txOutIndex);
+   if (id == SIZE_MAX)
+      return UtxoCache_Miss;
+
+   auto& slot = slots_[id];
+   stxo.blockHeight_ = getKeyHeight(slot.dbKey_);
+   stxo.duplicateID_ = (uint8_t)(slot.dbKey_ >> 32);
+   stxo.txIndex_ = (uint16_t)(slot.dbKey_ >> 16);
+   stxo.txOutIndex_ = (uint16_t)slot.dbKey_;
+
+   if (slot.state_ == SLOT_EVICTED)
+      return UtxoCache_Evicted;
+
+   stxo.dataCopy_ = BinaryData(
+      &arena_[slot.offset_], entrySize(slot.offset_));
+   stxo.isCoinbase_ = (slot.flags_ & FLAG_COINBASE) != 0;
+   stxo.txVersion_ = (slot.flags_ >> FLAG_TXVERSION_SHIFT) & 0x03;
+   stxo.spentness_ = TXOUT_UNSPENT;
+
+   return UtxoCache_Hit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool UtxoCache::erase(BinaryDataRef txHash, uint16_t txOutIndex)
+{
+   if (count_ == 0 || txHash.getSize() != 32)
+      return false;
+
+   auto id = findSlot(txHash, txOutIndex);
+   if (id == SIZE_MAX)
+      return false;
+
+   auto& slot = slots_[id];
+   if (slot.state_ == SLOT_LIVE)
+      deadBytes_ += entrySize(slot.offset_);
+   else
+      --evicted_;
+
+   slot.state_ = SLOT_DELETED;
+   --count_;
+   ++tombstones_;
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoCache::enforceBudget(int committedHeight)
+{
+   //spends leave the table sparse, give the memory back
+   if (slots_.size() > UTXOCACHE_MIN_SLOTS && 
+      getCapacity(count_) * 2 < slots_.size())
+      rehash(getCapacity(count_));
+
+   auto liveBytes = arena_.size() - deadBytes_;
+   if (liveBytes <= budget_ && deadBytes_ * 2 <= arena_.size())
+      return;
+
+   //leave some headroom, we don't want to pack the arena on every batch
+   auto target = budget_ / 4 * 3;
+
+   //entries are appended, arena order is insertion order
+   vector<size_t> liveIds;
+   for (size_t i = 0; i < slots_.size(); i++)
+   {
+      if (slots_[i].state_ == SLOT_LIVE)
+         liveIds.push_back(i);
+   }
+
+   sort(liveIds.begin(), liveIds.end(),
+      [this](size_t lhs, size_t rhs)->bool
+   {
+      return slots_[lhs].offset_ < slots_[rhs].offset_;
+   });
+
+   for (auto& id : liveIds)
+   {
+      if (liveBytes <= target)
+         break;
+
+      //only drop what the db can give back
+      auto& slot = slots_[id];
+      if ((slot.flags_ & FLAG_INDB) == 0 &&
+         (int)getKeyHeight(slot.dbKey_) > committedHeight)
+         continue;
+
+      liveBytes -= entrySize(slot.offset_);
+      slot.state_ = SLOT_EVICTED;
+      slot.offset_ = 0;
+      ++evicted_;
+   }
+
+   vector<uint8_t> packed;
+   packed.reserve(liveBytes);
+   for (auto& id : liveIds)
+   {
+      auto& slot = slots_[id];
+      if (slot.state_ != SLOT_LIVE)
+         continue;
+
+      auto size = entrySize(slot.offset_);
+      auto offset = packed.size();
+      packed.insert(packed.end(),
+         arena_.begin() + slot.offset_,
+         arena_.begin() + slot.offset_ + size);
+      slot.offset_ = (uint32_t)offset;
+   }
+
+   arena_.swap(packed);
+   deadBytes_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoCache::setBudget(size_t budget)
+{
+   budget_ = min(budget, (size_t)UINT32_MAX);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t UtxoCache::getArenaSize() const
+{
+   return arena_.capacity();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t UtxoCache::getMemoryUsage() const
+{
+   return slots_.size() * sizeof(Slot) + arena_.capacity();
+}
@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_UTXOCACHE
+#define _H_UTXOCACHE
+
+#include <vector>
+
+#include "BinaryData.h"
+#include "StoredBlockObj.h"
+
+/*
+Unspent txouts tracked by the scanner. Slots are keyed by the parent tx
+hash and the txout index, with open addressing and linear probing. Probes
+start from an 8 byte fingerprint of the hash, the slot keeps the rest of it
+and hits are matched on the full outpoint. A slot carries the STXO key of 
+the txout, the raw txout (value, script) is packed in a byte arena.
+
+Past the budget, the oldest entries that are already committed to the
+STXO db are dropped from the arena. Their slot and db key are kept, lookups
+report these as evicted and the caller pulls the txout from the db.
+
+The budget only covers the arena. Slots are what tells tracked outpoints
+from the rest of the chain and can't be dropped, the table is sized by the
+tracked utxo count (~56 bytes each) and shrinks back as they are spent.
+*/
+
+#define UTXOCACHE_MIN_SLOTS 1024
+
+enum UtxoCacheResult
+{
+   UtxoCache_Miss = 0,
+   UtxoCache_Hit,
+   UtxoCache_Evicted
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class UtxoCache
+{
+private:
+   struct Slot
+   {
+      uint64_t fingerprint_;
+
+      //parent hash past the fingerprint
+      uint8_t hashTail_[24];
+
+      //height (3) | dup (1) | txindex (2) | txout index (2), big endian
+      uint64_t dbKey_;
+
+      uint32_t offset_;
+      uint8_t state_;
+
+      //coinbase, in db, tx version (2 bits)
+      uint8_t flags_;
+   };
+
+private:
+   std::vector<Slot> slots_;
+   std::vector<uint8_t> arena_;
+
+   size_t budget_;
+   size_t count_ = 0;
+   size_t tombstones_ = 0;
+   size_t evicted_ = 0;
+   size_t deadBytes_ = 0;
+
+private:
+   static bool matches(const Slot&, uint64_t, BinaryDataRef, uint16_t);
+   size_t findSlot(BinaryDataRef txHash, uint16_t txOutIndex) const;
+   void rehash(size_t capacity);
+   size_t entrySize(uint32_t offset) const;
+
+public:
+   UtxoCache(size_t budget);
+
+   //inDb flags entries that can be evicted right away
+   void insert(const StoredTxOut&, bool inDb);
+
+   //sets the key fields of stxo on hits and evictions, the txout data on
+   //hits only. parentHash_ is left to the caller.
+   UtxoCacheResult find(
+      BinaryDataRef txHash, uint16_t txOutIndex, StoredTxOut& stxo) const;
+   bool erase(BinaryDataRef txHash, uint16_t txOutIndex);
+
+   //drops entries at or below committedHeight until the arena fits in the
+   //budget, then packs it. Pass -1 when nothing was committed yet.
+   void enforceBudget(int committedHeight);
+
+   void setBudget(size_t);
+
+   size_t size(void) const { return count_; }
+   size_t evictedCount(void) const { return evicted_; }
+   size_t getArenaSize(void) const;
+
+   //slot table included
+   size_t getMemoryUsage(void) const;
+};
+
+#endif
@@ -0,0 +1,209 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "XorFilter.h"
+
+using namespace std;
+
+#define XORFILTER_MAX_ATTEMPTS 100
+
+////////////////////////////////////////////////////////////////////////////////
+static inline uint64_t rotl64(uint64_t n, unsigned c)
+{
+   return (n << (c & 63)) | (n >> ((-c) & 63));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline uint32_t getSlot(uint64_t hash, unsigned i, uint32_t blockLength)
+{
+   //i-th of the 3 slots, each picked within its own block
+   auto r = (uint32_t)rotl64(hash, i * 21);
+   return (uint32_t)(((uint64_t)r * blockLength) >> 32) + i * blockLength;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t getFingerprint(uint64_t hash)
+{
+   return (uint8_t)(hash ^ (hash >> 32));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+XorFilter::XorFilter(vector<uint64_t> keys)
+{
+   sort(keys.begin(), keys.end());
+   keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+   //peeling fails at random on small key sets, retry with new seeds
+   uint64_t seed = 0x9E3779B97F4A7C15ULL;
+   for (unsigned i = 0; i < XORFILTER_MAX_ATTEMPTS; i++)
+   {
+      if (build(keys, seed))
+         return;
+
+      seed = mix(seed, i);
+   }
+
+   throw XorFilterException("failed to build xor filter");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+XorFilter::XorFilter(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   if (brr.getSizeRemaining() < 16)
+      throw XorFilterException("xor filter data is too short");
+
+   auto version = brr.get_uint32_t();
+   if (version != XORFILTER_VERSION)
+      throw XorFilterException("unsupported xor filter version");
+
+   seed_ = brr.get_uint64_t();
+   blockLength_ = brr.get_uint32_t();
+
+   if (blockLength_ == 0 ||
+      brr.getSizeRemaining() != (size_t)blockLength_ * 3)
+      throw XorFilterException("invalid xor filter data");
+
+   fingerprints_ = brr.getCurrPtr();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+XorFilter::XorFilter(const XorFilter& obj)
+{
+   *this = obj;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+XorFilter& XorFilter::operator=(const XorFilter& rhs)
+{
+   seed_ = rhs.seed_;
+   blockLength_ = rhs.blockLength_;
+   fpVector_ = rhs.fpVector_;
+
+   if (fpVector_.size() != 0)
+      fingerprints_ = &fpVector_[0];
+   else
+      fingerprints_ = rhs.fingerprints_;
+
+   return *this;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t XorFilter::mix(uint64_t key, uint64_t seed)
+{
+   //murmur3 finalizer
+   uint64_t h = key + seed;
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+   return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool XorFilter::build(const vector<uint64_t>& keys, uint64_t seed)
+{
+   size_t capacity = 32 + (size_t)(1.23 * keys.size());
+   blockLength_ = capacity / 3;
+   capacity = (size_t)blockLength_ * 3;
+   seed_ = seed;
+
+   //xor of the hashes and count of keys mapping to each slot
+   vector<uint64_t> slotXor(capacity, 0);
+   vector<uint32_t> slotCount(capacity, 0);
+   for (auto& key : keys)
+   {
+      auto hash = mix(key, seed_);
+      for (unsigned i = 0; i < 3; i++)
+      {
+         auto slot = getSlot(hash, i, blockLength_);
+         slotXor[slot] ^= hash;
+         ++slotCount[slot];
+      }
+   }
+
+   //peel slots that have a single key left
+   vector<uint32_t> singles;
+   for (uint32_t i = 0; i < capacity; i++)
+   {
+      if (slotCount[i] == 1)
+         singles.push_back(i);
+   }
+
+   vector<pair<uint64_t, uint32_t>> peeled;
+   peeled.reserve(keys.size());
+   while (singles.size() > 0)
+   {
+      auto slot = singles.back();
+      singles.pop_back();
+      if (slotCount[slot] != 1)
+         continue;
+
+      auto hash = slotXor[slot];
+      peeled.push_back(make_pair(hash, slot));
+
+      for (unsigned i = 0; i < 3; i++)
+      {
+         auto other = getSlot(hash, i, blockLength_);
+         slotXor[other] ^= hash;
+         if (--slotCount[other] == 1)
+            singles.push_back(other);
+      }
+   }
+
+   if (peeled.size() != keys.size())
+      return false;
+
+   //assign fingerprints in reverse peeling order
+   fpVector_.assign(capacity, 0);
+   for (auto iter = peeled.rbegin(); iter != peeled.rend(); ++iter)
+   {
+      auto fp = getFingerprint(iter->first);
+      for (unsigned i = 0; i < 3; i++)
+      {
+         auto other = getSlot(iter->first, i, blockLength_);
+         if (other != iter->second)
+            fp ^= fpVector_[other];
+      }
+
+      fpVector_[iter->second] = fp;
+   }
+
+   fingerprints_ = &fpVector_[0];
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool XorFilter::contains(uint64_t key) const
+{
+   if (!isValid())
+      throw XorFilterException("uninitialized xor filter");
+
+   auto hash = mix(key, seed_);
+   auto fp = getFingerprint(hash);
+   for (unsigned i = 0; i < 3; i++)
+      fp ^= fingerprints_[getSlot(hash, i, blockLength_)];
+
+   return fp == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void XorFilter::serialize(BinaryWriter& bw) const
+{
+   if (!isValid())
+      throw XorFilterException("uninitialized xor filter");
+
+   bw.put_uint32_t(XORFILTER_VERSION);
+   bw.put_uint64_t(seed_);
+   bw.put_uint32_t(blockLength_);
+   bw.put_BinaryData(fingerprints_, (size_t)blockLength_ * 3);
+}
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2020, goatpig                                               //
+//  Distributed under the MIT license                                         //
+//  See LICENSE-MIT or https://opensource.org/licenses/MIT                    //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _H_XORFILTER
+#define _H_XORFILTER
+
+#include <vector>
+#include <stdexcept>
+
+#include "BinaryData.h"
+
+/*
+Static approximate membership filter (xor filter, 8 bit fingerprints).
+Uses ~9.9 bits per key, has no false negatives and a ~0.4% false positive
+rate. Used as a per blk file prefilter in front of TxFilterPool scans.
+
+Serialized layout:
+   version (4) | seed (8) | block length (4) | fingerprints (3 x block length)
+*/
+
+#define XORFILTER_VERSION 1
+
+////////////////////////////////////////////////////////////////////////////////
+class XorFilterException : public std::runtime_error
+{
+public:
+   XorFilterException(const std::string& err) :
+      std::runtime_error(err)
+   {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class XorFilter
+{
+private:
+   uint64_t seed_ = 0;
+   uint32_t blockLength_ = 0;
+
+   //fingerprints are either owned or point into a serialized filter
+   std::vector<uint8_t> fpVector_;
+   const uint8_t* fingerprints_ = nullptr;
+
+private:
+   static uint64_t mix(uint64_t key, uint64_t seed);
+   bool build(const std::vector<uint64_t>& keys, uint64_t seed);
+
+public:
+   XorFilter(void)
+   {}
+
+   //builds the filter, keys do not need to be unique
+   XorFilter(std::vector<uint64_t> keys);
+
+   //wraps a serialized filter without copying it, throws on bad data
+   XorFilter(BinaryDataRef);
+
+   XorFilter(const XorFilter&);
+   XorFilter& operator=(const XorFilter&);
+
+   bool isValid(void) const { return fingerprints_ != nullptr; }
+   bool contains(uint64_t key) const;
+
+   void serialize(BinaryWriter&) const;
+};
+
+#endif
@@ -696,6 +696,86 @@ TEST_F(ContainerTests, TimedStackTest_Concurrent)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(ContainerTests, BoundedQueueTest)
+{
+   BoundedQueue<uint64_t> theQueue(4);
+   unsigned iterCount = 10000;
+   atomic<size_t> maxCount;
+   maxCount.store(0, memory_order_relaxed);
+
+   auto push_thread = [&](uint64_t* tally)
+   {
+      for (unsigned i = 0; i < iterCount; i++)
+      {
+         uint64_t val = rand();
+         *tally += val;
+         theQueue.push_back(move(val));
+      }
+   };
+
+   auto pop_thread = [&](uint64_t* tally)
+   {
+      try
+      {
+         while (1)
+         {
+            auto count = theQueue.count();
+            auto current = maxCount.load(memory_order_relaxed);
+            while (count > current &&
+               !maxCount.compare_exchange_weak(current, count))
+            {}
+
+            *tally += theQueue.pop_front();
+         }
+      }
+      catch (StopBlockingLoop&)
+      {}
+   };
+
+   vector<thread> push_threads, pop_threads;
+   vector<uint64_t> push_tallies(threadCount_), pop_tallies(threadCount_);
+   for (unsigned i = 0; i < threadCount_; i++)
+   {
+      push_threads.push_back(thread(push_thread, &push_tallies[0] + i));
+      pop_threads.push_back(thread(pop_thread, &pop_tallies[0] + i));
+   }
+
+   for (auto& pushthr : push_threads)
+      if (pushthr.joinable())
+         pushthr.join();
+
+   theQueue.completed();
+
+   for (auto& popthr : pop_threads)
+      if (popthr.joinable())
+         popthr.join();
+
+   uint64_t pushtally = 0;
+   for (auto& tally : push_tallies)
+      pushtally += tally;
+
+   uint64_t poptally = 0;
+   for (auto& tally : pop_tallies)
+      poptally += tally;
+
+   EXPECT_EQ(pushtally, poptally);
+   EXPECT_EQ(theQueue.count(), 0);
+   EXPECT_LE(maxCount.load(), 4U);
+
+   //terminate releases blocked pushers
+   BoundedQueue<uint64_t> fullQueue(1);
+   fullQueue.push_back(1);
+   thread blocked([&fullQueue](void)->void
+   {
+      fullQueue.push_back(2);
+   });
+
+   fullQueue.terminate();
+   blocked.join();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 GTEST_API_ int main(int argc, char **argv)
 {
@@ -3973,6 +3973,186 @@ TEST_F(BlockObjTest, DISABLED_RegisteredTxStuff)
    EXPECT_TRUE(false);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockObjTest, HeaderStore)
+{
+   //enough headers to span several chunks and grow the hash table
+   unsigned count = HEADER_CHUNK_SIZE * 2 + 10;
+   vector<shared_ptr<BlockHeader>> headers;
+   map<unsigned, shared_ptr<BlockHeader>> heightMap;
+
+   for (unsigned i = 0; i < count; i++)
+   {
+      BinaryWriter bw;
+      bw.put_BinaryDataRef(rawHead_.getSliceRef(0, 76));
+      bw.put_uint32_t(i);
+      auto&& raw = bw.getData();
+
+      auto header = make_shared<BlockHeader>(raw);
+      header->setUniqueID(i);
+      header->setBlockHeight(count - i - 1);
+      headers.push_back(header);
+      heightMap[count - i - 1] = header;
+   }
+
+   HeaderStore store;
+   store.insert(headers);
+   store.setHeights(heightMap);
+
+   EXPECT_EQ(store.getHeightCount(), count);
+   EXPECT_EQ(store.getHeaders().size(), count);
+   EXPECT_EQ(store.getByHash(rawHead_.getSliceRef(0, 32)), nullptr);
+   EXPECT_EQ(store.getById(count), nullptr);
+   EXPECT_EQ(store.getByHeight(count), nullptr);
+
+   for (unsigned i = 0; i < count; i++)
+   {
+      auto& header = headers[i];
+      EXPECT_EQ(store.getByHash(header->getThisHash()), header);
+      EXPECT_EQ(store.getById(i), header);
+      EXPECT_EQ(store.getByHeight(count - i - 1), header);
+   }
+
+   //same hash under a new id replaces the header at that hash
+   auto replacement = make_shared<BlockHeader>(headers[5]->serialize());
+   unsigned newId = count;
+   replacement->setUniqueID(newId);
+   store.insert({ replacement });
+
+   EXPECT_EQ(store.getByHash(replacement->getThisHash()), replacement);
+   EXPECT_EQ(store.getById(5), headers[5]);
+   EXPECT_EQ(store.getById(count), replacement);
+   EXPECT_EQ(store.getHeaders().size(), count);
+   EXPECT_EQ(store.getHeadersById().size(), count + 1);
+
+   //a shorter main branch drops the heights past its top
+   unsigned shortTop = HEADER_CHUNK_SIZE + 5;
+   vector<shared_ptr<BlockHeader>> shortBranch;
+   for (unsigned i = 0; i <= shortTop; i++)
+      shortBranch.push_back(heightMap[i]);
+   store.setHeights(shortBranch);
+
+   EXPECT_EQ(store.getHeightCount(), shortTop + 1);
+   EXPECT_EQ(store.getByHeight(shortTop), heightMap[shortTop]);
+   EXPECT_EQ(store.getByHeight(shortTop + 1), nullptr);
+   EXPECT_EQ(store.getByHeight(count - 1), nullptr);
+
+   //growing back past the cut doesn't bring the dropped heights back
+   store.setHeights({ heightMap[shortTop + 3] });
+   EXPECT_EQ(store.getHeightCount(), shortTop + 4);
+   EXPECT_EQ(store.getByHeight(shortTop + 1), nullptr);
+   EXPECT_EQ(store.getByHeight(shortTop + 2), nullptr);
+   EXPECT_EQ(store.getByHeight(shortTop + 3), heightMap[shortTop + 3]);
+   EXPECT_EQ(store.getByHeight(shortTop), heightMap[shortTop]);
+
+   store.clear();
+   EXPECT_EQ(store.getHeightCount(), 0);
+   EXPECT_EQ(store.getByHash(headers[0]->getThisHash()), nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockObjTest, OrganizeWithoutGenesis)
+{
+   //headers past the genesis block are organized on top of the genesis 
+   //placeholder until the genesis header itself shows up
+   BinaryData genesisHash = rawHead_.getSliceCopy(4, 32);
+   Blockchain bc(genesisHash);
+
+   auto makeHeader = [&](const BinaryData& prevHash, 
+      uint32_t nonce, bool hard)->shared_ptr<BlockHeader>
+   {
+      BinaryWriter bw;
+      bw.put_BinaryDataRef(rawHead_.getSliceRef(0, 4));
+      bw.put_BinaryData(prevHash);
+      bw.put_BinaryDataRef(rawHead_.getSliceRef(36, 36));
+      bw.put_uint32_t(hard ? 0x196a93b3 : 0x1a6a93b3);
+      bw.put_uint32_t(nonce);
+
+      auto header = make_shared<BlockHeader>(bw.getData());
+      auto id = bc.getNewUniqueID();
+      header->setUniqueID(id);
+      return header;
+   };
+
+   auto addHeaders = [&bc](const vector<shared_ptr<BlockHeader>>& headers)
+   {
+      map<BinaryData, shared_ptr<BlockHeader>> bhMap;
+      for (auto& header : headers)
+         bhMap[header->getThisHash()] = header;
+      bc.addBlocksInBulk(bhMap, true);
+      return bc.organize(false);
+   };
+
+   vector<shared_ptr<BlockHeader>> branchA;
+   branchA.push_back(makeHeader(genesisHash, 0, false));
+   for (unsigned i = 1; i < 3; i++)
+      branchA.push_back(makeHeader(branchA.back()->getThisHash(), i, false));
+
+   auto state = addHeaders(branchA);
+   EXPECT_TRUE(state.hasNewTop_);
+   EXPECT_EQ(bc.top(), branchA[2]);
+   EXPECT_EQ(bc.top()->getBlockHeight(), 3U);
+   EXPECT_EQ(bc.getHeaderByHeight(1, 0xFF), branchA[0]);
+   EXPECT_TRUE(bc.hasHeaderByHeight(3));
+
+   //a shorter branch with more work takes over, the height index is cut
+   //back to it
+   auto branchB = makeHeader(genesisHash, 10, true);
+   state = addHeaders({ branchB });
+   EXPECT_FALSE(state.prevTopStillValid_);
+   EXPECT_EQ(bc.top(), branchB);
+   EXPECT_EQ(bc.top()->getBlockHeight(), 1U);
+   EXPECT_EQ(bc.getHeaderByHeight(1, 0xFF), branchB);
+   EXPECT_FALSE(bc.hasHeaderByHeight(2));
+   EXPECT_FALSE(branchA[0]->isMainBranch());
+
+   //as much work as the current top doesn't move it
+   auto branchC = makeHeader(genesisHash, 11, true);
+   state = addHeaders({ branchC });
+   EXPECT_TRUE(state.prevTopStillValid_);
+   EXPECT_FALSE(state.hasNewTop_);
+   EXPECT_EQ(bc.top(), branchB);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockObjTest, VerifyProofOfWork)
+{
+   EXPECT_TRUE(BtcUtils::verifyProofOfWork(rawHead_, headHashLE_));
+
+   //headers hashed elsewhere keep the hash they are given
+   BlockHeader bh;
+   bh.unserialize(rawHead_.getRef(), headHashLE_.getRef());
+   EXPECT_EQ(bh.getThisHash(), headHashLE_);
+   EXPECT_EQ(bh.getDiffBits(), READHEX("b3936a1a"));
+
+   auto withBits = [this](const string& bitsHex)->BinaryData
+   {
+      BinaryWriter bw;
+      bw.put_BinaryDataRef(rawHead_.getSliceRef(0, 72));
+      bw.put_BinaryData(READHEX(bitsHex));
+      bw.put_BinaryDataRef(rawHead_.getSliceRef(76, 4));
+      return bw.getData();
+   };
+
+   //the hash is checked against the target in the header
+   auto&& lowTarget = withBits("ffff0019");
+   EXPECT_FALSE(BtcUtils::verifyProofOfWork(
+      lowTarget, BtcUtils::getHash256(lowTarget)));
+   EXPECT_FALSE(BtcUtils::verifyProofOfWork(lowTarget, headHashLE_));
+
+   //negative, zero and overflowing targets are invalid
+   EXPECT_FALSE(BtcUtils::verifyProofOfWork(
+      withBits("0000801a"), headHashLE_));
+   EXPECT_FALSE(BtcUtils::verifyProofOfWork(
+      withBits("0000001a"), headHashLE_));
+   EXPECT_FALSE(BtcUtils::verifyProofOfWork(
+      withBits("ffffff23"), headHashLE_));
+
+   //an easier target still passes
+   EXPECT_TRUE(BtcUtils::verifyProofOfWork(
+      withBits("ffff001d"), headHashLE_));
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -4559,7 +4739,7 @@ TEST_F(StoredBlockObjTest, SHeaderDBSerFull_B1)
    sbh_.numBytes_         = 65535;
 
    // SetUp already contains sbh_.unserialize(rawHead_);
-   BinaryData flags = READHEX("97011100");
+   BinaryData flags = READHEX("97021100");
    BinaryData ntx   = READHEX("0f000000");
    BinaryData nbyte = READHEX("ffff0000");
 
@@ -4752,7 +4932,7 @@ TEST_F(StoredBlockObjTest, STxSerDBValue_1)
    StoredTx stx;
    stx.unserialize(rawTxUnfrag_);
 
-   BinaryData  first2  = READHEX("97014400"); // little-endian, of course
+   BinaryData  first2  = READHEX("97024400"); // little-endian, of course
    BinaryData  txHash  = origTx.getThisHash();
    BinaryData  fragged = stx.getSerializedTxFragged();
    BinaryData  output  = first2 + txHash + fragged;
@@ -5137,6 +5317,57 @@ TEST_F(StoredBlockObjTest, SUndoDataUnser)
    EXPECT_EQ(sud.stxOutsRemovedByBlock_[1].txIndex_, 17);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(StoredBlockObjTest, SBlockUndoSerUnser)
+{
+   StoredBlockUndo sbu(100000, 2);
+   auto&& scrAddr0 = READHEX("008dce8946f1c7763bb60ea5cf16ef514cbed0633b");
+   auto&& scrAddr1 = READHEX("006a59ac0e8f553f292dfe5e9f3aaa1da93499c15e");
+
+   auto& created = sbu.createdTxOuts_[
+      DBUtils::getBlkDataKeyNoPrefix(100000, 2, 17, 0)];
+   created.scrAddr_ = scrAddr0;
+   created.value_ = 5 * COIN;
+
+   auto& spent = sbu.spentTxOuts_[
+      DBUtils::getBlkDataKeyNoPrefix(99000, 0, 3, 1)];
+   spent.scrAddr_ = scrAddr1;
+   spent.value_ = 1234;
+
+   EXPECT_EQ(sbu.getDBKey(), 
+      READHEX("06") + DBUtils::getBlkDataKeyNoPrefix(100000, 2));
+
+   BinaryWriter bw;
+   sbu.serializeDBValue(bw);
+
+   StoredBlockUndo sbu2;
+   sbu2.unserializeDBKey(sbu.getDBKey());
+   sbu2.unserializeDBValue(bw.getDataRef());
+
+   EXPECT_EQ(sbu2.blockHeight_, 100000U);
+   EXPECT_EQ(sbu2.duplicateID_, 2);
+   ASSERT_EQ(sbu2.createdTxOuts_.size(), 1U);
+   ASSERT_EQ(sbu2.spentTxOuts_.size(), 1U);
+
+   auto& created2 = *sbu2.createdTxOuts_.begin();
+   EXPECT_EQ(created2.first, DBUtils::getBlkDataKeyNoPrefix(100000, 2, 17, 0));
+   EXPECT_EQ(created2.second.scrAddr_, scrAddr0);
+   EXPECT_EQ(created2.second.value_, 5 * COIN);
+
+   auto& spent2 = *sbu2.spentTxOuts_.begin();
+   EXPECT_EQ(spent2.first, DBUtils::getBlkDataKeyNoPrefix(99000, 0, 3, 1));
+   EXPECT_EQ(spent2.second.scrAddr_, scrAddr1);
+   EXPECT_EQ(spent2.second.value_, 1234U);
+
+   //merging keeps one entry per txout
+   StoredBlockUndo sbu3(100000, 2);
+   sbu3.spentTxOuts_[DBUtils::getBlkDataKeyNoPrefix(99000, 0, 3, 1)] = spent;
+   sbu3.spentTxOuts_[DBUtils::getBlkDataKeyNoPrefix(99000, 0, 3, 2)] = spent;
+   sbu2.merge(sbu3);
+   EXPECT_EQ(sbu2.createdTxOuts_.size(), 1U);
+   EXPECT_EQ(sbu2.spentTxOuts_.size(), 2U);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(StoredBlockObjTest, STxHintsSer)
@@ -5605,199 +5836,1545 @@ TEST_F(StoredBlockObjTest, SScriptHistoryUnser)
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
-class testBlockHeader : public ::BlockHeader
+class TxHashIndexTest : public ::testing::Test
 {
-public:
-   void setBlockHeight(uint32_t height)
+protected:
+   string path_;
+
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void SetUp(void)
    {
-      blockHeight_ = height;
+      path_ = "./txhashindex_test";
+      remove(path_.c_str());
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void TearDown(void)
+   {
+      remove(path_.c_str());
    }
 };
 
-class LMDBTest : public ::testing::Test
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TxHashIndexTest, WriteAndFind)
 {
-protected:
-   virtual void SetUp(void) 
+   map<BinaryData, BinaryData> hashToKey;
+   vector<TxHashIndexEntry> entries;
+   for (unsigned i = 0; i < 1000; i++)
    {
-      DBUtils::removeDirectory("./ldbtestdir");
-      mkdir("./ldbtestdir");
+      auto&& hash = CryptoPRNG::generateRandom(32);
+      auto&& key = DBUtils::getBlkDataKeyNoPrefix(i / 10, 0, i % 10);
+      entries.emplace_back(hash.getRef(), key.getRef());
+      hashToKey.insert(make_pair(hash, key));
+   }
 
-      zeros_ = READHEX("00000000");
-         
-      BlockDataManagerConfig::setDbType(ARMORY_DB_FULL);
-      config_.dbDir_ = string("ldbtestdir");
+   TxHashIndex::write(path_, entries, 100);
+   TxHashIndex index(path_);
+   EXPECT_EQ(index.size(), 1000ULL);
+   EXPECT_EQ(index.getCoveredHeight(), 100U);
 
-      NetworkConfig::selectNetwork(NETWORK_MODE_MAINNET);
-      magic_ = NetworkConfig::getMagicBytes();
+   for (auto& hashPair : hashToKey)
+   {
+      auto range = index.find(hashPair.first);
+      ASSERT_EQ(range.second - range.first, 1ULL);
+      EXPECT_EQ(index.getDBKey(range.first), hashPair.second);
+   }
 
-      iface_ = new LMDBBlockDatabase(nullptr, string());
+   //unknown hash
+   auto&& hash = CryptoPRNG::generateRandom(32);
+   auto range = index.find(hash);
+   EXPECT_EQ(range.first, range.second);
+}
 
-      rawHead_ = READHEX(
-         "01000000"
-         "1d8f4ec0443e1f19f305e488c1085c95de7cc3fd25e0d2c5bb5d000000000000"
-         "9762547903d36881a86751f3f5049e23050113f779735ef82734ebf0b4450081"
-         "d8c8c84d"
-         "b3936a1a"
-         "334b035b");
-      headHashLE_ = READHEX(
-         "1195e67a7a6d0674bbd28ae096d602e1f038c8254b49dfe79d47000000000000");
-      headHashBE_ = READHEX(
-         "000000000000479de7df494b25c838f0e102d696e08ad2bb74066d7a7ae69511");
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TxHashIndexTest, FingerprintCollision)
+{
+   auto&& hash = CryptoPRNG::generateRandom(32);
+   auto&& key = DBUtils::getBlkDataKeyNoPrefix(10, 0, 1);
 
-      rawTx0_ = READHEX( 
-         "01000000016290dce984203b6a5032e543e9e272d8bce934c7de4d15fa0fe44d"
-         "d49ae4ece9010000008b48304502204f2fa458d439f957308bca264689aa175e"
-         "3b7c5f78a901cb450ebd20936b2c500221008ea3883a5b80128e55c9c6070aa6"
-         "264e1e0ce3d18b7cd7e85108ce3d18b7419a0141044202550a5a6d3bb81549c4"
-         "a7803b1ad59cdbba4770439a4923624a8acfc7d34900beb54a24188f7f0a4068"
-         "9d905d4847cc7d6c8d808a457d833c2d44ef83f76bffffffff0242582c0a0000"
-         "00001976a914c1b4695d53b6ee57a28647ce63e45665df6762c288ac80d1f008"
-         "000000001976a9140e0aec36fe2545fb31a41164fb6954adcd96b34288ac0000"
-         "0000");
-      rawTx1_ = READHEX( 
-         "0100000001f658dbc28e703d86ee17c9a2d3b167a8508b082fa0745f55be5144"
-         "a4369873aa010000008c49304602210041e1186ca9a41fdfe1569d5d807ca7ff"
-         "6c5ffd19d2ad1be42f7f2a20cdc8f1cc0221003366b5d64fe81e53910e156914"
-         "091d12646bc0d1d662b7a65ead3ebe4ab8f6c40141048d103d81ac9691cf13f3"
-         "fc94e44968ef67b27f58b27372c13108552d24a6ee04785838f34624b294afee"
-         "83749b64478bb8480c20b242c376e77eea2b3dc48b4bffffffff0200e1f50500"
-         "0000001976a9141b00a2f6899335366f04b277e19d777559c35bc888ac40aeeb"
-         "02000000001976a9140e0aec36fe2545fb31a41164fb6954adcd96b34288ac00"
-         "000000");
+   vector<TxHashIndexEntry> entries;
+   entries.emplace_back(hash.getRef(), key.getRef());
+   TxHashIndex::write(path_, entries, 10);
+   TxHashIndex index(path_);
 
-      rawBlock_ = READHEX(
-         // Header
-         "01000000eb10c9a996a2340a4d74eaab41421ed8664aa49d18538bab59010000"
-         "000000005a2f06efa9f2bd804f17877537f2080030cadbfa1eb50e02338117cc"
-         "604d91b9b7541a4ecfbb0a1a64f1ade7"
-         // 3 transactions
-         "03"  
-         ///// Tx0, version
-         "01000000"
-         "01"
-         // Tx0, Txin0
-         "0000000000000000000000000000000000000000000000000000000000000000"
-         "ffffffff"
-         "08""04cfbb0a1a02360a""ffffffff"  
-         // Tx0, 1 TxOut
-         "01"
-         // Tx0, TxOut0
-         "00f2052a01000000"
-         "434104c2239c4eedb3beb26785753463be3ec62b82f6acd62efb65f452f8806f"
-         "2ede0b338e31d1f69b1ce449558d7061aa1648ddc2bf680834d3986624006a27"
-         "2dc21cac"
-         // Tx0, Locktime
-         "00000000"
-         ///// Tx1, Version 
-         "01000000"
-         // Tx1, 3 txins
-         "03"
-         // Tx1, TxIn0
-         "e8caa12bcb2e7e86499c9de49c45c5a1c6167ea4b894c8c83aebba1b6100f343"
-         "01000000"
-         "8c493046022100e2f5af5329d1244807f8347a2c8d9acc55a21a5db769e9274e"
-         "7e7ba0bb605b26022100c34ca3350df5089f3415d8af82364d7f567a6a297fcc"
-         "2c1d2034865633238b8c014104129e422ac490ddfcb7b1c405ab9fb42441246c"
-         "4bca578de4f27b230de08408c64cad03af71ee8a3140b40408a7058a1984a9f2"
-         "46492386113764c1ac132990d1""ffffffff" 
-         // Tx1, TxIn1
-         "5b55c18864e16c08ef9989d31c7a343e34c27c30cd7caa759651b0e08cae0106"
-         "00000000"
-         "8c4930460221009ec9aa3e0caf7caa321723dea561e232603e00686d4bfadf46"
-         "c5c7352b07eb00022100a4f18d937d1e2354b2e69e02b18d11620a6a9332d563"
-         "e9e2bbcb01cee559680a014104411b35dd963028300e36e82ee8cf1b0c8d5bf1"
-         "fc4273e970469f5cb931ee07759a2de5fef638961726d04bd5eb4e5072330b9b"
-         "371e479733c942964bb86e2b22""ffffffff" 
-         // Tx1, TxIn2
-         "3de0c1e913e6271769d8c0172cea2f00d6d3240afc3a20f9fa247ce58af30d2a"
-         "01000000"
-         "8c493046022100b610e169fd15ac9f60fe2b507529281cf2267673f4690ba428"
-         "cbb2ba3c3811fd022100ffbe9e3d71b21977a8e97fde4c3ba47b896d08bc09ec"
-         "b9d086bb59175b5b9f03014104ff07a1833fd8098b25f48c66dcf8fde34cbdbc"
-         "c0f5f21a8c2005b160406cbf34cc432842c6b37b2590d16b165b36a3efc9908d"
-         "65fb0e605314c9b278f40f3e1a""ffffffff" 
-         // Tx1, 2 TxOuts
-         "02"
-         // Tx1, TxOut0
-         "40420f0000000000""19""76a914adfa66f57ded1b655eb4ccd96ee07ca62bc1ddfd88ac"
-         // Tx1, TxOut1
-         "007d6a7d04000000""19""76a914981a0c9ae61fa8f8c96ae6f8e383d6e07e77133e88ac"
-         // Tx1 Locktime
-         "00000000"
-         ///// Tx2 Version
-         "01000000"
-         // Tx2 1 TxIn
-         "01"
-         "38e7586e0784280df58bd3dc5e3d350c9036b1ec4107951378f45881799c92a4"
-         "00000000"
-         "8a47304402207c945ae0bbdaf9dadba07bdf23faa676485a53817af975ddf85a"
-         "104f764fb93b02201ac6af32ddf597e610b4002e41f2de46664587a379a01613"
-         "23a85389b4f82dda014104ec8883d3e4f7a39d75c9f5bb9fd581dc9fb1b7cdf7"
-         "d6b5a665e4db1fdb09281a74ab138a2dba25248b5be38bf80249601ae688c90c"
-         "6e0ac8811cdb740fcec31d""ffffffff" 
-         // Tx2, 2 TxOuts
-         "02"
-         // Tx2, TxOut0
-         "2f66ac6105000000""19""76a914964642290c194e3bfab661c1085e47d67786d2d388ac"
-         // Tx2, TxOut1
-         "2f77e20000000000""19""76a9141486a7046affd935919a3cb4b50a8a0c233c286c88ac"
-         // Tx2 Locktime
-         "00000000");
+   //a hash sharing the fingerprint misses, entries carry 8 more bytes
+   BinaryData forged(hash);
+   forged.getPtr()[31] ^= 0xFF;
+   forged.getPtr()[15] ^= 0xFF;
+   ASSERT_EQ(TxHashIndex::getFingerprint(forged),
+      TxHashIndex::getFingerprint(hash));
 
-      rawTxUnfrag_ = READHEX(
-         // Version
-         "01000000"
-         // NumTxIn
-         "02"
-         // Start TxIn0
-         "0044fbc929d78e4203eed6f1d3d39c0157d8e5c100bbe0886779c0"
-         "ebf6a69324010000008a47304402206568144ed5e7064d6176c74738b04c08ca"
-         "19ca54ddeb480084b77f45eebfe57802207927d6975a5ac0e1bb36f5c05356dc"
-         "da1f521770511ee5e03239c8e1eecf3aed0141045d74feae58c4c36d7c35beac"
-         "05eddddc78b3ce4b02491a2eea72043978056a8bc439b99ddaad327207b09ef1"
-         "6a8910828e805b0cc8c11fba5caea2ee939346d7ffffffff"
-         // Start TxIn1
-         "45c866b219b17695"
-         "2508f8e5aea728f950186554fc4a5807e2186a8e1c4009e5000000008c493046"
-         "022100bd5d41662f98cfddc46e86ea7e4a3bc8fe9f1dfc5c4836eaf7df582596"
-         "cfe0e9022100fc459ae4f59b8279d679003b88935896acd10021b6e2e4619377"
-         "e336b5296c5e014104c00bab76a708ba7064b2315420a1c533ca9945eeff9754"
-         "cdc574224589e9113469b4e71752146a10028079e04948ecdf70609bf1b9801f"
-         "6b73ab75947ac339e5ffffffff"
-         // NumTxOut
-         "02"
-         // Start TxOut0
-         "ac4c8bd5000000001976a9148dce8946f1c7763bb60ea5cf16ef514cbed0633b88ac"
-         // Start TxOut1
-         "002f6859000000001976a9146a59ac0e8f553f292dfe5e9f3aaa1da93499c15e88ac"
-         // Locktime
-         "00000000");
+   auto range = index.find(forged);
+   EXPECT_EQ(range.first, range.second);
 
-      rawTxFragged_ = READHEX(
-         // Version
-         "01000000"
-         // NumTxIn
-         "02"
-         // Start TxIn0
-         "0044fbc929d78e4203eed6f1d3d39c0157d8e5c100bbe0886779c0"
-         "ebf6a69324010000008a47304402206568144ed5e7064d6176c74738b04c08ca"
-         "19ca54ddeb480084b77f45eebfe57802207927d6975a5ac0e1bb36f5c05356dc"
-         "da1f521770511ee5e03239c8e1eecf3aed0141045d74feae58c4c36d7c35beac"
-         "05eddddc78b3ce4b02491a2eea72043978056a8bc439b99ddaad327207b09ef1"
-         "6a8910828e805b0cc8c11fba5caea2ee939346d7ffffffff"
-         // Start TxIn1
-         "45c866b219b17695"
-         "2508f8e5aea728f950186554fc4a5807e2186a8e1c4009e5000000008c493046"
-         "022100bd5d41662f98cfddc46e86ea7e4a3bc8fe9f1dfc5c4836eaf7df582596"
-         "cfe0e9022100fc459ae4f59b8279d679003b88935896acd10021b6e2e4619377"
-         "e336b5296c5e014104c00bab76a708ba7064b2315420a1c533ca9945eeff9754"
-         "cdc574224589e9113469b4e71752146a10028079e04948ecdf70609bf1b9801f"
-         "6b73ab75947ac339e5ffffffff"
-         // NumTxOut
-         "02"
-         // ... TxOuts fragged out 
-         // Locktime
-         "00000000");
+   range = index.find(hash);
+   ASSERT_EQ(range.second - range.first, 1ULL);
+   EXPECT_EQ(index.getDBKey(range.first), key);
+
+   //both hashes indexed, each only finds its own entry
+   auto&& forgedKey = DBUtils::getBlkDataKeyNoPrefix(11, 0, 2);
+   entries.emplace_back(forged.getRef(), forgedKey.getRef());
+   TxHashIndex::write(path_, entries, 11);
+   TxHashIndex index2(path_);
+
+   range = index2.find(hash);
+   ASSERT_EQ(range.second - range.first, 1ULL);
+   EXPECT_EQ(index2.getDBKey(range.first), key);
+
+   range = index2.find(forged);
+   ASSERT_EQ(range.second - range.first, 1ULL);
+   EXPECT_EQ(index2.getDBKey(range.first), forgedKey);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TxHashIndexTest, CorruptDirectory)
+{
+   vector<TxHashIndexEntry> entries;
+   for (unsigned i = 0; i < 100; i++)
+   {
+      auto&& hash = CryptoPRNG::generateRandom(32);
+      auto&& key = DBUtils::getBlkDataKeyNoPrefix(i, 0, 0);
+      entries.emplace_back(hash.getRef(), key.getRef());
+   }
+
+   TxHashIndex::write(path_, entries, 100);
+   {
+      TxHashIndex index(path_);
+      EXPECT_EQ(index.size(), 100ULL);
+   }
+
+   //point the first bucket past the entry count
+   {
+      fstream fs(path_, ios::binary | ios::in | ios::out);
+      fs.seekp(24 + sizeof(uint32_t));
+      uint32_t offset = 0xFFFFFFF0;
+      fs.write((const char*)&offset, sizeof(offset));
+   }
+
+   EXPECT_THROW(TxHashIndex index(path_), TxHashIndexException);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TxHashIndexTest, Empty)
+{
+   vector<TxHashIndexEntry> entries;
+   TxHashIndex::write(path_, entries, 0);
+
+   TxHashIndex index(path_);
+   EXPECT_EQ(index.size(), 0ULL);
+
+   auto&& hash = CryptoPRNG::generateRandom(32);
+   auto range = index.find(hash);
+   EXPECT_EQ(range.first, range.second);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(TxFilterPoolTest, Compare)
+{
+   //3 filters with uneven lengths to hit the vectorized and tail paths
+   vector<vector<BinaryData>> hashes(3);
+   set<TxFilter<TxFilterType>> filters;
+   for (unsigned i = 0; i < hashes.size(); i++)
+   {
+      for (unsigned y = 0; y < 37 + i * 20; y++)
+         hashes[i].push_back(CryptoPRNG::generateRandom(32));
+
+      TxFilter<TxFilterType> filter(i, hashes[i].size());
+      filter.update(hashes[i]);
+      filters.insert(filter);
+   }
+
+   //same hash in filter 0 at 5 and filter 2 at 70
+   auto hash = hashes[0][5];
+   hashes[2][70] = hash;
+   TxFilter<TxFilterType> filter2(2, hashes[2].size());
+   filter2.update(hashes[2]);
+   filters.erase(filter2);
+   filters.insert(filter2);
+
+   TxFilterPool<TxFilterType> pool(filters);
+   BinaryWriter bw;
+   pool.serialize(bw);
+   TxFilterPool<TxFilterType> poolPtr(bw.getDataRef().getPtr(), bw.getSize());
+
+   for (auto poolObj : { &pool, &poolPtr })
+   {
+      auto&& result = poolObj->compare(hash);
+      ASSERT_EQ(result.size(), 2U);
+      EXPECT_EQ(result[0], set<uint32_t>({ 5 }));
+      EXPECT_EQ(result[2], set<uint32_t>({ 70 }));
+
+      EXPECT_EQ(poolObj->compare(hashes[1][56]).size(), 1U);
+      EXPECT_EQ(poolObj->compare(CryptoPRNG::generateRandom(32)).size(), 0U);
+   }
+
+   EXPECT_EQ(poolPtr.getFilterPoolPtr().size(), 3U);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(TxFilterPoolTest, Update)
+{
+   auto getFilter = [](unsigned blockKey, vector<BinaryData>& hashes)->
+      TxFilter<TxFilterType>
+   {
+      for (unsigned i = 0; i < 10 + blockKey; i++)
+         hashes.push_back(CryptoPRNG::generateRandom(32));
+
+      TxFilter<TxFilterType> filter(blockKey, hashes.size());
+      filter.update(hashes);
+      return filter;
+   };
+
+   vector<BinaryData> hashes1, hashes3, hashes2, hashes4, hashes3b;
+   set<TxFilter<TxFilterType>> filters;
+   filters.insert(getFilter(1, hashes1));
+   filters.insert(getFilter(3, hashes3));
+   TxFilterPool<TxFilterType> pool(filters);
+
+   //new keys interleave with the existing ones, existing keys win
+   set<TxFilter<TxFilterType>> newFilters;
+   newFilters.insert(getFilter(2, hashes2));
+   newFilters.insert(getFilter(4, hashes4));
+   newFilters.insert(getFilter(3, hashes3b));
+   pool.update(newFilters);
+
+   //roundtrip, pools come back from the db this way
+   BinaryWriter bw;
+   pool.serialize(bw);
+   BinaryData rawPool(bw.getData());
+   TxFilterPool<TxFilterType> poolCopy;
+   poolCopy.deserialize(rawPool.getPtr(), rawPool.getSize());
+   TxFilterPool<TxFilterType> poolPtr(bw.getDataRef().getPtr(), bw.getSize());
+
+   for (auto poolObj : { &poolCopy, &poolPtr })
+   {
+      EXPECT_EQ(poolObj->compare(hashes1[3])[1], set<uint32_t>({ 3 }));
+      EXPECT_EQ(poolObj->compare(hashes2[7])[2], set<uint32_t>({ 7 }));
+      EXPECT_EQ(poolObj->compare(hashes3[5])[3], set<uint32_t>({ 5 }));
+      EXPECT_EQ(poolObj->compare(hashes4[13])[4], set<uint32_t>({ 13 }));
+      EXPECT_EQ(poolObj->compare(hashes3b[5]).count(3), 0U);
+
+      auto&& filter = poolObj->getFilterById(2);
+      EXPECT_EQ(filter.getBlockKey(), 2U);
+      EXPECT_EQ(filter.compare(hashes2[11]), set<uint32_t>({ 11 }));
+      EXPECT_THROW(poolObj->getFilterById(5), TxFilterException);
+   }
+
+   auto&& ptrFilters = poolPtr.getFilterPoolPtr();
+   ASSERT_EQ(ptrFilters.size(), 4U);
+   for (unsigned i = 0; i < ptrFilters.size(); i++)
+      EXPECT_EQ(ptrFilters[i].getBlockKey(), 4U - i);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(TxFilterPoolTest, Prefilter)
+{
+   vector<BinaryData> hashes;
+   for (unsigned i = 0; i < 500; i++)
+      hashes.push_back(CryptoPRNG::generateRandom(32));
+
+   TxFilter<TxFilterType> filter(0, hashes.size());
+   filter.update(hashes);
+   set<TxFilter<TxFilterType>> filters;
+   filters.insert(filter);
+   TxFilterPool<TxFilterType> pool(filters);
+
+   //roundtrip through the serialized form
+   BinaryWriter bw;
+   pool.getPrefilter().serialize(bw);
+   XorFilter prefilter(bw.getDataRef());
+   ASSERT_TRUE(prefilter.isValid());
+
+   //no false negatives
+   for (auto& hash : hashes)
+      EXPECT_TRUE(prefilter.contains(*(TxFilterType*)hash.getPtr()));
+
+   //false positives around 1/256
+   unsigned hits = 0;
+   for (unsigned i = 0; i < 10000; i++)
+   {
+      auto&& hash = CryptoPRNG::generateRandom(32);
+      if (prefilter.contains(*(TxFilterType*)hash.getPtr()))
+         ++hits;
+   }
+   EXPECT_LT(hits, 200U);
+
+   //empty pools get a valid filter
+   TxFilterPool<TxFilterType> emptyPool(set<TxFilter<TxFilterType>>{});
+   EXPECT_TRUE(emptyPool.getPrefilter().isValid());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(DBObjectCacheTest, LRU)
+{
+   DBObjectCache<BinaryData> cache;
+   auto&& key1 = DBUtils::getBlkDataKeyNoPrefix(1, 0xFF, 1);
+   auto obj = make_shared<BinaryData>(READHEX("0102"));
+
+   //disabled by default
+   cache.put(key1, obj, 100);
+   EXPECT_EQ(cache.get(key1), nullptr);
+
+   //~1000 bytes per shard
+   cache.setBudget(1000 * DBOBJECTCACHE_SHARDS);
+   cache.put(key1, obj, 100);
+   ASSERT_NE(cache.get(key1), nullptr);
+   EXPECT_EQ(*cache.get(key1), READHEX("0102"));
+
+   //flood the cache, key1 is the least recently used and gets evicted
+   for (unsigned i = 2; i < 2000; i++)
+   {
+      auto&& key = DBUtils::getBlkDataKeyNoPrefix(i, 0xFF, 1);
+      cache.put(key, obj, 100);
+   }
+   EXPECT_EQ(cache.get(key1), nullptr);
+
+   auto&& stats = cache.getStats();
+   EXPECT_EQ(stats.hits_, 2ULL);
+   EXPECT_EQ(stats.misses_, 1ULL);
+   EXPECT_LE(stats.size_, 1000ULL * DBOBJECTCACHE_SHARDS);
+   EXPECT_EQ(stats.size_, stats.count_ * 100);
+
+   cache.clear();
+   EXPECT_EQ(cache.getStats().count_, 0ULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(DBMetricsTest, Histogram)
+{
+   EXPECT_EQ(DBLatencyHistogram::getBucket(0), 0U);
+   EXPECT_EQ(DBLatencyHistogram::getBucket(1), 1U);
+   EXPECT_EQ(DBLatencyHistogram::getBucket(1023), 10U);
+   EXPECT_EQ(DBLatencyHistogram::getBucket(1024), 11U);
+   EXPECT_EQ(DBLatencyHistogram::getBucket(UINT64_MAX),
+      unsigned(DBMETRICS_BUCKETS - 1));
+
+   DBLatencyHistogram hist;
+   EXPECT_EQ(hist.getPercentile(0.5), 0ULL);
+
+   //90 samples at ~1us, 10 at ~1ms
+   hist.buckets_[DBLatencyHistogram::getBucket(1000)] = 90;
+   hist.buckets_[DBLatencyHistogram::getBucket(1000000)] = 10;
+   EXPECT_EQ(hist.getCount(), 100ULL);
+   EXPECT_EQ(hist.getPercentile(0.5), 1024ULL);
+   EXPECT_EQ(hist.getPercentile(0.99), 1048576ULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(DBMetricsTest, ThreadTotals)
+{
+   auto before = DBMetrics::getStats(TXFILTERS);
+
+   //exited threads keep their share of the totals
+   auto count_lbd = [](void)->void
+   {
+      for (unsigned i = 0; i < 100; i++)
+      {
+         DBMetrics::count(TXFILTERS, DBMetrics_Get);
+         DBMetrics::count(TXFILTERS, DBMetrics_BytesRead, 10);
+         DBMetrics::record(TXFILTERS, DBMetrics_GetLatency, 500);
+      }
+   };
+
+   vector<thread> threads;
+   for (unsigned i = 0; i < 4; i++)
+      threads.push_back(thread(count_lbd));
+   for (auto& thr : threads)
+      thr.join();
+
+   count_lbd();
+
+   auto after = DBMetrics::getStats(TXFILTERS);
+   EXPECT_EQ(after.counters_[DBMetrics_Get] -
+      before.counters_[DBMetrics_Get], 500ULL);
+   EXPECT_EQ(after.counters_[DBMetrics_BytesRead] -
+      before.counters_[DBMetrics_BytesRead], 5000ULL);
+
+   auto& histAfter = after.histograms_[DBMetrics_GetLatency];
+   auto& histBefore = before.histograms_[DBMetrics_GetLatency];
+   EXPECT_EQ(histAfter.getCount() - histBefore.getCount(), 500ULL);
+   EXPECT_EQ(histAfter.totalNs_ - histBefore.totalNs_, 250000ULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(ScriptCompressionTest, TxOut)
+{
+   vector<uint64_t> amounts = {
+      0, 1, 7, 29, 100, 12345678, 50 * COIN, SCRIPTCOMPRESSION_MAX_MONEY };
+   for (auto& amount : amounts)
+   {
+      EXPECT_EQ(ScriptCompression::decompressAmount(
+         ScriptCompression::compressAmount(amount)), amount);
+   }
+   EXPECT_EQ(ScriptCompression::compressAmount(COIN), 9ULL);
+
+   vector<BinaryData> scripts = {
+      READHEX("76a9148dce8946f1c7763bb60ea5cf16ef514cbed0633b88ac"),
+      READHEX("a9148dce8946f1c7763bb60ea5cf16ef514cbed0633b87"),
+      READHEX("2103c00bab76a708ba7064b2315420a1c533ca9945eeff9754cdc574224589e91134ac"),
+      READHEX("00148dce8946f1c7763bb60ea5cf16ef514cbed0633b"),
+      READHEX("0020e471262336aa67391e57c8c6fe03bae29734079e06ff75c7fa4d0a873c83f03c"),
+      READHEX("6a0b68656c6c6f20776f726c64")
+   };
+
+   for (unsigned i = 0; i < scripts.size(); i++)
+   {
+      auto& script = scripts[i];
+      BinaryWriter bwTxOut;
+      bwTxOut.put_uint64_t(12345678);
+      bwTxOut.put_var_int(script.getSize());
+      bwTxOut.put_BinaryData(script);
+
+      BinaryWriter bw;
+      ASSERT_TRUE(ScriptCompression::compressTxOut(bw, bwTxOut.getDataRef()));
+      if (i < scripts.size() - 1)
+         EXPECT_LT(bw.getSize(), bwTxOut.getSize());
+
+      BinaryRefReader brr(bw.getDataRef());
+      EXPECT_EQ(ScriptCompression::decompressTxOut(brr), bwTxOut.getData());
+      EXPECT_EQ(brr.getSizeRemaining(), 0U);
+
+      //scrAddr without decompressing
+      BinaryRefReader brrLazy(bw.getDataRef());
+      BinaryDataRef templateRef;
+      EXPECT_EQ(ScriptCompression::readTxOut(brrLazy, templateRef), 12345678ULL);
+      EXPECT_EQ(ScriptCompression::getScrAddr(templateRef),
+         BtcUtils::getTxOutScrAddrNoCopy(script.getRef()).getScrAddr());
+   }
+
+   //stxo values, the version nibble flags the encoding
+   BinaryWriter bwTxOut;
+   bwTxOut.put_uint64_t(COIN);
+   bwTxOut.put_var_int(scripts[0].getSize());
+   bwTxOut.put_BinaryData(scripts[0]);
+
+   StoredTxOut stxo;
+   stxo.unserialize(bwTxOut.getData());
+   stxo.txVersion_ = 1;
+   stxo.spentness_ = TXOUT_SPENT;
+   stxo.spentByTxInKey_ = DBUtils::getBlkDataKeyNoPrefix(100000, 1, 127, 15);
+
+   ScriptCompression::setEnabled(true);
+   auto&& compressed = serializeDBValue(stxo);
+   ScriptCompression::setEnabled(false);
+   auto&& raw = serializeDBValue(stxo);
+
+   EXPECT_EQ(compressed.getPtr()[0] >> 4, STXO_VALUE_COMPRESSED);
+   EXPECT_EQ(raw.getPtr()[0] >> 4, STXO_VALUE_RAW);
+   EXPECT_LT(compressed.getSize(), raw.getSize());
+
+   for (auto& val : { compressed, raw })
+   {
+      StoredTxOut stxoUnser;
+      stxoUnser.unserializeDBValue(val);
+      EXPECT_EQ(stxoUnser.dataCopy_, bwTxOut.getData());
+      EXPECT_EQ(stxoUnser.spentness_, TXOUT_SPENT);
+      EXPECT_EQ(stxoUnser.spentByTxInKey_, stxo.spentByTxInKey_);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(ScriptCompressionTest, SubHistory)
+{
+   BinaryData uniq = READHEX("00""0000ffff0000ffff0000ffff0000ffff0000ffff");
+   BinaryData hgtX = READHEX("0000ff00");
+   BinaryData compressed = READHEX("01""04""09""0004""0004");
+   BinaryData raw = READHEX("01""00""00e1f50500000000""0004""0004");
+
+   BinaryWriter bw;
+   bw.put_uint8_t(DB_PREFIX_SCRIPT);
+   bw.put_BinaryData(uniq);
+   bw.put_BinaryData(hgtX);
+
+   StoredSubHistory subssh;
+   subssh.unserializeDBKey(bw.getData());
+   subssh.unserializeDBValue(compressed);
+   ASSERT_EQ(subssh.txioMap_.size(), 1U);
+   EXPECT_EQ(subssh.txioMap_.begin()->second.getValue(), COIN);
+
+   ScriptCompression::setEnabled(true);
+   EXPECT_EQ(serializeDBValue(subssh), compressed);
+   ScriptCompression::setEnabled(false);
+   EXPECT_EQ(serializeDBValue(subssh), raw);
+
+   //supernode txio flags
+   uint64_t value = 9;
+   EXPECT_EQ(StoredSubHistory::readTxioFlag(
+      SUBSSH_FLAG_SPENT ^ SUBSSH_FLAG_AMOUNT, value), SUBSSH_FLAG_SPENT);
+   EXPECT_EQ(value, COIN);
+   EXPECT_EQ(StoredSubHistory::readTxioFlag(
+      SUBSSH_FLAG_UNSPENT, value), SUBSSH_FLAG_UNSPENT);
+   EXPECT_EQ(value, COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(ShardedDBTest, Spentness)
+{
+   DBUtils::removeDirectory("./shardtestdir");
+   mkdir("./shardtestdir");
+
+   NetworkConfig::selectNetwork(NETWORK_MODE_MAINNET);
+   DatabaseContainer::baseDir_ = "./shardtestdir";
+   DatabaseContainer::magicBytes_ = NetworkConfig::getMagicBytes();
+
+   vector<unsigned> heights = { 10, 400000, 500000, 600000 };
+   auto getKey = [](unsigned height, uint16_t txid)->BinaryData
+   {
+      return DBUtils::getBlkDataKeyNoPrefix(UINT32_MAX - height, 0, txid, 0);
+   };
+
+   {
+      DatabaseContainer_Sharded db(SPENTNESS);
+      db.open();
+
+      set<unsigned> shardIds;
+      for (auto& height : heights)
+         shardIds.insert(db.getShardIdForKey(getKey(height, 0)));
+      EXPECT_EQ(shardIds.size(), heights.size());
+
+      //one writer per shard
+      auto write_lbd = [&db, &getKey](unsigned height)->void
+      {
+         auto tx = db.beginTransaction(LMDB::ReadWrite);
+         for (uint16_t i = 0; i < 10; i++)
+            db.putValue(getKey(height, i), WRITE_UINT32_BE(height));
+      };
+
+      vector<thread> threads;
+      for (auto& height : heights)
+         threads.push_back(thread(write_lbd, height));
+      for (auto& thr : threads)
+         thr.join();
+
+      auto tx = db.beginTransaction(LMDB::ReadWrite);
+      auto&& sdbi = db.getStoredDBInfo(0);
+      sdbi.metaInt_ = 12;
+      db.putStoredDBInfo(sdbi, UINT32_MAX);
+   }
+
+   //shards are picked up from disk
+   DatabaseContainer_Sharded db(SPENTNESS);
+   db.open();
+
+   auto tx = db.beginTransaction(LMDB::ReadOnly);
+   EXPECT_EQ(db.getStoredDBInfo(UINT32_MAX).metaInt_, 12U);
+   EXPECT_EQ(BinaryData(db.getValue(getKey(500000, 3))), 
+      WRITE_UINT32_BE(500000));
+   EXPECT_EQ(db.getValue(getKey(500001, 3)).getSize(), 0U);
+
+   //key order across shards, top height first
+   auto dbIter = db.getIterator();
+   ASSERT_TRUE(dbIter->seekToFirst());
+   BinaryData prevKey;
+   unsigned count = 0;
+   do
+   {
+      EXPECT_TRUE(prevKey < dbIter->getKey());
+      prevKey = dbIter->getKey();
+      ++count;
+   } while (dbIter->advanceAndRead());
+   EXPECT_EQ(count, 40U);
+
+   //bulk reads span shards
+   {
+      auto batchIter = db.getIterator();
+      ASSERT_TRUE(batchIter->seekToFirst());
+
+      vector<LDBIterSpan> spans(16);
+      vector<BinaryData> batchKeys;
+      size_t batchCount;
+      while ((batchCount = batchIter->readBatch(
+         spans.data(), spans.size(), LDBITER_PREFETCH_BYTES)) > 0)
+      {
+         for (size_t i = 0; i < batchCount; i++)
+            batchKeys.push_back(spans[i].key_);
+      }
+
+      ASSERT_EQ(batchKeys.size(), 40U);
+      EXPECT_EQ(batchKeys[0], getKey(600000, 0));
+      EXPECT_EQ(batchKeys[39], getKey(10, 9));
+      for (unsigned i = 1; i < batchKeys.size(); i++)
+         EXPECT_TRUE(batchKeys[i - 1] < batchKeys[i]);
+
+      ASSERT_TRUE(batchIter->seekTo(getKey(500000, 5)));
+      EXPECT_EQ(batchIter->readBatch(spans.data(), 3, 0), 3U);
+      EXPECT_EQ(spans[2].key_, getKey(500000, 7));
+      ASSERT_TRUE(batchIter->readIterData());
+      EXPECT_EQ(batchIter->getKey(), getKey(500000, 8));
+   }
+
+   ASSERT_TRUE(dbIter->seekTo(getKey(550000, 0)));
+   EXPECT_EQ(dbIter->getKey(), getKey(500000, 0));
+
+   ASSERT_TRUE(dbIter->seekToBefore(getKey(550000, 0)));
+   EXPECT_EQ(dbIter->getKey(), getKey(600000, 9));
+   
+   ASSERT_TRUE(dbIter->seekToExact(getKey(500000, 0)));
+   ASSERT_TRUE(dbIter->retreat());
+   ASSERT_TRUE(dbIter->readIterData());
+   EXPECT_EQ(dbIter->getKey(), getKey(600000, 9));
+
+   ASSERT_TRUE(dbIter->seekToLast());
+   EXPECT_EQ(dbIter->getKey(), getKey(10, 9));
+   EXPECT_FALSE(dbIter->seekTo(getKey(5, 0)));
+
+   dbIter.reset();
+   tx.reset();
+   db.eraseOnDisk();
+   EXPECT_EQ(db.getMapUsage().first, 0U);
+   DBUtils::removeDirectory("./shardtestdir");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(ShardedDBTest, CompactCopy)
+{
+   DBUtils::removeDirectory("./shardtestdir");
+   DBUtils::removeDirectory("./shardsnapshotdir");
+   mkdir("./shardtestdir");
+   mkdir("./shardsnapshotdir");
+
+   NetworkConfig::selectNetwork(NETWORK_MODE_MAINNET);
+   DatabaseContainer::baseDir_ = "./shardtestdir";
+   DatabaseContainer::magicBytes_ = NetworkConfig::getMagicBytes();
+
+   auto getKey = [](unsigned height, uint16_t txid)->BinaryData
+   {
+      return DBUtils::getBlkDataKeyNoPrefix(UINT32_MAX - height, 0, txid, 0);
+   };
+
+   vector<unsigned> heights = { 10, 600000 };
+   {
+      DatabaseContainer_Sharded db(SPENTNESS);
+      db.open();
+
+      {
+         auto tx = db.beginTransaction(LMDB::ReadWrite);
+         for (auto& height : heights)
+         {
+            for (uint16_t i = 0; i < 10; i++)
+               db.putValue(getKey(height, i), WRITE_UINT32_BE(height));
+         }
+      }
+
+      //copy with a reader live on the db
+      mutex writeMutex;
+      atomic<bool> cancel;
+      cancel.store(true);
+      auto tx = db.beginTransaction(LMDB::ReadOnly);
+
+      //a cancelled copy leaves nothing behind
+      EXPECT_ANY_THROW(
+         db.compactCopy("./shardsnapshotdir", writeMutex, cancel));
+      EXPECT_EQ(DBUtils::getDirectoryContent("./shardsnapshotdir").size(), 0U);
+
+      cancel.store(false);
+      db.compactCopy("./shardsnapshotdir", writeMutex, cancel);
+   }
+
+   //the snapshot opens as is
+   DatabaseContainer::baseDir_ = "./shardsnapshotdir";
+   DatabaseContainer_Sharded db(SPENTNESS);
+   db.open();
+
+   auto tx = db.beginTransaction(LMDB::ReadOnly);
+   for (auto& height : heights)
+   {
+      EXPECT_EQ(BinaryData(db.getValue(getKey(height, 9))),
+         WRITE_UINT32_BE(height));
+   }
+
+   tx.reset();
+   db.close();
+   DBUtils::removeDirectory("./shardtestdir");
+   DBUtils::removeDirectory("./shardsnapshotdir");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(ShardedDBTest, UncommittedShards)
+{
+   DBUtils::removeDirectory("./shardtestdir");
+   mkdir("./shardtestdir");
+
+   NetworkConfig::selectNetwork(NETWORK_MODE_MAINNET);
+   DatabaseContainer::baseDir_ = "./shardtestdir";
+   DatabaseContainer::magicBytes_ = NetworkConfig::getMagicBytes();
+
+   auto getKey = [](unsigned height, uint16_t txid)->BinaryData
+   {
+      return DBUtils::getBlkDataKeyNoPrefix(UINT32_MAX - height, 0, txid, 0);
+   };
+
+   vector<unsigned> heights = { 10, 600000 };
+   unsigned topShard, newShard;
+   {
+      DatabaseContainer_Sharded db(SPENTNESS);
+      db.open();
+
+      auto tx = db.beginTransaction(LMDB::ReadWrite);
+      for (auto& height : heights)
+      {
+         for (uint16_t i = 0; i < 10; i++)
+            db.putValue(getKey(height, i), WRITE_UINT32_BE(height));
+      }
+
+      topShard = db.getShardIdForKey(getKey(600000, 0));
+      newShard = db.getShardIdForKey(getKey(700000, 0));
+      ASSERT_EQ(db.getShardIdForKey(getKey(600001, 0)), topShard);
+      ASSERT_NE(newShard, topShard);
+   }
+
+   //shard writes that never made it to meta, as left by a crash between 
+   //the shard and the meta commits
+   auto&& dbName = DatabaseContainer::getDbName(SPENTNESS);
+   for (auto& shardPair : map<unsigned, unsigned>(
+      { {topShard, 600001}, {newShard, 700000} }))
+   {
+      DBPair shard(shardPair.first);
+      shard.open(DatabaseContainer::getDbPath(
+         dbName + "-" + to_string(shardPair.first)), dbName);
+
+      auto tx = shard.beginTransaction(LMDB::ReadWrite);
+      shard.putValue(getKey(shardPair.second, 0), 
+         WRITE_UINT32_BE(shardPair.second));
+   }
+
+   //open drops them, committed entries stay
+   DatabaseContainer_Sharded db(SPENTNESS);
+   db.open();
+
+   {
+      auto tx = db.beginTransaction(LMDB::ReadOnly);
+      EXPECT_EQ(db.getValue(getKey(600001, 0)).getSize(), 0U);
+      EXPECT_EQ(db.getValue(getKey(700000, 0)).getSize(), 0U);
+      for (auto& height : heights)
+      {
+         EXPECT_EQ(BinaryData(db.getValue(getKey(height, 9))),
+            WRITE_UINT32_BE(height));
+      }
+   }
+
+   //committed writes extend the ranges
+   {
+      auto tx = db.beginTransaction(LMDB::ReadWrite);
+      db.putValue(getKey(600001, 0), WRITE_UINT32_BE(600001));
+   }
+
+   db.close();
+   db.open();
+
+   {
+      auto tx = db.beginTransaction(LMDB::ReadOnly);
+      EXPECT_EQ(BinaryData(db.getValue(getKey(600001, 0))),
+         WRITE_UINT32_BE(600001));
+   }
+
+   db.close();
+   DBUtils::removeDirectory("./shardtestdir");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(SshTaskTest, SplitShards)
+{
+   SshBounds bounds;
+   SshMapping mapping;
+   auto task = make_shared<SshTask>(&bounds, READHEX("00"), READHEX("ff"), 0, 7);
+
+   unsigned id;
+   ASSERT_TRUE(task->claimShard(id));
+   EXPECT_EQ(id, 0U);
+
+   //the owner keeps the shard in progress, thieves get the upper half of
+   //the ones left
+   vector<pair<unsigned, unsigned>> expected = { {4, 7}, {2, 3}, {1, 1} };
+   for (auto& range : expected)
+   {
+      unique_lock<mutex> lock(task->mu_);
+      auto stolen = task->split(mapping);
+      ASSERT_NE(stolen, nullptr);
+
+      EXPECT_EQ(stolen->currentId_, range.first);
+      EXPECT_EQ(stolen->idEnd_, range.second);
+      EXPECT_EQ(task->idEnd_, range.first - 1);
+      EXPECT_EQ(stolen->keyStart_, task->keyStart_);
+      EXPECT_EQ(stolen->keyEnd_, task->keyEnd_);
+   }
+
+   //last shard, no keys in the mapping to split on
+   unique_lock<mutex> lock(task->mu_);
+   EXPECT_EQ(task->split(mapping), nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(SshTaskTest, SplitKeys)
+{
+   /***
+   Keys are spread over 3 byte prefixes with the lowest and highest key of
+   each prefix present, so whichever prefix a split lands on, the keys on
+   both sides of the boundary are there. Some prefixes end in 0x00 to 
+   make the owner's keyEnd_ borrow across bytes.
+   ***/
+
+   set<BinaryData> keys;
+   SshMapping mapping;
+   for (uint8_t first : { 0x00, 0x05 })
+   {
+      for (uint8_t second : { 0x00, 0x10, 0x11, 0xFF })
+      {
+         for (uint8_t third : { 0x00, 0x01, 0x7F, 0xFE, 0xFF })
+         {
+            vector<BinaryData> suffixes = {
+               READHEX(string(36, '0')),
+               READHEX(string(36, 'f')),
+               CryptoPRNG::generateRandom(18) };
+
+            for (auto& suffix : suffixes)
+            {
+               BinaryWriter bw;
+               bw.put_uint8_t(first);
+               bw.put_uint8_t(second);
+               bw.put_uint8_t(third);
+               bw.put_BinaryData(suffix);
+               keys.insert(bw.getData());
+            }
+
+            //same layout as the subssh db mapping
+            mapping.count_ += 3;
+            auto mapping1 = mapping.getMappingForKey(first);
+            mapping1->count_ += 3;
+            auto mapping2 = mapping1->getMappingForKey(second);
+            mapping2->count_ += 3;
+            mapping2->getMappingForKey(third)->count_ += 3;
+         }
+      }
+   }
+
+   //each task walks the keys from its start, as the parser threads do
+   struct Walker
+   {
+      shared_ptr<SshTask> task_;
+      set<BinaryData>::iterator iter_;
+      bool done_;
+   };
+
+   SshBounds bounds;
+   vector<Walker> walkers;
+   auto addWalker = [&keys, &walkers](shared_ptr<SshTask> task)->void
+   {
+      unsigned id;
+      ASSERT_TRUE(task->claimShard(id));
+      EXPECT_EQ(id, 0U);
+      walkers.push_back({ task, keys.lower_bound(task->keyStart_), false });
+   };
+
+   addWalker(make_shared<SshTask>(&bounds, READHEX("00"), READHEX("ff"), 0, 0));
+
+   map<BinaryData, unsigned> claimed;
+   unsigned step = 0;
+   unsigned splits = 0;
+   while (true)
+   {
+      //every third step, split the next task in line
+      if (++step % 3 == 0)
+      {
+         auto task = walkers[step % walkers.size()].task_;
+         shared_ptr<SshTask> stolen;
+         {
+            unique_lock<mutex> lock(task->mu_);
+            stolen = task->split(mapping);
+         }
+
+         if (stolen != nullptr)
+         {
+            ++splits;
+            addWalker(stolen);
+            continue;
+         }
+      }
+
+      //advance the tasks in turn
+      Walker* walker = nullptr;
+      for (unsigned i = 0; i < walkers.size(); i++)
+      {
+         auto& candidate = walkers[(step + i) % walkers.size()];
+         if (!candidate.done_)
+         {
+            walker = &candidate;
+            break;
+         }
+      }
+
+      if (walker == nullptr)
+         break;
+
+      if (walker->iter_ == keys.end() || 
+          !walker->task_->claimKey(*walker->iter_))
+      {
+         walker->task_->completeShard();
+         walker->done_ = true;
+         continue;
+      }
+
+      ++claimed[*walker->iter_];
+      ++walker->iter_;
+   }
+
+   EXPECT_GT(splits, 4U);
+   ASSERT_EQ(claimed.size(), keys.size());
+   for (auto& claim : claimed)
+      EXPECT_EQ(claim.second, 1U);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(UtxoCacheTest, Budget)
+{
+   auto getUtxo = [](unsigned height, uint16_t txid, uint16_t id)->StoredTxOut
+   {
+      BinaryWriter bw;
+      bw.put_uint64_t(height * 1000 + id);
+      bw.put_var_int(25);
+      bw.put_BinaryData(READHEX("76a914"));
+      bw.put_BinaryData(BtcUtils::getHash160(WRITE_UINT32_BE(height)));
+      bw.put_BinaryData(READHEX("88ac"));
+
+      StoredTxOut stxo;
+      stxo.dataCopy_ = bw.getData();
+      stxo.parentHash_ = BtcUtils::getHash256(
+         WRITE_UINT32_BE(height * 0x10000 + txid));
+      stxo.blockHeight_ = height;
+      stxo.duplicateID_ = 0;
+      stxo.txIndex_ = txid;
+      stxo.txOutIndex_ = id;
+      stxo.isCoinbase_ = txid == 0;
+      return stxo;
+   };
+
+   //500 txouts, 34 bytes each, over a budget of 8kB for the arena
+   UtxoCache cache(8192);
+
+   for (unsigned height = 1; height <= 10; height++)
+   {
+      for (uint16_t txid = 0; txid < 10; txid++)
+      {
+         for (uint16_t id = 0; id < 5; id++)
+            cache.insert(getUtxo(height, txid, id), false);
+      }
+   }
+   EXPECT_EQ(cache.size(), 500U);
+
+   auto check = [&](unsigned height, uint16_t txid, uint16_t id)->UtxoCacheResult
+   {
+      auto&& utxo = getUtxo(height, txid, id);
+      StoredTxOut stxo;
+      auto result = cache.find(utxo.parentHash_, id, stxo);
+      if (result == UtxoCache_Miss)
+         return result;
+
+      EXPECT_EQ(stxo.getDBKey(), utxo.getDBKey());
+      if (result == UtxoCache_Hit)
+      {
+         EXPECT_EQ(stxo.dataCopy_, utxo.dataCopy_);
+         EXPECT_EQ(stxo.isCoinbase_, utxo.isCoinbase_);
+      }
+      return result;
+   };
+
+   EXPECT_EQ(check(1, 0, 0), UtxoCache_Hit);
+   EXPECT_EQ(check(10, 9, 4), UtxoCache_Hit);
+   EXPECT_EQ(check(10, 9, 5), UtxoCache_Miss);
+   EXPECT_EQ(check(11, 0, 0), UtxoCache_Miss);
+
+   //nothing committed, nothing to evict
+   cache.enforceBudget(-1);
+   EXPECT_EQ(cache.evictedCount(), 0U);
+   EXPECT_EQ(check(1, 3, 2), UtxoCache_Hit);
+
+   //only heights 1 to 5 can go, that's not enough to fit the budget
+   cache.enforceBudget(5);
+   EXPECT_EQ(cache.evictedCount(), 250U);
+   EXPECT_EQ(check(1, 3, 2), UtxoCache_Evicted);
+   EXPECT_EQ(check(5, 9, 4), UtxoCache_Evicted);
+   EXPECT_EQ(check(6, 0, 0), UtxoCache_Hit);
+   EXPECT_EQ(check(10, 9, 4), UtxoCache_Hit);
+
+   //committing more evicts the oldest first
+   cache.enforceBudget(10);
+   EXPECT_EQ(check(6, 0, 0), UtxoCache_Evicted);
+   EXPECT_EQ(check(10, 9, 4), UtxoCache_Hit);
+   EXPECT_LE(cache.getArenaSize(), 8192U);
+
+   //the slot table doesn't count against the budget, a budget it alone 
+   //exceeds doesn't evict more than the arena needs
+   auto evicted = cache.evictedCount();
+   cache.setBudget(8192 / 4 * 3);
+   cache.enforceBudget(10);
+   EXPECT_EQ(cache.evictedCount(), evicted);
+   EXPECT_GT(cache.getMemoryUsage(), 8192U);
+
+   //spent entries go away, evicted or not
+   EXPECT_TRUE(cache.erase(getUtxo(1, 3, 2).parentHash_, 2));
+   EXPECT_TRUE(cache.erase(getUtxo(10, 9, 4).parentHash_, 4));
+   EXPECT_FALSE(cache.erase(getUtxo(10, 9, 4).parentHash_, 4));
+   EXPECT_EQ(check(1, 3, 2), UtxoCache_Miss);
+   EXPECT_EQ(check(10, 9, 4), UtxoCache_Miss);
+   EXPECT_EQ(check(10, 9, 3), UtxoCache_Hit);
+   EXPECT_EQ(cache.size(), 498U);
+
+   //spending most of the set shrinks the table back
+   UtxoCache bigCache(SIZE_MAX);
+   for (unsigned height = 1; height <= 100; height++)
+   {
+      for (uint16_t txid = 0; txid < 4; txid++)
+      {
+         for (uint16_t id = 0; id < 5; id++)
+            bigCache.insert(getUtxo(height, txid, id), false);
+      }
+   }
+
+   auto slotBytes = bigCache.getMemoryUsage() - bigCache.getArenaSize();
+   for (unsigned height = 1; height < 100; height++)
+   {
+      for (uint16_t txid = 0; txid < 4; txid++)
+      {
+         for (uint16_t id = 0; id < 5; id++)
+            bigCache.erase(getUtxo(height, txid, id).parentHash_, id);
+      }
+   }
+
+   bigCache.enforceBudget(100);
+   EXPECT_EQ(bigCache.size(), 20U);
+   EXPECT_LT(bigCache.getMemoryUsage() - bigCache.getArenaSize(), slotBytes);
+
+   StoredTxOut stxo;
+   EXPECT_EQ(bigCache.find(getUtxo(100, 3, 4).parentHash_, 4, stxo), 
+      UtxoCache_Hit);
+   EXPECT_EQ(bigCache.find(getUtxo(99, 3, 4).parentHash_, 4, stxo), 
+      UtxoCache_Miss);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(UtxoCacheTest, FingerprintCollision)
+{
+   //two outpoints that share the 8 byte fingerprint, only the rest of the
+   //hash tells them apart
+   auto getUtxo = [](const BinaryData& hash, unsigned height)->StoredTxOut
+   {
+      BinaryWriter bw;
+      bw.put_uint64_t(height * COIN);
+      bw.put_var_int(25);
+      bw.put_BinaryData(READHEX("76a914"));
+      bw.put_BinaryData(BtcUtils::getHash160(WRITE_UINT32_BE(height)));
+      bw.put_BinaryData(READHEX("88ac"));
+
+      StoredTxOut stxo;
+      stxo.dataCopy_ = bw.getData();
+      stxo.parentHash_ = hash;
+      stxo.blockHeight_ = height;
+      stxo.duplicateID_ = 0;
+      stxo.txIndex_ = 1;
+      stxo.txOutIndex_ = 0;
+      stxo.isCoinbase_ = false;
+      return stxo;
+   };
+
+   auto&& hashA = BtcUtils::getHash256(READHEX("aa"));
+   auto hashB = hashA;
+   hashB.getPtr()[31] ^= 0x01;
+   auto hashC = hashA;
+   hashC.getPtr()[8] ^= 0x01;
+   ASSERT_EQ(TxHashIndex::getFingerprint(hashA),
+      TxHashIndex::getFingerprint(hashB));
+
+   auto&& utxoA = getUtxo(hashA, 10);
+   auto&& utxoB = getUtxo(hashB, 20);
+
+   UtxoCache cache(SIZE_MAX);
+   cache.insert(utxoA, false);
+
+   //the attacker's outpoint isn't tracked, it can't spend ours
+   StoredTxOut stxo;
+   EXPECT_EQ(cache.find(hashB, 0, stxo), UtxoCache_Miss);
+   EXPECT_EQ(cache.find(hashC, 0, stxo), UtxoCache_Miss);
+   EXPECT_FALSE(cache.erase(hashB, 0));
+   EXPECT_EQ(cache.size(), 1U);
+
+   //both tracked, each resolves to its own txout
+   cache.insert(utxoB, false);
+   EXPECT_EQ(cache.size(), 2U);
+
+   ASSERT_EQ(cache.find(hashA, 0, stxo), UtxoCache_Hit);
+   EXPECT_EQ(stxo.getDBKey(), utxoA.getDBKey());
+   EXPECT_EQ(stxo.dataCopy_, utxoA.dataCopy_);
+
+   ASSERT_EQ(cache.find(hashB, 0, stxo), UtxoCache_Hit);
+   EXPECT_EQ(stxo.getDBKey(), utxoB.getDBKey());
+   EXPECT_EQ(stxo.dataCopy_, utxoB.dataCopy_);
+
+   //same outpoint again, first one in stays
+   cache.insert(getUtxo(hashB, 30), false);
+   EXPECT_EQ(cache.size(), 2U);
+
+   //spending one leaves the other, evicted entries keep the full hash
+   EXPECT_TRUE(cache.erase(hashB, 0));
+   EXPECT_EQ(cache.find(hashB, 0, stxo), UtxoCache_Miss);
+   cache.setBudget(0);
+   cache.enforceBudget(10);
+   EXPECT_EQ(cache.find(hashB, 0, stxo), UtxoCache_Miss);
+   ASSERT_EQ(cache.find(hashA, 0, stxo), UtxoCache_Evicted);
+   EXPECT_EQ(stxo.getDBKey(), utxoA.getDBKey());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(ScanPipelineTest, Allocation)
+{
+   ScanPipeline pipeline(8);
+   EXPECT_EQ(pipeline.getThreadCount(), 8U);
+
+   //work items are claimed off a shared counter, copies stop once it's
+   //exhausted
+   auto runBatch = [&pipeline](ScanStage stage, unsigned itemCount,
+      unsigned sleepUs)->unsigned
+   {
+      atomic<unsigned> counter, processed;
+      counter.store(0, memory_order_relaxed);
+      processed.store(0, memory_order_relaxed);
+
+      pipeline.run(stage, [&](void)->void
+      {
+         while (counter.fetch_add(1, memory_order_relaxed) < itemCount)
+         {
+            this_thread::sleep_for(chrono::microseconds(sleepUs));
+            processed.fetch_add(1, memory_order_relaxed);
+         }
+      });
+
+      pipeline.record(stage, 1000000);
+      return processed.load();
+   };
+
+   //no history, stages get the whole pool
+   EXPECT_EQ(runBatch(ScanStage_Outputs, 100, 100), 100U);
+   EXPECT_EQ(pipeline.getStats(ScanStage_Outputs).lastWorkers_, 8U);
+
+   EXPECT_EQ(runBatch(ScanStage_Inputs, 10, 100), 10U);
+   EXPECT_EQ(pipeline.getStats(ScanStage_Inputs).lastWorkers_, 8U);
+
+   //stages that run concurrently split the pool by cost
+   thread slowStage([&](void)->void
+   {
+      runBatch(ScanStage_Outputs, 4000, 100);
+   });
+
+   this_thread::sleep_for(chrono::milliseconds(20));
+   EXPECT_EQ(runBatch(ScanStage_Inputs, 10, 100), 10U);
+   slowStage.join();
+
+   EXPECT_LT(pipeline.getStats(ScanStage_Inputs).lastWorkers_, 8U);
+   EXPECT_EQ(pipeline.getStats(ScanStage_Outputs).batches_, 2U);
+
+   //stages that never call run are their own single worker
+   pipeline.record(ScanStage_Read, 5000);
+   auto stats = pipeline.getStats(ScanStage_Read);
+   EXPECT_EQ(stats.lastWorkers_, 1U);
+   EXPECT_EQ(stats.workerNs_, 5000U);
+
+   //exceptions make it back to the caller
+   EXPECT_THROW(pipeline.run(ScanStage_Parse, [](void)->void
+   {
+      throw runtime_error("stage error");
+   }), runtime_error);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(BlockDataLoaderTest, Readahead)
+{
+   DBUtils::removeDirectory("./readaheaddir");
+   mkdir("./readaheaddir");
+
+   //6 blk files, filled with their id
+   for (unsigned i = 0; i < 6; i++)
+   {
+      auto&& path = BtcUtils::getBlkFilename("./readaheaddir", i);
+      ofstream os(path.c_str(), ios::out | ios::binary);
+      string data(20000, (char)i);
+      os.write(data.c_str(), data.size());
+   }
+
+   BlockDataLoader bdl("./readaheaddir");
+
+   //not running, nothing is prefetched
+   bdl.readahead(0);
+   EXPECT_EQ(bdl.prefetchedCount(), 0U);
+
+   bdl.startReadahead(2, 2);
+   bdl.readahead(0);
+   EXPECT_EQ(bdl.prefetchedCount(), 2U);
+
+   //prefetched maps are handed out once
+   auto fileMap = bdl.get(1);
+   ASSERT_NE(fileMap->getPtr(), nullptr);
+   EXPECT_EQ(fileMap->size(), 20000U);
+   EXPECT_EQ(fileMap->getPtr()[19999], 1);
+   EXPECT_EQ(bdl.prefetchedCount(), 1U);
+
+   bdl.readahead(1);
+   EXPECT_EQ(bdl.prefetchedCount(), 2U);
+
+   //skipped files are dropped, the queue stops at the last file
+   bdl.readahead(4);
+   EXPECT_EQ(bdl.prefetchedCount(), 1U);
+   fileMap = bdl.get(5);
+   EXPECT_EQ(fileMap->getPtr()[0], 5);
+
+   bdl.stopReadahead();
+   EXPECT_EQ(bdl.prefetchedCount(), 0U);
+
+   //released maps drop their pages, the data reads back from the file
+   fileMap.reset();
+   fileMap = bdl.get(5);
+   EXPECT_EQ(fileMap->getPtr()[10000], 5);
+
+   fileMap.reset();
+   DBUtils::removeDirectory("./readaheaddir");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(Sha256MultiTest, Kernels)
+{
+   //lengths around the padding edges, and more messages than lanes
+   vector<BinaryData> msgs;
+   vector<size_t> lengths = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000 };
+   for (unsigned i = 0; i < 40; i++)
+   {
+      BinaryData msg(lengths[i % lengths.size()] + i / lengths.size());
+      for (size_t y = 0; y < msg.getSize(); y++)
+         msg.getPtr()[y] = (uint8_t)(y * 31 + i);
+      msgs.push_back(move(msg));
+   }
+
+   vector<BinaryDataRef> refs;
+   vector<BinaryData> expected;
+   for (auto& msg : msgs)
+   {
+      refs.push_back(msg.getRef());
+      expected.push_back(BtcUtils::getHash256(msg));
+   }
+
+   vector<Sha256Kernel> kernels = { Sha256Kernel_Scalar,
+      Sha256Kernel_SSE4, Sha256Kernel_AVX2, Sha256Kernel_SHANI };
+   for (auto& kernel : kernels)
+   {
+      if (!Sha256Multi::isSupported(kernel))
+         continue;
+
+      //batches smaller and larger than the lane count
+      for (size_t count : { (size_t)1, (size_t)3, msgs.size() })
+      {
+         vector<BinaryData> digests(count);
+         vector<uint8_t*> digestPtrs;
+         for (auto& digest : digests)
+         {
+            digest.resize(32);
+            digestPtrs.push_back(digest.getPtr());
+         }
+
+         Sha256Multi::getHash256(kernel, refs.data(), digestPtrs.data(), count);
+         for (size_t i = 0; i < count; i++)
+            EXPECT_EQ(digests[i], expected[i]) <<
+               Sha256Multi::getKernelName(kernel) << ", msg #" << i;
+      }
+   }
+
+   EXPECT_TRUE(Sha256Multi::isSupported(Sha256Multi::getKernel()));
+   EXPECT_EQ(BtcUtils::getHash256Many(refs), expected);
+
+   //odd levels pair the last node with itself
+   vector<BinaryData> leaves(expected.begin(), expected.begin() + 5);
+   auto pair = [](const BinaryData& a, const BinaryData& b)->BinaryData
+   {
+      BinaryData data(a);
+      data.append(b);
+      return BtcUtils::getHash256(data);
+   };
+
+   auto&& l1a = pair(leaves[0], leaves[1]);
+   auto&& l1b = pair(leaves[2], leaves[3]);
+   auto&& l1c = pair(leaves[4], leaves[4]);
+   auto&& root = pair(pair(l1a, l1b), pair(l1c, l1c));
+
+   auto&& tree = BtcUtils::calculateMerkleTree(leaves);
+   EXPECT_EQ(tree.size(), 11U);
+   EXPECT_EQ(tree[5], l1a);
+   EXPECT_EQ(BtcUtils::calculateMerkleRoot(leaves), root);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST(GcsFilterTest, MatchItems)
+{
+   //bip158 basic filter for the testnet genesis block
+   auto&& genesisHash = READHEX(
+      "43497fd7f826957108f4a30fd9cec3aeba79972084e90ead01ea330900000000");
+   auto&& coinbaseScript = READHEX(
+      "4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61de"
+      "b649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac");
+
+   vector<BinaryDataRef> genesisItems = { coinbaseScript.getRef() };
+   auto&& genesisFilter = GcsFilter::build(genesisHash, genesisItems);
+   EXPECT_EQ(genesisFilter, READHEX("019dfca8"));
+
+   GcsFilter gcsGenesis(genesisHash, genesisFilter);
+   EXPECT_EQ(gcsGenesis.getItemCount(), 1ULL);
+   EXPECT_TRUE(gcsGenesis.match(coinbaseScript.getRef()));
+
+   //duplicates count once
+   auto blockHash = BtcUtils::getHash256(READHEX("0102030405"));
+   vector<BinaryData> items;
+   for (unsigned i = 0; i < 500; i++)
+   {
+      BinaryWriter bw;
+      bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
+      bw.put_BinaryData(BtcUtils::getHash160(WRITE_UINT32_LE(i)));
+      items.push_back(bw.getData());
+   }
+
+   vector<BinaryDataRef> itemRefs;
+   for (auto& item : items)
+      itemRefs.push_back(item.getRef());
+   itemRefs.push_back(items[0].getRef());
+
+   auto&& filterData = GcsFilter::build(blockHash, itemRefs);
+   GcsFilter filter(blockHash, filterData);
+   EXPECT_EQ(filter.getItemCount(), 500ULL);
+
+   //no false negatives
+   for (auto& item : items)
+      EXPECT_TRUE(filter.match(item.getRef()));
+   EXPECT_TRUE(filter.matchAny({ items[250].getRef(), items[499].getRef() }));
+
+   //false positives at ~1/M per item
+   vector<BinaryData> others;
+   vector<BinaryDataRef> otherRefs;
+   unsigned falsePositives = 0;
+   for (unsigned i = 1000; i < 11000; i++)
+   {
+      others.push_back(BtcUtils::getHash160(WRITE_UINT32_LE(i)));
+      if (filter.match(others.back().getRef()))
+         ++falsePositives;
+   }
+   EXPECT_LT(falsePositives, 5U);
+
+   for (auto& other : others)
+      otherRefs.push_back(other.getRef());
+   otherRefs.push_back(items[123].getRef());
+   EXPECT_TRUE(filter.matchAny(otherRefs));
+
+   //same items under another block key, different filter
+   auto&& otherFilter = GcsFilter::build(genesisHash, itemRefs);
+   EXPECT_NE(otherFilter, filterData);
+
+   //empty sets match nothing
+   auto&& emptyData = GcsFilter::build(blockHash, {});
+   GcsFilter emptyFilter(blockHash, emptyData);
+   EXPECT_EQ(emptyData.getSize(), 1U);
+   EXPECT_EQ(emptyFilter.getItemCount(), 0ULL);
+   EXPECT_FALSE(emptyFilter.match(items[0].getRef()));
+   EXPECT_FALSE(filter.matchAny({}));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class testBlockHeader : public ::BlockHeader
+{
+public:
+   void setBlockHeight(uint32_t height)
+   {
+      blockHeight_ = height;
+   }
+};
+
+class LMDBTest : public ::testing::Test
+{
+protected:
+   virtual void SetUp(void) 
+   {
+      DBUtils::removeDirectory("./ldbtestdir");
+      mkdir("./ldbtestdir");
+
+      zeros_ = READHEX("00000000");
+         
+      BlockDataManagerConfig::setDbType(ARMORY_DB_FULL);
+      config_.dbDir_ = string("ldbtestdir");
+
+      NetworkConfig::selectNetwork(NETWORK_MODE_MAINNET);
+      magic_ = NetworkConfig::getMagicBytes();
+
+      iface_ = new LMDBBlockDatabase(nullptr, string());
+
+      rawHead_ = READHEX(
+         "01000000"
+         "1d8f4ec0443e1f19f305e488c1085c95de7cc3fd25e0d2c5bb5d000000000000"
+         "9762547903d36881a86751f3f5049e23050113f779735ef82734ebf0b4450081"
+         "d8c8c84d"
+         "b3936a1a"
+         "334b035b");
+      headHashLE_ = READHEX(
+         "1195e67a7a6d0674bbd28ae096d602e1f038c8254b49dfe79d47000000000000");
+      headHashBE_ = READHEX(
+         "000000000000479de7df494b25c838f0e102d696e08ad2bb74066d7a7ae69511");
+
+      rawTx0_ = READHEX( 
+         "01000000016290dce984203b6a5032e543e9e272d8bce934c7de4d15fa0fe44d"
+         "d49ae4ece9010000008b48304502204f2fa458d439f957308bca264689aa175e"
+         "3b7c5f78a901cb450ebd20936b2c500221008ea3883a5b80128e55c9c6070aa6"
+         "264e1e0ce3d18b7cd7e85108ce3d18b7419a0141044202550a5a6d3bb81549c4"
+         "a7803b1ad59cdbba4770439a4923624a8acfc7d34900beb54a24188f7f0a4068"
+         "9d905d4847cc7d6c8d808a457d833c2d44ef83f76bffffffff0242582c0a0000"
+         "00001976a914c1b4695d53b6ee57a28647ce63e45665df6762c288ac80d1f008"
+         "000000001976a9140e0aec36fe2545fb31a41164fb6954adcd96b34288ac0000"
+         "0000");
+      rawTx1_ = READHEX( 
+         "0100000001f658dbc28e703d86ee17c9a2d3b167a8508b082fa0745f55be5144"
+         "a4369873aa010000008c49304602210041e1186ca9a41fdfe1569d5d807ca7ff"
+         "6c5ffd19d2ad1be42f7f2a20cdc8f1cc0221003366b5d64fe81e53910e156914"
+         "091d12646bc0d1d662b7a65ead3ebe4ab8f6c40141048d103d81ac9691cf13f3"
+         "fc94e44968ef67b27f58b27372c13108552d24a6ee04785838f34624b294afee"
+         "83749b64478bb8480c20b242c376e77eea2b3dc48b4bffffffff0200e1f50500"
+         "0000001976a9141b00a2f6899335366f04b277e19d777559c35bc888ac40aeeb"
+         "02000000001976a9140e0aec36fe2545fb31a41164fb6954adcd96b34288ac00"
+         "000000");
+
+      rawBlock_ = READHEX(
+         // Header
+         "01000000eb10c9a996a2340a4d74eaab41421ed8664aa49d18538bab59010000"
+         "000000005a2f06efa9f2bd804f17877537f2080030cadbfa1eb50e02338117cc"
+         "604d91b9b7541a4ecfbb0a1a64f1ade7"
+         // 3 transactions
+         "03"  
+         ///// Tx0, version
+         "01000000"
+         "01"
+         // Tx0, Txin0
+         "0000000000000000000000000000000000000000000000000000000000000000"
+         "ffffffff"
+         "08""04cfbb0a1a02360a""ffffffff"  
+         // Tx0, 1 TxOut
+         "01"
+         // Tx0, TxOut0
+         "00f2052a01000000"
+         "434104c2239c4eedb3beb26785753463be3ec62b82f6acd62efb65f452f8806f"
+         "2ede0b338e31d1f69b1ce449558d7061aa1648ddc2bf680834d3986624006a27"
+         "2dc21cac"
+         // Tx0, Locktime
+         "00000000"
+         ///// Tx1, Version 
+         "01000000"
+         // Tx1, 3 txins
+         "03"
+         // Tx1, TxIn0
+         "e8caa12bcb2e7e86499c9de49c45c5a1c6167ea4b894c8c83aebba1b6100f343"
+         "01000000"
+         "8c493046022100e2f5af5329d1244807f8347a2c8d9acc55a21a5db769e9274e"
+         "7e7ba0bb605b26022100c34ca3350df5089f3415d8af82364d7f567a6a297fcc"
+         "2c1d2034865633238b8c014104129e422ac490ddfcb7b1c405ab9fb42441246c"
+         "4bca578de4f27b230de08408c64cad03af71ee8a3140b40408a7058a1984a9f2"
+         "46492386113764c1ac132990d1""ffffffff" 
+         // Tx1, TxIn1
+         "5b55c18864e16c08ef9989d31c7a343e34c27c30cd7caa759651b0e08cae0106"
+         "00000000"
+         "8c4930460221009ec9aa3e0caf7caa321723dea561e232603e00686d4bfadf46"
+         "c5c7352b07eb00022100a4f18d937d1e2354b2e69e02b18d11620a6a9332d563"
+         "e9e2bbcb01cee559680a014104411b35dd963028300e36e82ee8cf1b0c8d5bf1"
+         "fc4273e970469f5cb931ee07759a2de5fef638961726d04bd5eb4e5072330b9b"
+         "371e479733c942964bb86e2b22""ffffffff" 
+         // Tx1, TxIn2
+         "3de0c1e913e6271769d8c0172cea2f00d6d3240afc3a20f9fa247ce58af30d2a"
+         "01000000"
+         "8c493046022100b610e169fd15ac9f60fe2b507529281cf2267673f4690ba428"
+         "cbb2ba3c3811fd022100ffbe9e3d71b21977a8e97fde4c3ba47b896d08bc09ec"
+         "b9d086bb59175b5b9f03014104ff07a1833fd8098b25f48c66dcf8fde34cbdbc"
+         "c0f5f21a8c2005b160406cbf34cc432842c6b37b2590d16b165b36a3efc9908d"
+         "65fb0e605314c9b278f40f3e1a""ffffffff" 
+         // Tx1, 2 TxOuts
+         "02"
+         // Tx1, TxOut0
+         "40420f0000000000""19""76a914adfa66f57ded1b655eb4ccd96ee07ca62bc1ddfd88ac"
+         // Tx1, TxOut1
+         "007d6a7d04000000""19""76a914981a0c9ae61fa8f8c96ae6f8e383d6e07e77133e88ac"
+         // Tx1 Locktime
+         "00000000"
+         ///// Tx2 Version
+         "01000000"
+         // Tx2 1 TxIn
+         "01"
+         "38e7586e0784280df58bd3dc5e3d350c9036b1ec4107951378f45881799c92a4"
+         "00000000"
+         "8a47304402207c945ae0bbdaf9dadba07bdf23faa676485a53817af975ddf85a"
+         "104f764fb93b02201ac6af32ddf597e610b4002e41f2de46664587a379a01613"
+         "23a85389b4f82dda014104ec8883d3e4f7a39d75c9f5bb9fd581dc9fb1b7cdf7"
+         "d6b5a665e4db1fdb09281a74ab138a2dba25248b5be38bf80249601ae688c90c"
+         "6e0ac8811cdb740fcec31d""ffffffff" 
+         // Tx2, 2 TxOuts
+         "02"
+         // Tx2, TxOut0
+         "2f66ac6105000000""19""76a914964642290c194e3bfab661c1085e47d67786d2d388ac"
+         // Tx2, TxOut1
+         "2f77e20000000000""19""76a9141486a7046affd935919a3cb4b50a8a0c233c286c88ac"
+         // Tx2 Locktime
+         "00000000");
+
+      rawTxUnfrag_ = READHEX(
+         // Version
+         "01000000"
+         // NumTxIn
+         "02"
+         // Start TxIn0
+         "0044fbc929d78e4203eed6f1d3d39c0157d8e5c100bbe0886779c0"
+         "ebf6a69324010000008a47304402206568144ed5e7064d6176c74738b04c08ca"
+         "19ca54ddeb480084b77f45eebfe57802207927d6975a5ac0e1bb36f5c05356dc"
+         "da1f521770511ee5e03239c8e1eecf3aed0141045d74feae58c4c36d7c35beac"
+         "05eddddc78b3ce4b02491a2eea72043978056a8bc439b99ddaad327207b09ef1"
+         "6a8910828e805b0cc8c11fba5caea2ee939346d7ffffffff"
+         // Start TxIn1
+         "45c866b219b17695"
+         "2508f8e5aea728f950186554fc4a5807e2186a8e1c4009e5000000008c493046"
+         "022100bd5d41662f98cfddc46e86ea7e4a3bc8fe9f1dfc5c4836eaf7df582596"
+         "cfe0e9022100fc459ae4f59b8279d679003b88935896acd10021b6e2e4619377"
+         "e336b5296c5e014104c00bab76a708ba7064b2315420a1c533ca9945eeff9754"
+         "cdc574224589e9113469b4e71752146a10028079e04948ecdf70609bf1b9801f"
+         "6b73ab75947ac339e5ffffffff"
+         // NumTxOut
+         "02"
+         // Start TxOut0
+         "ac4c8bd5000000001976a9148dce8946f1c7763bb60ea5cf16ef514cbed0633b88ac"
+         // Start TxOut1
+         "002f6859000000001976a9146a59ac0e8f553f292dfe5e9f3aaa1da93499c15e88ac"
+         // Locktime
+         "00000000");
+
+      rawTxFragged_ = READHEX(
+         // Version
+         "01000000"
+         // NumTxIn
+         "02"
+         // Start TxIn0
+         "0044fbc929d78e4203eed6f1d3d39c0157d8e5c100bbe0886779c0"
+         "ebf6a69324010000008a47304402206568144ed5e7064d6176c74738b04c08ca"
+         "19ca54ddeb480084b77f45eebfe57802207927d6975a5ac0e1bb36f5c05356dc"
+         "da1f521770511ee5e03239c8e1eecf3aed0141045d74feae58c4c36d7c35beac"
+         "05eddddc78b3ce4b02491a2eea72043978056a8bc439b99ddaad327207b09ef1"
+         "6a8910828e805b0cc8c11fba5caea2ee939346d7ffffffff"
+         // Start TxIn1
+         "45c866b219b17695"
+         "2508f8e5aea728f950186554fc4a5807e2186a8e1c4009e5000000008c493046"
+         "022100bd5d41662f98cfddc46e86ea7e4a3bc8fe9f1dfc5c4836eaf7df582596"
+         "cfe0e9022100fc459ae4f59b8279d679003b88935896acd10021b6e2e4619377"
+         "e336b5296c5e014104c00bab76a708ba7064b2315420a1c533ca9945eeff9754"
+         "cdc574224589e9113469b4e71752146a10028079e04948ecdf70609bf1b9801f"
+         "6b73ab75947ac339e5ffffffff"
+         // NumTxOut
+         "02"
+         // ... TxOuts fragged out 
+         // Locktime
+         "00000000");
 
       rawTxOut0_ = READHEX(
          // Value
@@ -5984,7 +7561,7 @@ TEST_F(LMDBTest, OpenClose)
 
    // 0123 4567 0123 4567
    // 0000 0010 0001 ---- ---- ---- ---- ----
-   BinaryData flags = READHEX("97011000");
+   BinaryData flags = READHEX("97021000");
    BinaryData ff = READHEX("ffffffffffffffff");
 
    for(uint32_t i=0; i<HList.size(); i++)
@@ -6010,7 +7587,7 @@ TEST_F(LMDBTest, OpenCloseOpenNominal)
 {
    // 0123 4567 0123 4567
    // 0000 0010 0001 ---- ---- ---- ---- ----
-   BinaryData flags = READHEX("97011000");
+   BinaryData flags = READHEX("97021000");
    BinaryData ff = READHEX("ffffffffffffffff");
 
    iface_->openDatabases(
@@ -6046,7 +7623,7 @@ TEST_F(LMDBTest, OpenCloseOpenNominal)
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(LMDBTest, PutGetDelete)
 {
-   BinaryData flags = READHEX("97011000");
+   BinaryData flags = READHEX("97021000");
    BinaryData ff = READHEX("ffffffffffffffff");
 
    iface_->openDatabases(
@@ -6284,6 +7861,197 @@ TEST_F(LMDBTest, PutGetStoredTxHints)
    EXPECT_EQ(   sths.preferredDBKey_.getSize(), 0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(LMDBTest, MapGrowth)
+{
+   //setup db env with a map too small for the data
+   LMDBEnv dbEnv;
+   dbEnv.open("./ldbtestdir/mapgrowth", MDB_NOTLS);
+   dbEnv.setMapSize(1024 * 1024);
+   dbEnv.setMapGrowth(2.0f, 256 * 1024);
+
+   LMDB db;
+   db.open(&dbEnv, "test");
+
+   //keep readers busy while the writer grows the map, growth goes in
+   //between their txns
+   atomic<bool> done(false);
+   auto readThread = [&]()->void
+   {
+      while (!done.load())
+      {
+         {
+            auto tx = LMDBEnv::Transaction(&dbEnv, LMDB::ReadOnly);
+            auto iter = db.begin();
+            while (iter.isValid())
+               ++iter;
+         }
+
+         this_thread::sleep_for(chrono::microseconds(100));
+      }
+   };
+   thread readThr(readThread);
+
+   map<BinaryData, BinaryData> keyValMap;
+   for (unsigned i = 0; i < 32; i++)
+   {
+      auto tx = LMDBEnv::Transaction(&dbEnv, LMDB::ReadWrite);
+      for (unsigned y = 0; y < 64; y++)
+      {
+         auto&& key = CryptoPRNG::generateRandom(20);
+         auto&& val = CryptoPRNG::generateRandom(1024);
+         
+         CharacterArrayRef carKey(key.getSize(), key.getPtr());
+         CharacterArrayRef carVal(val.getSize(), val.getPtr());
+         ASSERT_NO_THROW(db.insert(carKey, carVal));
+         keyValMap.insert(make_pair(key, val));
+      }
+   }
+
+   done.store(true);
+   readThr.join();
+
+   EXPECT_GT(dbEnv.getMapSize(), 1024 * 1024);
+   EXPECT_GT(dbEnv.getUsedSize(), 2 * 1024 * 1024);
+   EXPECT_LE(dbEnv.getUsedSize(), dbEnv.getMapSize());
+
+   {
+      auto tx = LMDBEnv::Transaction(&dbEnv, LMDB::ReadOnly);
+      auto iter = db.begin();
+      for (auto& keyVal : keyValMap)
+      {
+         ASSERT_TRUE(iter.isValid());
+         BinaryDataRef key(
+            (uint8_t*)iter.key().mv_data, iter.key().mv_size);
+         BinaryDataRef val(
+            (uint8_t*)iter.value().mv_data, iter.value().mv_size);
+         EXPECT_EQ(key, keyVal.first);
+         EXPECT_EQ(val, keyVal.second);
+         ++iter;
+      }
+      EXPECT_FALSE(iter.isValid());
+   }
+
+   db.close();
+   dbEnv.close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(LMDBTest, MapFull_Replay)
+{
+   LMDBEnv dbEnv;
+   dbEnv.open("./ldbtestdir/mapfull", MDB_NOTLS);
+   dbEnv.setMapSize(1024 * 1024);
+   dbEnv.setMapGrowth(2.0f, 256 * 1024);
+
+   LMDB db;
+   db.open(&dbEnv, "test");
+
+   map<BinaryData, BinaryData> keyValMap;
+   auto put = [&](map<BinaryData, BinaryData>& kvMap)->void
+   {
+      auto&& key = CryptoPRNG::generateRandom(20);
+      auto&& val = CryptoPRNG::generateRandom(1024);
+
+      CharacterArrayRef carKey(key.getSize(), key.getPtr());
+      CharacterArrayRef carVal(val.getSize(), val.getPtr());
+      db.insert(carKey, carVal);
+      kvMap.insert(make_pair(key, val));
+   };
+
+   {
+      //a single txn 2 times the size of the map, no other txn is live,
+      //it is replayed in a grown map
+      auto tx = LMDBEnv::Transaction(&dbEnv, LMDB::ReadWrite);
+      for (unsigned i = 0; i < 16; i++)
+         ASSERT_NO_THROW(put(keyValMap));
+
+      //iterators opened before the replay get a cursor in the new txn
+      auto iter = db.begin();
+      ASSERT_TRUE(iter.isValid());
+      auto firstKey = keyValMap.begin()->first;
+
+      for (unsigned i = 0; i < 2048; i++)
+         ASSERT_NO_THROW(put(keyValMap));
+
+      iter.seek(CharacterArrayRef(firstKey.getSize(), firstKey.getPtr()));
+      ASSERT_TRUE(iter.isValid());
+      BinaryDataRef key((uint8_t*)iter.key().mv_data, iter.key().mv_size);
+      EXPECT_EQ(key, firstKey);
+
+      ++iter;
+      auto mapIter = keyValMap.upper_bound(firstKey);
+      ASSERT_TRUE(iter.isValid());
+      key = BinaryDataRef((uint8_t*)iter.key().mv_data, iter.key().mv_size);
+      EXPECT_EQ(key, mapIter->first);
+   }
+
+   EXPECT_GT(dbEnv.getMapSize(), 2 * 1024 * 1024);
+   EXPECT_LE(dbEnv.getUsedSize(), dbEnv.getMapSize());
+
+   //a reader holds its txn while the writer fills the map, the map 
+   //cannot be swapped under it: the write fails and nobody waits
+   auto mapSize = dbEnv.getMapSize();
+   atomic<bool> reading(false);
+   atomic<bool> written(false);
+   auto readThread = [&]()->void
+   {
+      auto tx = LMDBEnv::Transaction(&dbEnv, LMDB::ReadOnly);
+      reading.store(true);
+      while (!written.load())
+         this_thread::sleep_for(chrono::milliseconds(1));
+   };
+   thread readThr(readThread);
+   while (!reading.load())
+      this_thread::sleep_for(chrono::milliseconds(1));
+
+   map<BinaryData, BinaryData> failedMap;
+   {
+      auto tx = LMDBEnv::Transaction(&dbEnv, LMDB::ReadWrite);
+
+      bool failed = false;
+      for (unsigned i = 0; i < 8192 && !failed; i++)
+      {
+         try
+         {
+            put(failedMap);
+         }
+         catch (LMDBException&)
+         {
+            failed = true;
+         }
+      }
+
+      EXPECT_TRUE(failed);
+   }
+   EXPECT_EQ(dbEnv.getMapSize(), mapSize);
+
+   //the last txn to close grows the map for the failed batch
+   written.store(true);
+   readThr.join();
+   EXPECT_GT(dbEnv.getMapSize(), mapSize);
+
+   {
+      auto tx = LMDBEnv::Transaction(&dbEnv, LMDB::ReadOnly);
+      auto iter = db.begin();
+      for (auto& keyVal : keyValMap)
+      {
+         ASSERT_TRUE(iter.isValid());
+         BinaryDataRef key(
+            (uint8_t*)iter.key().mv_data, iter.key().mv_size);
+         BinaryDataRef val(
+            (uint8_t*)iter.value().mv_data, iter.value().mv_size);
+         EXPECT_EQ(key, keyVal.first);
+         EXPECT_EQ(val, keyVal.second);
+         ++iter;
+      }
+      EXPECT_FALSE(iter.isValid());
+   }
+
+   db.close();
+   dbEnv.close();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 class TxRefTest : public ::testing::Test
@@ -6759,6 +8527,106 @@ TEST_F(BlockDir, BlockFileSplitUpdate)
    delete BDMt;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockDir, BlockFileWatcher)
+{
+   TestUtils::setBlocks({ "0", "1" }, blk0dat_);
+
+   mutex mu;
+   condition_variable cv;
+   unsigned count = 0;
+
+   auto callback = [&mu, &cv, &count](void)->void
+   {
+      unique_lock<mutex> lock(mu);
+      ++count;
+      cv.notify_all();
+   };
+
+   auto waitOnCount = [&mu, &cv, &count](unsigned expected)->bool
+   {
+      unique_lock<mutex> lock(mu);
+      return cv.wait_for(lock, chrono::seconds(10),
+         [&count, expected](void)->bool { return count >= expected; });
+   };
+
+   {
+      BlockFileWatcher watcher(blkdir_, 50, callback);
+      watcher.start();
+      EXPECT_TRUE(watcher.usesInotify());
+
+      //only blk files are watched
+      auto revFile = blkdir_ + "/rev00000.dat";
+      TestUtils::setBlocks({ "0" }, revFile);
+      this_thread::sleep_for(chrono::milliseconds(200));
+      EXPECT_EQ(count, 0);
+
+      TestUtils::appendBlocks({ "2" }, blk0dat_);
+      EXPECT_TRUE(waitOnCount(1));
+
+      //new blk file
+      TestUtils::setBlocks({ "3" }, BtcUtils::getBlkFilename(blkdir_, 1));
+      EXPECT_TRUE(waitOnCount(2));
+   }
+
+   //missing folder, falls back to polling
+   auto pollDir = blkdir_ + "/poll";
+   BlockFileWatcher watcher(pollDir, 50, callback);
+   watcher.start();
+   EXPECT_FALSE(watcher.usesInotify());
+
+   mkdir(pollDir);
+   TestUtils::setBlocks({ "0", "1" }, BtcUtils::getBlkFilename(pollDir, 0));
+   EXPECT_TRUE(waitOnCount(3));
+
+   TestUtils::appendBlocks({ "2" }, BtcUtils::getBlkFilename(pollDir, 0));
+   EXPECT_TRUE(waitOnCount(4));
+
+   watcher.shutdown();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockDir, BlockDataFileMap_Grow)
+{
+   TestUtils::setBlocks({ "0", "1" }, blk0dat_);
+
+   auto readFile = [this](void)->BinaryData
+   {
+      ifstream file(blk0dat_, ios::binary);
+      string str((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+      return BinaryData::fromString(str);
+   };
+
+   BlockDataFileMap fileMap(blk0dat_);
+   auto&& data = readFile();
+   ASSERT_EQ(fileMap.size(), data.getSize());
+   EXPECT_FALSE(fileMap.grow());
+
+   //appended bytes get mapped
+   TestUtils::appendBlocks({ "2", "3" }, blk0dat_);
+   data = readFile();
+   EXPECT_TRUE(fileMap.grow());
+   ASSERT_EQ(fileMap.size(), data.getSize());
+   EXPECT_EQ(BinaryDataRef(fileMap.getPtr(), fileMap.size()), data.getRef());
+   EXPECT_FALSE(fileMap.grow());
+
+   //a truncated file is mapped again
+   TestUtils::setBlocks({ "0" }, blk0dat_);
+   data = readFile();
+   EXPECT_TRUE(fileMap.grow());
+   ASSERT_EQ(fileMap.size(), data.getSize());
+   EXPECT_EQ(BinaryDataRef(fileMap.getPtr(), fileMap.size()), data.getRef());
+
+   //so is a replaced one, even at the same size
+   auto tmpPath = blkdir_ + "/tmp.dat";
+   TestUtils::setBlocks({ "0" }, tmpPath);
+   ASSERT_EQ(rename(tmpPath.c_str(), blk0dat_.c_str()), 0);
+   data = readFile();
+   EXPECT_TRUE(fileMap.grow());
+   ASSERT_EQ(fileMap.size(), data.getSize());
+   EXPECT_EQ(BinaryDataRef(fileMap.getPtr(), fileMap.size()), data.getRef());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -8005,13 +9873,129 @@ TEST_F(BlockUtilsBare, Load5Blocks_FullReorg)
 
    auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
 
-   //wait on signals
-   DBTestUtils::goOnline(clients_, bdvID);
-   DBTestUtils::waitOnBDMReady(clients_, bdvID);
-   auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
-   auto wlt2 = bdvPtr->getWalletOrLockbox(wallet2id);
-   auto wltLB1 = bdvPtr->getWalletOrLockbox(LB1ID);
-   auto wltLB2 = bdvPtr->getWalletOrLockbox(LB2ID);
+   //wait on signals
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+   auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+   auto wlt2 = bdvPtr->getWalletOrLockbox(wallet2id);
+   auto wltLB1 = bdvPtr->getWalletOrLockbox(LB1ID);
+   auto wltLB2 = bdvPtr->getWalletOrLockbox(LB2ID);
+
+   TestUtils::setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
+   DBTestUtils::triggerNewBlockNotification(theBDMt_);
+
+   TestUtils::appendBlocks({ "5A" }, blk0dat_);
+   DBTestUtils::triggerNewBlockNotification(theBDMt_);
+   DBTestUtils::waitOnNewBlockSignal(clients_, bdvID);
+
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
+
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(),30*COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
+
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+
+   EXPECT_EQ(wlt->getFullBalance(), 135*COIN);
+   EXPECT_EQ(wlt2->getFullBalance(), 150*COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 5*COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 10*COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_FullReorg_UndoRecords)
+{
+   theBDMt_->start(config.initMode_);
+   auto&& bdvID = DBTestUtils::registerBDV(clients_, NetworkConfig::getMagicBytes());
+
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet2");
+
+   auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+   //wait on signals
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+   auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+   auto wlt2 = bdvPtr->getWalletOrLockbox(wallet2id);
+
+   auto readUndo = [this](void)->map<unsigned, StoredBlockUndo>
+   {
+      map<unsigned, StoredBlockUndo> result;
+
+      auto&& tx = iface_->beginTransaction(BLKUNDO, LMDB::ReadOnly);
+      auto dbIter = iface_->getIterator(BLKUNDO);
+      if (!dbIter->seekToFirst())
+         return result;
+
+      do
+      {
+         //skip the sdbi
+         auto keyRef = dbIter->getKeyRef();
+         if (keyRef.getSize() != 5 || keyRef.getPtr()[0] != DB_PREFIX_UNDODATA)
+            continue;
+
+         StoredBlockUndo sbu;
+         sbu.unserializeDBKey(keyRef);
+         sbu.unserializeDBValue(dbIter->getValueRef());
+         result.insert(make_pair(sbu.blockHeight_, move(sbu)));
+      } while (dbIter->advanceAndRead());
+
+      return result;
+   };
+
+   //one record per block, the initial scan is within the undo depth
+   auto&& undoMap = readUndo();
+   ASSERT_EQ(undoMap.size(), 6U);
+   for (auto& undo_pair : undoMap)
+   {
+      auto header = theBDMt_->bdm()->blockchain()->getHeaderByHeight(
+         undo_pair.first, 0xFF);
+      EXPECT_EQ(undo_pair.second.duplicateID_, header->getDuplicateID());
+   }
+
+   //created minus spent is what the wallets hold
+   auto undoBalance = [](const map<unsigned, StoredBlockUndo>& undoMap)->int64_t
+   {
+      int64_t balance = 0;
+      for (auto& undo_pair : undoMap)
+      {
+         for (auto& delta : undo_pair.second.createdTxOuts_)
+            balance += delta.second.value_;
+         for (auto& delta : undo_pair.second.spentTxOuts_)
+            balance -= delta.second.value_;
+      }
+
+      return balance;
+   };
+
+   EXPECT_EQ(undoBalance(undoMap), 
+      (int64_t)(wlt->getFullBalance() + wlt2->getFullBalance()));
 
    TestUtils::setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
    DBTestUtils::triggerNewBlockNotification(theBDMt_);
@@ -8020,34 +10004,19 @@ TEST_F(BlockUtilsBare, Load5Blocks_FullReorg)
    DBTestUtils::triggerNewBlockNotification(theBDMt_);
    DBTestUtils::waitOnNewBlockSignal(clients_, bdvID);
 
-   const ScrAddrObj* scrObj;
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
-
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(),30*COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
-
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   //records of the reorged blocks are replaced by the new branch ones
+   undoMap = readUndo();
+   ASSERT_EQ(undoMap.size(), 6U);
+   for (auto& undo_pair : undoMap)
+   {
+      auto header = theBDMt_->bdm()->blockchain()->getHeaderByHeight(
+         undo_pair.first, 0xFF);
+      EXPECT_EQ(undo_pair.second.duplicateID_, header->getDuplicateID());
+   }
 
    EXPECT_EQ(wlt->getFullBalance(), 135*COIN);
    EXPECT_EQ(wlt2->getFullBalance(), 150*COIN);
-   EXPECT_EQ(wltLB1->getFullBalance(), 5*COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 10*COIN);
+   EXPECT_EQ(undoBalance(undoMap), (int64_t)(285 * COIN));
 }
 
 
@@ -8273,6 +10242,138 @@ TEST_F(BlockUtilsBare, Load5Blocks_ReloadBDM_Reorg)
    EXPECT_EQ(wltLB2->getFullBalance(), 10 * COIN);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_HeaderSnapshot)
+{
+   const vector<BinaryData> scrAddrVec
+   {
+      TestChain::scrAddrA,
+      TestChain::scrAddrB,
+      TestChain::scrAddrC
+   };
+
+   auto snapshotPath = ldbdir_ + "/" + HEADERSNAPSHOT_FILENAME;
+
+   auto startBDM = [this, &scrAddrVec](void)->void
+   {
+      theBDMt_->start(config.initMode_);
+      auto&& bdvID = DBTestUtils::registerBDV(
+         clients_, NetworkConfig::getMagicBytes());
+      DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+      auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+      DBTestUtils::goOnline(clients_, bdvID);
+      DBTestUtils::waitOnBDMReady(clients_, bdvID);
+
+      EXPECT_EQ(theBDMt_->bdm()->blockchain()->top()->getBlockHeight(), 5);
+      auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+      EXPECT_EQ(wlt->getScrAddrObjByKey(TestChain::scrAddrA)->getFullBalance(), 50 * COIN);
+      EXPECT_EQ(wlt->getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance(), 70 * COIN);
+      EXPECT_EQ(wlt->getScrAddrObjByKey(TestChain::scrAddrC)->getFullBalance(), 20 * COIN);
+   };
+
+   auto stopBDM = [this](void)->void
+   {
+      clients_->exitRequestLoop();
+      clients_->shutdown();
+
+      delete clients_;
+      delete theBDMt_;
+   };
+
+   startBDM();
+   EXPECT_FALSE(DBUtils::fileExists(snapshotPath, 0));
+   stopBDM();
+
+   //clean shutdown leaves a snapshot of the chain, swapped in from a
+   //temp file
+   ASSERT_TRUE(DBUtils::fileExists(snapshotPath, 0));
+   EXPECT_FALSE(DBUtils::fileExists(snapshotPath + ".tmp", 0));
+   {
+      HeaderSnapshot snapshot(snapshotPath);
+      EXPECT_EQ(snapshot.size(), 6);
+   }
+
+   //it is used and checked on the next start, then deleted
+   initBDM();
+   startBDM();
+   EXPECT_FALSE(DBUtils::fileExists(snapshotPath, 0));
+   stopBDM();
+
+   //damaged snapshots are dropped, headers come from the db
+   ASSERT_TRUE(DBUtils::fileExists(snapshotPath, 0));
+   {
+      fstream file(snapshotPath, ios::binary | ios::in | ios::out);
+      file.seekp(100);
+      file.put(0x5A);
+   }
+
+   EXPECT_THROW(HeaderSnapshot snapshot(snapshotPath), HeaderSnapshotException);
+
+   initBDM();
+   startBDM();
+   EXPECT_FALSE(DBUtils::fileExists(snapshotPath, 0));
+   stopBDM();
+
+   //a snapshot with a header the db doesn't have is used as is, the chain 
+   //is swapped for the db one once the check fails
+   ASSERT_TRUE(DBUtils::fileExists(snapshotPath, 0));
+   BinaryData orphanHash;
+   {
+      vector<shared_ptr<BlockHeader>> headers;
+      BinaryData tipHash;
+      {
+         HeaderSnapshot snapshot(snapshotPath);
+         for (size_t i = 0; i < snapshot.size(); i++)
+            headers.push_back(snapshot.getHeader(i));
+         tipHash = snapshot.getTipHash();
+      }
+
+      BinaryData rawHeader(headers[0]->serialize());
+      rawHeader.getPtr()[76] ^= 0xFF;
+      auto orphan = make_shared<BlockHeader>(rawHeader);
+      unsigned orphanID = 100;
+      orphan->setUniqueID(orphanID);
+      orphanHash = orphan->getThisHash();
+
+      headers.push_back(orphan);
+      HeaderSnapshot::write(snapshotPath, headers, tipHash);
+   }
+
+   initBDM();
+   startBDM();
+   EXPECT_FALSE(DBUtils::fileExists(snapshotPath, 0));
+
+   auto bc = theBDMt_->bdm()->blockchain();
+   unsigned waitCount = 0;
+   while (true)
+   {
+      try
+      {
+         bc->getHeaderByHash(orphanHash);
+      }
+      catch (exception&)
+      {
+         break;
+      }
+
+      ASSERT_LT(waitCount++, 5000U);
+      this_thread::sleep_for(chrono::milliseconds(1));
+   }
+
+   EXPECT_EQ(bc->top()->getBlockHeight(), 5U);
+   stopBDM();
+
+   //the reloaded chain is what gets carried over
+   {
+      HeaderSnapshot snapshot(snapshotPath);
+      EXPECT_EQ(snapshot.size(), 6);
+   }
+
+   initBDM();
+   startBDM();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BlockUtilsBare, CorruptedBlock)
 {
@@ -8462,6 +10563,194 @@ TEST_F(BlockUtilsBare, Load5Blocks_RescanOps)
    checkBalance();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_ScanCheckpoint)
+{
+   TestUtils::setBlocks({ "0", "1", "2" }, blk0dat_);
+
+   shared_ptr<BtcWallet> wlt;
+   shared_ptr<BtcWallet> wltLB1;
+   shared_ptr<BtcWallet> wltLB2;
+
+   auto startbdm = [&wlt, &wltLB1, &wltLB2, this](void)->void
+   {
+      theBDMt_->start(INIT_RESUME);
+      auto&& bdvID = DBTestUtils::registerBDV(clients_, NetworkConfig::getMagicBytes());
+
+      vector<BinaryData> scrAddrVec;
+      scrAddrVec.push_back(TestChain::scrAddrA);
+      scrAddrVec.push_back(TestChain::scrAddrB);
+      scrAddrVec.push_back(TestChain::scrAddrC);
+      scrAddrVec.push_back(TestChain::scrAddrD);
+      scrAddrVec.push_back(TestChain::scrAddrE);
+      scrAddrVec.push_back(TestChain::scrAddrF);
+
+      const vector<BinaryData> lb1ScrAddrs
+      {
+         TestChain::lb1ScrAddr,
+         TestChain::lb1ScrAddrP2SH
+      };
+      const vector<BinaryData> lb2ScrAddrs
+      {
+         TestChain::lb2ScrAddr,
+         TestChain::lb2ScrAddrP2SH
+      };
+
+      DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+      DBTestUtils::regLockbox(
+         clients_, bdvID, lb1ScrAddrs, TestChain::lb1B58ID);
+      DBTestUtils::regLockbox(
+         clients_, bdvID, lb2ScrAddrs, TestChain::lb2B58ID);
+
+      auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+      //wait on signals
+      DBTestUtils::goOnline(clients_, bdvID);
+      DBTestUtils::waitOnBDMReady(clients_, bdvID);
+      wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+      wltLB1 = bdvPtr->getWalletOrLockbox(LB1ID);
+      wltLB2 = bdvPtr->getWalletOrLockbox(LB2ID);
+   };
+
+   auto checkBalance = [&wlt, &wltLB1, &wltLB2](void)->void
+   {
+      const ScrAddrObj* scrObj;
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+      EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+      EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+      EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+      EXPECT_EQ(scrObj->getFullBalance(), 65 * COIN);
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+      EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+      EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+      scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+      EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+      scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+      EXPECT_EQ(scrObj->getFullBalance(), 25 * COIN);
+      scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+      EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+      scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+      EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   };
+
+   auto resetbdm = [&wlt, &wltLB1, &wltLB2, this](void)->void
+   {
+      wlt.reset();
+      wltLB1.reset();
+      wltLB2.reset();
+
+      clients_->exitRequestLoop();
+      clients_->shutdown();
+
+      delete clients_;
+      delete theBDMt_;
+
+      initBDM();
+   };
+
+   auto readDb = [this](DB_SELECT db)->map<BinaryData, BinaryData>
+   {
+      map<BinaryData, BinaryData> result;
+
+      auto&& tx = iface_->beginTransaction(db, LMDB::ReadOnly);
+      auto dbIter = iface_->getIterator(db);
+      if (!dbIter->seekToFirst())
+         return result;
+
+      vector<LDBIterSpan> spans(LDBITER_BATCH_SIZE);
+      while (true)
+      {
+         auto count = dbIter->readBatch(
+            spans.data(), spans.size(), LDBITER_PREFETCH_BYTES);
+         if (count == 0)
+            break;
+
+         for (size_t i = 0; i < count; i++)
+            result[spans[i].key_] = spans[i].value_;
+      }
+
+      return result;
+   };
+
+   //scan up to block #2, keep the SSH db as it was then
+   startbdm();
+   auto&& sshAt2 = readDb(SSH);
+   EXPECT_GT(sshAt2.size(), 0U);
+
+   auto rewindTo4 = [&, this](void)->void
+   {
+      /***
+      Rewind the db to a scan of blocks #3 to #5 that died right after 
+      block #4 was committed: SSH is still at #2, block #5 made it to STXO
+      but not to SUBSSH, the checkpoint is at #4.
+      ***/
+
+      {
+         auto&& ssh = readDb(SSH);
+         auto&& tx = iface_->beginTransaction(SSH, LMDB::ReadWrite);
+         for (auto& entry : ssh)
+            iface_->deleteValue(SSH, entry.first.getRef());
+
+         for (auto& entry : sshAt2)
+         {
+            iface_->putValue(
+               SSH, entry.first.getRef(), entry.second.getRef());
+         }
+      }
+
+      auto&& subssh = readDb(SUBSSH);
+      auto&& tx = iface_->beginTransaction(SUBSSH, LMDB::ReadWrite);
+      unsigned dropped = 0;
+      for (auto& entry : subssh)
+      {
+         auto& key = entry.first;
+         if (key.getSize() < 6 || key.getPtr()[0] != DB_PREFIX_SCRIPT)
+            continue;
+
+         auto&& hgtx = key.getSliceCopy(key.getSize() - 4, 4);
+         if (DBUtils::hgtxToHeight(hgtx) != 5)
+            continue;
+
+         iface_->deleteValue(SUBSSH, key.getRef());
+         ++dropped;
+      }
+      EXPECT_GT(dropped, 0U);
+
+      auto&& sdbi = iface_->getStoredDBInfo(SUBSSH, 0);
+      EXPECT_EQ(sdbi.topBlkHgt_, 5U);
+      auto header4 = theBDMt_->bdm()->blockchain()->getHeaderByHeight(4, 0xFF);
+      sdbi.topBlkHgt_ = 4;
+      sdbi.topScannedBlkHash_ = header4->getThisHash();
+      iface_->putStoredDBInfo(SUBSSH, sdbi, 0);
+   };
+
+   //scan up to block #5
+   resetbdm();
+   TestUtils::appendBlocks({ "3", "4", "5" }, blk0dat_);
+   startbdm();
+   checkBalance();
+
+   //resume from the checkpoint
+   rewindTo4();
+   resetbdm();
+   startbdm();
+   checkBalance();
+   EXPECT_EQ(iface_->getStoredDBInfo(SUBSSH, 0).topBlkHgt_, 5U);
+   EXPECT_EQ(iface_->getStoredDBInfo(SSH, 0).topBlkHgt_, 5U);
+
+   //resume in verify mode, the state past the checkpoint is dropped first
+   rewindTo4();
+   config.verifyCheckpoint_ = true;
+   resetbdm();
+   startbdm();
+   checkBalance();
+   EXPECT_EQ(iface_->getStoredDBInfo(SUBSSH, 0).topBlkHgt_, 5U);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BlockUtilsBare, Load5Blocks_RescanEmptyDB)
 {
@@ -8778,6 +11067,64 @@ TEST_F(BlockUtilsBare, Load5Blocks_GetUtxos)
    EXPECT_EQ(spendableBalance, totalUtxoVal);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_TxHashIndex)
+{
+   theBDMt_->start(config.initMode_);
+   auto&& bdvID = DBTestUtils::registerBDV(clients_, NetworkConfig::getMagicBytes());
+
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+
+   auto bdvPtr = DBTestUtils::getBDV(clients_, bdvID);
+
+   //wait on signals
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+   auto wlt = bdvPtr->getWalletOrLockbox(wallet1id);
+
+   auto&& utxoVec = wlt->getSpendableTxOutListForValue();
+   ASSERT_FALSE(utxoVec.empty());
+   auto txHash = utxoVec[0].getTxHash();
+   auto&& dbKey = iface_->getDBKeyForHash(txHash);
+   ASSERT_EQ(dbKey.getSize(), 6U);
+
+   //shutdown bdm
+   bdvPtr.reset();
+   clients_->exitRequestLoop();
+   clients_->shutdown();
+
+   delete clients_;
+   delete theBDMt_;
+
+   //index the tx, the chain is too short for the bdm to do it
+   BinaryData forged(txHash);
+   forged.getPtr()[15] ^= 0xFF;
+   ASSERT_EQ(TxHashIndex::getFingerprint(forged),
+      TxHashIndex::getFingerprint(txHash));
+
+   vector<TxHashIndexEntry> entries;
+   entries.emplace_back(txHash.getRef(), dbKey.getRef());
+   TxHashIndex::write(
+      DatabaseContainer::getDbPath("txhashindex"), entries, 5);
+
+   //restart bdm
+   initBDM();
+
+   theBDMt_->start(config.initMode_);
+   bdvID = DBTestUtils::registerBDV(clients_, NetworkConfig::getMagicBytes());
+   DBTestUtils::registerWallet(clients_, bdvID, scrAddrVec, "wallet1");
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+
+   //the forged hash shares the fingerprint of the indexed one
+   EXPECT_EQ(iface_->getDBKeyForHash(txHash), dbKey);
+   EXPECT_EQ(iface_->getDBKeyForHash(forged).getSize(), 0U);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BlockUtilsBare, Load4Blocks_ZC_GetUtxos)
 {
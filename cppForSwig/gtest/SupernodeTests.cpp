@@ -1540,6 +1540,103 @@ TEST_F(BlockUtilsSuper, Load5Blocks_DynamicReorg_GrabSTXO)
 
    auto&& key6_1_1_0 = DBUtils::getBlkDataKeyNoPrefix(6, 1, 1, 0);
    EXPECT_FALSE(iface_->getStoredTxOut(stxo7, key6_1_1_0));
+
+   /*batched fetch should match the per key accessor*/
+   vector<BinaryData> stxoKeys = 
+      { key6_1_1_0, key5_0_1_0, key4_1_0_0, key4_0_0_0, key6_0_1_0 };
+   vector<StoredTxOut> stxoBatch;
+   EXPECT_EQ(iface_->getStoredTxOuts(stxoKeys, stxoBatch), 4U);
+   ASSERT_EQ(stxoBatch.size(), 5U);
+
+   EXPECT_FALSE(stxoBatch[0].isInitialized());
+   EXPECT_EQ(stxoBatch[1].dataCopy_, stxo5.dataCopy_);
+   EXPECT_EQ(stxoBatch[1].spentness_, stxo5.spentness_);
+   EXPECT_EQ(stxoBatch[2].dataCopy_, stxo2.dataCopy_);
+   EXPECT_EQ(stxoBatch[2].spentness_, stxo2.spentness_);
+   EXPECT_EQ(stxoBatch[3].dataCopy_, stxo1.dataCopy_);
+   EXPECT_EQ(stxoBatch[3].getHeight(), stxo1.getHeight());
+   EXPECT_EQ(stxoBatch[4].dataCopy_, stxo6.dataCopy_);
+   EXPECT_EQ(stxoBatch[4].spentByTxInKey_, stxo6.spentByTxInKey_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, Load5Blocks_SshParserThreads)
+{
+   TestUtils::setBlocks({ "0", "1", "2" }, blk0dat_);
+
+   theBDMt_->start(config.initMode_);
+   auto&& bdvID = DBTestUtils::registerBDV(clients_, NetworkConfig::getMagicBytes());
+   DBTestUtils::goOnline(clients_, bdvID);
+   DBTestUtils::waitOnBDMReady(clients_, bdvID);
+
+   //one block per update, spreads the subssh entries over several shards
+   for (auto& block : { "3", "4", "5" })
+   {
+      TestUtils::appendBlocks({ block }, blk0dat_);
+      DBTestUtils::triggerNewBlockNotification(theBDMt_);
+      DBTestUtils::waitOnNewBlockSignal(clients_, bdvID);
+   }
+   EXPECT_EQ(DBTestUtils::getTopBlockHeight(iface_, HEADERS), 5);
+
+   //balance and txio count per scrAddr
+   auto getSshState = [this](void)->map<BinaryData, pair<uint64_t, uint64_t>>
+   {
+      map<BinaryData, pair<uint64_t, uint64_t>> result;
+      auto tx = iface_->beginTransaction(SSH, LMDB::ReadOnly);
+      auto dbIter = iface_->getIterator(SSH);
+      if (!dbIter->seekToStartsWith(DB_PREFIX_SCRIPT))
+         return result;
+
+      do
+      {
+         StoredScriptHistory ssh;
+         ssh.unserializeDBKey(dbIter->getKeyRef());
+         ssh.unserializeDBValue(dbIter->getValueRef());
+         result.insert(make_pair(ssh.uniqueKey_, 
+            make_pair(ssh.totalUnspent_, ssh.totalTxioCount_)));
+      } while (dbIter->advanceAndRead(DB_PREFIX_SCRIPT));
+
+      return result;
+   };
+
+   auto runParser = [this](
+      unsigned height, unsigned threadCount, bool undo)->void
+   {
+      ShardedSshParser parser(iface_, height, threadCount, false);
+      if (undo)
+         parser.undo();
+      else
+         parser.updateSsh();
+   };
+
+   auto&& reference = getSshState();
+   ASSERT_GT(reference.size(), 0U);
+
+   //single thread results
+   runParser(0, 1, false);
+   EXPECT_EQ(getSshState(), reference);
+
+   runParser(3, 1, true);
+   auto&& undone = getSshState();
+   EXPECT_NE(undone, reference);
+
+   //a full update overwrites the ssh
+   runParser(0, 1, false);
+   EXPECT_EQ(getSshState(), reference);
+
+   /***
+   More threads than bounds, idle threads split the tasks of busy ones.
+   Which tasks get split varies from run to run, the results may not.
+   Splits themselves are covered by SshTaskTest.
+   ***/
+   for (unsigned i = 0; i < 20; i++)
+   {
+      runParser(3, 8, true);
+      EXPECT_EQ(getSshState(), undone);
+
+      runParser(0, 8, false);
+      EXPECT_EQ(getSshState(), reference);
+   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
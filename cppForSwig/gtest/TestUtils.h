@@ -49,6 +49,13 @@
 #include "../WalletManager.h"
 #include "../BIP32_Node.h"
 #include "../BitcoinP2p.h"
+#include "../UtxoCache.h"
+#include "../ScanPipeline.h"
+#include "../SshParser.h"
+#include "../Sha256Multi.h"
+#include "../GcsFilter.h"
+#include "../HeaderSnapshot.h"
+#include "../BlockFileWatcher.h"
 #include "btc/ecc.h"
 
 #include "NodeUnitTest.h"
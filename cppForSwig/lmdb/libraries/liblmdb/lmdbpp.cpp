@@ -11,6 +11,7 @@
 #include <unistd.h>
 #include <sstream>
 #include <cstring>
+#include <cerrno>
 #include <algorithm>
 #include <iostream>
 
@@ -19,6 +20,7 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #endif
 
 static std::string errorString(int rc)
@@ -26,12 +28,30 @@ static std::string errorString(int rc)
    return mdb_strerror(rc);
 }
 
+//write txns that log more than this can't be replayed, a MAP_FULL fails
+//them instead. Growth ahead of the txn is what keeps big batches going
+#define WRITELOG_MAX_SIZE (16 * 1024 * 1024)
+#define MAP_FULL_MAX_RETRIES 4
+
+#define WRITELOG_PUT  1
+#define WRITELOG_DEL  2
+#define WRITELOG_WIPE 3
+#define WRITELOG_DROP 4
+
 inline void LMDB::Iterator::checkHasDb() const
 {
    if (!db_)
    {
       throw std::logic_error("Iterator is not associated with a db");
    }
+
+   //the cursor went away with its txn (replayed after the map filled up), 
+   //open a new one before repositioning
+   if (!hasTx)
+   {
+      const_cast<Iterator*>(this)->openCursor();
+      hasTx=true;
+   }
 }
 
 
@@ -74,7 +94,8 @@ void LMDB::Iterator::openCursor()
    
    lock.unlock();
    
-   if (txnIter->second.transactionLevel_ == 0)
+   if (txnIter->second.transactionLevel_ == 0 || 
+      txnIter->second.txn_ == nullptr)
       throw std::runtime_error("Iterator must be created within Transaction");
    
    txnPtr_ = &txnIter->second;
@@ -146,6 +167,7 @@ LMDB::Iterator& LMDB::Iterator::operator=(Iterator &&move)
    std::swap(val_, move.val_);
    std::swap(hasTx, move.hasTx);
    std::swap(db_, move.db_);
+   seekKey_.swap(move.seekKey_);
    
    move.reset();
    
@@ -262,6 +284,27 @@ void LMDB::Iterator::toFirst()
    }
 }
 
+void LMDB::Iterator::toLast()
+{
+   checkHasDb();
+   
+   MDB_val mkey;
+   MDB_val mval;
+   
+   int rc = mdb_cursor_get(csr_, &mkey, &mval, MDB_LAST);
+
+   if (rc == MDB_NOTFOUND)
+      has_ = false;
+   else if (rc != MDB_SUCCESS)
+      throw LMDBException("Failed to seek (" + errorString(rc) +")");
+   else
+   {
+      has_ = true;
+      key_ = mkey;
+      val_ = mval;
+   }
+}
+
 void LMDB::Iterator::seek(const CharacterArrayRef &key, SeekBy e)
 {
    checkHasDb();
@@ -362,12 +405,18 @@ void LMDBEnv::open(const char *filename, unsigned flags)
    }
 
    filename_ = std::string(filename);
+
+   //without MDB_NOTLS reader slots are bound to their thread, they cannot
+   //be handed around through the read txn pool
+   if ((flags & MDB_NOTLS) == 0)
+      setReadTxPoolSize(0);
 }
 
 void LMDBEnv::close()
 {
    if (dbenv)
    {
+      clearReadTxPool();
       mdb_env_close(dbenv);
       dbenv = nullptr;
    }
@@ -380,6 +429,8 @@ size_t LMDBEnv::getMapSize() const
 
 void LMDBEnv::setMapSize(size_t sz)
 {
+   clearReadTxPool();
+
    auto rc = mdb_env_set_mapsize(dbenv, sz);
    if (rc != MDB_SUCCESS)
    {
@@ -391,19 +442,472 @@ void LMDBEnv::setMapSize(size_t sz)
    }
 }
 
-void LMDBEnv::compactCopy(const std::string& fname)
+size_t LMDBEnv::getUsedSize() const
 {
-   auto rc = mdb_env_copy2(dbenv, fname.c_str(), MDB_CP_COMPACT);
-   if (rc != MDB_SUCCESS)
+   MDB_envinfo info;
+   MDB_stat stat;
+   if (mdb_env_info(dbenv, &info) != MDB_SUCCESS ||
+      mdb_env_stat(dbenv, &stat) != MDB_SUCCESS)
+      return 0;
+
+   return (info.me_last_pgno + 1) * stat.ms_psize;
+}
+
+void LMDBEnv::setMapGrowth(float factor, size_t minFree)
+{
+   std::unique_lock<std::mutex> lock(threadTxMutex_);
+   growthFactor_ = factor;
+   growthMinFree_ = minFree;
+}
+
+size_t LMDBEnv::getGrownMapSize(size_t from) const
+{
+   if (growthFactor_ <= 1.0f)
+      return from;
+
+   auto used = getUsedSize();
+   auto mapSize = std::max(from, used);
+   while (used + std::max(growthMinFree_, mapSize / 2) > mapSize)
+      mapSize = size_t(mapSize * growthFactor_) + 1;
+
+   //round up to the next MB
+   const size_t mb = 1024 * 1024;
+   return (mapSize + mb - 1) & ~(mb - 1);
+}
+
+bool LMDBEnv::resizeMap(size_t newSize)
+{
+   //pooled readers are reset, they hold no snapshot but still have to go
+   clearReadTxPool();
+   auto rc = mdb_env_set_mapsize(dbenv, newSize);
+   if (rc == MDB_SUCCESS)
+      return true;
+
+   std::cout << "failed to grow map for " << filename_ << 
+      ", returned following error string: " << errorString(rc) << 
+      std::endl;
+   return false;
+}
+
+void LMDBEnv::growMap(std::unique_lock<std::mutex>&)
+{
+   if (dbenv == nullptr || growthFactor_ <= 1.0f)
+      return;
+
+   auto mapSize = getMapSize();
+   auto newSize = getGrownMapSize(std::max(mapSize, growTarget_));
+   if (newSize == mapSize)
+      return;
+
+   //don't hold up readers for this, the last txn to close does the resize
+   if (!txForThreads_.empty())
+   {
+      growPending_ = true;
+      return;
+   }
+
+   if (resizeMap(newSize))
+   {
+      growPending_ = false;
+      growTarget_ = 0;
+   }
+}
+
+void LMDBEnv::txnClosed(std::unique_lock<std::mutex>& lock)
+{
+   if (growPending_ && txForThreads_.empty())
+      growMap(lock);
+}
+
+bool LMDBEnv::growMapForReplay(size_t txnSize)
+{
+   /***
+   The calling thread's write txn ran out of map and was aborted, its entry
+   in txForThreads_ stays up for the replay. The map can only be swapped if
+   that entry is the last one. Otherwise nobody waits: the write fails and
+   the last txn to close grows the map for the next one.
+   ***/
+
+   std::unique_lock<std::mutex> lock(threadTxMutex_);
+   if (growthFactor_ <= 1.0f)
+      return false;
+
+   //make room for twice the failed writes, to cover page overhead
+   auto newSize = std::max(
+      size_t(getMapSize() * growthFactor_) + 1, 
+      getUsedSize() + txnSize * 2);
+
+   if (txForThreads_.size() != 1)
+   {
+      growPending_ = true;
+      growTarget_ = std::max(growTarget_, newSize);
+      return false;
+   }
+
+   if (!resizeMap(getGrownMapSize(newSize)))
+      return false;
+
+   growPending_ = false;
+   growTarget_ = 0;
+   return true;
+}
+
+void LMDBEnv::logWrite(LMDBThreadTxInfo& thTx, char op, unsigned dbi,
+   const MDB_val* key, const MDB_val* val)
+{
+   if (!thTx.logWrites_)
+      return;
+
+   //op (1) | dbi (4) | key size (4) | key | val size (4) | val
+   auto& log = thTx.writeLog_;
+   size_t entrySize = 13;
+   if (key != nullptr)
+      entrySize += key->mv_size;
+   if (val != nullptr)
+      entrySize += val->mv_size;
+
+   if (log.size() + entrySize > WRITELOG_MAX_SIZE)
+   {
+      //too big to replay, don't keep a second copy of the batch around
+      thTx.logWrites_ = false;
+      std::vector<char>().swap(log);
+      return;
+   }
+
+   auto append = [&log](const void* ptr, size_t len)->void
+   {
+      auto data = static_cast<const char*>(ptr);
+      log.insert(log.end(), data, data + len);
+   };
+
+   uint32_t dbi32 = dbi;
+   log.push_back(op);
+   append(&dbi32, 4);
+
+   uint32_t len = key != nullptr ? key->mv_size : 0;
+   append(&len, 4);
+   if (len != 0)
+      append(key->mv_data, len);
+
+   len = val != nullptr ? val->mv_size : 0;
+   append(&len, 4);
+   if (len != 0)
+      append(val->mv_data, len);
+}
+
+int LMDBEnv::replayWrites(LMDBThreadTxInfo& thTx, bool commit)
+{
+   /***
+   The txn in thTx failed with MDB_MAP_FULL, LMDB only lets us abort it.
+   If the txn is small enough to have been logged and no other txn is 
+   live, grow the map and redo the logged writes in a fresh txn. Cursors
+   die with the txn, the iterators reopen theirs on next use.
+   ***/
+
+   for (auto iter : thTx.iterators_)
+   {
+      //the key may sit on a page that goes away with the txn
+      if (iter->has_)
+      {
+         auto keyPtr = static_cast<const char*>(iter->key_.mv_data);
+         iter->seekKey_.assign(keyPtr, keyPtr + iter->key_.mv_size);
+         iter->key_.mv_data = iter->seekKey_.data();
+      }
+
+      iter->hasTx = false;
+      iter->csr_ = nullptr;
+   }
+   thTx.iterators_.clear();
+
+   //a failed commit has freed the txn already
+   if (thTx.txn_ != nullptr)
+      mdb_txn_abort(thTx.txn_);
+   thTx.txn_ = nullptr;
+
+   if (!thTx.logWrites_)
+   {
+      //too big to replay, size the pending growth to the largest log
+      growMapForReplay(WRITELOG_MAX_SIZE);
+      return MDB_MAP_FULL;
+   }
+
+   int rc = MDB_MAP_FULL;
+   for (unsigned i = 0; i < MAP_FULL_MAX_RETRIES && rc == MDB_MAP_FULL; i++)
+   {
+      if (!growMapForReplay(thTx.writeLog_.size()))
+         return MDB_MAP_FULL;
+
+      rc = mdb_txn_begin(dbenv, nullptr, 0, &thTx.txn_);
+      if (rc != MDB_SUCCESS)
+      {
+         thTx.txn_ = nullptr;
+         return rc;
+      }
+
+      auto& log = thTx.writeLog_;
+      size_t pos = 0;
+      auto read = [&log, &pos](size_t len)->char*
+      {
+         auto ptr = &log[pos];
+         pos += len;
+         return ptr;
+      };
+
+      while (rc == MDB_SUCCESS && pos < log.size())
+      {
+         char op = *read(1);
+         uint32_t dbi, len;
+         memcpy(&dbi, read(4), 4);
+
+         MDB_val key, val;
+         memcpy(&len, read(4), 4);
+         key.mv_size = len;
+         key.mv_data = len != 0 ? read(len) : nullptr;
+         memcpy(&len, read(4), 4);
+         val.mv_size = len;
+         val.mv_data = len != 0 ? read(len) : nullptr;
+
+         switch (op)
+         {
+         case WRITELOG_PUT:
+            rc = mdb_put(thTx.txn_, dbi, &key, &val, 0);
+            break;
+
+         case WRITELOG_WIPE:
+         {
+            MDB_val data;
+            if (mdb_get(thTx.txn_, dbi, &key, &data) == MDB_SUCCESS &&
+               data.mv_data != nullptr)
+               memset(data.mv_data, 0, data.mv_size);
+         }
+         //fall through
+         case WRITELOG_DEL:
+            rc = mdb_del(thTx.txn_, dbi, &key, 0);
+            if (rc == MDB_NOTFOUND)
+               rc = MDB_SUCCESS;
+            break;
+
+         case WRITELOG_DROP:
+            rc = mdb_drop(thTx.txn_, dbi, 0);
+            break;
+
+         default:
+            rc = EINVAL;
+         }
+      }
+
+      if (rc == MDB_SUCCESS && commit)
+      {
+         rc = mdb_txn_commit(thTx.txn_);
+         if (rc != MDB_SUCCESS)
+            thTx.txn_ = nullptr;
+      }
+      else if (rc != MDB_SUCCESS)
+      {
+         mdb_txn_abort(thTx.txn_);
+         thTx.txn_ = nullptr;
+      }
+   }
+
+   return rc;
+}
+
+void LMDBEnv::compactCopy(
+   const std::string& fname, const std::atomic<bool>* cancel)
+{
+   auto throwCopyError = [](const std::string& err)->void
    {
       std::stringstream ss;
       ss << "failed to copy env, returned following error string: " << 
+         err << std::endl;
+      std::cout << ss.str();
+      throw LMDBException(ss.str());
+   };
+
+#ifdef _WIN32
+   if (cancel != nullptr && cancel->load(std::memory_order_relaxed))
+      throw LMDBException("env copy was cancelled");
+   cancel = nullptr;
+#endif
+
+   if (cancel == nullptr)
+   {
+      auto rc = mdb_env_copy2(dbenv, fname.c_str(), MDB_CP_COMPACT);
+      if (rc != MDB_SUCCESS)
+         throwCopyError(errorString(rc));
+      return;
+   }
+
+#ifndef _WIN32
+   /***
+   The copy is written to a pipe and drained into the file from here, so 
+   that it can be walked away from. Closing the read end fails the 
+   copy's writes with EPIPE, lmdb collects the signal on its side.
+   ***/
+   int fds[2];
+   if (pipe(fds) != 0)
+      throwCopyError(strerror(errno));
+
+   int fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+   if (fd < 0)
+   {
+      auto err = errno;
+      ::close(fds[0]);
+      ::close(fds[1]);
+      throwCopyError(strerror(err));
+   }
+
+   int rc = MDB_SUCCESS;
+   std::thread copyThr([this, &rc, &fds](void)->void
+   {
+      rc = mdb_env_copyfd2(dbenv, fds[1], MDB_CP_COMPACT);
+      ::close(fds[1]);
+   });
+
+   std::vector<char> buffer(1024 * 1024);
+   int err = 0;
+   bool cancelled = false;
+   while (true)
+   {
+      if (cancel->load(std::memory_order_relaxed))
+      {
+         cancelled = true;
+         break;
+      }
+
+      auto readSize = read(fds[0], &buffer[0], buffer.size());
+      if (readSize == 0)
+         break;
+
+      if (readSize < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         err = errno;
+         break;
+      }
+
+      ssize_t written = 0;
+      while (written < readSize)
+      {
+         auto result = write(fd, &buffer[written], readSize - written);
+         if (result < 0)
+         {
+            if (errno == EINTR)
+               continue;
+            err = errno;
+            break;
+         }
+
+         written += result;
+      }
+
+      if (err != 0)
+         break;
+   }
+
+   ::close(fds[0]);
+   copyThr.join();
+
+   if (err == 0 && !cancelled && rc == MDB_SUCCESS && fsync(fd) != 0)
+      err = errno;
+   ::close(fd);
+
+   if (cancelled || err != 0 || rc != MDB_SUCCESS)
+   {
+      unlink(fname.c_str());
+      if (cancelled)
+         throw LMDBException("env copy was cancelled");
+
+      if (err != 0)
+         throwCopyError(strerror(err));
+      throwCopyError(errorString(rc));
+   }
+#endif
+}
+
+void LMDBEnv::sync()
+{
+   auto rc = mdb_env_sync(dbenv, 1);
+   if (rc != MDB_SUCCESS)
+   {
+      std::stringstream ss;
+      ss << "failed to sync env, returned following error string: " << 
          errorString(rc) << std::endl;
       std::cout << ss.str();
       throw LMDBException(ss.str());
    }
 }
 
+void LMDBEnv::setReadTxPoolSize(size_t sz)
+{
+   {
+      std::unique_lock<std::mutex> lock(readTxPoolMutex_);
+      readTxPoolMax_ = sz;
+      if (readTxPool_.size() <= sz)
+         return;
+   }
+
+   clearReadTxPool();
+}
+
+int LMDBEnv::getReadTx(MDB_txn** txn)
+{
+   *txn = nullptr;
+
+   {
+      std::unique_lock<std::mutex> lock(readTxPoolMutex_);
+      if (!readTxPool_.empty())
+      {
+         *txn = readTxPool_.back();
+         readTxPool_.pop_back();
+      }
+   }
+
+   if (*txn != nullptr)
+   {
+      //renewing grabs the latest snapshot, so commits from the writer that
+      //landed while this txn sat in the pool are visible
+      int rc = mdb_txn_renew(*txn);
+      if (rc == MDB_SUCCESS)
+         return rc;
+
+      mdb_txn_abort(*txn);
+      *txn = nullptr;
+   }
+
+   return mdb_txn_begin(dbenv, nullptr, MDB_RDONLY, txn);
+}
+
+void LMDBEnv::releaseReadTx(MDB_txn* txn)
+{
+   //release the snapshot right away so the writer can reclaim pages, but 
+   //hold on to the reader slot
+   mdb_txn_reset(txn);
+
+   {
+      std::unique_lock<std::mutex> lock(readTxPoolMutex_);
+      if (readTxPool_.size() < readTxPoolMax_)
+      {
+         readTxPool_.push_back(txn);
+         return;
+      }
+   }
+
+   mdb_txn_abort(txn);
+}
+
+void LMDBEnv::clearReadTxPool()
+{
+   std::vector<MDB_txn*> pool;
+   {
+      std::unique_lock<std::mutex> lock(readTxPoolMutex_);
+      pool.swap(readTxPool_);
+   }
+
+   for (auto txn : pool)
+      mdb_txn_abort(txn);
+}
 
 LMDBEnv::Transaction::Transaction(LMDBEnv *_env, LMDB::Mode mode)
    : env(_env), mode_(mode)
@@ -460,6 +964,13 @@ void LMDBEnv::Transaction::begin()
    auto tID = std::this_thread::get_id();
    
    std::unique_lock<std::mutex> lock(env->threadTxMutex_);
+
+   //top level write txn for this thread, give the map a chance to grow 
+   //ahead of the batch
+   if (mode_ == LMDB::ReadWrite &&
+      env->txForThreads_.find(tID) == env->txForThreads_.end())
+      env->growMap(lock);
+
    LMDBThreadTxInfo& thTx = env->txForThreads_[tID];
    lock.unlock();
    
@@ -472,20 +983,25 @@ void LMDBEnv::Transaction::begin()
    if (!env->dbenv)
       throw LMDBException("Cannot start transaction without db env");
       
-   int modef = MDB_RDONLY;
-   thTx.mode_ = LMDB::ReadOnly;
-   
+   int rc;
    if (mode_ == LMDB::ReadWrite)
    {
-      modef = 0;
       thTx.mode_ = LMDB::ReadWrite;
+      thTx.logWrites_ = env->growthFactor_ > 1.0f;
+      thTx.writeLog_.clear();
+      rc = mdb_txn_begin(env->dbenv, nullptr, 0, &thTx.txn_);
+   }
+   else
+   {
+      thTx.mode_ = LMDB::ReadOnly;
+      rc = env->getReadTx(&thTx.txn_);
    }
 
-   int rc = mdb_txn_begin(env->dbenv, nullptr, modef, &thTx.txn_);
    if (rc != MDB_SUCCESS)
    {
       lock.lock();
       env->txForThreads_.erase(tID);
+      env->txnClosed(lock);
       lock.unlock();
       
       began = false;
@@ -524,7 +1040,25 @@ void LMDBEnv::Transaction::commit()
 
    if (thTx.transactionLevel_-- == 1)
    {
-      int rc = mdb_txn_commit(thTx.txn_);
+      //read-only txns go back to the pool instead of being torn down
+      int rc = MDB_SUCCESS;
+      if (thTx.mode_ == LMDB::ReadOnly)
+      {
+         env->releaseReadTx(thTx.txn_);
+      }
+      else if (thTx.txn_ == nullptr)
+      {
+         //lost to a write that filled the map, that write threw already
+      }
+      else
+      {
+         rc = mdb_txn_commit(thTx.txn_);
+         if (rc == MDB_MAP_FULL)
+         {
+            thTx.txn_ = nullptr;
+            rc = env->replayWrites(thTx, true);
+         }
+      }
       
       for (LMDB::Iterator *i : thTx.iterators_)
       {
@@ -532,13 +1066,16 @@ void LMDBEnv::Transaction::commit()
          i->csr_=nullptr;
       }
       
+      //a failed commit frees the txn all the same
+      lock.lock();
+      env->txForThreads_.erase(txnIter);
+      env->txnClosed(lock);
+      lock.unlock();
+
       if (rc != MDB_SUCCESS)
       {
          throw LMDBException("Failed to close env tx (" + errorString(rc) +")");
       }
-      
-      lock.lock();
-      env->txForThreads_.erase(txnIter);
    }
 }
 
@@ -622,9 +1159,19 @@ void LMDB::insert(
 
    if (txnIter == env->txForThreads_.end())
       throw LMDBException("Failed to insert: need transaction");
+   auto& thTx = txnIter->second;
    lock.unlock();
 
-   int rc = mdb_put(txnIter->second.txn_, dbi, &mkey, &mval, 0);
+   if (thTx.txn_ == nullptr)
+      throw LMDBException("Failed to insert: transaction was lost");
+
+   env->logWrite(thTx, WRITELOG_PUT, dbi, &mkey, &mval);
+   int rc = mdb_put(thTx.txn_, dbi, &mkey, &mval, 0);
+
+   //the txn is toast, grow the map and redo it
+   if (rc == MDB_MAP_FULL)
+      rc = env->replayWrites(thTx, false);
+
    if (rc == MDB_SUCCESS)
       return;
 
@@ -641,10 +1188,18 @@ void LMDB::erase(const CharacterArrayRef& key)
 
    if (txnIter == env->txForThreads_.end())
       throw LMDBException("Failed to insert: need transaction");
+   auto& thTx = txnIter->second;
    lock.unlock();
+
+   if (thTx.txn_ == nullptr)
+      throw LMDBException("Failed to erase: transaction was lost");
       
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
-   int rc = mdb_del(txnIter->second.txn_, dbi, &mkey, 0);
+   env->logWrite(thTx, WRITELOG_DEL, dbi, &mkey, nullptr);
+   int rc = mdb_del(thTx.txn_, dbi, &mkey, 0);
+   if (rc == MDB_MAP_FULL)
+      rc = env->replayWrites(thTx, false);
+
    if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)
    {
       std::cout << "failed to erase data, returned following error string: " << errorString(rc) << std::endl;
@@ -660,8 +1215,12 @@ void LMDB::wipe(const CharacterArrayRef& key)
 
    if (txnIter == env->txForThreads_.end())
       throw LMDBException("Failed to insert: need transaction");
+   auto& thTx = txnIter->second;
    lock.unlock();
 
+   if (thTx.txn_ == nullptr)
+      throw LMDBException("Failed to wipe: transaction was lost");
+
    try
    {
       MDB_val mdb_data_obj;
@@ -675,7 +1234,11 @@ void LMDB::wipe(const CharacterArrayRef& key)
    }   
 
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
-   int rc = mdb_del(txnIter->second.txn_, dbi, &mkey, 0); // , MDB_WIPE_DATA);
+   env->logWrite(thTx, WRITELOG_WIPE, dbi, &mkey, nullptr);
+   int rc = mdb_del(thTx.txn_, dbi, &mkey, 0); // , MDB_WIPE_DATA);
+   if (rc == MDB_MAP_FULL)
+      rc = env->replayWrites(thTx, false);
+
    if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)
    {
       std::cout << "failed to erase data, returned following error string: " << errorString(rc) << std::endl;
@@ -701,7 +1264,8 @@ CharacterArrayRef LMDB::get_NoCopy(const CharacterArrayRef& key) const
    std::unique_lock<std::mutex> lock(env->threadTxMutex_);
    
    auto txnIter = env->txForThreads_.find(tID);
-   if (txnIter == env->txForThreads_.end())
+   if (txnIter == env->txForThreads_.end() || 
+      txnIter->second.txn_ == nullptr)
       throw std::runtime_error("Need transaction to get data");
    
    /*
@@ -732,10 +1296,18 @@ void LMDB::drop(void)
    auto txnIter = env->txForThreads_.find(tID);
    if (txnIter == env->txForThreads_.end())
       throw std::runtime_error("Need transaction to get data");
-
+   auto& thTx = txnIter->second;
    lock.unlock();
 
-   if (mdb_drop(txnIter->second.txn_, dbi, 0) != MDB_SUCCESS)
+   if (thTx.txn_ == nullptr)
+      throw std::runtime_error("Failed to drop DB!");
+
+   env->logWrite(thTx, WRITELOG_DROP, dbi, nullptr, nullptr);
+   int rc = mdb_drop(thTx.txn_, dbi, 0);
+   if (rc == MDB_MAP_FULL)
+      rc = env->replayWrites(thTx, false);
+
+   if (rc != MDB_SUCCESS)
       throw std::runtime_error("Failed to drop DB!");
 }
 
@@ -14,6 +14,7 @@
 #include <unordered_map>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include "lmdb.h"
 
 struct MDB_env;
@@ -98,6 +99,9 @@ public:
       bool has_=false;
       LMDBThreadTxInfo* txnPtr_=nullptr;
       MDB_val key_, val_;
+
+      //copy of the key to seek back to once a txn is replayed
+      std::vector<char> seekKey_;
          
       void reset();
       void checkHasDb() const;
@@ -159,6 +163,9 @@ public:
       
       // seek this iterator to the first sequence
       void toFirst();
+
+      // seek this iterator to the last sequence
+      void toLast();
       
       // returns the key currently pointed to, if no key is being pointed to
       // std::logic_error is returned (not LSMException). LSMException may
@@ -249,6 +256,11 @@ struct LMDBThreadTxInfo
    std::vector<LMDB::Iterator*> iterators_;
    unsigned transactionLevel_=0;
    LMDB::Mode mode_;
+
+   //writes of this txn, replayed in a fresh txn if the map fills up.
+   //Only kept on envs that grow their map, dropped past WRITELOG_MAX_SIZE
+   bool logWrites_=false;
+   std::vector<char> writeLog_;
 };
 
 
@@ -264,6 +276,21 @@ private:
    std::string filename_;
    std::mutex threadTxMutex_;
    std::unordered_map<std::thread::id, LMDBThreadTxInfo> txForThreads_;
+
+   //reset read-only txns, renewed instead of begun from scratch. Requires
+   //MDB_NOTLS, so that any thread can pick up a pooled reader slot
+   std::mutex readTxPoolMutex_;
+   std::vector<MDB_txn*> readTxPool_;
+   size_t readTxPoolMax_ = 64;
+
+   //online map growth. Remapping is only safe while no txn is live in this
+   //process, growth is left pending until the last live txn closes. 
+   //Writes that failed on a full map leave the size they needed in 
+   //growTarget_
+   float growthFactor_ = 0.0f;
+   size_t growthMinFree_ = 0;
+   bool growPending_ = false;
+   size_t growTarget_ = 0;
    
    friend class LMDB;
 
@@ -323,10 +350,52 @@ public:
    const std::string& getFilename(void) const { return filename_; }
    size_t getMapSize(void) const;
    void setMapSize(size_t);
-   void compactCopy(const std::string& fname);
+
+   // size of the data within the map, in bytes
+   size_t getUsedSize(void) const;
+
+   // grow the map by (factor) whenever a write txn begins with less than
+   // max(minFree, mapsize / 2) left. The resize happens once no txn is
+   // live on the env, nothing waits on it. A small write txn that fills 
+   // the map anyway while it is the only live txn is replayed in a grown
+   // map, references into the map it obtained are invalidated. Otherwise
+   // the write fails with MDB_MAP_FULL. A factor <= 1 disables growth
+   void setMapGrowth(float factor, size_t minFree);
+
+   // smallest size reached by growing (from) that leaves enough headroom
+   // for the data currently in the env
+   size_t getGrownMapSize(size_t from) const;
+
+   // compacted copy of the env to (fname). Setting (cancel) stops the copy
+   // and removes the partial file, the call throws then. On Windows it is
+   // only checked before the copy starts
+   void compactCopy(const std::string& fname, 
+      const std::atomic<bool>* cancel = nullptr);
+
+   // flush committed txns to disk, envs opened with MDB_NOSYNC only get
+   // there when the OS decides to write the pages back
+   void sync(void);
+
+   // max amount of idle read txns kept around for reuse, 0 disables pooling.
+   // Pooling is turned off on envs opened without MDB_NOTLS
+   void setReadTxPoolSize(size_t);
    
 private:
    LMDBEnv(const LMDBEnv&); // disallow copy
+
+   int getReadTx(MDB_txn**);
+   void releaseReadTx(MDB_txn*);
+   void clearReadTxPool(void);
+
+   //expect threadTxMutex_ to be held
+   void growMap(std::unique_lock<std::mutex>&);
+   void txnClosed(std::unique_lock<std::mutex>&);
+   bool resizeMap(size_t);
+
+   bool growMapForReplay(size_t txnSize);
+   void logWrite(LMDBThreadTxInfo&, char op, unsigned dbi,
+      const MDB_val* key, const MDB_val* val);
+   int replayWrites(LMDBThreadTxInfo&, bool commit);
 };
 
 
@@ -17,6 +17,8 @@
 #include <list>
 #include <vector>
 #include <set>
+#include <algorithm>
+#include <atomic>
 #include "BinaryData.h"
 #include "BtcUtils.h"
 #include "BlockObj.h"
@@ -31,24 +33,26 @@
 #else
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #endif
 
 using namespace std;
 
-const set<DB_SELECT> LMDBBlockDatabase::supernodeDBs_({});
-const map<string, size_t> LMDBBlockDatabase::mapSizes_ = {
-   {"headers", 4 * 1024 * 1024 * 1024ULL},
-   {"blkdata", 1024 * 1024ULL},
-   {"history", 1024 * 1024ULL},
-   {"txhints", 20 * 1024 * 1024 * 1024ULL},
-   {"ssh",   500 * 1024 * 1024 * 1024ULL},
-   {"subssh", 2000 * 1024 * 1024 * 1024ULL},
-   {"subssh_meta", 100 * 1024 * 1024ULL},
-   {"stxo", 2000 * 1024 * 1024 * 1024ULL},
-   {"zeroconf", 10 * 1024 * 1024 * 1024ULL},
-   {"txfilters", 10 * 1024 * 1024 * 1024ULL},
-   {"spentness", 500 * 1024 * 1024 * 1024ULL},
-};
+const set<DB_SELECT> LMDBBlockDatabase::shardedDBs_({ SUBSSH, SPENTNESS });
+
+//maps start out small and grow online as they fill up, see 
+//LMDBEnv::setMapGrowth
+#define DB_MAP_INITIAL_SIZE (64 * 1024 * 1024ULL)
+#define DB_MAP_MIN_FREE (1024 * 1024 * 1024ULL)
+
+//headers per hashing batch when reading the HEADERS db
+#define HEADER_BATCH_SIZE 256
+
+#define TXHASHINDEX_FILENAME "txhashindex"
+//blocks this deep are treated as immutable by the txhash index
+#define TXHASHINDEX_REORG_DEPTH 144
+//rebuild the txhash index once it can be extended by this many blocks
+#define TXHASHINDEX_STEP 1008
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -78,6 +82,22 @@ bool LDBIter::advance(DB_PREFIX prefix)
    return isValid(prefix);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+size_t LDBIter::readBatch(LDBIterSpan* spans, size_t count, size_t)
+{
+   size_t filled = 0;
+   while (filled < count && readIterData())
+   {
+      spans[filled].key_ = currKey_;
+      spans[filled].value_ = currValue_;
+      ++filled;
+
+      advance();
+   }
+
+   return filled;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 bool LDBIter::advanceAndRead(void)
 {
@@ -283,6 +303,7 @@ bool LDBIter::checkKeyStartsWith(DB_PREFIX prefix, BinaryDataRef key)
 ////////////////////////////////////////////////////////////////////////////////
 bool LDBIter_Single::seekTo(BinaryDataRef key)
 {
+   countSeek();
    iter_.seek(CharacterArrayRef(
       key.getSize(), key.getPtr()), LMDB::Iterator::Seek_GE);
    return readIterData();
@@ -300,6 +321,7 @@ bool LDBIter_Single::seekToExact(BinaryDataRef key)
 ////////////////////////////////////////////////////////////////////////////////
 bool LDBIter_Single::seekToBefore(BinaryDataRef key)
 {
+   countSeek();
    iter_.seek(CharacterArrayRef(key.getSize(), key.getPtr()), LMDB::Iterator::Seek_LE);
    return readIterData();
 }
@@ -345,10 +367,275 @@ bool LDBIter_Single::readIterData(void)
 ////////////////////////////////////////////////////////////////////////////////
 bool LDBIter_Single::seekToFirst(void)
 {
+   countSeek();
    iter_.toFirst();
    return readIterData();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Single::seekToLast(void)
+{
+   countSeek();
+   iter_.toLast();
+   return readIterData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t LDBIter_Single::readBatch(
+   LDBIterSpan* spans, size_t count, size_t prefetchBytes)
+{
+   //straight off the cursor, no per entry readers
+   isDirty_ = true;
+   size_t filled = 0;
+   while (filled < count && iter_.isValid())
+   {
+      auto& key = iter_.key();
+      auto& val = iter_.value();
+
+      auto& span = spans[filled++];
+      span.key_.setRef((uint8_t*)key.mv_data, key.mv_size);
+      span.value_.setRef((uint8_t*)val.mv_data, val.mv_size);
+
+      iter_.advance();
+   }
+
+#ifndef _WIN32
+   //leaf pages of bulk loaded dbs mostly follow each other in the map,
+   //warm up the stretch past the last page we read
+   if (prefetchBytes > 0 && filled > 0)
+   {
+      const uintptr_t pageMask = ~(uintptr_t(4096) - 1);
+      auto lastPtr = (uintptr_t)spans[filled - 1].value_.getPtr();
+      madvise((void*)(lastPtr & pageMask), prefetchBytes, MADV_WILLNEED);
+   }
+#endif
+
+   return filled;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+/////LDBIter_Sharded
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::isNull(void) const
+{
+   return !isValid();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::isValid(void) const
+{
+   return iter_ != nullptr && iter_->isValid();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LDBIter_Sharded::setShard(shared_ptr<DBPair> shardPtr)
+{
+   auto dbPair = dbPtr_->getShardWithTx(shardPtr.get());
+   iter_ = dbPair->getIterator();
+   currentShard_ = dbPair->getId();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::nextShard(void)
+{
+   while (iter_ != nullptr && currentShard_ < SHARD_ID_MAX)
+   {
+      auto shardPtr = dbPtr_->getShardFrom(currentShard_ + 1);
+      if (shardPtr == nullptr)
+         break;
+
+      setShard(shardPtr);
+      if (iter_->seekToFirst())
+         return readIterData();
+   }
+
+   iter_.reset();
+   isDirty_ = true;
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::prevShard(void)
+{
+   while (iter_ != nullptr && currentShard_ > 0)
+   {
+      auto shardPtr = dbPtr_->getShardUpTo(currentShard_ - 1);
+      if (shardPtr == nullptr)
+         break;
+
+      setShard(shardPtr);
+      if (iter_->seekToLast())
+         return readIterData();
+   }
+
+   iter_.reset();
+   isDirty_ = true;
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekTo(BinaryDataRef key)
+{
+   countSeek();
+   auto id = dbPtr_->getShardIdForKey(key);
+   auto shardPtr = dbPtr_->getShardFrom(id);
+   if (shardPtr == nullptr)
+   {
+      iter_.reset();
+      isDirty_ = true;
+      return false;
+   }
+
+   setShard(shardPtr);
+   
+   //shards past the key's own shard only carry greater keys
+   bool result;
+   if (currentShard_ == id)
+      result = iter_->seekTo(key);
+   else
+      result = iter_->seekToFirst();
+
+   if (result)
+      return readIterData();
+   return nextShard();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToExact(BinaryDataRef key)
+{
+   if (!seekTo(key))
+      return false;
+
+   return checkKeyExact(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToBefore(BinaryDataRef key)
+{
+   countSeek();
+   auto id = dbPtr_->getShardIdForKey(key);
+   auto shardPtr = dbPtr_->getShardUpTo(id);
+   if (shardPtr == nullptr)
+   {
+      iter_.reset();
+      isDirty_ = true;
+      return false;
+   }
+
+   setShard(shardPtr);
+
+   bool result;
+   if (currentShard_ == id)
+      result = iter_->seekToBefore(key);
+   else
+      result = iter_->seekToLast();
+
+   if (result)
+      return readIterData();
+   return prevShard();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToFirst(void)
+{
+   countSeek();
+   auto shardPtr = dbPtr_->getShardFrom(0);
+   if (shardPtr == nullptr)
+   {
+      iter_.reset();
+      isDirty_ = true;
+      return false;
+   }
+
+   setShard(shardPtr);
+   if (iter_->seekToFirst())
+      return readIterData();
+   return nextShard();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::seekToLast(void)
+{
+   countSeek();
+   auto shardPtr = dbPtr_->getShardUpTo(SHARD_ID_MAX);
+   if (shardPtr == nullptr)
+   {
+      iter_.reset();
+      isDirty_ = true;
+      return false;
+   }
+
+   setShard(shardPtr);
+   if (iter_->seekToLast())
+      return readIterData();
+   return prevShard();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t LDBIter_Sharded::readBatch(
+   LDBIterSpan* spans, size_t count, size_t prefetchBytes)
+{
+   size_t filled = 0;
+   while (filled < count && iter_ != nullptr)
+   {
+      filled += iter_->readBatch(
+         spans + filled, count - filled, prefetchBytes);
+
+      //the shard iterator only runs off when it has no more entries
+      if (iter_->isValid() || !nextShard())
+         break;
+   }
+
+   isDirty_ = true;
+   return filled;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::advance(void)
+{
+   if (iter_ == nullptr)
+      return false;
+
+   isDirty_ = true;
+   if (iter_->advance())
+      return true;
+
+   return nextShard();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::retreat(void)
+{
+   if (iter_ == nullptr)
+      return false;
+
+   isDirty_ = true;
+   if (iter_->retreat())
+      return true;
+
+   return prevShard();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LDBIter_Sharded::readIterData(void)
+{
+   if (iter_ == nullptr || !iter_->readIterData())
+   {
+      isDirty_ = true;
+      return false;
+   }
+
+   currKey_ = iter_->getKeyRef();
+   currValue_ = iter_->getValueRef();
+
+   currKeyReader_.setNewData(currKey_);
+   currValueReader_.setNewData(currValue_);
+   isDirty_ = false;
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 /////LMDBBlockDatabase
@@ -397,14 +684,25 @@ void LMDBBlockDatabase::openDatabases(
       auto iter = dbMap_.find(CURRDB);
       if (iter == dbMap_.end())
       {
-         if (getDbType() == ARMORY_DB_SUPER)
+         shared_ptr<DatabaseContainer> dbPtr;
+         if (getDbType() == ARMORY_DB_SUPER &&
+            shardedDBs_.find(CURRDB) != shardedDBs_.end())
          {
-            if (supernodeDBs_.find(CURRDB) != supernodeDBs_.end())
-               continue;
+            //dbs built before sharding keep their single env until rebuilt
+            if (DatabaseContainer_Sharded::isShardedOnDisk(CURRDB))
+            {
+               dbPtr = make_shared<DatabaseContainer_Sharded>(CURRDB);
+            }
+            else
+            {
+               LOGINFO << "single env " << 
+                  DatabaseContainer::getDbName(CURRDB) << " db, not sharded";
+            }
          }
             
-         dbMap_.insert(make_pair(
-            CURRDB, make_shared<DatabaseContainer_Single>(CURRDB)));
+         if (dbPtr == nullptr)
+            dbPtr = make_shared<DatabaseContainer_Single>(CURRDB);
+         dbMap_.insert(make_pair(CURRDB, dbPtr));
       }
 
       StoredDBInfo sdbi = openDB(CURRDB);
@@ -422,6 +720,11 @@ void LMDBBlockDatabase::openDatabases(
             LOGERR << "db type mismatch, aborting";
             exit(-2);
          }
+
+         //older dbs keep writing uncompressed values, readers handle both
+         ScriptCompression::setEnabled(sdbi.armoryVer_ == ARMORY_DB_VERSION);
+         if (sdbi.armoryVer_ != ARMORY_DB_VERSION)
+            LOGINFO << "legacy db version, txout compression is disabled";
       }
    }
 
@@ -429,6 +732,8 @@ void LMDBBlockDatabase::openDatabases(
    {
       loadHeightToIdMap();
    }
+
+   loadTxHashIndex();
  
    {
       //sanity check: try to open older SDBI version
@@ -452,6 +757,10 @@ void LMDBBlockDatabase::openDatabases(
 /////////////////////////////////////////////////////////////////////////////
 void LMDBBlockDatabase::closeDatabases(void)
 {
+   atomic_store(&txHashIndex_, shared_ptr<TxHashIndex>());
+   invalidateObjectCache(true);
+   ScriptCompression::setEnabled(false);
+
    for (auto& dbPair : dbMap_)
       dbPair.second->close();
    dbMap_.clear();
@@ -498,6 +807,144 @@ void LMDBBlockDatabase::cycleDatabase(DB_SELECT db)
    dbPtr->open();
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::syncDatabase(DB_SELECT db)
+{
+   getDbPtr(db)->sync();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+map<string, pair<size_t, size_t>> LMDBBlockDatabase::getMapUsage() const
+{
+   map<string, pair<size_t, size_t>> result;
+   for (auto& dbPair : dbMap_)
+   {
+      result.insert(make_pair(
+         DatabaseContainer::getDbName(dbPair.first), 
+         dbPair.second->getMapUsage()));
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::snapshotDatabases(const string& destDir,
+   const function<void(unsigned, unsigned)>& progress,
+   mutex& writeMutex, const atomic<bool>& cancel) const
+{
+   if (!DBUtils::isDir(destDir))
+      throw LmdbWrapperException("snapshot dir does not exist");
+
+   if (DBUtils::getDirectoryContent(destDir).size() != 0)
+      throw LmdbWrapperException("snapshot dir is not empty");
+
+   /***
+   Blocks land in the dbs between copies. Copy them against the order 
+   the scan writes them in: the history dbs trail the ones they are built
+   from and the headers lead all of them. The copied dbs can then only be
+   ahead of those copied before them, and the scan picks up from the 
+   lagging ones on restore.
+   ***/
+   vector<DB_SELECT> copyOrder = { SSH, SUBSSH, SUBSSH_META };
+   for (auto& dbPair : dbMap_)
+   {
+      if (dbPair.first == HEADERS || 
+         find(copyOrder.begin(), copyOrder.end(), dbPair.first) !=
+         copyOrder.end())
+         continue;
+      copyOrder.push_back(dbPair.first);
+   }
+   copyOrder.push_back(HEADERS);
+
+   //the tx hash index is rebuilt from TXHINTS on load, it isn't carried
+   unsigned count = 0;
+   for (auto& dbSelect : copyOrder)
+   {
+      auto iter = dbMap_.find(dbSelect);
+      if (iter == dbMap_.end())
+         continue;
+
+      if (cancel.load(memory_order_relaxed))
+         throw LmdbWrapperException("snapshot was cancelled");
+
+      progress(count, dbMap_.size());
+
+      LOGINFO << "snapshotting " << 
+         DatabaseContainer::getDbName(dbSelect) << " db";
+      iter->second->compactCopy(destDir, writeMutex, cancel);
+      ++count;
+   }
+
+   progress(count, dbMap_.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+map<string, DBMetricsStats> LMDBBlockDatabase::getDbMetrics() const
+{
+   map<string, DBMetricsStats> result;
+   for (auto& dbPair : dbMap_)
+   {
+      result.insert(make_pair(
+         DatabaseContainer::getDbName(dbPair.first),
+         DBMetrics::getStats(dbPair.first)));
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<DbTransaction> LMDBBlockDatabase::beginTransaction(
+   DB_SELECT db, LMDB::Mode mode) const
+{
+   auto dbObj = getDbPtr(db);
+
+   //sharded dbs open their shard txns on first access, their writer lock
+   //wait doesn't show here
+   auto start = DBMetrics::now();
+   auto txPtr = dbObj->beginTransaction(mode);
+   if (mode == LMDB::ReadWrite)
+      DBMetrics::recordSince(db, DBMetrics_WriteLockWait, start);
+
+   txPtr->setMetrics(db, mode);
+   return txPtr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<LDBIter> LMDBBlockDatabase::getIterator(DB_SELECT db) const
+{
+   auto dbObj = getDbPtr(db);
+   auto iter = dbObj->getIterator();
+   iter->setMetricsDb(db);
+   return iter;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::setObjectCacheSize(size_t bytes)
+{
+   //txs are larger and more often requested than single txouts
+   txCache_.setBudget(bytes / 4 * 3);
+   stxoCache_.setBudget(bytes / 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::invalidateObjectCache(bool reorg)
+{
+   //new blocks mine zc and spend outputs, drop txouts on every new top
+   stxoCache_.clear();
+
+   if (reorg)
+      txCache_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+map<string, DBObjectCacheStats> LMDBBlockDatabase::getObjectCacheStats() const
+{
+   map<string, DBObjectCacheStats> result;
+   result.insert(make_pair("tx", txCache_.getStats()));
+   result.insert(make_pair("txout", stxoCache_.getStats()));
+   return result;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void LMDBBlockDatabase::resetHistoryDatabases(void)
 {
@@ -508,11 +955,14 @@ void LMDBBlockDatabase::resetHistoryDatabases(void)
       auto db_subssh = getDbPtr(SUBSSH);
       auto db_hints = getDbPtr(TXHINTS);
       auto db_stxo = getDbPtr(STXO);
+      auto db_undo = getDbPtr(BLKUNDO);
       closeDatabases();
 
       db_subssh->eraseOnDisk();
       db_hints->eraseOnDisk();
       db_stxo->eraseOnDisk();
+      db_undo->eraseOnDisk();
+      eraseTxHashIndex();
    }
    else
    {
@@ -520,12 +970,14 @@ void LMDBBlockDatabase::resetHistoryDatabases(void)
       auto db_subssh_meta = getDbPtr(SUBSSH_META);
       auto db_ssh = getDbPtr(SSH);
       auto db_spentness = getDbPtr(SPENTNESS);
+      auto db_undo = getDbPtr(BLKUNDO);
       closeDatabases();
 
       db_subssh->eraseOnDisk();
       db_subssh_meta->eraseOnDisk();
       db_ssh->eraseOnDisk();
       db_spentness->eraseOnDisk();
+      db_undo->eraseOnDisk();
    }
    
    openDatabases(DatabaseContainer::baseDir_);
@@ -540,6 +992,11 @@ void LMDBBlockDatabase::destroyAndResetDatabases(void)
       closeDatabases();
       for (auto& dbPair : dbMap_)
          dbPair.second->eraseOnDisk();
+      eraseTxHashIndex();
+
+      auto&& snapshotPath = 
+         DatabaseContainer::getDbPath(HEADERSNAPSHOT_FILENAME);
+      remove(snapshotPath.c_str());
    }
    
    // Reopen the databases with the exact same parameters as before
@@ -559,7 +1016,14 @@ BinaryDataRef LMDBBlockDatabase::getValueNoCopy(DB_SELECT db,
    BinaryDataRef key) const
 {
    auto dbPtr = getDbPtr(db);
-   return dbPtr->getValue(key);
+
+   auto start = DBMetrics::now();
+   auto val = dbPtr->getValue(key);
+   DBMetrics::recordSince(db, DBMetrics_GetLatency, start);
+   DBMetrics::count(db, DBMetrics_Get);
+   DBMetrics::count(db, DBMetrics_BytesRead, val.getSize());
+
+   return val;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -668,6 +1132,11 @@ BinaryData LMDBBlockDatabase::getDBKeyForHash(const BinaryData& txhash,
       return BinaryData();
    }
 
+   //immutable block range first, this spares us the hint lookups
+   auto&& indexKey = getDBKeyFromTxHashIndex(txhash, expectedDupId);
+   if (indexKey.getSize() != 0)
+      return indexKey;
+
    BinaryData hash4(txhash.getSliceRef(0, 4));
 
    auto&& txHints = beginTransaction(TXHINTS, LMDB::ReadOnly);
@@ -754,23 +1223,155 @@ BinaryData LMDBBlockDatabase::getDBKeyForHash(const BinaryData& txhash,
 }
 
 /////////////////////////////////////////////////////////////////////////////
-unsigned LMDBBlockDatabase::getHeightForTxHash(
-   const BinaryDataRef& hash) const
+BinaryData LMDBBlockDatabase::getDBKeyFromTxHashIndex(
+   const BinaryData& txhash, uint8_t expectedDupId) const
 {
-   auto&& dbkey = getDBKeyForHash(hash);
-   if (dbkey.empty())
-      return UINT32_MAX;
-      
-   auto hgtx = dbkey.getSliceRef(0, 4);
+   auto index = atomic_load(&txHashIndex_);
+   if (index == nullptr)
+      return BinaryData();
 
-   if (getDbType() == ARMORY_DB_SUPER)
+   //entries match 128 bits of the hash, that is taken as proof
+   auto range = index->find(txhash);
+   for (auto i = range.first; i < range.second; i++)
    {
-      auto block_id = DBUtils::hgtxToHeight(hgtx);
-      auto header = blockchainPtr_->getHeaderById(block_id);
-      return header->getBlockHeight();
+      auto key = index->getDBKey(i);
+
+      //same dupId rules as the hint lookup
+      uint32_t height;
+      uint8_t  dup;
+      uint16_t txIdx;
+      BinaryRefReader brr(key);
+      DBUtils::readBlkDataKeyNoPrefix(brr, height, dup, txIdx);
+
+      if (dup != expectedDupId)
+      {
+         if (dup != getValidDupIDForHeight(height) && 
+            range.second - range.first > 1)
+            continue;
+      }
+
+      return key;
    }
 
-   return DBUtils::hgtxToHeight(hgtx);
+   return BinaryData();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::loadTxHashIndex()
+{
+   atomic_store(&txHashIndex_, shared_ptr<TxHashIndex>());
+
+   //supernode hints do not carry full hashes
+   if (getDbType() == ARMORY_DB_SUPER)
+      return;
+
+   auto&& path = DatabaseContainer::getDbPath(TXHASHINDEX_FILENAME);
+   if (!DBUtils::fileExists(path, 0))
+      return;
+
+   try
+   {
+      atomic_store(&txHashIndex_, make_shared<TxHashIndex>(path));
+   }
+   catch (exception& e)
+   {
+      LOGWARN << "failed to load txhash index: " << e.what();
+      remove(path.c_str());
+   }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::eraseTxHashIndex()
+{
+   atomic_store(&txHashIndex_, shared_ptr<TxHashIndex>());
+
+   auto&& path = DatabaseContainer::getDbPath(TXHASHINDEX_FILENAME);
+   remove(path.c_str());
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::updateTxHashIndex()
+{
+   if (getDbType() == ARMORY_DB_SUPER)
+      return;
+
+   auto topHeight = blockchainPtr_->top()->getBlockHeight();
+   if (topHeight < TXHASHINDEX_REORG_DEPTH + TXHASHINDEX_STEP)
+      return;
+   unsigned coverTo = topHeight - TXHASHINDEX_REORG_DEPTH;
+
+   auto index = atomic_load(&txHashIndex_);
+   if (index != nullptr && index->getCoveredHeight() <= coverTo &&
+      coverTo - index->getCoveredHeight() < TXHASHINDEX_STEP)
+      return;
+
+   //resolved hashes are saved under their tx key, so this walks them in
+   //height order. The index is rebuilt from scratch to pick up hints that
+   //were added for older blocks since the last run
+   vector<TxHashIndexEntry> entries;
+   {
+      auto&& tx = beginTransaction(TXHINTS, LMDB::ReadOnly);
+      auto dbIter = getIterator(TXHINTS);
+      if (dbIter->seekToStartsWith(DB_PREFIX_TXDATA))
+      {
+         do
+         {
+            auto keyRef = dbIter->getKeyRef();
+            auto valRef = dbIter->getValueRef();
+            if (keyRef.getSize() != 7 || valRef.getSize() < 36)
+               continue;
+
+            auto height = DBUtils::hgtxToHeight(keyRef.getSliceRef(1, 4));
+            if (height >= coverTo)
+               break;
+
+            entries.emplace_back(
+               valRef.getSliceRef(4, 32), keyRef.getSliceRef(1, 6));
+         } while (dbIter->advanceAndRead(DB_PREFIX_TXDATA));
+      }
+   }
+
+   //write to a temp file and swap it in, readers may still be holding
+   //on to the current map
+   auto&& path = DatabaseContainer::getDbPath(TXHASHINDEX_FILENAME);
+   auto tempPath = path;
+   tempPath.append(".tmp");
+
+   try
+   {
+      TxHashIndex::write(tempPath, entries, coverTo);
+      rename(tempPath.c_str(), path.c_str());
+      atomic_store(&txHashIndex_, make_shared<TxHashIndex>(path));
+   }
+   catch (exception& e)
+   {
+      LOGWARN << "failed to update txhash index: " << e.what();
+      remove(tempPath.c_str());
+      return;
+   }
+
+   LOGINFO << "indexed " << entries.size() << 
+      " tx hashes up to height #" << coverTo;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+unsigned LMDBBlockDatabase::getHeightForTxHash(
+   const BinaryDataRef& hash) const
+{
+   auto&& dbkey = getDBKeyForHash(hash);
+   if (dbkey.empty())
+      return UINT32_MAX;
+      
+   auto hgtx = dbkey.getSliceRef(0, 4);
+
+   if (getDbType() == ARMORY_DB_SUPER)
+   {
+      auto block_id = DBUtils::hgtxToHeight(hgtx);
+      auto header = blockchainPtr_->getHeaderById(block_id);
+      return header->getBlockHeight();
+   }
+
+   return DBUtils::hgtxToHeight(hgtx);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -781,6 +1382,9 @@ void LMDBBlockDatabase::putValue(DB_SELECT db,
 {
    auto dbPtr = getDbPtr(db);
    dbPtr->putValue(key, value);
+
+   DBMetrics::count(db, DBMetrics_Put);
+   DBMetrics::count(db, DBMetrics_BytesWritten, key.getSize() + value.getSize());
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -811,6 +1415,7 @@ void LMDBBlockDatabase::deleteValue(DB_SELECT db,
 {
    auto dbPtr = getDbPtr(db);
    dbPtr->deleteValue(key);
+   DBMetrics::count(db, DBMetrics_Delete);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -1208,53 +1813,191 @@ bool LMDBBlockDatabase::getFullUTXOMapForSSH(
 //       that would get us since we are reading all the headers and doing
 //       a fresh organize/sort anyway.
 void LMDBBlockDatabase::readAllHeaders(
-   const function<void(shared_ptr<BlockHeader>, uint32_t, uint8_t)> &callback
+   const function<void(shared_ptr<BlockHeader>, uint32_t, uint8_t)> &callback,
+   unsigned threadCount
 )
 {
-   auto&& tx = beginTransaction(HEADERS, LMDB::ReadOnly);
-   auto ldbIter = getIterator(HEADERS);
+   /***
+   Reading the db is serial, hashing and checking the headers is not. 
+   Headers are hashed in batches across the SIMD lanes of Sha256Multi, 
+   batches are spread over threadCount threads. The callback still sees 
+   headers in db order, from the calling thread.
+   ***/
 
-   if(!ldbIter->seekToStartsWith(DB_PREFIX_HEADHASH))
+   vector<StoredHeader> sbhVec;
    {
-      LOGWARN << "No headers in DB yet!";
-      return;
+      auto&& tx = beginTransaction(HEADERS, LMDB::ReadOnly);
+      auto ldbIter = getIterator(HEADERS);
+
+      if(!ldbIter->seekToStartsWith(DB_PREFIX_HEADHASH))
+      {
+         LOGWARN << "No headers in DB yet!";
+         return;
+      }
+
+      do
+      {
+         ldbIter->resetReaders();
+         ldbIter->verifyPrefix(DB_PREFIX_HEADHASH);
+
+         if(ldbIter->getKeyReader().getSizeRemaining() != 32)
+         {
+            LOGERR << "How did we get header hash not 32 bytes?";
+            continue;
+         }
+
+         sbhVec.emplace_back();
+         auto& sbh = sbhVec.back();
+         ldbIter->getKeyReader().get_BinaryData(sbh.thisHash_, 32);
+         sbh.unserializeDBValue(HEADERS, ldbIter->getValueRef());
+
+         if (sbh.dataCopy_.getSize() != HEADER_SIZE)
+         {
+            LOGERR << "invalid header data for block " <<
+               sbh.thisHash_.copySwapEndian().toHexStr();
+            sbhVec.pop_back();
+         }
+      } while(ldbIter->advanceAndRead(DB_PREFIX_HEADHASH));
    }
-   
-   do
+
+   vector<shared_ptr<BlockHeader>> headers(sbhVec.size());
+   atomic<size_t> batchCounter;
+   batchCounter.store(0, memory_order_relaxed);
+
+   auto hashLbd = [&sbhVec, &headers, &batchCounter](void)->void
    {
-      ldbIter->resetReaders();
-      ldbIter->verifyPrefix(DB_PREFIX_HEADHASH);
-   
-      if(ldbIter->getKeyReader().getSizeRemaining() != 32)
+      vector<BinaryDataRef> msgs;
+      while (true)
       {
-         LOGERR << "How did we get header hash not 32 bytes?";
-         continue;
+         auto start = batchCounter.fetch_add(
+            HEADER_BATCH_SIZE, memory_order_relaxed);
+         if (start >= sbhVec.size())
+            return;
+
+         auto end = min<size_t>(start + HEADER_BATCH_SIZE, sbhVec.size());
+
+         msgs.clear();
+         for (auto i = start; i < end; i++)
+            msgs.push_back(sbhVec[i].dataCopy_.getRef());
+         auto&& hashes = BtcUtils::getHash256Many(msgs);
+
+         for (auto i = start; i < end; i++)
+         {
+            auto& sbh = sbhVec[i];
+            auto& hash = hashes[i - start];
+
+            auto regHead = make_shared<BlockHeader>();
+            regHead->unserialize(sbh.dataCopy_.getRef(), hash.getRef());
+            regHead->setBlockSize(sbh.numBytes_);
+            regHead->setNumTx(sbh.numTx_);
+
+            regHead->setBlockFileNum(sbh.fileID_);
+            regHead->setBlockFileOffset(sbh.offset_);
+            regHead->setUniqueID(sbh.uniqueID_);
+
+            if (sbh.thisHash_ != hash)
+            {
+               LOGWARN << "Corruption detected: block header hash " <<
+                  sbh.thisHash_.copySwapEndian().toHexStr() << " does not match "
+                  << hash.copySwapEndian().toHexStr();
+            }
+            else if (!BtcUtils::verifyProofOfWork(
+               sbh.dataCopy_.getRef(), hash.getRef()))
+            {
+               LOGWARN << "Corruption detected: block header " <<
+                  hash.copySwapEndian().toHexStr() << 
+                  " does not meet its target";
+            }
+
+            headers[i] = regHead;
+         }
       }
+   };
 
-      StoredHeader sbh;
-      ldbIter->getKeyReader().get_BinaryData(sbh.thisHash_, 32);
+   vector<thread> threads;
+   for (unsigned i = 1; i < threadCount; i++)
+      threads.push_back(thread(hashLbd));
+   hashLbd();
 
-      sbh.unserializeDBValue(HEADERS, ldbIter->getValueRef());
+   for (auto& thr : threads)
+   {
+      if (thr.joinable())
+         thr.join();
+   }
+
+   for (size_t i = 0; i < headers.size(); i++)
+      callback(headers[i], sbhVec[i].blockHeight_, sbhVec[i].duplicateID_);
+}
 
-      auto regHead = make_shared<BlockHeader>();
+/////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::checkHeaderSnapshot(const HeaderSnapshot& snapshot,
+   const function<bool(const StoredHeader&)>& isNew)
+{
+   /***
+   Both sides are sorted by hash, walk them together. Headers this run 
+   wrote to the db come between the snapshot records, isNew tells them
+   apart from headers the snapshot missed.
+   ***/
 
-      regHead->unserialize(sbh.dataCopy_);
-      regHead->setBlockSize(sbh.numBytes_);
-      regHead->setNumTx(sbh.numTx_);
+   auto&& tx = beginTransaction(HEADERS, LMDB::ReadOnly);
 
-      regHead->setBlockFileNum(sbh.fileID_);
-      regHead->setBlockFileOffset(sbh.offset_);
-      regHead->setUniqueID(sbh.uniqueID_);
+   auto ldbIter = getIterator(HEADERS);
+   size_t index = 0;
 
-      if (sbh.thisHash_ != regHead->getThisHash())
+   if (ldbIter->seekToStartsWith(DB_PREFIX_HEADHASH))
+   {
+      do
       {
-         LOGWARN << "Corruption detected: block header hash " <<
-            sbh.thisHash_.copySwapEndian().toHexStr() << " does not match "
-            << regHead->getThisHash().copySwapEndian().toHexStr();
-      }
-      callback(regHead, sbh.blockHeight_, sbh.duplicateID_);
+         ldbIter->resetReaders();
+         ldbIter->verifyPrefix(DB_PREFIX_HEADHASH);
+
+         if (ldbIter->getKeyReader().getSizeRemaining() != 32)
+            continue;
+
+         StoredHeader sbh;
+         ldbIter->getKeyReader().get_BinaryData(sbh.thisHash_, 32);
+         sbh.unserializeDBValue(HEADERS, ldbIter->getValueRef());
+
+         //snapshot records the db doesn't have
+         if (index < snapshot.size() && 
+            snapshot.getHash(index) < sbh.thisHash_.getRef())
+         {
+            LOGWARN << "header snapshot has block " <<
+               BinaryData(snapshot.getHash(index)).copySwapEndian().toHexStr() <<
+               " that is missing from the HEADERS db";
+            return false;
+         }
+
+         if (index < snapshot.size() && 
+            snapshot.getHash(index) == sbh.thisHash_.getRef())
+         {
+            if (!snapshot.matches(index++, sbh))
+            {
+               LOGWARN << "header snapshot mismatch for block " <<
+                  sbh.thisHash_.copySwapEndian().toHexStr();
+               return false;
+            }
+
+            continue;
+         }
+
+         if (!isNew(sbh))
+         {
+            LOGWARN << "header snapshot is missing block " <<
+               sbh.thisHash_.copySwapEndian().toHexStr();
+            return false;
+         }
+      } while (ldbIter->advanceAndRead(DB_PREFIX_HEADHASH));
+   }
+
+   if (index != snapshot.size())
+   {
+      LOGWARN << "header snapshot has " << snapshot.size() - index <<
+         " headers past the last one in the HEADERS db";
+      return false;
+   }
 
-   } while(ldbIter->advanceAndRead(DB_PREFIX_HEADHASH));
+   return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1655,8 +2398,29 @@ void LMDBBlockDatabase::updatePreferredTxHint( BinaryDataRef hashOrPrefix,
 
 }
 
+////////////////////////////////////////////////////////////////////////////////
+static size_t getCachedSize(const Tx& tx)
+{
+   //raw tx plus in/out/witness offsets, roughly
+   return sizeof(Tx) + tx.getSize() +
+      (tx.getNumTxIn() * 2 + tx.getNumTxOut() + 3) * sizeof(size_t);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static size_t getCachedSize(const StoredTxOut& stxo)
+{
+   return sizeof(StoredTxOut) + stxo.dataCopy_.getSize() +
+      stxo.spentByTxInKey_.getSize();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 Tx LMDBBlockDatabase::getFullTxCopy(BinaryData ldbKey6B) const
+{
+   return *getFullTxPtr(ldbKey6B);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<const Tx> LMDBBlockDatabase::getFullTxPtr(BinaryData ldbKey6B) const
 {
    unsigned height;
    uint8_t dup;
@@ -1684,7 +2448,7 @@ Tx LMDBBlockDatabase::getFullTxCopy(BinaryData ldbKey6B) const
    else
       header = blockchainPtr_->getHeaderById(height);
 
-   return getFullTxCopy(txid, header);
+   return getFullTxPtr(txid, header);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1711,6 +2475,13 @@ Tx LMDBBlockDatabase::getFullTxCopy(
 ////////////////////////////////////////////////////////////////////////////////
 Tx LMDBBlockDatabase::getFullTxCopy(
    uint16_t txIndex, shared_ptr<BlockHeader> bhPtr) const
+{
+   return *getFullTxPtr(txIndex, bhPtr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<const Tx> LMDBBlockDatabase::getFullTxPtr(
+   uint16_t txIndex, shared_ptr<BlockHeader> bhPtr) const
 {
    if (bhPtr == nullptr)
       throw LmdbWrapperException("null bhPtr");
@@ -1721,6 +2492,13 @@ Tx LMDBBlockDatabase::getFullTxCopy(
    if (blkFolder_.size() == 0)
       throw LmdbWrapperException("invalid blkFolder");
 
+   //header ids are unique across branches, unlike height|dup
+   auto&& cacheKey = DBUtils::getBlkDataKeyNoPrefix(
+      bhPtr->getThisID(), 0xFF, txIndex);
+   auto cachedTx = txCache_.get(cacheKey);
+   if (cachedTx != nullptr)
+      return cachedTx;
+
    //open block file
    BlockDataLoader bdl(blkFolder_);
 
@@ -1738,7 +2516,13 @@ Tx LMDBBlockDatabase::getFullTxCopy(
 
    BinaryRefReader brr(bctx->data_, bctx->size_);
 
-   return Tx(brr);
+   auto txPtr = make_shared<Tx>(brr);
+
+   //the hash is computed lazily, get it out of the way before readers 
+   //share the object
+   txPtr->getThisHash();
+   txCache_.put(cacheKey, txPtr, getCachedSize(*txPtr));
+   return txPtr;
 }
 
 
@@ -1769,6 +2553,15 @@ TxOut LMDBBlockDatabase::getTxOutCopy(
       auto header = blockchainPtr_->getHeaderByHeight(block, dup);
       auto&& key_super = DBUtils::getBlkDataKeyNoPrefix(
          header->getThisID(), 0xFF, txid, txOutIdx);
+
+      auto cachedStxo = stxoCache_.get(key_super);
+      if (cachedStxo != nullptr)
+      {
+         auto&& txout_raw = cachedStxo->getSerializedTxOut();
+         txoOut.unserialize(txout_raw, txout_raw.getSize(), txOutIdx);
+         return txoOut;
+      }
+
       brr = getValueReader(STXO, key_super);
 
       if (brr.getSize() == 0)
@@ -1777,9 +2570,17 @@ TxOut LMDBBlockDatabase::getTxOutCopy(
          return TxOut();
       }
 
-      StoredTxOut stxo;
-      stxo.unserializeDBValue(brr.getRawRef());
-      auto&& txout_raw = stxo.getSerializedTxOut();
+      auto stxoPtr = make_shared<StoredTxOut>();
+      stxoPtr->unserializeDBValue(brr.getRawRef());
+      stxoPtr->blockHeight_ = header->getBlockHeight();
+      stxoPtr->duplicateID_ = header->getDuplicateID();
+      stxoPtr->txIndex_ = txid;
+      stxoPtr->txOutIndex_ = txOutIdx;
+      stxoPtr->isCoinbase_ = (txid == 0);
+
+      stxoCache_.put(key_super, stxoPtr, getCachedSize(*stxoPtr));
+
+      auto&& txout_raw = stxoPtr->getSerializedTxOut();
       txoOut.unserialize(txout_raw, txout_raw.getSize(), txOutIdx);
       return txoOut;
    }
@@ -1794,9 +2595,12 @@ TxOut LMDBBlockDatabase::getTxOutCopy(
       return TxOut();
    }
 
-   brr.advance(2);
+   //values may be compressed, go through the stxo
+   StoredTxOut stxo;
+   stxo.unserializeDBValue(brr);
+   auto&& txout_raw = stxo.getSerializedTxOut();
    txoOut.unserialize_checked(
-      brr.getCurrPtr(), brr.getSizeRemaining(), 0, (uint32_t)txOutIdx);
+      txout_raw.getPtr(), txout_raw.getSize(), 0, (uint32_t)txOutIdx);
    return txoOut;
 }
 
@@ -2338,21 +3142,40 @@ bool LMDBBlockDatabase::getStoredTxOut(
          }
       }
 
-      auto&& stxo_tx = beginTransaction(STXO, LMDB::ReadOnly);
-      auto data = getValueNoCopy(STXO, bdr_key);
-      if (data.getSize() == 0)
+      auto cachedStxo = stxoCache_.get(bdr_key);
+      if (cachedStxo == nullptr)
       {
-         LOGWARN << "no txout for key: " << header->getBlockHeight() <<
-            "|" << header->getDuplicateID() << "|" << txIdx << "|" << txoutid;
-         return false;
+         auto&& stxo_tx = beginTransaction(STXO, LMDB::ReadOnly);
+         auto data = getValueNoCopy(STXO, bdr_key);
+         if (data.getSize() == 0)
+         {
+            LOGWARN << "no txout for key: " << header->getBlockHeight() <<
+               "|" << header->getDuplicateID() << "|" << txIdx << "|" << txoutid;
+            return false;
+         }
+
+         auto stxoPtr = make_shared<StoredTxOut>();
+         stxoPtr->unserializeDBValue(data);
+         stxoPtr->blockHeight_ = header->getBlockHeight();
+         stxoPtr->duplicateID_ = header->getDuplicateID();
+         stxoPtr->txIndex_ = txIdx;
+         stxoPtr->txOutIndex_ = txoutid;
+         stxoPtr->isCoinbase_ = (txIdx == 0);
+
+         stxoCache_.put(bdr_key, stxoPtr, getCachedSize(*stxoPtr));
+         cachedStxo = stxoPtr;
       }
 
-      stxo.unserializeDBValue(data);
-      stxo.blockHeight_ = header->getBlockHeight();
-      stxo.duplicateID_ = header->getDuplicateID();
-      stxo.txIndex_ = txIdx;
-      stxo.txOutIndex_ = txoutid;
-      stxo.isCoinbase_ = (txIdx == 0);
+      //only copy what a db read would set, leave the rest to the caller
+      stxo.unserArmVer_ = cachedStxo->unserArmVer_;
+      stxo.txVersion_ = cachedStxo->txVersion_;
+      stxo.dataCopy_ = cachedStxo->dataCopy_;
+      stxo.spentByTxInKey_ = cachedStxo->spentByTxInKey_;
+      stxo.blockHeight_ = cachedStxo->blockHeight_;
+      stxo.duplicateID_ = cachedStxo->duplicateID_;
+      stxo.txIndex_ = cachedStxo->txIndex_;
+      stxo.txOutIndex_ = cachedStxo->txOutIndex_;
+      stxo.isCoinbase_ = cachedStxo->isCoinbase_;
 
       //get spentness
       auto&& spentness_tx = beginTransaction(SPENTNESS, LMDB::ReadOnly);
@@ -2422,45 +3245,183 @@ void LMDBBlockDatabase::getSpentness(StoredTxOut& stxo)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void LMDBBlockDatabase::getUTXOflags(map<BinaryData, StoredSubHistory>&
-   subSshMap) const
+unsigned LMDBBlockDatabase::getStoredTxOuts(
+   const vector<BinaryData>& dbKeys, vector<StoredTxOut>& stxos) const
 {
-   if (getDbType() != ARMORY_DB_SUPER)
+   stxos.clear();
+   stxos.resize(dbKeys.size());
+
+   //on disk key and position in the result vector
+   vector<pair<BinaryData, size_t>> keys;
+   keys.reserve(dbKeys.size());
+
+   unsigned count = 0;
+   for (size_t i = 0; i < dbKeys.size(); i++)
    {
-      auto tx = beginTransaction(STXO, LMDB::ReadOnly);
-      for (auto& subssh : subSshMap)
-         getUTXOflags(subssh.second);
+      auto& dbKey = dbKeys[i];
+      if (dbKey.getSize() != 8)
+      {
+         LOGERR << "Tried to get StoredTxOut, but the provided key is not of "
+            "the proper size. Expect size is 8, this key is: " << 
+            dbKey.getSize();
+         continue;
+      }
+
+      auto& stxo = stxos[i];
+
+      unsigned height;
+      uint8_t dup;
+      uint16_t txIdx, txOutIdx;
+      BinaryRefReader brrKey(dbKey);
+      DBUtils::readBlkDataKeyNoPrefix(brrKey, height, dup, txIdx, txOutIdx);
+
+      if (getDbType() != ARMORY_DB_SUPER)
+      {
+         stxo.blockHeight_ = height;
+         stxo.duplicateID_ = dup;
+         stxo.txIndex_ = txIdx;
+         stxo.txOutIndex_ = txOutIdx;
+
+         keys.emplace_back(
+            DBUtils::getBlkDataKey(height, dup, txIdx, txOutIdx), i);
+         continue;
+      }
+
+      //supernode stxos are keyed by block id
+      shared_ptr<BlockHeader> header;
+      try
+      {
+         if (dup != 0x7F)
+            header = blockchainPtr_->getHeaderByHeight(height, dup);
+         else
+            header = blockchainPtr_->getHeaderById(height);
+      }
+      catch (range_error&)
+      {
+         LOGWARN << "no header for id " << height;
+         continue;
+      }
+      catch (length_error&)
+      {
+         //dupId is not on the main branch, defer to the hhl lookup in the
+         //single key accessor
+         if (getStoredTxOut(stxo, dbKey))
+            ++count;
+         continue;
+      }
+
+      stxo.blockHeight_ = header->getBlockHeight();
+      stxo.duplicateID_ = header->getDuplicateID();
+      stxo.txIndex_ = txIdx;
+      stxo.txOutIndex_ = txOutIdx;
+      stxo.isCoinbase_ = (txIdx == 0);
+
+      keys.emplace_back(DBUtils::getBlkDataKeyNoPrefix(
+         header->getThisID(), 0xFF, txIdx, txOutIdx), i);
    }
-   else
+
+   //walk the keys in order with a single cursor
+   sort(keys.begin(), keys.end());
+
    {
-      auto tx = beginTransaction(SPENTNESS, LMDB::ReadOnly);
-      for (auto& subssh : subSshMap)
-         getUTXOflags(subssh.second);
+      auto&& tx = beginTransaction(STXO, LMDB::ReadOnly);
+      auto dbIter = getIterator(STXO);
+
+      for (auto& keyPair : keys)
+      {
+         if (!dbIter->seekToExact(keyPair.first.getRef()))
+            continue;
+
+         stxos[keyPair.second].unserializeDBValue(dbIter->getValueRef());
+         ++count;
+      }
    }
+
+   //supernode tracks spentness in its own db
+   if (getDbType() == ARMORY_DB_SUPER)
+      getSpentnessBatch(stxos);
+
+   return count;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void LMDBBlockDatabase::getUTXOflags(StoredSubHistory& subssh) const
+void LMDBBlockDatabase::getSpentnessBatch(vector<StoredTxOut>& stxos) const
 {
-   if (getDbType() == ARMORY_DB_SUPER)
-   {
-      getUTXOflags_Super(subssh);
-      return;
-   }
+   if (getDbType() != ARMORY_DB_SUPER)
+      throw runtime_error("need to implement this for full node");
 
-   for (auto& txioPair : subssh.txioMap_)
-   {
-      auto& txio = txioPair.second;
+   vector<pair<BinaryData, size_t>> keys;
+   keys.reserve(stxos.size());
 
-      txio.setUTXO(false);
-      if (txio.hasTxIn())
+   for (size_t i = 0; i < stxos.size(); i++)
+   {
+      auto&& key = stxos[i].getSpentnessKey();
+      if (key.getSize() == 0)
          continue;
 
-      auto&& stxoKey = txio.getDBKeyOfOutput();
+      keys.emplace_back(move(key), i);
+   }
 
-      StoredTxOut stxo;
-      if (!getStoredTxOut(stxo, stxoKey))
-         continue;
+   sort(keys.begin(), keys.end());
+
+   auto&& spentness_tx = beginTransaction(SPENTNESS, LMDB::ReadOnly);
+   auto dbIter = getIterator(SPENTNESS);
+
+   for (auto& keyPair : keys)
+   {
+      auto& stxo = stxos[keyPair.second];
+      if (dbIter->seekToExact(keyPair.first.getRef()))
+      {
+         stxo.spentByTxInKey_ = dbIter->getValueRef();
+         stxo.spentness_ = TXOUT_SPENT;
+      }
+      else
+      {
+         stxo.spentness_ = TXOUT_UNSPENT;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::getUTXOflags(map<BinaryData, StoredSubHistory>&
+   subSshMap) const
+{
+   if (getDbType() != ARMORY_DB_SUPER)
+   {
+      auto tx = beginTransaction(STXO, LMDB::ReadOnly);
+      for (auto& subssh : subSshMap)
+         getUTXOflags(subssh.second);
+   }
+   else
+   {
+      auto tx = beginTransaction(SPENTNESS, LMDB::ReadOnly);
+      for (auto& subssh : subSshMap)
+         getUTXOflags(subssh.second);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::getUTXOflags(StoredSubHistory& subssh) const
+{
+   if (getDbType() == ARMORY_DB_SUPER)
+   {
+      getUTXOflags_Super(subssh);
+      return;
+   }
+
+   for (auto& txioPair : subssh.txioMap_)
+   {
+      auto& txio = txioPair.second;
+
+      txio.setUTXO(false);
+      if (txio.hasTxIn())
+         continue;
+
+      auto&& stxoKey = txio.getDBKeyOfOutput();
+
+      StoredTxOut stxo;
+      if (!getStoredTxOut(stxo, stxoKey))
+         continue;
 
       if (stxo.spentness_ == TXOUT_UNSPENT)
          txio.setUTXO(true);
@@ -2575,6 +3536,63 @@ bool LMDBBlockDatabase::getStoredHeadHgtList(
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putStoredBlockUndo(StoredBlockUndo const & sbu)
+{
+   BinaryWriter bw;
+   sbu.serializeDBValue(bw);
+   putValue(BLKUNDO, sbu.getDBKey().getRef(), bw.getDataRef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getStoredBlockUndo(
+   StoredBlockUndo & sbu, uint32_t height, uint8_t dupID) const
+{
+   sbu.blockHeight_ = height;
+   sbu.duplicateID_ = dupID;
+   sbu.createdTxOuts_.clear();
+   sbu.spentTxOuts_.clear();
+
+   auto bdr = getValueNoCopy(BLKUNDO, sbu.getDBKey().getRef());
+   if (bdr.getSize() == 0)
+      return false;
+
+   sbu.unserializeDBValue(bdr);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::pruneBlockUndo(uint32_t height)
+{
+   //keys are prefix | hgtx, heights are big endian
+   vector<BinaryData> keys;
+   auto&& tx = beginTransaction(BLKUNDO, LMDB::ReadWrite);
+
+   {
+      auto dbIter = getIterator(BLKUNDO);
+      if (dbIter->seekToStartsWith(DB_PREFIX_UNDODATA))
+      {
+         do
+         {
+            auto keyRef = dbIter->getKeyRef();
+            if (keyRef.getSize() != 5 || 
+               keyRef.getPtr()[0] != DB_PREFIX_UNDODATA)
+               break;
+
+            StoredBlockUndo sbu;
+            sbu.unserializeDBKey(keyRef);
+            if (sbu.blockHeight_ >= height)
+               break;
+
+            keys.push_back(keyRef);
+         } while (dbIter->advanceAndRead());
+      }
+   }
+
+   for (auto& key : keys)
+      deleteValue(BLKUNDO, key.getRef());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TxRef LMDBBlockDatabase::getTxRef(BinaryDataRef txHash)
 {
@@ -2816,13 +3834,32 @@ void LMDBBlockDatabase::resetSSHdb()
       auto&& tx = beginTransaction(SSH, LMDB::ReadOnly);
 
       auto dbIter = getIterator(SSH);
-
-      while (dbIter->advanceAndRead(DB_PREFIX_SCRIPT))
+      if (dbIter->seekToStartsWith(DB_PREFIX_SCRIPT))
       {
-         StoredScriptHistory ssh;
-         ssh.unserializeDBValue(dbIter->getValueRef());
+         vector<LDBIterSpan> spans(LDBITER_BATCH_SIZE);
+         bool done = false;
+         while (!done)
+         {
+            auto count = dbIter->readBatch(
+               spans.data(), spans.size(), LDBITER_PREFETCH_BYTES);
+            if (count == 0)
+               break;
 
-         sshKeys[dbIter->getKeyRef()] = ssh.scanHeight_;
+            for (size_t i = 0; i < count; i++)
+            {
+               auto& span = spans[i];
+               if (span.key_.getPtr()[0] != DB_PREFIX_SCRIPT)
+               {
+                  done = true;
+                  break;
+               }
+
+               StoredScriptHistory ssh;
+               ssh.unserializeDBValue(span.value_);
+
+               sshKeys[span.key_] = ssh.scanHeight_;
+            }
+         }
       }
    }
 
@@ -2901,6 +3938,48 @@ set<BinaryData> LMDBBlockDatabase::getMissingHashes(uint32_t id) const
    return missingHashesSet;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+XorFilter LMDBBlockDatabase::getPrefilterRefForFileNum(uint32_t fileNum) const
+{
+   auto&& key = DBUtils::getPrefilterKey(fileNum);
+
+   auto&& tx = beginTransaction(TXFILTERS, LMDB::ReadOnly);
+   auto val = getValueNoCopy(TXFILTERS, key);
+   if (val.getSize() == 0)
+      return XorFilter();
+
+   try
+   {
+      return XorFilter(val);
+   }
+   catch (XorFilterException&)
+   {
+      LOGWARN << "invalid prefilter for file: " << fileNum;
+   }
+
+   return XorFilter();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putPrefilterForFileNum(
+   uint32_t fileNum, const XorFilter& prefilter)
+{
+   BinaryWriter bw;
+   prefilter.serialize(bw);
+
+   auto&& key = DBUtils::getPrefilterKey(fileNum);
+   auto&& tx = beginTransaction(TXFILTERS, LMDB::ReadWrite);
+   putValue(TXFILTERS, key.getRef(), bw.getDataRef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::deleteFilterPoolForFileNum(uint32_t fileNum)
+{
+   auto&& tx = beginTransaction(TXFILTERS, LMDB::ReadWrite);
+   deleteValue(TXFILTERS, DBUtils::getFilterPoolKey(fileNum));
+   deleteValue(TXFILTERS, DBUtils::getPrefilterKey(fileNum));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void LMDBBlockDatabase::putStoredDBInfo(
    DB_SELECT db, StoredDBInfo const & sdbi, uint32_t id)
@@ -2970,6 +4049,7 @@ void LMDBBlockDatabase::loadHeightToIdMap()
 ////////////////////////////////////////////////////////////////////////////////
 string DatabaseContainer::baseDir_;
 BinaryData DatabaseContainer::magicBytes_;
+float DatabaseContainer::mapGrowthFactor_ = 2.0f;
 
 DatabaseContainer::~DatabaseContainer()
 {}
@@ -3026,6 +4106,12 @@ string DatabaseContainer::getDbName(DB_SELECT db)
    case SPENTNESS:
       return "spentness";
 
+   case BLKFILTERS:
+      return "blkfilters";
+
+   case BLKUNDO:
+      return "blkundo";
+
    default:
       throw LmdbWrapperException("unknown db");
    }
@@ -3050,25 +4136,11 @@ void DBPair::open(const string& path, const string& dbName)
    unsigned flags = MDB_NOSYNC | MDB_NOTLS;
 
    env_.open(path, flags);
-   auto map_size = env_.getMapSize();
-   auto iter = LMDBBlockDatabase::mapSizes_.find(dbName);
-   if (iter != LMDBBlockDatabase::mapSizes_.end())
-   {
-      auto default_size = iter->second;
-      if (map_size < default_size)
-         map_size = default_size;
-      try
-      {
-         auto file_size = DBUtils::getFileSize(path);
-         auto ratio = float(file_size) / float(map_size);
-         if (ratio > 0.75f)
-            map_size *= 2;
-      }
-      catch (runtime_error&)
-      {
-      }
-   }
-   env_.setMapSize(map_size);
+   env_.setMapGrowth(DatabaseContainer::mapGrowthFactor_, DB_MAP_MIN_FREE);
+
+   //size the map after the data on disk rather than the stored map size, 
+   //this drops oversized reservations left by previous runs
+   env_.setMapSize(env_.getGrownMapSize(DB_MAP_INITIAL_SIZE));
 
    auto&& tx = beginTransaction(LMDB::ReadWrite);
    db_.open(&env_, dbName);
@@ -3084,6 +4156,42 @@ void DBPair::close()
    env_.close();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+pair<size_t, size_t> DBPair::getMapUsage() const
+{
+   if (!isOpen())
+      return make_pair(0, 0);
+
+   return make_pair(env_.getMapSize(), env_.getUsedSize());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBPair::compactCopy(const string& path, const atomic<bool>& cancel)
+{
+   if (!isOpen())
+      throw LmdbWrapperException("cannot copy closed db");
+
+   if (env_.getGrownMapSize(env_.getMapSize()) != env_.getMapSize())
+   {
+      throw LmdbWrapperException(
+         "db " + path + " is due to grow, retry the snapshot later");
+   }
+
+   //the copy runs in its own read txn, hold one on our side as well so map
+   //resizes are put off until the copy is done
+   auto&& tx = beginTransaction(LMDB::ReadOnly);
+   env_.compactCopy(path, &cancel);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DBPair::sync()
+{
+   if (!isOpen())
+      return;
+
+   env_.sync();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 BinaryDataRef DBPair::getValue(BinaryDataRef key) const
 {
@@ -3133,6 +4241,29 @@ void DatabaseContainer_Single::close()
    db_.close();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+pair<size_t, size_t> DatabaseContainer_Single::getMapUsage() const
+{
+   return db_.getMapUsage();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::compactCopy(const string& destDir,
+   mutex& writeMutex, const atomic<bool>& cancel) const
+{
+   auto path = destDir;
+   DBUtils::appendPath(path, getDbName(dbSelect_));
+
+   unique_lock<mutex> lock(writeMutex);
+   db_.compactCopy(path, cancel);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Single::sync() const
+{
+   db_.sync();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void DatabaseContainer_Single::eraseOnDisk()
 {
@@ -3230,6 +4361,592 @@ unique_ptr<LDBIter> DatabaseContainer_Single::getIterator()
    return db_.getIterator();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+static uint32_t getShardKeyPrefix(BinaryDataRef keyRef)
+{
+   //short keys are zero padded, that's where a seek on them lands
+   uint32_t val = 0;
+   for (unsigned i = 0; i < 4; i++)
+   {
+      val <<= 8;
+      if (i < keyRef.getSize())
+         val |= keyRef.getPtr()[i];
+   }
+
+   return val;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//// DatabaseContainer_Sharded
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+bool DatabaseContainer_Sharded::isShardedOnDisk(DB_SELECT dbSelect)
+{
+   //new dbs are sharded, existing ones keep their layout
+   auto&& metaPath = getDbPath(getDbName(dbSelect) + "-meta");
+   auto hasMeta = DBUtils::fileExists(metaPath, 0);
+   auto hasSingle = DBUtils::fileExists(getDbPath(dbSelect), 0);
+
+   if (hasMeta && hasSingle)
+   {
+      throw LmdbWrapperException("both single and sharded " + 
+         getDbName(dbSelect) + " dbs on disk");
+   }
+
+   return !hasSingle;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+string DatabaseContainer_Sharded::getShardName(unsigned id) const
+{
+   stringstream ss;
+   ss << getDbName(dbSelect_) << "-";
+   if (id == META_SHARD_ID)
+      ss << "meta";
+   else
+      ss << id;
+
+   return ss.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+string DatabaseContainer_Sharded::getShardPath(unsigned id) const
+{
+   return getDbPath(getShardName(id));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<ShardFilter> DatabaseContainer_Sharded::getDefaultFilter() const
+{
+   switch (dbSelect_)
+   {
+   case SUBSSH:
+      return make_unique<ShardFilter_ScrAddr>(SHARD_FILTER_SCRADDR_STEP);
+
+   case SPENTNESS:
+      return make_unique<ShardFilter_Spentness>(SHARD_FILTER_SPENTNESS_STEP);
+
+   default:
+      throw LmdbWrapperException("no shard filter for this db");
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<pair<unsigned, string>> DatabaseContainer_Sharded::getShardsOnDisk() 
+   const
+{
+   //shard files are [dbname]-[id], skip lock files and the meta env
+   auto&& prefix = getDbName(dbSelect_);
+   prefix.append("-");
+
+   vector<pair<unsigned, string>> result;
+   auto&& filenames = DBUtils::getDirectoryContent(baseDir_);
+   for (auto& filename : filenames)
+   {
+      if (filename.size() <= prefix.size() ||
+         filename.compare(0, prefix.size(), prefix) != 0)
+         continue;
+
+      auto idStr = filename.substr(prefix.size());
+      if (idStr.size() > 10 || 
+         idStr.find_first_not_of("0123456789") != string::npos)
+         continue;
+
+      auto id = stoull(idStr);
+      if (id > SHARD_ID_MAX)
+         continue;
+
+      result.push_back(make_pair((unsigned)id, getShardPath((unsigned)id)));
+   }
+
+   sort(result.begin(), result.end());
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+StoredDBInfo DatabaseContainer_Sharded::open()
+{
+   meta_.open(getShardPath(META_SHARD_ID), getDbName(dbSelect_));
+
+   StoredDBInfo sdbi;
+   try
+   {
+      sdbi = move(getStoredDBInfo(0));
+   }
+   catch (runtime_error&)
+   {
+      // If DB didn't exist yet (dbinfo key is empty), seed it
+      auto&& tx = meta_.beginTransaction(LMDB::ReadWrite);
+
+      sdbi.magic_ = magicBytes_;
+      sdbi.metaHash_ = BtcUtils::EmptyHash_;
+      sdbi.topBlkHgt_ = 0;
+      sdbi.armoryType_ = BlockDataManagerConfig::getDbType();
+      meta_.putValue(StoredDBInfo::getDBKey(0), serializeDBValue(sdbi));
+   }
+
+   {
+      //shard filter, dbs keep the one they were created with
+      auto&& tx = meta_.beginTransaction(LMDB::ReadWrite);
+      auto&& filterKey = ShardFilter::getDbKey();
+      auto filterData = meta_.getValue(filterKey.getRef());
+      if (filterData.getSize() == 0)
+      {
+         filterPtr_ = getDefaultFilter();
+         meta_.putValue(filterKey.getRef(), filterPtr_->serialize());
+      }
+      else
+      {
+         filterPtr_ = ShardFilter::deserialize(filterData);
+      }
+   }
+
+   unique_lock<mutex> lock(shardMutex_);
+   auto&& tx = meta_.beginTransaction(LMDB::ReadWrite);
+
+   bool tracked;
+   auto&& ranges = getCommittedRanges(tracked);
+   for (auto& shardPair : getShardsOnDisk())
+   {
+      auto shardPtr = make_shared<DBPair>(shardPair.first);
+      shardPtr->open(shardPair.second, getDbName(dbSelect_));
+      shards_.insert(make_pair(shardPair.first, shardPtr));
+
+      if (!tracked)
+      {
+         //older dbs didn't record the ranges, take the shards as they are
+         auto&& shardTx = shardPtr->beginTransaction(LMDB::ReadOnly);
+         auto iter = shardPtr->getIterator();
+         if (!iter->seekToFirst())
+            continue;
+         auto first = getShardKeyPrefix(iter->getKeyRef());
+
+         iter->seekToLast();
+         ranges[shardPair.first] = 
+            make_pair(first, getShardKeyPrefix(iter->getKeyRef()));
+         continue;
+      }
+
+      auto rangeIter = ranges.find(shardPair.first);
+      auto count = trimShard(*shardPtr, 
+         rangeIter == ranges.end() ? nullptr : &rangeIter->second);
+      if (count > 0)
+      {
+         LOGWARN << "dropped " << count << " uncommitted entries from " <<
+            getShardName(shardPair.first);
+      }
+   }
+
+   if (!tracked)
+      putCommittedRanges(ranges);
+
+   return sdbi;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DatabaseContainer_Sharded::ShardRanges 
+   DatabaseContainer_Sharded::getCommittedRanges(bool& tracked) const
+{
+   ShardRanges ranges;
+   auto&& key = WRITE_UINT32_BE(SHARD_RANGES_DBKEY);
+   auto data = meta_.getValue(key.getRef());
+
+   tracked = data.getSize() > 0;
+   if (!tracked)
+      return ranges;
+
+   BinaryRefReader brr(data);
+   auto count = brr.get_uint32_t();
+   for (unsigned i = 0; i < count; i++)
+   {
+      auto id = brr.get_uint32_t();
+      auto first = brr.get_uint32_t();
+      ranges[id] = make_pair(first, brr.get_uint32_t());
+   }
+
+   return ranges;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::putCommittedRanges(
+   const ShardRanges& ranges) const
+{
+   BinaryWriter bw;
+   bw.put_uint32_t((uint32_t)ranges.size());
+   for (auto& rangePair : ranges)
+   {
+      bw.put_uint32_t(rangePair.first);
+      bw.put_uint32_t(rangePair.second.first);
+      bw.put_uint32_t(rangePair.second.second);
+   }
+
+   auto&& key = WRITE_UINT32_BE(SHARD_RANGES_DBKEY);
+   meta_.putValue(key.getRef(), bw.getDataRef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t DatabaseContainer_Sharded::trimShard(
+   DBPair& shard, const pair<uint32_t, uint32_t>* range)
+{
+   auto&& tx = shard.beginTransaction(LMDB::ReadWrite);
+   auto iter = shard.getIterator();
+
+   vector<BinaryData> keys;
+   if (iter->seekToFirst())
+   {
+      do
+      {
+         if (range != nullptr && 
+            getShardKeyPrefix(iter->getKeyRef()) >= range->first)
+            break;
+         keys.push_back(iter->getKey());
+      } while (iter->advanceAndRead());
+   }
+
+   if (range != nullptr && range->second < UINT32_MAX && 
+      iter->seekTo(WRITE_UINT32_BE(range->second + 1)))
+   {
+      do
+      {
+         keys.push_back(iter->getKey());
+      } while (iter->advanceAndRead());
+   }
+
+   for (auto& key : keys)
+      shard.deleteValue(key.getRef());
+
+   return keys.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::close()
+{
+   {
+      unique_lock<mutex> lock(shardMutex_);
+      for (auto& shardPair : shards_)
+         shardPair.second->close();
+      shards_.clear();
+   }
+
+   meta_.close();
+   filterPtr_.reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::eraseOnDisk()
+{
+   close();
+
+   auto&& shards = getShardsOnDisk();
+   shards.push_back(make_pair(META_SHARD_ID, getShardPath(META_SHARD_ID)));
+
+   for (auto& shardPair : shards)
+   {
+      auto& dbPath = shardPair.second;
+      remove(dbPath.c_str());
+
+      dbPath.append("-lock");
+      remove(dbPath.c_str());
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<DBPair> DatabaseContainer_Sharded::getShard(
+   unsigned id, bool create) const
+{
+   if (id > SHARD_ID_MAX)
+      throw LmdbWrapperException("invalid shard id");
+
+   unique_lock<mutex> lock(shardMutex_);
+   auto iter = shards_.find(id);
+   if (iter != shards_.end())
+      return iter->second;
+
+   if (!create)
+      return nullptr;
+
+   auto shardPtr = make_shared<DBPair>(id);
+   shardPtr->open(getShardPath(id), getDbName(dbSelect_));
+   shards_.insert(make_pair(id, shardPtr));
+   return shardPtr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<DBPair> DatabaseContainer_Sharded::getShardFrom(unsigned id) const
+{
+   unique_lock<mutex> lock(shardMutex_);
+   auto iter = shards_.lower_bound(id);
+   if (iter == shards_.end())
+      return nullptr;
+
+   return iter->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<DBPair> DatabaseContainer_Sharded::getShardUpTo(unsigned id) const
+{
+   unique_lock<mutex> lock(shardMutex_);
+   auto iter = shards_.upper_bound(id);
+   if (iter == shards_.begin())
+      return nullptr;
+
+   --iter;
+   return iter->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::beginThreadTx(LMDB::Mode mode) const
+{
+   unique_lock<mutex> lock(txMutex_);
+   auto& txPtr = txMap_[this_thread::get_id()];
+   if (txPtr == nullptr)
+   {
+      txPtr = make_shared<ThreadTx>();
+      txPtr->mode_ = mode;
+   }
+   else if (mode == LMDB::ReadWrite && txPtr->mode_ == LMDB::ReadOnly)
+   {
+      throw LMDBException(
+         "Cannot access ReadOnly Transaction in ReadWrite mode");
+   }
+
+   ++txPtr->level_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::endThreadTx() const
+{
+   shared_ptr<ThreadTx> txPtr;
+   {
+      unique_lock<mutex> lock(txMutex_);
+      auto iter = txMap_.find(this_thread::get_id());
+      if (iter == txMap_.end())
+         return;
+
+      if (--iter->second->level_ > 0)
+         return;
+
+      txPtr = iter->second;
+      txMap_.erase(iter);
+   }
+
+   //commit the shard txns outside of the lock, writers to other
+   //shards shouldn't wait on this. Meta goes last, it can only trail the 
+   //shards
+   auto& shardTx = txPtr->shardTx_;
+   while (!shardTx.empty() && shardTx.begin()->first != META_SHARD_ID)
+      shardTx.erase(shardTx.begin());
+
+   if (txPtr->mode_ == LMDB::ReadWrite && txPtr->written_.size() > 0)
+   {
+      if (shardTx.empty())
+         shardTx.emplace(META_SHARD_ID, 
+            meta_.beginTransaction(LMDB::ReadWrite));
+
+      bool tracked;
+      auto&& ranges = getCommittedRanges(tracked);
+      for (auto& rangePair : txPtr->written_)
+      {
+         auto iter = ranges.find(rangePair.first);
+         if (iter == ranges.end())
+         {
+            ranges.insert(rangePair);
+            continue;
+         }
+
+         iter->second.first = 
+            min(iter->second.first, rangePair.second.first);
+         iter->second.second = 
+            max(iter->second.second, rangePair.second.second);
+      }
+
+      putCommittedRanges(ranges);
+   }
+
+   shardTx.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DBPair* DatabaseContainer_Sharded::getShardWithTx(
+   DBPair* shardPtr, BinaryDataRef writtenKey) const
+{
+   shared_ptr<ThreadTx> txPtr;
+   {
+      unique_lock<mutex> lock(txMutex_);
+      auto iter = txMap_.find(this_thread::get_id());
+      if (iter == txMap_.end())
+         throw LMDBException("Need transaction to access sharded db");
+
+      txPtr = iter->second;
+   }
+
+   //only the owning thread touches its shard txns
+   auto id = shardPtr->getId();
+   if (txPtr->shardTx_.find(id) == txPtr->shardTx_.end())
+      txPtr->shardTx_.emplace(id, shardPtr->beginTransaction(txPtr->mode_));
+
+   if (writtenKey.getSize() > 0)
+   {
+      auto prefix = getShardKeyPrefix(writtenKey);
+      auto iter = txPtr->written_.find(id);
+      if (iter == txPtr->written_.end())
+      {
+         txPtr->written_.emplace(id, make_pair(prefix, prefix));
+      }
+      else
+      {
+         iter->second.first = min(iter->second.first, prefix);
+         iter->second.second = max(iter->second.second, prefix);
+      }
+   }
+
+   return shardPtr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<DbTransaction> DatabaseContainer_Sharded::beginTransaction(
+   LMDB::Mode mode) const
+{
+   return make_unique<DbTransaction_Sharded>(this, mode);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unique_ptr<LDBIter> DatabaseContainer_Sharded::getIterator()
+{
+   return make_unique<LDBIter_Sharded>(this);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned DatabaseContainer_Sharded::getShardIdForKey(BinaryDataRef key) const
+{
+   if (filterPtr_ == nullptr)
+      throw LmdbWrapperException("sharded db is not open");
+
+   return filterPtr_->keyToId(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef DatabaseContainer_Sharded::getValue(BinaryDataRef key) const
+{
+   auto shardPtr = getShard(getShardIdForKey(key), false);
+   if (shardPtr == nullptr)
+      return BinaryDataRef();
+
+   return getShardWithTx(shardPtr.get())->getValue(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::putValue(
+   BinaryDataRef key,
+   BinaryDataRef value)
+{
+   auto shardPtr = getShard(getShardIdForKey(key), true);
+   getShardWithTx(shardPtr.get(), key)->putValue(key, value);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::deleteValue(BinaryDataRef key)
+{
+   auto shardPtr = getShard(getShardIdForKey(key), false);
+   if (shardPtr == nullptr)
+      return;
+
+   getShardWithTx(shardPtr.get())->deleteValue(key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::putStoredDBInfo(
+   StoredDBInfo const & sdbi, uint32_t id)
+{
+   SCOPED_TIMER("putStoredDBInfo");
+   if (!sdbi.isInitialized())
+      throw LmdbWrapperException("tried to write uninitiliazed sdbi");
+
+   getShardWithTx(&meta_)->putValue(
+      StoredDBInfo::getDBKey(id), serializeDBValue(sdbi));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+StoredDBInfo DatabaseContainer_Sharded::getStoredDBInfo(uint32_t id)
+{
+   SCOPED_TIMER("getStoredDBInfo");
+   auto&& tx = meta_.beginTransaction(LMDB::ReadOnly);
+
+   auto&& key = StoredDBInfo::getDBKey(id);
+   BinaryRefReader brr(meta_.getValue(key.getRef()));
+
+   if (brr.getSize() == 0)
+      throw LmdbWrapperException("no sdbi at this key");
+
+   StoredDBInfo sdbi;
+   sdbi.unserializeDBValue(brr);
+   return sdbi;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::compactCopy(const string& destDir,
+   mutex& writeMutex, const atomic<bool>& cancel) const
+{
+   //meta goes first: its sdbi and shard ranges can only trail the shard 
+   //content, open() drops whatever lands in the shards past them
+   auto path = destDir;
+   DBUtils::appendPath(path, getShardName(META_SHARD_ID));
+   {
+      unique_lock<mutex> lock(writeMutex);
+      meta_.compactCopy(path, cancel);
+   }
+
+   map<unsigned, shared_ptr<DBPair>> shards;
+   {
+      unique_lock<mutex> lock(shardMutex_);
+      shards = shards_;
+   }
+
+   for (auto& shardPair : shards)
+   {
+      if (cancel.load(memory_order_relaxed))
+         throw LmdbWrapperException("snapshot was cancelled");
+
+      path = destDir;
+      DBUtils::appendPath(path, getShardName(shardPair.first));
+
+      unique_lock<mutex> lock(writeMutex);
+      shardPair.second->compactCopy(path, cancel);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DatabaseContainer_Sharded::sync() const
+{
+   meta_.sync();
+
+   map<unsigned, shared_ptr<DBPair>> shards;
+   {
+      unique_lock<mutex> lock(shardMutex_);
+      shards = shards_;
+   }
+
+   for (auto& shardPair : shards)
+      shardPair.second->sync();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+pair<size_t, size_t> DatabaseContainer_Sharded::getMapUsage() const
+{
+   auto result = meta_.getMapUsage();
+
+   unique_lock<mutex> lock(shardMutex_);
+   for (auto& shardPair : shards_)
+   {
+      auto shardUsage = shardPair.second->getMapUsage();
+      result.first += shardUsage.first;
+      result.second += shardUsage.second;
+   }
+
+   return result;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //// ShardFilter
@@ -3297,36 +5014,15 @@ unique_ptr<ShardFilter> ShardFilter_ScrAddr::deserialize(BinaryDataRef dataRef)
 ////////////////////////////////////////////////////////////////////////////////
 unsigned ShardFilter_ScrAddr::keyToId(BinaryDataRef keyRef) const
 {
-   auto size = keyRef.getSize();
-   if (size < 4)
-      throw FilterException("key is too short for scrAddr shard filter");
-
-   BinaryRefReader brr(keyRef);
-   brr.advance(size - 4);
-   auto height = DBUtils::hgtxToHeight(brr.get_BinaryDataRef(4));
-
-   if (height >= thresholdValue_)
-   {
-      auto diff = height - thresholdValue_;
-      return thresholdId_ + (diff / step_);
-   }
-   else
-   {
-      //id = exp((height/50k - 4)*1.6)
-      auto val = (float(height) / 50000.0f - 4.0f) * 1.6f;
-      return expl(val);
-   }
+   //key is batch id (BE) | scrAddr
+   return getShardKeyPrefix(keyRef) / step_;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 unsigned ShardFilter_ScrAddr::getHeightForId(unsigned id) const
 {
-   if (id == 0)
-      return 0;
-   else if (id <= thresholdId_)
-      return unsigned((logf(id) / 1.6f + 4.0f) * 50000.0f);
-   else
-      return thresholdValue_ + (id - thresholdId_) * step_;
+   //first batch id of the shard, SUBSSH_META maps it to a height
+   return id * step_;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3359,35 +5055,37 @@ unique_ptr<ShardFilter> ShardFilter_Spentness::deserialize(BinaryDataRef dataRef
 ////////////////////////////////////////////////////////////////////////////////
 unsigned ShardFilter_Spentness::keyToId(BinaryDataRef keyRef) const
 {
-   auto size = keyRef.getSize();
-   if (size < 4)
-      throw FilterException("key is too short for scrAddr shard filter");
-
-   BinaryRefReader brr(keyRef);
-   auto height = DBUtils::hgtxToHeight(brr.get_BinaryDataRef(4));
+   //key is hgtx(UINT32_MAX - height) | txid | txoutid, so the leading
+   //height counts down from 0xFFFFFF
+   auto height = 0xFFFFFF - (getShardKeyPrefix(keyRef) >> 8);
 
+   unsigned heightId;
    if (height >= thresholdValue_)
    {
       auto diff = height - thresholdValue_;
-      return thresholdId_ + (diff / step_);
+      heightId = thresholdId_ + (diff / step_);
    }
    else
    {
       //id = exp((height/50k - 4))
       auto val = (float(height) / 50000.0f - 4.0f);
-      return expl(val);
+      heightId = (unsigned)expl(val);
    }
+
+   //ids follow key order
+   return SHARD_ID_MAX - heightId;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 unsigned ShardFilter_Spentness::getHeightForId(unsigned id) const
 {
-   if (id == 0)
+   auto heightId = SHARD_ID_MAX - id;
+   if (heightId == 0)
       return 0;
-   else if (id <= thresholdId_)
-      return unsigned((logf(id) + 4.0f) * 50000.0f);
+   else if (heightId <= thresholdId_)
+      return unsigned((logf(heightId) + 4.0f) * 50000.0f);
    else
-      return thresholdValue_ + (id - thresholdId_) * step_;
+      return thresholdValue_ + (heightId - thresholdId_) * step_;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3396,4 +5094,34 @@ unsigned ShardFilter_Spentness::getHeightForId(unsigned id) const
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 DbTransaction::~DbTransaction()
-{}
\ No newline at end of file
+{
+   if (metricsDb_ == COUNT)
+      return;
+
+   DBMetrics::recordSince(metricsDb_, 
+      mode_ == LMDB::ReadWrite ? 
+         DBMetrics_WriteTxDuration : DBMetrics_ReadTxDuration, 
+      start_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DbTransaction::setMetrics(DB_SELECT db, LMDB::Mode mode)
+{
+   metricsDb_ = db;
+   mode_ = mode;
+   start_ = DBMetrics::now();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DbTransaction_Sharded::DbTransaction_Sharded(
+   const DatabaseContainer_Sharded* dbPtr, LMDB::Mode mode) :
+   dbPtr_(dbPtr)
+{
+   dbPtr_->beginThreadTx(mode);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+DbTransaction_Sharded::~DbTransaction_Sharded()
+{
+   dbPtr_->endThreadTx();
+}
\ No newline at end of file
@@ -16,6 +16,11 @@
 
 #include <list>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
 #include "log.h"
 #include "BinaryData.h"
 #include "BtcUtils.h"
@@ -26,12 +31,19 @@
 #include "lmdbpp.h"
 #include "ThreadSafeClasses.h"
 #include "ReentrantLock.h"
+#include "TxHashIndex.h"
+#include "HeaderSnapshot.h"
+#include "XorFilter.h"
+#include "DBObjectCache.h"
+#include "DBMetrics.h"
 
 #define META_SHARD_ID               0xFFFFFFFF
+#define SHARD_ID_MAX                0xFFFFFFFE
 #define SHARD_COUNTER_KEY           0xA76B6C00
 #define SHARD_TOPHASH_ID            0xFFAAAA
 
 #define SHARD_FILTER_DBKEY          0xAC28337D
+#define SHARD_RANGES_DBKEY          0xAC28337E
 
 #ifndef UNIT_TESTS
 #define SHARD_FILTER_SCRADDR_STEP   1500
@@ -123,6 +135,17 @@ class StoredTx;
 class StoredTxOut;
 class StoredScriptHistory;
 
+//spans per readBatch call and read ahead in full db passes
+#define LDBITER_BATCH_SIZE          256
+#define LDBITER_PREFETCH_BYTES      (1024 * 1024)
+
+////////////////////////////////////////////////////////////////////////////////
+struct LDBIterSpan
+{
+   BinaryDataRef key_;
+   BinaryDataRef value_;
+};
+
 enum ShardFilterType
 {
    ShardFilterType_ScrAddr = 0,
@@ -140,6 +163,9 @@ public:
    // fill_cache argument should be false for large bulk scans
    LDBIter(void) { isDirty_=true;}
 
+   //seeks are counted against this db, shard iterators are left untagged
+   void setMetricsDb(DB_SELECT db) { metricsDb_ = db; }
+
    virtual bool isNull(void) const = 0;
    virtual bool isValid(void) const = 0;
    bool isValid(DB_PREFIX dbpref);
@@ -173,6 +199,14 @@ public:
    bool seekToBefore(DB_PREFIX prefix);
    bool seekToBefore(DB_PREFIX pref, BinaryDataRef key);
    virtual bool seekToFirst(void) = 0;
+   virtual bool seekToLast(void) = 0;
+
+   // Bulk read: fills up to count spans from the current entry on and moves
+   // past the last one, returns 0 once the iterator ran off the db. Spans 
+   // point into the db map and are valid for as long as the read txn is.
+   // prefetchBytes > 0 has the kernel page in that much of the map ahead.
+   virtual size_t readBatch(
+      LDBIterSpan* spans, size_t count, size_t prefetchBytes);
 
    // Return true if the iterator is currently on valid data, with key match
    bool checkKeyExact(BinaryDataRef key);
@@ -191,6 +225,13 @@ protected:
    mutable BinaryRefReader  currValueReader_;
 
    bool isDirty_;
+   DB_SELECT metricsDb_ = COUNT;
+
+   void countSeek(void) const
+   {
+      if (metricsDb_ != COUNT)
+         DBMetrics::count(metricsDb_, DBMetrics_Seek);
+   }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -212,6 +253,8 @@ public:
    bool seekToExact(BinaryDataRef key);
    bool seekToBefore(BinaryDataRef key);
    bool seekToFirst(void);
+   bool seekToLast(void);
+   size_t readBatch(LDBIterSpan*, size_t, size_t);
 
    bool advance(void);
    bool retreat(void);
@@ -223,15 +266,26 @@ class DBPair;
 class DatabaseContainer_Sharded;
 class LDBIter_Sharded : public LDBIter
 {
+   /***
+   Walks the shards of a sharded db as a single key space. Shard ids follow
+   key order, the iterator hops to the next/previous shard on disk when it
+   runs off the current one.
+   ***/
+
 private:
    std::unique_ptr<LDBIter> iter_;
    DatabaseContainer_Sharded* dbPtr_;
    unsigned currentShard_;
 
+private:
+   void setShard(std::shared_ptr<DBPair>);
+   bool nextShard(void);
+   bool prevShard(void);
+
 public:
    LDBIter_Sharded(
       DatabaseContainer_Sharded* dbPtr) :
-      dbPtr_(dbPtr)
+      dbPtr_(dbPtr), currentShard_(UINT32_MAX)
    {}
 
    //virutals
@@ -242,6 +296,8 @@ public:
    bool seekToExact(BinaryDataRef key);
    bool seekToBefore(BinaryDataRef key);
    bool seekToFirst(void);
+   bool seekToLast(void);
+   size_t readBatch(LDBIterSpan*, size_t, size_t);
 
    bool advance(void);
    bool retreat(void);
@@ -276,17 +332,32 @@ public:
    bool isOpen(void) const;
 
    LMDBEnv* getEnv(void) { return &env_; }
+   std::pair<size_t, size_t> getMapUsage(void) const;
+
+   //compacted copy of the env to path, writers keep going meanwhile.
+   //Refuses envs due to grow: the copy holds a txn that would put the
+   //resize off, writes have to fit in the map until it is done
+   void compactCopy(const std::string& path, const std::atomic<bool>&);
+   void sync(void);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 class DbTransaction
 {
+private:
+   DB_SELECT metricsDb_ = COUNT;
+   LMDB::Mode mode_ = LMDB::ReadOnly;
+   DBMetrics::TimePoint start_;
+
 public:
    DbTransaction(void)
    {}
 
    virtual ~DbTransaction(void) = 0;
+
+   //the txn duration is recorded against db on destruction
+   void setMetrics(DB_SELECT db, LMDB::Mode mode);
 };
 
 ////////
@@ -301,6 +372,23 @@ public:
    {}
 };
 
+////////
+class DbTransaction_Sharded : public DbTransaction
+{
+   /***
+   Shard txns are opened on demand by the container, per thread. This
+   object only scopes them: they are committed when the outermost sharded
+   tx of the thread goes out of scope.
+   ***/
+
+private:
+   const DatabaseContainer_Sharded* dbPtr_;
+
+public:
+   DbTransaction_Sharded(const DatabaseContainer_Sharded*, LMDB::Mode);
+   ~DbTransaction_Sharded(void);
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 template<typename T> class TxFilterPool
 {
@@ -308,30 +396,149 @@ template<typename T> class TxFilterPool
    //each bucket represents on blk file
 
 private:
-   std::set<TxFilter<T>> pool_;
    const uint8_t* poolPtr_ = nullptr;
    size_t len_ = SIZE_MAX;
 
+   //flat view of the pool, in descending block key order. Per filter block 
+   //key, byte offset of the first prefix and prefix count. Offsets point in
+   //poolPtr_ when running against a pointer, in flatPrefixes_ otherwise.
+   //Owning pools only keep this view, per block filters are built on demand
+   std::vector<T> flatPrefixes_;
+   std::vector<uint32_t> flatBlockKeys_;
+   std::vector<size_t> flatOffsets_;
+   std::vector<uint32_t> flatLengths_;
+
+private:
+   void clearFlat(void)
+   {
+      flatPrefixes_.clear();
+      flatBlockKeys_.clear();
+      flatOffsets_.clear();
+      flatLengths_.clear();
+   }
+
+   void pushFilter(uint32_t blockKey, const T* prefixes, size_t len)
+   {
+      flatBlockKeys_.push_back(blockKey);
+      flatOffsets_.push_back(flatPrefixes_.size() * sizeof(T));
+      flatLengths_.push_back(len);
+
+      flatPrefixes_.insert(flatPrefixes_.end(), prefixes, prefixes + len);
+   }
+
+   void pushFilter(const TxFilter<T>& filter)
+   {
+      if (filter.filterVector_.size() != 0 || filter.filterPtr_ == nullptr)
+      {
+         pushFilter(filter.getBlockKey(),
+            filter.filterVector_.data(), filter.filterVector_.size());
+      }
+      else
+      {
+         pushFilter(filter.getBlockKey(),
+            (const T*)(filter.filterPtr_ + 12), filter.len_);
+      }
+   }
+
+   const uint8_t* getBase(void) const
+   {
+      if (poolPtr_ != nullptr) //running against a pointer
+         return poolPtr_;
+      return (const uint8_t*)flatPrefixes_.data();
+   }
+
+   void indexPoolPtr(void)
+   {
+      if (poolPtr_ == nullptr || len_ < 4)
+         throw TxFilterException("invalid pool ptr");
+
+      //get count
+      auto count = *(uint32_t*)poolPtr_;
+      size_t pos = 4;
+
+      flatBlockKeys_.reserve(count);
+      flatOffsets_.reserve(count);
+      flatLengths_.reserve(count);
+
+      for (uint32_t i = 0; i < count; i++)
+      {
+         if (pos + 12 > len_)
+            throw TxFilterException("overflow while reading pool ptr");
+
+         //filter header: size | block key | prefix count
+         auto filterSize = *(uint32_t*)(poolPtr_ + pos);
+         auto filterLen = *(uint32_t*)(poolPtr_ + pos + 8);
+         if (filterSize != filterLen * sizeof(T) + 12 ||
+            pos + filterSize > len_)
+            throw TxFilterException("invalid filter in pool ptr");
+
+         flatBlockKeys_.push_back(*(uint32_t*)(poolPtr_ + pos + 4));
+         flatOffsets_.push_back(pos + 12);
+         flatLengths_.push_back(filterLen);
+
+         pos += filterSize;
+      }
+   }
+
 public:
    TxFilterPool(void) 
    {}
 
-   TxFilterPool(std::set<TxFilter<T>> pool) :
-      pool_(move(pool)), len_(pool_.size())
-   {}
+   TxFilterPool(const std::set<TxFilter<T>>& pool) :
+      len_(pool.size())
+   {
+      for (auto& filter : pool)
+         pushFilter(filter);
+   }
 
    TxFilterPool(const TxFilterPool<T>& filter) :
-      pool_(filter.pool_), len_(filter.len_)
+      poolPtr_(filter.poolPtr_), len_(filter.len_),
+      flatPrefixes_(filter.flatPrefixes_),
+      flatBlockKeys_(filter.flatBlockKeys_),
+      flatOffsets_(filter.flatOffsets_),
+      flatLengths_(filter.flatLengths_)
    {}
 
    TxFilterPool(const uint8_t* ptr, size_t len) :
       poolPtr_(ptr), len_(len)
-   {}
+   {
+      indexPoolPtr();
+   }
 
    void update(const std::set<TxFilter<T>>& hashSet)
    {
-      pool_.insert(hashSet.begin(), hashSet.end());
-      len_ = pool_.size();
+      if (poolPtr_ != nullptr)
+         throw TxFilterException("cannot update pool ptr");
+
+      //merge in block key order, filters already in the pool win
+      auto prefixes = std::move(flatPrefixes_);
+      auto blockKeys = std::move(flatBlockKeys_);
+      auto offsets = std::move(flatOffsets_);
+      auto lengths = std::move(flatLengths_);
+      clearFlat();
+
+      auto base = (const uint8_t*)prefixes.data();
+      auto iter = hashSet.begin();
+      size_t i = 0;
+      while (i < blockKeys.size() || iter != hashSet.end())
+      {
+         if (iter == hashSet.end() || 
+            (i < blockKeys.size() && blockKeys[i] >= iter->getBlockKey()))
+         {
+            if (iter != hashSet.end() && blockKeys[i] == iter->getBlockKey())
+               ++iter;
+
+            pushFilter(blockKeys[i], 
+               (const T*)(base + offsets[i]), lengths[i]);
+            ++i;
+            continue;
+         }
+
+         pushFilter(*iter);
+         ++iter;
+      }
+
+      len_ = flatBlockKeys_.size();
    }
 
    bool isValid(void) const { return len_ != SIZE_MAX; }
@@ -341,95 +548,80 @@ public:
       if (hash.getSize() != 32)
          throw TxFilterException("hash is 32 bytes long");
 
-      if (!isValid())
+      if (!isValid() || 
+         (poolPtr_ == nullptr && flatBlockKeys_.size() == 0))
          throw TxFilterException("invalid pool");
 
+      auto base = getBase();
+
       //get key
+      auto key = *(T*)hash.getPtr();
 
+      //only filters with hits get an entry
       std::map<uint32_t, std::set<uint32_t>> returnMap;
-
-      if (pool_.size())
+      for (size_t i = 0; i < flatBlockKeys_.size(); i++)
       {
-         for (auto& filter : pool_)
+         std::set<uint32_t>* hits = nullptr;
+         auto onHit = [&](size_t id)->void
          {
-            auto&& resultSet = filter.compare(hash);
-            if (resultSet.size() > 0)
-            {
-               returnMap.insert(make_pair(
-                  filter.getBlockKey(),
-                  move(resultSet)));
-            }
-         }
-      }
-      else if (poolPtr_ != nullptr) //running against a pointer
-      {
-         //get count
-         auto size = (uint32_t*)poolPtr_;
-         uint32_t* filterSize;
-         size_t pos = 4;
+            if (hits == nullptr)
+               hits = &returnMap[flatBlockKeys_[i]];
+            hits->insert((uint32_t)id);
+         };
 
-         for (uint32_t i = 0; i < *size; i++)
-         {
-            if (pos >= len_)
-               throw TxFilterException("overflow while reading pool ptr");
-
-            //iterate through entries
-            filterSize = (uint32_t*)(poolPtr_ + pos);
-
-            TxFilter<T> filterPtr(poolPtr_ + pos);
-            auto&& resultSet = filterPtr.compare(hash);
-            if (resultSet.size() > 0)
-            {
-               returnMap.insert(std::make_pair(
-                  filterPtr.getBlockKey(),
-                  move(resultSet)));
-            }
-
-            pos += *filterSize;
-         }
+         TxFilterScan::find((const T*)(base + flatOffsets_[i]),
+            flatLengths_[i], key, onHit);
       }
-      else
-         throw TxFilterException("invalid pool");
 
       return returnMap;
    }
 
-   std::vector<TxFilter<T>> getFilterPoolPtr(void)
+   //approximate set of all prefixes in the pool, checked ahead of compare()
+   //to skip pools that cannot match a hash
+   XorFilter getPrefilter(void) const
    {
-      if (poolPtr_ == nullptr)
-         throw TxFilterException("missing pool ptr");
-
-      std::vector<TxFilter<T>> filters;
+      if (!isValid())
+         throw TxFilterException("invalid pool");
 
-      //get count
-      auto size = (uint32_t*)poolPtr_;
-      uint32_t* filterSize;
-      size_t pos = 4;
+      auto base = getBase();
 
-      for (uint32_t i = 0; i < *size; i++)
+      std::vector<uint64_t> keys;
+      for (size_t i = 0; i < flatBlockKeys_.size(); i++)
       {
-         if (pos >= len_)
-            throw TxFilterException("overflow while reading pool ptr");
+         auto prefixes = (const T*)(base + flatOffsets_[i]);
+         keys.insert(keys.end(), prefixes, prefixes + flatLengths_[i]);
+      }
 
-         //iterate through entries
-         filterSize = (uint32_t*)(poolPtr_ + pos);
+      return XorFilter(move(keys));
+   }
 
-         TxFilter<T> filterPtr(poolPtr_ + pos);
-         filters.push_back(filterPtr);
+   std::vector<TxFilter<T>> getFilterPoolPtr(void)
+   {
+      if (poolPtr_ == nullptr)
+         throw TxFilterException("missing pool ptr");
 
-         pos += *filterSize;
-      }
+      //filter headers sit 12 bytes ahead of their prefixes
+      std::vector<TxFilter<T>> filters;
+      filters.reserve(flatOffsets_.size());
+      for (auto& offset : flatOffsets_)
+         filters.push_back(TxFilter<T>(poolPtr_ + offset - 12));
 
       return filters;
    }
 
    void serialize(BinaryWriter& bw) const
    {
-      bw.put_uint32_t(len_); //item count
+      bw.put_uint32_t(flatBlockKeys_.size()); //item count
 
-      for (auto& filter : pool_)
+      //same layout as TxFilter::serialize
+      auto base = getBase();
+      for (size_t i = 0; i < flatBlockKeys_.size(); i++)
       {
-         filter.serialize(bw);
+         auto size = flatLengths_[i] * sizeof(T);
+         bw.put_uint32_t(12 + size);
+         bw.put_uint32_t(flatBlockKeys_[i]);
+         bw.put_uint32_t(flatLengths_[i]);
+         bw.put_BinaryData(base + flatOffsets_[i], size);
       }
    }
 
@@ -439,38 +631,56 @@ public:
       if (ptr == nullptr || len < 4)
          throw TxFilterException("invalid pointer");
 
-      len_ = *(uint32_t*)ptr;
-
-      if (len_ == 0)
+      auto count = *(uint32_t*)ptr;
+      if (count == 0)
          throw TxFilterException("empty pool ptr");
 
-      size_t offset = 4;
+      poolPtr_ = nullptr;
+      len_ = SIZE_MAX;
+      clearFlat();
 
-      for (unsigned i = 0; i < len_; i++)
+      size_t offset = 4;
+      for (unsigned i = 0; i < count; i++)
       {
-         if (offset >= len)
+         if (offset + 12 > len)
             throw TxFilterException("deser error");
 
-         auto filtersize = (uint32_t*)(ptr + offset);
-
-         TxFilter<TxFilterType> filter;
-         filter.deserialize(ptr + offset);
+         auto filterSize = *(uint32_t*)(ptr + offset);
+         auto blockKey = *(uint32_t*)(ptr + offset + 4);
+         auto filterLen = *(uint32_t*)(ptr + offset + 8);
+         if (filterSize != filterLen * sizeof(T) + 12 ||
+            offset + filterSize > len)
+            throw TxFilterException("deser error");
 
-         offset += *filtersize;
+         //pools are written in descending block key order, update() 
+         //relies on it
+         if (i > 0 && blockKey >= flatBlockKeys_.back())
+            throw TxFilterException("deser error");
 
-         pool_.insert(std::move(filter));
+         pushFilter(blockKey, (const T*)(ptr + offset + 12), filterLen);
+         offset += filterSize;
       }
+
+      len_ = count;
    }
 
-   const TxFilter<T>& getFilterById(uint32_t id)
+   TxFilter<T> getFilterById(uint32_t id) const
    {
-      TxFilter<T> filter(id, 0);
-      auto filterIter = pool_.find(filter);
+      for (size_t i = 0; i < flatBlockKeys_.size(); i++)
+      {
+         if (flatBlockKeys_[i] != id)
+            continue;
 
-      if (filterIter == pool_.end())
-         throw TxFilterException("invalid filter id");
+         if (poolPtr_ != nullptr)
+            return TxFilter<T>(poolPtr_ + flatOffsets_[i] - 12);
 
-      return *filterIter;
+         auto prefixes = (const T*)(getBase() + flatOffsets_[i]);
+         TxFilter<T> filter(id, flatLengths_[i]);
+         filter.filterVector_.assign(prefixes, prefixes + flatLengths_[i]);
+         return filter;
+      }
+
+      throw TxFilterException("invalid filter id");
    }
 };
 
@@ -484,6 +694,7 @@ protected:
 public:
    static std::string baseDir_;
    static BinaryData magicBytes_;
+   static float mapGrowthFactor_;
 
 public:
    //tor
@@ -512,6 +723,20 @@ public:
 
    virtual StoredDBInfo getStoredDBInfo(uint32_t id) = 0;
    virtual void putStoredDBInfo(StoredDBInfo const & sdbi, uint32_t id) = 0;
+
+   //{map size, used size} in bytes
+   virtual std::pair<size_t, size_t> getMapUsage(void) const = 0;
+
+   //writers to different shards do not contend, single dbs have only one
+   virtual unsigned getShardIdForKey(BinaryDataRef) const { return 0; }
+
+   //compacted copy of the env files to destDir, under their own file names.
+   //Each env is copied under writeMutex, the lock is released in between
+   virtual void compactCopy(const std::string& destDir, 
+      std::mutex& writeMutex, const std::atomic<bool>& cancel) const = 0;
+
+   //flushes committed writes to disk, the envs are opened with MDB_NOSYNC
+   virtual void sync(void) const = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -544,12 +769,18 @@ public:
 
    StoredDBInfo getStoredDBInfo(uint32_t id);
    void putStoredDBInfo(StoredDBInfo const & sdbi, uint32_t id);
+
+   std::pair<size_t, size_t> getMapUsage(void) const;
+   void compactCopy(const std::string&,
+      std::mutex&, const std::atomic<bool>&) const;
+   void sync(void) const;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 struct ShardFilter
 {
+   //shard ids have to follow the key order of the db
    virtual ~ShardFilter(void) = 0;
    virtual unsigned keyToId(BinaryDataRef) const = 0;
    virtual unsigned getHeightForId(unsigned) const = 0;
@@ -562,25 +793,13 @@ struct ShardFilter
 ////////
 struct ShardFilter_ScrAddr : public ShardFilter
 {
+   //subssh keys lead with the scan batch id. Batches carry a fixed amount
+   //of block data, shards are a flat range of them
    const unsigned step_;
-   unsigned thresholdId_;
-   unsigned thresholdValue_;
 
    ShardFilter_ScrAddr(unsigned step) : 
       step_(step)
-   {
-#ifndef UNIT_TESTS
-      //x < -exp(step * 1.6 / 50k) / (1 - exp(step * 1.6 / 50k))
-      auto eVal = expf(step * 1.6f / 50000.0f);
-      thresholdId_ = unsigned(-eVal / (1.0f - eVal));
-
-      //height = (ln(id) / 1.6 + 4) * 50k
-      thresholdValue_ = unsigned((logf(thresholdId_) / 1.6f + 4.0f) * 50000.0f);
-#else
-      thresholdId_ = 0;
-      thresholdValue_ = 0;
-#endif
-   }
+   {}
 
    unsigned keyToId(BinaryDataRef) const;
    unsigned getHeightForId(unsigned) const;
@@ -592,6 +811,8 @@ struct ShardFilter_ScrAddr : public ShardFilter
 ////////
 struct ShardFilter_Spentness : public ShardFilter
 {
+   //spentness keys lead with the inverted height, ids count down from
+   //SHARD_ID_MAX as the height goes up
    const unsigned step_;
    unsigned thresholdId_;
    unsigned thresholdValue_;
@@ -619,6 +840,112 @@ struct ShardFilter_Spentness : public ShardFilter
    static std::unique_ptr<ShardFilter> deserialize(BinaryDataRef);
 };
 
+////////////////////////////////////////////////////////////////////////////////
+class DatabaseContainer_Sharded : public DatabaseContainer
+{
+   /***
+   Height sharded db, each shard is its own LMDB env so writers to different
+   shards run concurrently. Shards sit next to each other on disk as
+   [dbname]-[shard id], the meta env ([dbname]-meta) carries the sdbi and
+   shard filter.
+
+   Shard txns are per thread and opened on first access, within the scope
+   of a DbTransaction_Sharded.
+
+   Shards commit before meta, which records the key range (4 byte key 
+   prefix) committed to each shard along with the sdbi. A crash between 
+   the two leaves shards ahead of meta, open() drops whatever lies past the
+   recorded ranges.
+   ***/
+
+   friend class LDBIter_Sharded;
+   friend class DbTransaction_Sharded;
+
+private:
+   typedef std::map<unsigned, std::pair<uint32_t, uint32_t>> ShardRanges;
+
+   struct ThreadTx
+   {
+      LMDB::Mode mode_;
+      unsigned level_ = 0;
+      std::map<unsigned, LMDBEnv::Transaction> shardTx_;
+
+      //key prefixes written per shard
+      ShardRanges written_;
+   };
+
+private:
+   mutable DBPair meta_;
+   std::unique_ptr<ShardFilter> filterPtr_;
+
+   mutable std::mutex shardMutex_;
+   mutable std::map<unsigned, std::shared_ptr<DBPair>> shards_;
+
+   mutable std::mutex txMutex_;
+   mutable std::map<std::thread::id, std::shared_ptr<ThreadTx>> txMap_;
+
+private:
+   std::string getShardName(unsigned) const;
+   std::string getShardPath(unsigned) const;
+   std::unique_ptr<ShardFilter> getDefaultFilter(void) const;
+   std::vector<std::pair<unsigned, std::string>> getShardsOnDisk(void) const;
+
+   std::shared_ptr<DBPair> getShard(unsigned, bool create) const;
+
+   //closest shard at or past/before id, nullptr if there is none
+   std::shared_ptr<DBPair> getShardFrom(unsigned) const;
+   std::shared_ptr<DBPair> getShardUpTo(unsigned) const;
+
+   //opens this thread's txn on the shard if it doesn't have one yet,
+   //writtenKey is added to the range committed with the txn
+   DBPair* getShardWithTx(DBPair*, 
+      BinaryDataRef writtenKey = BinaryDataRef()) const;
+
+   //need a txn on meta. tracked is false for dbs that predate the ranges
+   ShardRanges getCommittedRanges(bool& tracked) const;
+   void putCommittedRanges(const ShardRanges&) const;
+
+   //deletes the keys outside of range, all of them if range is null
+   static size_t trimShard(DBPair&, const std::pair<uint32_t, uint32_t>*);
+
+   void beginThreadTx(LMDB::Mode) const;
+   void endThreadTx(void) const;
+
+public:
+   DatabaseContainer_Sharded(DB_SELECT dbSelect) :
+      DatabaseContainer(dbSelect), meta_(META_SHARD_ID)
+   {}
+
+   ~DatabaseContainer_Sharded(void)
+   {
+      close();
+   }
+
+   //virtuals
+   StoredDBInfo open(void);
+   void close(void);
+   void eraseOnDisk(void);
+
+   std::unique_ptr<DbTransaction> beginTransaction(LMDB::Mode) const;
+   std::unique_ptr<LDBIter> getIterator(void);
+
+   BinaryDataRef getValue(BinaryDataRef key) const;
+   void putValue(BinaryDataRef key, BinaryDataRef value);
+   void deleteValue(BinaryDataRef key);
+
+   StoredDBInfo getStoredDBInfo(uint32_t id);
+   void putStoredDBInfo(StoredDBInfo const & sdbi, uint32_t id);
+
+   std::pair<size_t, size_t> getMapUsage(void) const;
+   unsigned getShardIdForKey(BinaryDataRef) const;
+   void compactCopy(const std::string&,
+      std::mutex&, const std::atomic<bool>&) const;
+   void sync(void) const;
+
+   //local
+   static bool isShardedOnDisk(DB_SELECT);
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 class LMDBBlockDatabase
 {
@@ -647,11 +974,36 @@ public:
    void replaceDatabases(DB_SELECT, const std::string&);
    void cycleDatabase(DB_SELECT);
 
+   //forces the committed writes of this db to disk, no-op on closed dbs
+   void syncDatabase(DB_SELECT);
+
+   //db name -> {map size, used size}
+   std::map<std::string, std::pair<size_t, size_t>> getMapUsage(void) const;
+
+   //compacted copy of all open dbs to an empty directory, progress is
+   //called with (dbs copied, db count). dbs are copied one after the other
+   //under writeMutex, each is consistent on its own. Setting cancel stops
+   //the copy, the call throws then
+   void snapshotDatabases(const std::string& destDir,
+      const std::function<void(unsigned, unsigned)>& progress,
+      std::mutex& writeMutex, const std::atomic<bool>& cancel) const;
+
+   //decoded Tx and StoredTxOut cache, budget in bytes, 0 disables it
+   void setObjectCacheSize(size_t);
+   void invalidateObjectCache(bool reorg);
+   std::map<std::string, DBObjectCacheStats> getObjectCacheStats(void) const;
+
+   //db name -> op counters and latency histograms, process wide totals
+   std::map<std::string, DBMetricsStats> getDbMetrics(void) const;
+
    /////////////////////////////////////////////////////////////////////////////
-   std::unique_ptr<DbTransaction> beginTransaction(DB_SELECT db, LMDB::Mode mode) const
+   std::unique_ptr<DbTransaction> beginTransaction(DB_SELECT db, LMDB::Mode mode) const;
+
+   //writers to distinct shards of a db can run in parallel
+   unsigned getShardIdForKey(DB_SELECT db, BinaryDataRef key) const
    {
       auto dbObj = getDbPtr(db);
-      return dbObj->beginTransaction(mode);
+      return dbObj->getShardIdForKey(key);
    }
 
    ARMORY_DB_TYPE getDbType(void) const { return BlockDataManagerConfig::getDbType(); }
@@ -670,11 +1022,7 @@ public:
 
 
    /////////////////////////////////////////////////////////////////////////////
-   std::unique_ptr<LDBIter> getIterator(DB_SELECT db) const
-   {
-      auto dbObj = getDbPtr(db);
-      return dbObj->getIterator();
-   }
+   std::unique_ptr<LDBIter> getIterator(DB_SELECT db) const;
 
    /////////////////////////////////////////////////////////////////////////////
    // Get value using BinaryData object.  If you have a string, you can use
@@ -703,6 +1051,10 @@ public:
 
    unsigned getHeightForTxHash(const BinaryDataRef& hash) const;
 
+   //rebuilds the txhash index if the chain moved far enough past the range
+   //it covers
+   void updateTxHashIndex(void);
+
    /////////////////////////////////////////////////////////////////////////////
    // Put value based on BinaryDataRefs key and value
    void putValue(DB_SELECT db, BinaryDataRef key, BinaryDataRef value);
@@ -716,9 +1068,15 @@ public:
 
    /////////////////////////////////////////////////////////////////////////////
    void readAllHeaders(
-      const std::function<void(std::shared_ptr<BlockHeader>, uint32_t, uint8_t)> &callback
+      const std::function<void(std::shared_ptr<BlockHeader>, uint32_t, uint8_t)> &callback,
+      unsigned threadCount = 1
       );
 
+   //true if the snapshot carries the same headers as the HEADERS db.
+   //Db headers missing from the snapshot pass if isNew accepts them
+   bool checkHeaderSnapshot(const HeaderSnapshot&, 
+      const std::function<bool(const StoredHeader&)>& isNew);
+
    std::map<uint32_t, uint32_t> getSSHSummary(BinaryDataRef scrAddrStr);
 
    uint32_t getStxoCountForTx(const BinaryData & dbKey6) const;
@@ -810,6 +1168,14 @@ public:
 
    void getSpentness(StoredTxOut& stxo);
 
+   // Batched versions of getStoredTxOut/getSpentness. Keys are sorted and 
+   // resolved with a single cursor within one read transaction. Results are 
+   // filled in place, in the order of the keys. Outputs that could not be
+   // found are left uninitialized.
+   unsigned getStoredTxOuts(const std::vector<BinaryData>& dbKeys,
+      std::vector<StoredTxOut>& stxos) const;
+   void getSpentnessBatch(std::vector<StoredTxOut>& stxos) const;
+
    void getUTXOflags(std::map<BinaryData, StoredSubHistory>&) const;
    void getUTXOflags(StoredSubHistory&) const;
    void getUTXOflags_Super(StoredSubHistory&) const;
@@ -863,6 +1229,13 @@ public:
    bool putStoredHeadHgtList(StoredHeadHgtList const & hhl);
    bool getStoredHeadHgtList(StoredHeadHgtList & hhl, uint32_t height) const;
 
+   void putStoredBlockUndo(StoredBlockUndo const & sbu);
+   bool getStoredBlockUndo(
+      StoredBlockUndo & sbu, uint32_t height, uint8_t dupID) const;
+
+   //drops the undo records below height
+   void pruneBlockUndo(uint32_t height);
+
    // TxRefs are much simpler with LDB than the previous FileDataPtr construct
    TxRef getTxRef(BinaryDataRef txHash);
    TxRef getTxRef(BinaryData hgtx, uint16_t txIndex);
@@ -874,6 +1247,13 @@ public:
    Tx    getFullTxCopy(uint32_t hgt, uint16_t txIndex) const;
    Tx    getFullTxCopy(uint32_t hgt, uint8_t dup, uint16_t txIndex) const;
    Tx    getFullTxCopy(uint16_t txIndex, std::shared_ptr<BlockHeader> bhPtr) const;
+
+   // Same as above, without copying the cached tx. The object is shared
+   // with other readers, callers that set its height, index or op ids
+   // need a copy
+   std::shared_ptr<const Tx> getFullTxPtr(BinaryData ldbKey6B) const;
+   std::shared_ptr<const Tx> getFullTxPtr(
+      uint16_t txIndex, std::shared_ptr<BlockHeader> bhPtr) const;
    TxOut getTxOutCopy(BinaryData ldbKey6B, uint16_t txOutIdx) const;
    TxIn  getTxInCopy(BinaryData ldbKey6B, uint16_t txInIdx) const;
 
@@ -956,8 +1336,16 @@ public:
 
       auto data = bw.getData();
       putValue(TXFILTERS, key, data);
+
+      //prefilter goes along with the pool
+      putPrefilterForFileNum(fileNum, pool.getPrefilter());
    }
 
+   //returns an invalid filter if the file has no prefilter
+   XorFilter getPrefilterRefForFileNum(uint32_t fileNum) const;
+   void putPrefilterForFileNum(uint32_t fileNum, const XorFilter&);
+   void deleteFilterPoolForFileNum(uint32_t fileNum);
+
    void putMissingHashes(const std::set<BinaryData>&, uint32_t);
    std::set<BinaryData> getMissingHashes(uint32_t) const;
 
@@ -972,7 +1360,6 @@ public:
 
 public:
    std::map<DB_SELECT, std::shared_ptr<DatabaseContainer>> dbMap_;
-   const static std::map<std::string, size_t> mapSizes_;
 
 private:
    bool                 dbIsOpen_;
@@ -989,9 +1376,24 @@ private:
    std::map<BinaryData, StoredScriptHistory>   registeredSSHs_;
    const std::shared_ptr<Blockchain> blockchainPtr_;   
    std::string blkFolder_;
-   const static std::set<DB_SELECT> supernodeDBs_;
+   const static std::set<DB_SELECT> shardedDBs_;
 
    ArmoryThreading::TransactionalMap<unsigned, unsigned> heightToBatchId_;
+
+   //resolves hashes for blocks past reorg depth, TXHINTS covers the rest
+   std::shared_ptr<TxHashIndex> txHashIndex_;
+
+   //keyed by block id|0xFF|tx index(|txout index). Mined txs only go stale
+   //on reorgs. Txouts carry their spentness, new blocks spend them, so
+   //the txout cache is dropped on every new top (invalidateObjectCache)
+   mutable DBObjectCache<Tx> txCache_;
+   mutable DBObjectCache<StoredTxOut> stxoCache_;
+
+private:
+   void loadTxHashIndex(void);
+   void eraseTxHashIndex(void);
+   BinaryData getDBKeyFromTxHashIndex(
+      const BinaryData& txhash, uint8_t expectedDupId) const;
 };
 
 #endif
@@ -12,6 +12,7 @@
 #include <mutex>
 #include <memory>
 #include <string>
+#include <map>
 #include <functional>
 
 #include "SocketObject.h"
@@ -22,6 +23,8 @@
 
 #include "ReentrantLock.h"
 #include "BlockDataManagerConfig.h"
+#include "DBObjectCache.h"
+#include "DBMetrics.h"
 
 ////
 enum NodeStatus
@@ -125,6 +128,16 @@ struct NodeStatusStruct
    bool SegWitEnabled_ = false;
    RpcStatus rpcStatus_ = RpcStatus_Disabled;
    ::NodeChainState chainState_;
+
+   //db name -> {map size, used size}
+   std::map<std::string, std::pair<uint64_t, uint64_t>> dbMapUsage_;
+
+   //cache name -> hit/miss counters and size
+   std::map<std::string, DBObjectCacheStats> dbCacheStats_;
+
+   //db name -> op counters and latency histograms, only carried by
+   //getNodeStatus replies
+   std::map<std::string, DBMetricsStats> dbMetrics_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////